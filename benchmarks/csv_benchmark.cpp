@@ -0,0 +1,73 @@
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+#include "../include/database.h"
+
+// Скорость массовой загрузки CSV (Database::importCsv) в МБ/с и строках/с для разной степени
+// параллелизма в сравнении с построчным readFromFile на тех же строках. Файлы форматов разного размера,
+// поэтому МБ/с каждого считается по своему файлу, а сравнивать их напрямую стоит по строкам/с
+
+static double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static double fileMegabytes(const std::string& filename)
+{
+    std::ifstream sized(filename, std::ios::binary | std::ios::ate);
+    return double(sized.tellg()) / 1e6;
+}
+
+int main()
+{
+    const int rows = 4000000;
+    std::string filename = "csv_benchmark.csv";
+    {
+        std::ofstream file(filename, std::ios::binary);
+        file << "id,amount,flag,name\n";
+        for (int i = 0; i < rows; ++i)
+        {
+            file << i << "," << (int64_t(i) * 7919) % 100000 << "," << (i % 2) << ",";
+            if (i % 10 == 0)
+            {
+                file << "\"customer, " << i << "\"";
+            }
+            else
+            {
+                file << "customer_" << i;
+            }
+            file << "\n";
+        }
+    }
+    double megabytes = fileMegabytes(filename);
+
+    Database db;
+    for (size_t threads : {size_t(1), size_t(2), size_t(4), size_t(std::thread::hardware_concurrency())})
+    {
+        db.clear();
+        db.setParallelism(threads);
+        db.createTable("orders", {{"id", 0}, {"amount", 0}, {"flag", 1}, {"name", 2}});
+        auto start = std::chrono::steady_clock::now();
+        size_t loaded = db.importCsv("orders", filename);
+        double seconds = secondsSince(start);
+        std::printf("importCsv, %2zu threads: %zu rows, %.1f MB in %.3f s, %.0f MB/s, %.0f rows/s\n", threads, loaded,
+                    megabytes, seconds, megabytes / seconds, loaded / seconds);
+    }
+
+    // тот же объём в старом текстовом формате
+    std::string legacy = "csv_benchmark_legacy.csv";
+    db.saveToFile(legacy);
+    double legacyMegabytes = fileMegabytes(legacy);
+    auto start = std::chrono::steady_clock::now();
+    db.readFromFile(legacy);
+    double seconds = secondsSince(start);
+    size_t loaded = db.tables["orders"].rowCount();
+    std::printf("readFromFile:          %zu rows, %.1f MB in %.3f s, %.0f MB/s, %.0f rows/s\n", loaded, legacyMegabytes,
+                seconds, legacyMegabytes / seconds, loaded / seconds);
+
+    std::remove(filename.c_str());
+    std::remove(legacy.c_str());
+    return 0;
+}
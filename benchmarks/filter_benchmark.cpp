@@ -0,0 +1,78 @@
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+#include "../include/database.h"
+#include "../include/filter_kernels.h"
+
+// Скорость ядер сравнения int32 на одном ядре процессора: ГБ/с прочитанных значений колонки
+// для каждого уровня (scalar, sse2, avx2), поддерживаемого процессором, и каждого сравнения,
+// плюс полный проход Table::matchingRows с AND/OR нескольких условий
+
+static double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main()
+{
+    const size_t count = size_t(1) << 24;
+    const int repeats = 20;
+    std::vector<int32_t> values(count);
+    uint32_t seed = 12345;
+    for (auto& value : values)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        value = int32_t(seed >> 8) % 1000;
+    }
+    std::vector<uint64_t> words((count + 63) / 64);
+    double gigabytes = double(count) * sizeof(int32_t) * repeats / 1e9;
+
+    std::printf("detected: %s\n", FilterKernels::levelName(FilterKernels::level()));
+    const char* names[] = {"=", ">", "<"};
+    for (KernelLevel level : {KernelLevel::SCALAR, KernelLevel::SSE2, KernelLevel::AVX2})
+    {
+        if (level > FilterKernels::level())
+        {
+            continue;
+        }
+        FilterKernels::Int32Kernel kernel = FilterKernels::kernel(level);
+        for (KernelCompare cmp : {KernelCompare::EQUAL, KernelCompare::GREATER, KernelCompare::LESS})
+        {
+            uint64_t checksum = 0;
+            auto start = std::chrono::steady_clock::now();
+            for (int r = 0; r < repeats; ++r)
+            {
+                kernel(values.data(), count, cmp, 500, false, words.data());
+                checksum += words[r % words.size()];
+            }
+            double seconds = secondsSince(start);
+            std::printf("%-7s int32 %s const: %6.2f GB/s (checksum %llu)\n", FilterKernels::levelName(level),
+                        names[int(cmp)], gigabytes / seconds, (unsigned long long)checksum);
+        }
+    }
+
+    Table table("numbers");
+    table.addColumn("a", 0);
+    table.addColumn("b", 0);
+    table.addColumn("flag", 1);
+    for (size_t i = 0; i < count; ++i)
+    {
+        table.columns["a"].push_int(values[i]);
+        table.columns["b"].push_int(values[count - 1 - i]);
+        table.columns["flag"].push_bool(values[i] % 2 == 0);
+    }
+    for (const char* text : {"a < 100", "a < 500 AND b >= 250", "(a < 100 OR b > 900) AND flag"})
+    {
+        std::shared_ptr<QueryCondition> condition = QueryCondition::compile(text);
+        auto start = std::chrono::steady_clock::now();
+        size_t matched = 0;
+        for (int r = 0; r < repeats / 4; ++r)
+        {
+            matched = table.matchingRows(*condition).size();
+        }
+        double seconds = secondsSince(start) / (repeats / 4);
+        std::printf("table scan '%s': %zu rows, %.2f M rows/s\n", text, matched, count / seconds / 1e6);
+    }
+    return 0;
+}
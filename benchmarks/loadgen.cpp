@@ -0,0 +1,209 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../include/client.h"
+
+// Нагрузка на работающий memorydb-server:
+// loadgen [--host ADDR] [--port N] [--socket PATH] [--connections N] [--depth N] [--requests N]
+//         [--setup SQL]... [--query SQL]...
+// Каждое соединение - свой поток, держит в конвейере до depth запросов и отправляет --requests запросов
+// (--query по кругу). --setup выполняются один раз до замера, их ошибки не считаются (таблица может
+// уже быть). Без --query создаёт таблицу loadgen и, если её ещё не было, заполняет 1000 строками,
+// затем читает из неё выборку
+
+namespace
+{
+struct Options
+{
+    std::string host = "127.0.0.1", socketPath;
+    uint16_t port = 5433;
+    size_t connections = 4, depth = 16, requests = 100000;
+    std::vector<std::string> setup, queries;
+    std::string create; // таблица по умолчанию; fill заполняют её, только если она создана
+    std::vector<std::string> fill;
+};
+
+struct Totals
+{
+    std::mutex mutex;
+    std::vector<double> latencies; // микросекунды
+    size_t errors = 0;
+    uint64_t rows = 0;
+};
+
+void usage()
+{
+    std::cerr << "usage: loadgen [--host ADDR] [--port N] [--socket PATH] [--connections N] [--depth N] "
+                 "[--requests N] [--setup SQL]... [--query SQL]...\n";
+}
+
+void connect(Client& client, const Options& options)
+{
+    if (options.socketPath.empty())
+    {
+        client.connectTcp(options.host, options.port);
+    }
+    else
+    {
+        client.connectUnix(options.socketPath);
+    }
+}
+
+void drive(const Options& options, size_t requests, Totals& totals)
+{
+    Client client;
+    connect(client, options);
+    std::deque<std::chrono::steady_clock::time_point> sent;
+    std::vector<double> latencies;
+    latencies.reserve(requests);
+    size_t errors = 0, next = 0;
+    uint64_t rows = 0;
+    while (latencies.size() < requests)
+    {
+        while (next < requests && client.pending() < options.depth)
+        {
+            client.send(options.queries[next++ % options.queries.size()]);
+            sent.push_back(std::chrono::steady_clock::now());
+        }
+        Client::Result result = client.receive();
+        latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - sent.front()).count());
+        sent.pop_front();
+        if (result.ok()) {
+            rows += result.names.empty() ? 0 : result.count;
+        } else {
+            ++errors;
+        }
+    }
+    std::lock_guard<std::mutex> lock(totals.mutex);
+    totals.latencies.insert(totals.latencies.end(), latencies.begin(), latencies.end());
+    totals.errors += errors;
+    totals.rows += rows;
+}
+
+double percentile(const std::vector<double>& sorted, double fraction)
+{
+    return sorted.empty() ? 0 : sorted[std::min(sorted.size() - 1, size_t(fraction * sorted.size()))];
+}
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string option = argv[i];
+        if (i + 1 >= argc)
+        {
+            usage();
+            return 2;
+        }
+        std::string value = argv[++i];
+        if (option == "--host") {
+            options.host = value;
+        } else if (option == "--port") {
+            options.port = uint16_t(std::atoi(value.c_str()));
+        } else if (option == "--socket") {
+            options.socketPath = value;
+        } else if (option == "--connections") {
+            options.connections = std::max(1, std::atoi(value.c_str()));
+        } else if (option == "--depth") {
+            options.depth = std::max(1, std::atoi(value.c_str()));
+        } else if (option == "--requests") {
+            options.requests = std::max(1, std::atoi(value.c_str()));
+        } else if (option == "--setup") {
+            options.setup.push_back(value);
+        } else if (option == "--query") {
+            options.queries.push_back(value);
+        } else {
+            usage();
+            return 2;
+        }
+    }
+    if (options.queries.empty())
+    {
+        options.create = "CREATE TABLE loadgen ({key, autoincrement} id : int32, v : int32, name : string[32])";
+        for (int i = 0; i < 1000; ++i)
+        {
+            options.fill.push_back("INSERT INTO loadgen (v, name) VALUES (" + std::to_string(i % 100) + ", 'name" +
+                                   std::to_string(i) + "')");
+        }
+        options.queries.push_back("SELECT id, name FROM loadgen WHERE v < 10");
+    }
+
+    try
+    {
+        Client client;
+        connect(client, options);
+        for (const std::string& statement : options.setup)
+        {
+            client.send(statement);
+        }
+        while (client.pending() > 0)
+        {
+            client.receive();
+        }
+        // иначе каждый запуск дописывал бы в уже существующую таблицу ещё 1000 строк
+        if (!options.create.empty() && client.query(options.create).ok())
+        {
+            for (const std::string& statement : options.fill)
+            {
+                client.send(statement);
+            }
+            while (client.pending() > 0)
+            {
+                Client::Result result = client.receive();
+                if (!result.ok())
+                {
+                    throw std::runtime_error("Could not fill table loadgen: " + result.error);
+                }
+            }
+        }
+
+        Totals totals;
+        std::vector<std::thread> threads;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t c = 0; c < options.connections; ++c)
+        {
+            size_t share = options.requests / options.connections + (c < options.requests % options.connections ? 1 : 0);
+            threads.emplace_back([&options, &totals, share] {
+                try
+                {
+                    drive(options, share, totals);
+                }
+                catch (const std::exception& e)
+                {
+                    std::cerr << "loadgen: " << e.what() << "\n";
+                    std::exit(1);
+                }
+            });
+        }
+        for (std::thread& thread : threads)
+        {
+            thread.join();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::sort(totals.latencies.begin(), totals.latencies.end());
+        std::printf("%zu requests over %zu connections, depth %zu: %.3f s, %.0f requests/s, %.0f rows/s, %zu errors\n",
+                    totals.latencies.size(), options.connections, options.depth, seconds,
+                    totals.latencies.size() / seconds, totals.rows / seconds, totals.errors);
+        std::printf("latency, us: p50 %.0f, p99 %.0f, max %.0f\n", percentile(totals.latencies, 0.5),
+                    percentile(totals.latencies, 0.99), totals.latencies.empty() ? 0 : totals.latencies.back());
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "loadgen: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,279 @@
+#ifndef AGGREGATE_H
+#define AGGREGATE_H
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <stdexcept>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include "table.h"
+#include "query.h"
+
+// Хеш-агрегация (GROUP BY + COUNT/SUM/MIN/MAX/AVG) прямо по буферам колонок: каждая подходящая
+// строка один раз находит номер своей группы в хеш-таблице и обновляет аккумуляторы по этому номеру.
+// Ни строки (Line), ни промежуточные таблицы не создаются.
+// Результат - таблица: колонки группировки того же типа и колонки агрегатов. COUNT, SUM и AVG - int32
+// (AVG округляется к нулю), MIN и MAX - того же типа, что колонка. Без GROUP BY всегда одна строка
+class HashAggregation
+{
+public:
+    HashAggregation(const Table& table, const std::vector<std::string>& groupColumns, const std::vector<AggregateSpec>& specs)
+        : source(table), groupNames(groupColumns), aggregates(specs)
+    {
+        for (const auto& columnName : groupNames)
+        {
+            keys.push_back(&columnOf(columnName));
+        }
+        for (const auto& spec : aggregates)
+        {
+            const Column* column = spec.column == "*" ? nullptr : &columnOf(spec.column);
+            Function function = parseFunction(spec.function);
+            if ((function == Function::SUM || function == Function::AVG) && column->type >= 2)
+            {
+                throw std::invalid_argument("Cannot " + spec.function + " non-numeric column: " + spec.column);
+            }
+            inputs.push_back(column);
+            functions.push_back(function);
+        }
+        states.resize(aggregates.size());
+    }
+
+    // view - снимок, по которому считается агрегат (nullptr - последнее состояние таблицы)
+    Table run(const std::string& newTableName, const QueryCondition& condition, const ReadView* view = nullptr)
+    {
+        std::shared_ptr<QueryCondition> bound = condition.bind(source.columns);
+        if (keys.empty())
+        {
+            addGroup(0);
+            source.forEachMatching(*bound, [this](uint32_t row) {
+                accumulate(0, row);
+                return true;
+            }, view);
+        }
+        else if (keys.size() == 1 && keys[0]->type < 2)
+        {
+            // одна числовая колонка: ключ - само число, NULL - отдельное значение вне int32
+            const Column& key = *keys[0];
+            std::unordered_map<int64_t, uint32_t> groups;
+            source.forEachMatching(*bound, [&](uint32_t row) {
+                int64_t value = key.is_null(row) ? INT64_MIN : (key.type == 0 ? key.get_int(row) : int64_t(key.get_bool(row)));
+                auto [it, inserted] = groups.try_emplace(value, uint32_t(firstRows.size()));
+                if (inserted)
+                {
+                    addGroup(row);
+                }
+                accumulate(it->second, row);
+                return true;
+            }, view);
+        }
+        else
+        {
+            // общий случай: значения колонок группировки склеиваются в байтовый ключ, буфер переиспользуется
+            std::unordered_map<std::string, uint32_t> groups;
+            std::string buffer;
+            source.forEachMatching(*bound, [&](uint32_t row) {
+                buffer.clear();
+                for (const Column* column : keys)
+                {
+                    appendKey(buffer, *column, row);
+                }
+                auto it = groups.find(buffer);
+                if (it == groups.end())
+                {
+                    it = groups.emplace(buffer, uint32_t(firstRows.size())).first;
+                    addGroup(row);
+                }
+                accumulate(it->second, row);
+                return true;
+            }, view);
+        }
+        return result(newTableName);
+    }
+
+private:
+    enum class Function {
+        COUNT,
+        SUM,
+        MIN,
+        MAX,
+        AVG
+    };
+
+    struct State
+    {
+        std::vector<int64_t> counts; // COUNT и знаменатель AVG
+        std::vector<int64_t> sums;
+        std::vector<uint32_t> best;  // строка с текущим MIN/MAX, UINT32_MAX - значений ещё не было
+    };
+
+    const Table& source;
+    std::vector<std::string> groupNames;
+    std::vector<AggregateSpec> aggregates;
+    std::vector<const Column*> keys;
+    std::vector<const Column*> inputs; // nullptr для COUNT(*)
+    std::vector<Function> functions;
+    std::vector<State> states;
+    std::vector<uint32_t> firstRows;   // первая строка каждой группы - из неё берутся значения группировки
+
+    static Function parseFunction(const std::string& name)
+    {
+        if (name == "count") return Function::COUNT;
+        if (name == "sum") return Function::SUM;
+        if (name == "min") return Function::MIN;
+        if (name == "max") return Function::MAX;
+        if (name == "avg") return Function::AVG;
+        throw std::invalid_argument("Unknown aggregate function: " + name);
+    }
+
+    const Column& columnOf(const std::string& columnName) const
+    {
+        auto it = source.columns.find(columnName);
+        if (it == source.columns.end())
+        {
+            throw std::invalid_argument("Column not found: " + columnName);
+        }
+        return it->second;
+    }
+
+    static void appendKey(std::string& buffer, const Column& column, uint32_t row)
+    {
+        if (column.is_null(row))
+        {
+            buffer.push_back('\0');
+            return;
+        }
+        buffer.push_back('\1');
+        if (column.type == 0)
+        {
+            int32_t value = column.get_int(row);
+            buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+        }
+        else if (column.type == 1)
+        {
+            buffer.push_back(column.get_bool(row) ? '\1' : '\0');
+        }
+        else
+        {
+            std::string_view value = column.get_string(row);
+            uint32_t length = value.size();
+            buffer.append(reinterpret_cast<const char*>(&length), sizeof(length));
+            buffer.append(value.data(), value.size());
+        }
+    }
+
+    void addGroup(uint32_t row)
+    {
+        firstRows.push_back(row);
+        for (State& state : states)
+        {
+            state.counts.push_back(0);
+            state.sums.push_back(0);
+            state.best.push_back(UINT32_MAX);
+        }
+    }
+
+    static int compare(const Column& column, uint32_t a, uint32_t b)
+    {
+        if (column.type == 0)
+        {
+            return column.get_int(a) < column.get_int(b) ? -1 : (column.get_int(a) > column.get_int(b) ? 1 : 0);
+        }
+        if (column.type == 1)
+        {
+            return int(column.get_bool(a)) - int(column.get_bool(b));
+        }
+        return column.get_string(a).compare(column.get_string(b));
+    }
+
+    void accumulate(uint32_t group, uint32_t row)
+    {
+        for (size_t k = 0; k < aggregates.size(); ++k)
+        {
+            const Column* column = inputs[k];
+            State& state = states[k];
+            if (column == nullptr)
+            {
+                ++state.counts[group];
+                continue;
+            }
+            if (column->is_null(row))
+            {
+                continue;
+            }
+            ++state.counts[group];
+            Function function = functions[k];
+            if (function == Function::SUM || function == Function::AVG)
+            {
+                state.sums[group] += column->type == 0 ? column->get_int(row) : int64_t(column->get_bool(row));
+            }
+            else if (function == Function::MIN || function == Function::MAX)
+            {
+                uint32_t& best = state.best[group];
+                int sign = function == Function::MIN ? -1 : 1;
+                if (best == UINT32_MAX || compare(*column, row, best) * sign > 0)
+                {
+                    best = row;
+                }
+            }
+        }
+    }
+
+    static int32_t narrow(int64_t value, const std::string& name)
+    {
+        if (value < INT32_MIN || value > INT32_MAX)
+        {
+            throw std::overflow_error("Aggregate does not fit in int32: " + name);
+        }
+        return int32_t(value);
+    }
+
+    Table result(const std::string& newTableName) const
+    {
+        Table table(newTableName);
+        for (size_t g = 0; g < groupNames.size(); ++g)
+        {
+            table.addColumn(groupNames[g], keys[g]->type);
+            table.columns[groupNames[g]].append_rows(*keys[g], firstRows);
+        }
+        size_t groups = firstRows.size();
+        for (size_t k = 0; k < aggregates.size(); ++k)
+        {
+            const AggregateSpec& spec = aggregates[k];
+            const State& state = states[k];
+            Function function = functions[k];
+            bool keepsType = function == Function::MIN || function == Function::MAX;
+            table.addColumn(spec.name, keepsType ? inputs[k]->type : 0);
+            Column& output = table.columns[spec.name];
+            output.reserve(groups);
+            for (size_t group = 0; group < groups; ++group)
+            {
+                if (function == Function::COUNT)
+                {
+                    output.push_int(narrow(state.counts[group], spec.name));
+                }
+                else if (state.counts[group] == 0)
+                {
+                    output.push_null();
+                }
+                else if (function == Function::SUM)
+                {
+                    output.push_int(narrow(state.sums[group], spec.name));
+                }
+                else if (function == Function::AVG)
+                {
+                    output.push_int(narrow(state.sums[group] / state.counts[group], spec.name));
+                }
+                else
+                {
+                    output.append_from(*inputs[k], state.best[group]);
+                }
+            }
+        }
+        return table;
+    }
+};
+
+#endif // AGGREGATE_H
@@ -0,0 +1,354 @@
+#ifndef BPLUS_TREE_H
+#define BPLUS_TREE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// B+-дерево пар (ключ, номер строки), упорядоченных сначала по ключу, потом по строке,
+// так что одинаковые ключи разных строк - разные записи.
+// Узел занимает несколько кеш-линий (kNodeBytes), листья связаны в список для упорядоченного обхода.
+// Удаление ленивое: запись убирается из листа без слияния узлов - разделители во внутренних узлах
+// остаются верными, а дерево перестраивается целиком при compact таблицы
+template <class Key>
+class BPlusTree
+{
+public:
+    struct Entry
+    {
+        Key key;
+        uint32_t row;
+
+        bool operator<(const Entry& other) const
+        {
+            return key < other.key || (!(other.key < key) && row < other.row);
+        }
+    };
+
+    static constexpr size_t kNodeBytes = 4 * 64;
+    static constexpr size_t kCapacity = std::max<size_t>(4, (kNodeBytes - 16) / sizeof(Entry));
+
+    BPlusTree() = default;
+
+    BPlusTree(const BPlusTree& other)
+    {
+        std::vector<Entry> entries;
+        entries.reserve(other.size_);
+        other.for_each([&entries](const Key& key, uint32_t row) {
+            entries.push_back(Entry{key, row});
+        });
+        bulk_load(entries);
+    }
+
+    BPlusTree(BPlusTree&& other) noexcept
+    {
+        swap(other);
+    }
+
+    BPlusTree& operator=(BPlusTree other)
+    {
+        swap(other);
+        return *this;
+    }
+
+    ~BPlusTree()
+    {
+        destroy(root_);
+    }
+
+    void swap(BPlusTree& other) noexcept
+    {
+        std::swap(root_, other.root_);
+        std::swap(first_, other.first_);
+        std::swap(size_, other.size_);
+    }
+
+    size_t size() const
+    {
+        return size_;
+    }
+
+    void clear()
+    {
+        destroy(root_);
+        root_ = nullptr;
+        first_ = nullptr;
+        size_ = 0;
+    }
+
+    // строит дерево заново по записям, отсортированным по возрастанию
+    void bulk_load(const std::vector<Entry>& entries)
+    {
+        clear();
+        if (entries.empty())
+        {
+            return;
+        }
+
+        std::vector<Node*> level;
+        std::vector<Entry> firsts;
+        Leaf* previous = nullptr;
+        for (size_t i = 0; i < entries.size(); i += kCapacity)
+        {
+            Leaf* leaf = new Leaf();
+            leaf->count = std::min(kCapacity, entries.size() - i);
+            std::copy(entries.begin() + i, entries.begin() + i + leaf->count, leaf->entries);
+            if (previous)
+            {
+                previous->next = leaf;
+            }
+            else
+            {
+                first_ = leaf;
+            }
+            previous = leaf;
+            level.push_back(leaf);
+            firsts.push_back(entries[i]);
+        }
+
+        while (level.size() > 1)
+        {
+            std::vector<Node*> parents;
+            std::vector<Entry> parentFirsts;
+            for (size_t i = 0; i < level.size(); i += kCapacity + 1)
+            {
+                Inner* inner = new Inner();
+                size_t children = std::min(kCapacity + 1, level.size() - i);
+                for (size_t c = 0; c < children; ++c)
+                {
+                    inner->children[c] = level[i + c];
+                    if (c > 0)
+                    {
+                        inner->keys[c - 1] = firsts[i + c];
+                    }
+                }
+                inner->count = children - 1;
+                parents.push_back(inner);
+                parentFirsts.push_back(firsts[i]);
+            }
+            level = std::move(parents);
+            firsts = std::move(parentFirsts);
+        }
+        root_ = level[0];
+        size_ = entries.size();
+    }
+
+    void insert(const Key& key, uint32_t row)
+    {
+        Entry entry{key, row};
+        if (root_ == nullptr)
+        {
+            Leaf* leaf = new Leaf();
+            root_ = leaf;
+            first_ = leaf;
+        }
+        Entry separator;
+        Node* split = insert_into(root_, entry, separator);
+        if (split)
+        {
+            Inner* root = new Inner();
+            root->count = 1;
+            root->keys[0] = separator;
+            root->children[0] = root_;
+            root->children[1] = split;
+            root_ = root;
+        }
+        ++size_;
+    }
+
+    bool erase(const Key& key, uint32_t row)
+    {
+        if (root_ == nullptr)
+        {
+            return false;
+        }
+        Entry entry{key, row};
+        Node* node = root_;
+        while (!node->leaf)
+        {
+            Inner* inner = static_cast<Inner*>(node);
+            node = inner->children[std::upper_bound(inner->keys, inner->keys + inner->count, entry) - inner->keys];
+        }
+        Leaf* leaf = static_cast<Leaf*>(node);
+        Entry* position = std::lower_bound(leaf->entries, leaf->entries + leaf->count, entry);
+        if (position == leaf->entries + leaf->count || position->key != key || position->row != row)
+        {
+            return false;
+        }
+        std::move(position + 1, leaf->entries + leaf->count, position);
+        --leaf->count;
+        --size_;
+        return true;
+    }
+
+    // emit(ключ, строка) для записей с ключом в [low, high] (границы по флагам) в порядке ключей;
+    // emit возвращает false, чтобы остановить обход
+    template <class Emit>
+    void scan(const Key* low, bool lowInclusive, const Key* high, bool highInclusive, const Emit& emit) const
+    {
+        Leaf* leaf = first_;
+        size_t position = 0;
+        if (low && root_)
+        {
+            Entry from{*low, lowInclusive ? 0u : UINT32_MAX};
+            Node* node = root_;
+            while (!node->leaf)
+            {
+                Inner* inner = static_cast<Inner*>(node);
+                node = inner->children[std::upper_bound(inner->keys, inner->keys + inner->count, from) - inner->keys];
+            }
+            leaf = static_cast<Leaf*>(node);
+            position = std::lower_bound(leaf->entries, leaf->entries + leaf->count, from) - leaf->entries;
+        }
+        for (; leaf; leaf = leaf->next, position = 0)
+        {
+            for (; position < leaf->count; ++position)
+            {
+                const Entry& entry = leaf->entries[position];
+                if (low && !lowInclusive && !(*low < entry.key))
+                {
+                    continue;
+                }
+                if (high && (highInclusive ? *high < entry.key : !(entry.key < *high)))
+                {
+                    return;
+                }
+                if (!emit(entry.key, entry.row))
+                {
+                    return;
+                }
+            }
+        }
+    }
+
+    template <class Emit>
+    void for_each(const Emit& emit) const
+    {
+        for (Leaf* leaf = first_; leaf; leaf = leaf->next)
+        {
+            for (size_t i = 0; i < leaf->count; ++i)
+            {
+                emit(leaf->entries[i].key, leaf->entries[i].row);
+            }
+        }
+    }
+
+private:
+    struct alignas(64) Node
+    {
+        bool leaf;
+        size_t count = 0;
+
+        explicit Node(bool isLeaf) : leaf(isLeaf) {}
+    };
+
+    struct Leaf : Node
+    {
+        Entry entries[kCapacity];
+        Leaf* next = nullptr;
+
+        Leaf() : Node(true) {}
+    };
+
+    struct Inner : Node
+    {
+        Entry keys[kCapacity];
+        Node* children[kCapacity + 1];
+
+        Inner() : Node(false) {}
+    };
+
+    Node* root_ = nullptr;
+    Leaf* first_ = nullptr;
+    size_t size_ = 0;
+
+    static void destroy(Node* node)
+    {
+        if (node == nullptr)
+        {
+            return;
+        }
+        if (node->leaf)
+        {
+            delete static_cast<Leaf*>(node);
+            return;
+        }
+        Inner* inner = static_cast<Inner*>(node);
+        for (size_t i = 0; i <= inner->count; ++i)
+        {
+            destroy(inner->children[i]);
+        }
+        delete inner;
+    }
+
+    // вставляет entry в поддерево node; если узел разделился, возвращает новый правый узел
+    // и в separator - его первую запись
+    Node* insert_into(Node* node, const Entry& entry, Entry& separator)
+    {
+        if (node->leaf)
+        {
+            Leaf* leaf = static_cast<Leaf*>(node);
+            if (leaf->count < kCapacity)
+            {
+                insert_into_leaf(leaf, entry);
+                return nullptr;
+            }
+            Leaf* right = new Leaf();
+            size_t half = kCapacity / 2;
+            right->count = kCapacity - half;
+            std::move(leaf->entries + half, leaf->entries + kCapacity, right->entries);
+            leaf->count = half;
+            right->next = leaf->next;
+            leaf->next = right;
+            insert_into_leaf(entry < right->entries[0] ? leaf : right, entry);
+            separator = right->entries[0];
+            return right;
+        }
+
+        Inner* inner = static_cast<Inner*>(node);
+        size_t index = std::upper_bound(inner->keys, inner->keys + inner->count, entry) - inner->keys;
+        Entry childSeparator;
+        Node* split = insert_into(inner->children[index], entry, childSeparator);
+        if (split == nullptr)
+        {
+            return nullptr;
+        }
+        if (inner->count < kCapacity)
+        {
+            std::move_backward(inner->keys + index, inner->keys + inner->count, inner->keys + inner->count + 1);
+            std::move_backward(inner->children + index + 1, inner->children + inner->count + 1, inner->children + inner->count + 2);
+            inner->keys[index] = childSeparator;
+            inner->children[index + 1] = split;
+            ++inner->count;
+            return nullptr;
+        }
+
+        // узел полон: раскладываем kCapacity + 1 разделителей на два узла, средний уходит наверх
+        std::vector<Entry> keys(inner->keys, inner->keys + kCapacity);
+        std::vector<Node*> children(inner->children, inner->children + kCapacity + 1);
+        keys.insert(keys.begin() + index, childSeparator);
+        children.insert(children.begin() + index + 1, split);
+
+        size_t middle = keys.size() / 2;
+        Inner* right = new Inner();
+        inner->count = middle;
+        std::move(keys.begin(), keys.begin() + middle, inner->keys);
+        std::copy(children.begin(), children.begin() + middle + 1, inner->children);
+        right->count = keys.size() - middle - 1;
+        std::move(keys.begin() + middle + 1, keys.end(), right->keys);
+        std::copy(children.begin() + middle + 1, children.end(), right->children);
+        separator = keys[middle];
+        return right;
+    }
+
+    static void insert_into_leaf(Leaf* leaf, const Entry& entry)
+    {
+        Entry* position = std::upper_bound(leaf->entries, leaf->entries + leaf->count, entry);
+        std::move_backward(position, leaf->entries + leaf->count, leaf->entries + leaf->count + 1);
+        *position = entry;
+        ++leaf->count;
+    }
+};
+
+#endif // BPLUS_TREE_H
@@ -0,0 +1,795 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "checksum.h"
+#include "mapped_file.h"
+#include "table.h"
+#include "thread_pool.h"
+
+// Инкрементальные контрольные точки в каталоге. Колонки и маска удалённых строк хранятся сегментами
+// по DirtySegments::kRows строк, каждый сегмент - отдельный неизменяемый файл из частей (размер u64 и байты):
+//   int32   значения, биты nulls
+//   bool    биты значений, биты nulls
+//   string  длины (u32), байты значений подряд, биты nulls
+//   deleted биты маски
+// Файл MANIFEST связывает сегменты в базу: LSN журнала, таблицы, колонки с ограничениями и списками
+// сегментов (имя файла, строки, контрольная сумма), индексы. Он заменяется целиком через rename, поэтому
+// в каталоге всегда одна целая контрольная точка.
+// Следующая точка пишет только сегменты, изменённые с прошлой (Column::dirty, Table::deletedDirty),
+// и сегменты, которых нет в её манифесте, - остальные берутся из него по имени файла.
+// begin копирует изменённые сегменты в памяти и возвращается; файлы, fsync и замена манифеста идут
+// в фоновом потоке, пока база выполняет запросы. Файлы, на которые манифест больше не ссылается, удаляются
+class Checkpointer
+{
+public:
+    static constexpr uint32_t kVersion = 1;
+
+    // каталог создаётся, если его нет; сегменты уже лежащей в нём точки не переиспользуются без load
+    explicit Checkpointer(const std::string& directory) : path(directory)
+    {
+        if (::mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST)
+        {
+            throw std::runtime_error("Could not create checkpoint directory: " + directory);
+        }
+        if (::access(manifestPath().c_str(), F_OK) == 0)
+        {
+            base.generation = readManifest().generation;
+        }
+    }
+
+    Checkpointer(const Checkpointer&) = delete;
+    Checkpointer& operator=(const Checkpointer&) = delete;
+
+    ~Checkpointer()
+    {
+        if (writer.joinable())
+        {
+            writer.join();
+        }
+    }
+
+    const std::string& directory() const
+    {
+        return path;
+    }
+
+    // точка ещё пишется в фоне
+    bool running() const
+    {
+        return busy;
+    }
+
+    // сколько файлов сегментов записала последняя начатая точка
+    size_t lastWritten() const
+    {
+        return written;
+    }
+
+    // Таблицы последней точки каталога (без пула - его задаёт Database) и её LSN.
+    // Загруженные таблицы помечаются чистыми, и следующая точка переиспользует их сегменты
+    std::vector<Table> load(ThreadPool* pool, uint64_t* lsn)
+    {
+        wait();
+        Manifest manifest = readManifest();
+        std::vector<Table> tables(manifest.tables.size());
+        std::vector<std::pair<Column*, const ColumnEntry*>> loads;
+        for (size_t t = 0; t < tables.size(); ++t)
+        {
+            const TableEntry& entry = manifest.tables[t];
+            tables[t].name = entry.name;
+            for (const ColumnEntry& columnEntry : entry.columns)
+            {
+                tables[t].addColumn(columnEntry.name, columnEntry.type);
+                loads.emplace_back(&tables[t].columns[columnEntry.name], &columnEntry);
+            }
+        }
+
+        auto loadColumn = [this, &loads](size_t k) {
+            Column& column = *loads[k].first;
+            const ColumnEntry& entry = *loads[k].second;
+            size_t rows = 0;
+            for (const Segment& segment : entry.segments)
+            {
+                rows += segment.rows;
+            }
+            column.reserve(rows);
+            size_t start = 0;
+            for (const Segment& segment : entry.segments)
+            {
+                MappedFile file(path + "/" + segment.file);
+                verify(file, segment, start, rows);
+                Parts parts{file.data, file.data + file.size};
+                size_t words = (segment.rows + 63) / 64;
+                if (column.type == 0)
+                {
+                    parts.append(column.ints, segment.rows);
+                }
+                else if (column.type == 1)
+                {
+                    parts.append(column.bools, words);
+                }
+                else
+                {
+                    std::pair<const char*, size_t> lengths = parts.next(segment.rows * sizeof(uint32_t));
+                    std::pair<const char*, size_t> bytes = parts.next(SIZE_MAX);
+                    uint64_t offset = column.blob.size();
+                    for (size_t r = 0; r < segment.rows; ++r)
+                    {
+                        uint32_t length;
+                        std::memcpy(&length, lengths.first + r * sizeof(uint32_t), sizeof(length));
+                        column.str_offsets.push_back(offset);
+                        column.str_lengths.push_back(length);
+                        offset += length;
+                    }
+                    if (offset - column.blob.size() != bytes.second)
+                    {
+                        throw std::runtime_error("Corrupted checkpoint segment: " + segment.file);
+                    }
+                    column.blob.append(bytes.first, bytes.second);
+                }
+                parts.bits(column.nulls, start, segment.rows, rows);
+                start += segment.rows;
+            }
+            column.adopt_buffers(rows);
+            column.next_autoincrement = entry.nextAutoincrement;
+        };
+        if (pool != nullptr && pool->workers() > 0)
+        {
+            pool->parallelFor(loads.size(), loadColumn);
+        }
+        else
+        {
+            for (size_t k = 0; k < loads.size(); ++k)
+            {
+                loadColumn(k);
+            }
+        }
+
+        for (size_t t = 0; t < tables.size(); ++t)
+        {
+            Table& table = tables[t];
+            const TableEntry& entry = manifest.tables[t];
+            for (const auto& [columnName, column] : table.columns)
+            {
+                if (column.size() != entry.rows)
+                {
+                    throw std::runtime_error("Corrupted checkpoint manifest");
+                }
+            }
+            size_t start = 0;
+            for (const Segment& segment : entry.deleted)
+            {
+                MappedFile file(path + "/" + segment.file);
+                verify(file, segment, start, entry.rows);
+                Parts parts{file.data, file.data + file.size};
+                parts.bits(table.deleted, start, segment.rows, entry.rows);
+                start += segment.rows;
+            }
+            for (size_t row = 0; row < entry.rows; ++row)
+            {
+                table.deletedCount += table.isDeleted(row);
+            }
+            for (const auto& [columnName, indexName] : entry.hashIndexes)
+            {
+                table.createIndex(columnName, indexName);
+            }
+            for (const auto& [columnName, indexName] : entry.orderedIndexes)
+            {
+                table.createOrderedIndex(columnName, indexName);
+            }
+            for (const ColumnEntry& columnEntry : entry.columns)
+            {
+                if (columnEntry.flags != 0)
+                {
+                    table.setConstraints(columnEntry.name, columnEntry.flags & 1, columnEntry.flags & 2, columnEntry.flags & 4);
+                }
+            }
+            table.markClean();
+        }
+        if (lsn != nullptr)
+        {
+            *lsn = manifest.lsn;
+        }
+        base = std::move(manifest);
+        reuse = true;
+        return tables;
+    }
+
+    // Начинает контрольную точку tables, в которой есть изменения журнала по lsn включительно.
+    // Изменённые сегменты копируются сразу, и таблицы помечаются чистыми; запись идёт в фоне,
+    // после замены манифеста вызывается durable(lsn). Ошибка предыдущей точки выбрасывается здесь
+    void begin(std::unordered_map<std::string, Table>& tables, uint64_t lsn, std::function<void(uint64_t)> durable)
+    {
+        wait();
+        Job job;
+        job.manifest.generation = base.generation + 1;
+        job.manifest.lsn = lsn;
+        std::unordered_map<std::string, const TableEntry*> previous;
+        if (reuse)
+        {
+            for (const TableEntry& entry : base.tables)
+            {
+                previous[entry.name] = &entry;
+            }
+        }
+        for (auto& [tableName, table] : tables)
+        {
+            auto old = previous.find(tableName);
+            const TableEntry* oldTable = old == previous.end() ? nullptr : old->second;
+            TableEntry entry;
+            entry.name = tableName;
+            entry.rows = table.slotCount();
+            for (const auto& [columnName, column] : table.columns)
+            {
+                const ColumnEntry* oldColumn = nullptr;
+                for (size_t c = 0; oldTable != nullptr && c < oldTable->columns.size(); ++c)
+                {
+                    if (oldTable->columns[c].name == columnName && oldTable->columns[c].type == column.type)
+                    {
+                        oldColumn = &oldTable->columns[c];
+                    }
+                }
+                ColumnEntry columnEntry{columnName, uint8_t(column.type),
+                        uint8_t((column.is_key ? 1 : 0) | (column.is_unique ? 2 : 0) | (column.is_autoincrement ? 4 : 0)),
+                        column.next_autoincrement, {}};
+                columnEntry.segments = segments(job, oldColumn ? &oldColumn->segments : nullptr, column.dirty, entry.rows,
+                        [&column](std::string& out, size_t begin, size_t end) { serialize(out, column, begin, end); });
+                entry.columns.push_back(std::move(columnEntry));
+            }
+            if (table.deletedCount > 0)
+            {
+                entry.deleted = segments(job, oldTable ? &oldTable->deleted : nullptr, table.deletedDirty, entry.rows,
+                        [&table](std::string& out, size_t begin, size_t end) { putBits(out, table.deleted, begin, end); });
+            }
+            for (const auto& [columnName, index] : table.indexes)
+            {
+                entry.hashIndexes.emplace_back(columnName, index.name);
+            }
+            for (const auto& [columnName, index] : table.orderedIndexes)
+            {
+                entry.orderedIndexes.emplace_back(columnName, index.name);
+            }
+            job.manifest.tables.push_back(std::move(entry));
+            table.markClean();
+        }
+        written = job.files.size();
+        // таблицы уже чистые: если точка не запишется, следующая пишет всё заново
+        reuse = false;
+        busy = true;
+        writer = std::thread([this, job = std::move(job), durable = std::move(durable)]() mutable {
+            try
+            {
+                finish(job, durable);
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+            busy = false;
+        });
+    }
+
+    // ждёт фоновую запись и выбрасывает её ошибку, если была; можно звать из нескольких потоков
+    void wait()
+    {
+        std::lock_guard<std::mutex> lock(waiting);
+        if (writer.joinable())
+        {
+            writer.join();
+        }
+        if (error)
+        {
+            std::exception_ptr failed = error;
+            error = nullptr;
+            std::rethrow_exception(failed);
+        }
+    }
+
+private:
+    static constexpr char kMagic[8] = {'M', 'E', 'M', 'D', 'B', 'M', 'A', 'N'};
+
+    struct Segment
+    {
+        std::string file;
+        uint64_t rows;
+        uint64_t checksum;
+    };
+
+    struct ColumnEntry
+    {
+        std::string name;
+        uint8_t type;
+        uint8_t flags; // 1 - key, 2 - unique, 4 - autoincrement
+        int32_t nextAutoincrement;
+        std::vector<Segment> segments;
+    };
+
+    struct TableEntry
+    {
+        std::string name;
+        uint64_t rows = 0;
+        std::vector<ColumnEntry> columns;
+        std::vector<Segment> deleted;
+        std::vector<std::pair<std::string, std::string>> hashIndexes;
+        std::vector<std::pair<std::string, std::string>> orderedIndexes;
+    };
+
+    struct Manifest
+    {
+        uint64_t generation = 0;
+        uint64_t lsn = 0;
+        std::vector<TableEntry> tables;
+    };
+
+    // файл сегмента, ещё не записанный на диск
+    struct PendingFile
+    {
+        std::string name;
+        std::string bytes;
+    };
+
+    struct Job
+    {
+        Manifest manifest;
+        std::vector<PendingFile> files;
+    };
+
+    // части файла сегмента по порядку
+    struct Parts
+    {
+        const char* position;
+        const char* end;
+
+        // следующая часть; expected - её размер в байтах (SIZE_MAX - любой)
+        std::pair<const char*, size_t> next(size_t expected)
+        {
+            uint64_t size;
+            if (size_t(end - position) < sizeof(size))
+            {
+                throw std::runtime_error("Corrupted checkpoint segment");
+            }
+            std::memcpy(&size, position, sizeof(size));
+            position += sizeof(size);
+            if (size > size_t(end - position) || (expected != SIZE_MAX && size != expected))
+            {
+                throw std::runtime_error("Corrupted checkpoint segment");
+            }
+            std::pair<const char*, size_t> part(position, size);
+            position += size;
+            return part;
+        }
+
+        template <class T>
+        void append(RowBuffer<T>& buffer, size_t count)
+        {
+            std::pair<const char*, size_t> part = next(count * sizeof(T));
+            size_t old = buffer.size();
+            buffer.resize(old + count);
+            if (count != 0)
+            {
+                std::memcpy(&buffer[old], part.first, part.second);
+            }
+        }
+
+        // биты строк [start, start + rows) маски words из rowsTotal строк; пустая часть - все нули
+        void bits(RowBuffer<uint64_t>& words, size_t start, size_t rows, size_t rowsTotal)
+        {
+            std::pair<const char*, size_t> part = next(SIZE_MAX);
+            if (part.second == 0)
+            {
+                return;
+            }
+            if (part.second != (rows + 63) / 64 * sizeof(uint64_t))
+            {
+                throw std::runtime_error("Corrupted checkpoint segment");
+            }
+            words.resize((rowsTotal + 63) / 64, 0);
+            std::memcpy(&words[start / 64], part.first, part.second);
+        }
+    };
+
+    std::string path;
+    Manifest base;       // последняя записанная (или загруженная) точка
+    bool reuse = false;  // сегменты base совпадают с чистыми сегментами таблиц
+    size_t written = 0;
+    std::thread writer;
+    std::mutex waiting;
+    std::atomic<bool> busy{false};
+    std::exception_ptr error;
+
+    std::string manifestPath() const
+    {
+        return path + "/MANIFEST";
+    }
+
+    // Сегменты колонки (или маски deleted) из rows строк: чистый сегмент с тем же числом строк
+    // берётся из old, остальные сериализуются в job под новыми именами
+    template <class Serialize>
+    static std::vector<Segment> segments(Job& job, const std::vector<Segment>* old, const DirtySegments& dirty, size_t rows,
+            const Serialize& serialize)
+    {
+        std::vector<Segment> result;
+        for (size_t s = 0; s * DirtySegments::kRows < rows; ++s)
+        {
+            size_t begin = s * DirtySegments::kRows;
+            size_t end = std::min(rows, begin + DirtySegments::kRows);
+            if (old != nullptr && s < old->size() && (*old)[s].rows == end - begin && !dirty.contains(s))
+            {
+                result.push_back((*old)[s]);
+                continue;
+            }
+            std::string name = std::to_string(job.manifest.generation) + "-" + std::to_string(job.files.size()) + ".seg";
+            PendingFile file{name, {}};
+            serialize(file.bytes, begin, end);
+            // контрольная сумма считается в фоне, при записи файла
+            result.push_back(Segment{name, end - begin, 0});
+            job.files.push_back(std::move(file));
+        }
+        return result;
+    }
+
+    static void putPart(std::string& out, const void* bytes, size_t size)
+    {
+        uint64_t length = size;
+        out.append(reinterpret_cast<const char*>(&length), sizeof(length));
+        out.append(static_cast<const char*>(bytes), size);
+    }
+
+    // биты строк [begin, end); begin кратно 64. Пустая маска - пустая часть
+    static void putBits(std::string& out, const RowBuffer<uint64_t>& words, size_t begin, size_t end)
+    {
+        if (words.empty())
+        {
+            putPart(out, nullptr, 0);
+            return;
+        }
+        std::vector<uint64_t> slice((end - begin + 63) / 64, 0);
+        for (size_t w = 0; w < slice.size() && begin / 64 + w < words.size(); ++w)
+        {
+            slice[w] = words[begin / 64 + w];
+        }
+        putPart(out, slice.data(), slice.size() * sizeof(uint64_t));
+    }
+
+    static void serialize(std::string& out, const Column& column, size_t begin, size_t end)
+    {
+        if (column.type == 0)
+        {
+            putPart(out, column.ints.data() + begin, (end - begin) * sizeof(int32_t));
+        }
+        else if (column.type == 1)
+        {
+            putBits(out, column.bools, begin, end);
+        }
+        else
+        {
+            putPart(out, column.str_lengths.data() + begin, (end - begin) * sizeof(uint32_t));
+            std::string bytes;
+            for (size_t row = begin; row < end; ++row)
+            {
+                bytes += column.get_string(row);
+            }
+            putPart(out, bytes.data(), bytes.size());
+        }
+        putBits(out, column.nulls, begin, end);
+    }
+
+    // фоновая часть begin: файлы сегментов, новый манифест, durable, удаление ненужных файлов
+    void finish(Job& job, const std::function<void(uint64_t)>& durable)
+    {
+        std::unordered_map<std::string, uint64_t> checksums;
+        for (const PendingFile& file : job.files)
+        {
+            writeFile(path + "/" + file.name, file.bytes);
+            checksums[file.name] = Checksum::of(file.bytes.data(), file.bytes.size());
+        }
+        std::unordered_set<std::string> referenced;
+        for (TableEntry& table : job.manifest.tables)
+        {
+            auto settle = [&checksums, &referenced](std::vector<Segment>& list) {
+                for (Segment& segment : list)
+                {
+                    auto checksum = checksums.find(segment.file);
+                    if (checksum != checksums.end())
+                    {
+                        segment.checksum = checksum->second;
+                    }
+                    referenced.insert(segment.file);
+                }
+            };
+            for (ColumnEntry& column : table.columns)
+            {
+                settle(column.segments);
+            }
+            settle(table.deleted);
+        }
+
+        std::string temporary = manifestPath() + ".tmp";
+        writeFile(temporary, encode(job.manifest));
+        if (::rename(temporary.c_str(), manifestPath().c_str()) != 0)
+        {
+            throw std::runtime_error("Could not replace checkpoint manifest in " + path);
+        }
+        syncDirectory();
+        base = std::move(job.manifest);
+        reuse = true;
+        if (durable)
+        {
+            durable(base.lsn);
+        }
+
+        DIR* listing = ::opendir(path.c_str());
+        if (listing == nullptr)
+        {
+            return;
+        }
+        std::vector<std::string> garbage;
+        while (dirent* item = ::readdir(listing))
+        {
+            std::string name = item->d_name;
+            if (name.size() > 4 && name.compare(name.size() - 4, 4, ".seg") == 0 && !referenced.count(name))
+            {
+                garbage.push_back(name);
+            }
+        }
+        ::closedir(listing);
+        for (const std::string& name : garbage)
+        {
+            ::unlink((path + "/" + name).c_str());
+        }
+    }
+
+    void writeFile(const std::string& filename, const std::string& bytes) const
+    {
+        int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+        {
+            throw std::runtime_error("Could not open file: " + filename);
+        }
+        const char* data = bytes.data();
+        size_t size = bytes.size();
+        while (size > 0)
+        {
+            ssize_t written = ::write(fd, data, size);
+            if (written < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (written < 0)
+            {
+                ::close(fd);
+                throw std::runtime_error("Could not write file: " + filename);
+            }
+            data += written;
+            size -= size_t(written);
+        }
+        bool synced = ::fdatasync(fd) == 0;
+        ::close(fd);
+        if (!synced)
+        {
+            throw std::runtime_error("Could not sync file: " + filename);
+        }
+    }
+
+    // rename манифеста переживает отключение питания только после fsync каталога
+    void syncDirectory() const
+    {
+        int fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY);
+        if (fd < 0 || ::fsync(fd) != 0)
+        {
+            if (fd >= 0)
+            {
+                ::close(fd);
+            }
+            throw std::runtime_error("Could not sync checkpoint directory: " + path);
+        }
+        ::close(fd);
+    }
+
+    // Содержимое файла сегмента, начинающегося со строки start, совпадает с контрольной суммой манифеста,
+    // а сам сегмент - полный (кроме последнего из rows строк)
+    static void verify(const MappedFile& file, const Segment& segment, size_t start, size_t rows)
+    {
+        if (segment.rows > rows - start || (start + segment.rows < rows && segment.rows != DirtySegments::kRows))
+        {
+            throw std::runtime_error("Corrupted checkpoint manifest");
+        }
+        if (Checksum::of(file.data, file.size) != segment.checksum)
+        {
+            throw std::runtime_error("Checkpoint segment checksum mismatch: " + segment.file);
+        }
+    }
+
+    // Манифест: "MEMDBMAN", версия (u32), 0 (u32), размер тела (u64), контрольная сумма тела (u64), тело
+    static std::string encode(const Manifest& manifest)
+    {
+        std::string body;
+        put(body, manifest.generation);
+        put(body, manifest.lsn);
+        put(body, uint32_t(manifest.tables.size()));
+        for (const TableEntry& table : manifest.tables)
+        {
+            putString(body, table.name);
+            put(body, table.rows);
+            put(body, uint32_t(table.columns.size()));
+            for (const ColumnEntry& column : table.columns)
+            {
+                putString(body, column.name);
+                put(body, column.type);
+                put(body, column.flags);
+                put(body, column.nextAutoincrement);
+                putSegments(body, column.segments);
+            }
+            putSegments(body, table.deleted);
+            for (const auto* indexes : {&table.hashIndexes, &table.orderedIndexes})
+            {
+                put(body, uint32_t(indexes->size()));
+                for (const auto& [columnName, indexName] : *indexes)
+                {
+                    putString(body, columnName);
+                    putString(body, indexName);
+                }
+            }
+        }
+
+        std::string result(kMagic, sizeof(kMagic));
+        put(result, kVersion);
+        put(result, uint32_t(0));
+        put(result, uint64_t(body.size()));
+        put(result, Checksum::of(body.data(), body.size()));
+        return result + body;
+    }
+
+    Manifest readManifest() const
+    {
+        MappedFile file(manifestPath());
+        const size_t headerSize = sizeof(kMagic) + 2 * sizeof(uint32_t) + 2 * sizeof(uint64_t);
+        if (file.size < headerSize || std::memcmp(file.data, kMagic, sizeof(kMagic)) != 0)
+        {
+            throw std::runtime_error("Not a checkpoint manifest: " + manifestPath());
+        }
+        Reader header{file.data + sizeof(kMagic), file.data + headerSize};
+        uint32_t version = header.get<uint32_t>();
+        header.get<uint32_t>();
+        uint64_t bodySize = header.get<uint64_t>();
+        uint64_t checksum = header.get<uint64_t>();
+        if (version == 0 || version > kVersion)
+        {
+            throw std::runtime_error("Unsupported checkpoint version " + std::to_string(version));
+        }
+        if (bodySize != file.size - headerSize || Checksum::of(file.data + headerSize, bodySize) != checksum)
+        {
+            throw std::runtime_error("Corrupted checkpoint manifest");
+        }
+
+        Reader body{file.data + headerSize, file.data + file.size};
+        Manifest manifest;
+        manifest.generation = body.get<uint64_t>();
+        manifest.lsn = body.get<uint64_t>();
+        manifest.tables.resize(body.get<uint32_t>());
+        for (TableEntry& table : manifest.tables)
+        {
+            table.name = body.getString();
+            table.rows = body.get<uint64_t>();
+            table.columns.resize(body.get<uint32_t>());
+            for (ColumnEntry& column : table.columns)
+            {
+                column.name = body.getString();
+                column.type = body.get<uint8_t>();
+                column.flags = body.get<uint8_t>();
+                column.nextAutoincrement = body.get<int32_t>();
+                column.segments = body.getSegments();
+                if (column.type > 3)
+                {
+                    throw std::runtime_error("Corrupted checkpoint manifest");
+                }
+            }
+            table.deleted = body.getSegments();
+            for (auto* indexes : {&table.hashIndexes, &table.orderedIndexes})
+            {
+                for (uint32_t i = 0, count = body.get<uint32_t>(); i < count; ++i)
+                {
+                    std::string columnName = body.getString();
+                    indexes->emplace_back(columnName, body.getString());
+                }
+            }
+        }
+        return manifest;
+    }
+
+    struct Reader
+    {
+        const char* position;
+        const char* end;
+
+        template <class T>
+        T get()
+        {
+            T number;
+            need(sizeof(number));
+            std::memcpy(&number, position, sizeof(number));
+            position += sizeof(number);
+            return number;
+        }
+
+        std::string getString()
+        {
+            uint32_t size = get<uint32_t>();
+            need(size);
+            std::string text(position, size);
+            position += size;
+            return text;
+        }
+
+        std::vector<Segment> getSegments()
+        {
+            std::vector<Segment> segments(get<uint32_t>());
+            for (Segment& segment : segments)
+            {
+                segment.file = getString();
+                segment.rows = get<uint64_t>();
+                segment.checksum = get<uint64_t>();
+                if (segment.file.find('/') != std::string::npos)
+                {
+                    throw std::runtime_error("Corrupted checkpoint manifest");
+                }
+            }
+            return segments;
+        }
+
+        void need(size_t size) const
+        {
+            if (size > size_t(end - position))
+            {
+                throw std::runtime_error("Corrupted checkpoint manifest");
+            }
+        }
+    };
+
+    template <class T>
+    static void put(std::string& out, T number)
+    {
+        out.append(reinterpret_cast<const char*>(&number), sizeof(number));
+    }
+
+    static void putString(std::string& out, const std::string& text)
+    {
+        put(out, uint32_t(text.size()));
+        out += text;
+    }
+
+    static void putSegments(std::string& out, const std::vector<Segment>& segments)
+    {
+        put(out, uint32_t(segments.size()));
+        for (const Segment& segment : segments)
+        {
+            putString(out, segment.file);
+            put(out, segment.rows);
+            put(out, segment.checksum);
+        }
+    }
+};
+
+#endif // CHECKPOINT_H
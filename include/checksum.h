@@ -0,0 +1,50 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Контрольная сумма блоков на диске (снимок, журнал): 64 бита по 8-байтным словам в четыре
+// независимые полосы, чтобы умножения шли параллельно. Не криптографическая - ловит порчу и недописанные данные
+class Checksum
+{
+public:
+    static uint64_t of(const char* bytes, size_t size)
+    {
+        const uint64_t prime = 0x9e3779b97f4a7c15ull;
+        uint64_t lanes[4] = {size, prime, ~size, prime >> 1};
+        size_t words = size / 8;
+        size_t w = 0;
+        for (; w + 4 <= words; w += 4)
+        {
+            for (size_t l = 0; l < 4; ++l)
+            {
+                uint64_t word;
+                std::memcpy(&word, bytes + (w + l) * 8, 8);
+                lanes[l] = (lanes[l] ^ word) * prime;
+                lanes[l] ^= lanes[l] >> 29;
+            }
+        }
+        uint64_t hash = lanes[0] ^ rotate(lanes[1], 17) ^ rotate(lanes[2], 31) ^ rotate(lanes[3], 47);
+        for (; w < words; ++w)
+        {
+            uint64_t word;
+            std::memcpy(&word, bytes + w * 8, 8);
+            hash = (hash ^ word) * prime;
+        }
+        for (size_t b = words * 8; b < size; ++b)
+        {
+            hash = (hash ^ uint8_t(bytes[b])) * prime;
+        }
+        return hash ^ (hash >> 32);
+    }
+
+private:
+    static uint64_t rotate(uint64_t value, int bits)
+    {
+        return (value << bits) | (value >> (64 - bits));
+    }
+};
+
+#endif // CHECKSUM_H
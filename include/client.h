@@ -0,0 +1,221 @@
+#ifndef CLIENT_H
+#define CLIENT_H
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "protocol.h"
+#include "table.h"
+
+// Клиент memorydb-server (protocol.h). Запросы отправляются конвейером: send только копит кадры,
+// receive дописывает их в сокет и возвращает ответы строго в порядке send, по одному. Пока кадры
+// уходят, клиент читает уже пришедшие ответы, поэтому длинный конвейер не блокируется встречным
+// потоком результатов. Ошибка запроса возвращается в Result, ошибка соединения - runtime_error
+class Client
+{
+public:
+    struct Result
+    {
+        std::string error;
+        uint64_t count = 0; // строк результата SELECT или affected_rows
+        std::vector<std::string> names; // колонки SELECT в порядке запроса
+        Table rows;
+
+        bool ok() const
+        {
+            return error.empty();
+        }
+    };
+
+    Client() = default;
+    Client(const Client&) = delete;
+    Client& operator=(const Client&) = delete;
+
+    ~Client()
+    {
+        close();
+    }
+
+    void connectTcp(const std::string& host, uint16_t port)
+    {
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        if (::inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1)
+        {
+            throw std::invalid_argument("Invalid IPv4 address: " + host);
+        }
+        open(AF_INET, reinterpret_cast<sockaddr*>(&address), sizeof(address), host + ":" + std::to_string(port));
+        int one = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+
+    void connectUnix(const std::string& path)
+    {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(address.sun_path))
+        {
+            throw std::invalid_argument("Socket path too long: " + path);
+        }
+        std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+        open(AF_UNIX, reinterpret_cast<sockaddr*>(&address), sizeof(address), path);
+    }
+
+    // неотправленные запросы и непрочитанные ответы пропадают
+    void close()
+    {
+        if (fd >= 0)
+        {
+            ::close(fd);
+            fd = -1;
+        }
+        input.clear();
+        output.clear();
+        consumed = written = 0;
+        waiting = 0;
+    }
+
+    void send(const std::string& query)
+    {
+        Protocol::appendFrame(output, FrameKind::QUERY, query);
+        ++waiting;
+    }
+
+    // запросов, ответ на которые ещё не получен через receive
+    size_t pending() const
+    {
+        return waiting;
+    }
+
+    // ответ на самый старый из отправленных запросов
+    Result receive()
+    {
+        if (fd < 0 || waiting == 0)
+        {
+            throw std::invalid_argument(fd < 0 ? "Client is not connected" : "No query to receive");
+        }
+        Result result;
+        std::vector<int> types;
+        bool header = false;
+        while (true)
+        {
+            FrameKind kind;
+            std::string_view payload;
+            while (!Protocol::nextFrame(input, consumed, kind, payload))
+            {
+                exchange();
+            }
+            if (kind == FrameKind::HEADER) {
+                Protocol::readHeader(payload, result.names, types);
+                for (size_t k = 0; k < types.size(); ++k)
+                {
+                    result.rows.addColumn(result.names[k], types[k]);
+                }
+                header = true;
+            } else if (kind == FrameKind::ROWS && header) {
+                std::vector<Column> batch = Protocol::readRows(payload, types);
+                for (size_t k = 0; k < batch.size(); ++k)
+                {
+                    result.rows.columns[result.names[k]].append_column(batch[k]);
+                }
+            } else if (kind == FrameKind::DONE && payload.size() == sizeof(uint64_t)) {
+                result.count = Protocol::get<uint64_t>(payload.data());
+                --waiting;
+                return result;
+            } else if (kind == FrameKind::ERROR) {
+                result.error = payload.empty() ? "Unknown error" : std::string(payload);
+                --waiting;
+                return result;
+            } else {
+                throw std::runtime_error("Unexpected frame from server");
+            }
+        }
+    }
+
+    // запрос без конвейера: отправить и дождаться ответа
+    Result query(const std::string& text)
+    {
+        if (waiting != 0)
+        {
+            throw std::invalid_argument("Pipelined queries are still waiting for receive");
+        }
+        send(text);
+        return receive();
+    }
+
+private:
+    int fd = -1;
+    std::string input;
+    size_t consumed = 0; // разобранные кадры в начале input
+    std::string output;
+    size_t written = 0;
+    size_t waiting = 0;
+
+    void open(int domain, const sockaddr* address, socklen_t length, const std::string& where)
+    {
+        close();
+        fd = ::socket(domain, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0 || ::connect(fd, address, length) != 0)
+        {
+            close();
+            throw std::runtime_error("Could not connect to " + where);
+        }
+    }
+
+    // ждёт сокет и отправляет, сколько он примет из output, и/или дочитывает пришедшее в input
+    void exchange()
+    {
+        pollfd event{fd, short(POLLIN | (written < output.size() ? POLLOUT : 0)), 0};
+        while (::poll(&event, 1, -1) < 0)
+        {
+            if (errno != EINTR)
+            {
+                throw std::runtime_error("poll failed");
+            }
+        }
+        if (event.revents & POLLOUT)
+        {
+            ssize_t size = ::send(fd, output.data() + written, output.size() - written, MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (size > 0) {
+                written += size_t(size);
+            } else if (size < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                throw std::runtime_error("Connection lost");
+            }
+            if (written == output.size())
+            {
+                output.clear();
+                written = 0;
+            }
+        }
+        if (event.revents & (POLLIN | POLLHUP | POLLERR))
+        {
+            input.erase(0, consumed);
+            consumed = 0;
+            char buffer[64 * 1024];
+            ssize_t size = ::recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+            if (size > 0) {
+                input.append(buffer, size_t(size));
+            } else if (size == 0) {
+                throw std::runtime_error("Connection closed by server");
+            } else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                throw std::runtime_error("Connection lost");
+            }
+        }
+    }
+};
+
+#endif // CLIENT_H
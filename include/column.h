@@ -1,9 +1,16 @@
+#ifndef COLUMN_H
+#define COLUMN_H
+
 #include <vector>
 #include <algorithm>
 #include <stdexcept>
 #include <memory>
+#include <string>
+#include <string_view>
+#include <cstdint>
 
 #include "cells.h"
+#include "row_buffer.h"
 
 /*
 std::vector<const std::type_info*> CellTypes(4);
@@ -13,87 +20,365 @@ std::vector<const std::type_info*> CellTypes(4);
         CellTypes[3] =  &typeid(CellBytes);
 */
 
-class Column 
+// Сегменты по kRows строк, изменённые после последней контрольной точки (см. checkpoint.h):
+// бит на сегмент, помечается при каждой записи значения
+struct DirtySegments
+{
+    static constexpr size_t kRows = 64 * 1024;
+
+    std::vector<uint64_t> bits;
+
+    void mark(size_t row)
+    {
+        size_t segment = row / kRows;
+        if ((segment >> 6) >= bits.size()) {
+            bits.resize((segment >> 6) + 1, 0);
+        }
+        bits[segment >> 6] |= uint64_t(1) << (segment & 63);
+    }
+
+    void mark_range(size_t begin, size_t end)
+    {
+        for (size_t row = begin - begin % kRows; row < end; row += kRows)
+        {
+            mark(row);
+        }
+    }
+
+    bool contains(size_t segment) const
+    {
+        return (segment >> 6) < bits.size() && (bits[segment >> 6] >> (segment & 63) & 1);
+    }
+
+    void clear()
+    {
+        bits.clear();
+    }
+};
+
+// Значения колонки лежат в непрерывных типизированных буферах, а не по одной ячейке в куче:
+//   int32        -> ints
+//   bool         -> bools (по 64 значения в слове)
+//   string/bytes -> str_offsets/str_lengths в общий blob
+// Ячейки (Cell) создаются только на границе API - в Line и при чтении через get_cell
+class Column
 {
 public:
-    int type; //смотрите выше
-    std::vector <std::shared_ptr<Cell>> cells;
-
-    bool is_key, is_unique, is_autoincrement;
-
-    Column() : type(0), is_key(false), is_unique(false), is_autoincrement(false) {}
-
-    Column (int tp): type(tp){}
-
-    Column(Column *other): type(other->type), is_key(other->is_key), is_unique(other->is_unique), is_autoincrement(other->is_autoincrement){
-        for (const auto& cell : other->cells) {
-            if (type == 0) {
-                cells.push_back(std::make_shared<CellInt>(*std::static_pointer_cast<CellInt>(cell)));
-            } else if (type == 1) {
-                cells.push_back(std::make_shared<CellBool>(*std::static_pointer_cast<CellBool>(cell)));
-            } else if (type == 2) {
-                cells.push_back(std::make_shared<CellString>(*std::static_pointer_cast<CellString>(cell)));
-            } else if (type == 3) {
-                cells.push_back(std::make_shared<CellBytes>(*std::static_pointer_cast<CellBytes>(cell)));
-            } else {
-                throw std::runtime_error("Unknown cell type");
-            }
+    int type = 0; //смотрите выше
+
+    bool is_key = false, is_unique = false, is_autoincrement = false;
+
+    // следующее значение autoincrement-колонки: больше всех, что в ней когда-либо были
+    int32_t next_autoincrement = 0;
+
+    RowBuffer<int32_t> ints;
+    RowBuffer<uint64_t> bools;
+    RowBuffer<uint64_t> str_offsets;
+    RowBuffer<uint32_t> str_lengths;
+    RowBuffer<char> blob;
+
+    // битовая маска NULL-значений, пустая пока в колонке нет ни одного NULL
+    // (после прямого заполнения буферов - см. adopt_buffers)
+    RowBuffer<uint64_t> nulls;
+
+    // сегменты, изменённые после последней контрольной точки
+    DirtySegments dirty;
+
+    Column() = default;
+
+    Column (int tp): type(tp)
+    {
+        if (type < 0 || type > 3)
+        {
+            throw std::runtime_error("Unknown cell type");
         }
     }
 
+    Column(Column *other): Column(*other) {}
 
-    //возможно, понадобится для select или join
-    //Column(Column &&other): type(other.type), cells(std::move(other.cells)), is_key(other.is_key), is_unique(other.is_unique), is_autoincrement(other.is_autoincrement){}
+    Column(Cell& cell)
+    {
+        type = cell_type(cell);
+        if (type > 3)
+        {
+            throw std::runtime_error("Unknown cell type");
+        }
+        add_cell(cell);
+    }
 
-    Column(Cell& cell) 
-    {   
+    static int cell_type(const Cell& cell)
+    {
         std::vector<const std::type_info*> CellTypes(4);
         CellTypes[0] = &typeid(CellInt);
         CellTypes[1] =  &typeid(CellBool);
         CellTypes[2] =  &typeid(CellString);
         CellTypes[3] =  &typeid(CellBytes);
 
-        type = std::find(CellTypes.begin(), CellTypes.end(), &typeid(cell)) - CellTypes.begin();
+        return std::find(CellTypes.begin(), CellTypes.end(), &typeid(cell)) - CellTypes.begin();
+    }
 
+    size_t size() const
+    {
+        return count;
+    }
+
+    bool empty() const
+    {
+        return count == 0;
+    }
 
+    void reserve(size_t n)
+    {
         if (type == 0) {
-            cells.push_back(std::make_shared<CellInt>(dynamic_cast<CellInt&>(cell)));  
+            ints.reserve(n);
         } else if (type == 1) {
-            cells.push_back(std::make_shared<CellBool>(dynamic_cast<CellBool&>(cell)));  
-        } else if (type == 2) {
-            cells.push_back(std::make_shared<CellString>(dynamic_cast<CellString&>(cell)));  
-        } else if (type == 3) {
-            cells.push_back(std::make_shared<CellBytes>(dynamic_cast<CellBytes&>(cell))); 
+            bools.reserve((n + 63) / 64);
         } else {
-            throw std::runtime_error("Unknown cell type");
+            str_offsets.reserve(n);
+            str_lengths.reserve(n);
         }
     }
 
-    Cell& get_cell(int index) 
-    {   
-        if (index >= cells.size()) 
+    // хватит ли буферов (с маской NULL) на rows строк и bytes байт blob без перевыделения
+    bool fits(size_t rows, size_t bytes) const
+    {
+        size_t words = (rows + 63) / 64;
+        if (nulls.capacity() < words) {
+            return false;
+        } else if (type == 0) {
+            return ints.capacity() >= rows;
+        } else if (type == 1) {
+            return bools.capacity() >= words;
+        }
+        return str_offsets.capacity() >= rows && str_lengths.capacity() >= rows && blob.capacity() >= bytes;
+    }
+
+    // резервирует все буферы, включая ещё пустую маску NULL (см. Table::reserveRows)
+    void reserve_room(size_t rows, size_t bytes)
+    {
+        reserve(rows);
+        nulls.reserve((rows + 63) / 64);
+        if (type >= 2 && blob.capacity() < bytes) {
+            blob.reserve(bytes);
+        }
+    }
+
+    // память всех буферов колонки доживёт до освобождения kept (см. RowBuffer::share)
+    void share_buffers(std::vector<std::shared_ptr<const void>>& kept) const
+    {
+        kept.push_back(ints.share());
+        kept.push_back(bools.share());
+        kept.push_back(str_offsets.share());
+        kept.push_back(str_lengths.share());
+        kept.push_back(blob.share());
+        kept.push_back(nulls.share());
+    }
+
+    void clear()
+    {
+        ints.clear();
+        bools.clear();
+        str_offsets.clear();
+        str_lengths.clear();
+        blob.clear();
+        nulls.clear();
+        any_nulls = false;
+        count = 0;
+        dead_bytes = 0;
+    }
+
+    // Слова bools и nulls меняются, пока их читают читатели снимков (Table::holdRows): они читаются
+    // и пишутся атомарно, а размеры буферов читатель не смотрит - маску NULL выдаёт has_nulls
+    bool has_nulls() const
+    {
+        return __atomic_load_n(&any_nulls, __ATOMIC_ACQUIRE);
+    }
+
+    uint64_t bool_word(size_t word) const
+    {
+        return __atomic_load_n(&bools[word], __ATOMIC_RELAXED);
+    }
+
+    uint64_t null_word(size_t word) const
+    {
+        return has_nulls() ? __atomic_load_n(&nulls[word], __ATOMIC_RELAXED) : 0;
+    }
+
+    bool is_null(size_t index) const
+    {
+        return null_word(index >> 6) >> (index & 63) & 1;
+    }
+
+    int32_t get_int(size_t index) const
+    {
+        return ints[index];
+    }
+
+    bool get_bool(size_t index) const
+    {
+        return bool_word(index >> 6) >> (index & 63) & 1;
+    }
+
+    std::string_view get_string(size_t index) const
+    {
+        return std::string_view(blob.data() + str_offsets[index], str_lengths[index]);
+    }
+
+    void push_int(int32_t value)
+    {
+        ints.push_back(value);
+        grow();
+    }
+
+    void push_bool(bool value)
+    {
+        if ((count & 63) == 0) {
+            bools.push_back(0);
+        }
+        grow();
+        set_bool(count - 1, value);
+    }
+
+    void push_string(std::string_view value)
+    {
+        str_offsets.push_back(blob.size());
+        str_lengths.push_back(value.size());
+        blob.append(value.data(), value.size());
+        grow();
+    }
+
+    void push_null()
+    {
+        if (type == 0) {
+            push_int(0);
+        } else if (type == 1) {
+            push_bool(false);
+        } else {
+            push_string("");
+        }
+        set_null_bit(count - 1, true);
+    }
+
+    void set_int(size_t index, int32_t value)
+    {
+        ints[index] = value;
+        set_null_bit(index, false);
+    }
+
+    void set_bool(size_t index, bool value)
+    {
+        uint64_t mask = uint64_t(1) << (index & 63);
+        if (value) {
+            __atomic_fetch_or(&bools[index >> 6], mask, __ATOMIC_RELAXED);
+        } else {
+            __atomic_fetch_and(&bools[index >> 6], ~mask, __ATOMIC_RELAXED);
+        }
+        set_null_bit(index, false);
+    }
+
+    void set_string(size_t index, std::string_view value)
+    {
+        if (value.size() <= str_lengths[index])
+        {
+            // новое значение помещается на старое место
+            dead_bytes += str_lengths[index] - value.size();
+            std::copy(value.begin(), value.end(), blob.begin() + str_offsets[index]);
+        }
+        else
+        {
+            dead_bytes += str_lengths[index];
+            str_offsets[index] = blob.size();
+            blob.append(value.data(), value.size());
+        }
+        str_lengths[index] = value.size();
+        set_null_bit(index, false);
+        if (dead_bytes > blob.size() / 2 && dead_bytes > 4096)
+        {
+            compact_blob();
+        }
+    }
+
+    void set_null(size_t index)
+    {
+        set_null_bit(index, true);
+    }
+
+    // значение строки index в виде отдельной ячейки (nullptr для NULL)
+    std::shared_ptr<Cell> get_cell(size_t index) const
+    {
+        if (index >= count)
         {
             throw "there's no such cell in this column\n";
         }
-        return *cells[index];
+        if (is_null(index)) {
+            return nullptr;
+        }
+        if (type == 0) {
+            return std::make_shared<CellInt>(get_int(index));
+        } else if (type == 1) {
+            return std::make_shared<CellBool>(get_bool(index));
+        } else if (type == 2) {
+            return std::make_shared<CellString>(std::string(get_string(index)));
+        } else {
+            return std::make_shared<CellBytes>(std::string(get_string(index)));
+        }
     }
 
-    int get_cell_index(Cell &cell) 
-    {   
-        std::vector<const std::type_info*> CellTypes(4);
-        CellTypes[0] = &typeid(CellInt);
-        CellTypes[1] =  &typeid(CellBool);
-        CellTypes[2] =  &typeid(CellString);
-        CellTypes[3] =  &typeid(CellBytes);
+    void set_cell(size_t index, const std::shared_ptr<Cell>& cell)
+    {
+        if (cell == nullptr)
+        {
+            set_null(index);
+            return;
+        }
+        check_type(*cell);
+        if (type == 0) {
+            set_int(index, static_cast<const CellInt&>(*cell).data);
+        } else if (type == 1) {
+            set_bool(index, static_cast<const CellBool&>(*cell).data);
+        } else if (type == 2) {
+            set_string(index, static_cast<const CellString&>(*cell).data);
+        } else {
+            set_string(index, static_cast<const CellBytes&>(*cell).data);
+        }
+    }
+
+    void push_cell(const std::shared_ptr<Cell>& cell)
+    {
+        if (cell == nullptr)
+        {
+            push_null();
+            return;
+        }
+        add_cell(*cell);
+    }
 
-        if (type != std::find(CellTypes.begin(), CellTypes.end(), &typeid(cell)) - CellTypes.begin()) 
+    bool cell_equals(size_t index, const Cell& cell) const
+    {
+        if (is_null(index) || cell_type(cell) != type) {
+            return false;
+        }
+        if (type == 0) {
+            return get_int(index) == static_cast<const CellInt&>(cell).data;
+        } else if (type == 1) {
+            return get_bool(index) == static_cast<const CellBool&>(cell).data;
+        } else if (type == 2) {
+            return get_string(index) == static_cast<const CellString&>(cell).data;
+        } else {
+            return get_string(index) == static_cast<const CellBytes&>(cell).data;
+        }
+    }
+
+    int get_cell_index(Cell &cell)
+    {
+        if (type != cell_type(cell))
         {
             throw "there's no cell in this column with such type\n";
             return -1;
         }
-        for (int i = 0; i < cells.size(); i++) 
+        for (size_t i = 0; i < count; i++)
         {
-            if (*cells[i] == cell) 
+            if (cell_equals(i, cell))
             {
                 return i;
             }
@@ -102,31 +387,210 @@ public:
         return -1;
     }
 
-    void add_cell(Cell& cell) 
+    void add_cell(Cell& cell)
     {
-        std::vector<const std::type_info*> CellTypes(4);
-        CellTypes[0] = &typeid(CellInt);
-        CellTypes[1] =  &typeid(CellBool);
-        CellTypes[2] =  &typeid(CellString);
-        CellTypes[3] =  &typeid(CellBytes);
+        check_type(cell);
+        if (type == 0) {
+            push_int(static_cast<CellInt&>(cell).data);
+        } else if (type == 1) {
+            push_bool(static_cast<CellBool&>(cell).data);
+        } else if (type == 2) {
+            push_string(static_cast<CellString&>(cell).data);
+        } else {
+            push_string(static_cast<CellBytes&>(cell).data);
+        }
+    }
+
+    // дописывает в конец значение строки index колонки того же типа
+    void append_from(const Column& other, size_t index)
+    {
+        if (other.is_null(index)) {
+            push_null();
+        } else if (type == 0) {
+            push_int(other.get_int(index));
+        } else if (type == 1) {
+            push_bool(other.get_bool(index));
+        } else {
+            push_string(other.get_string(index));
+        }
+    }
 
-        if (type != std::find(CellTypes.begin(), CellTypes.end(), &typeid(cell)) - CellTypes.begin()) 
+    // дописывает в конец строки rows колонки того же типа
+    void append_rows(const Column& other, const std::vector<uint32_t>& rows)
+    {
+        reserve(count + rows.size());
+        if (type == 0 && !other.has_nulls())
         {
-            throw "Unknown cell type\n";
+            for (uint32_t row : rows)
+            {
+                ints.push_back(other.ints[row]);
+            }
+            dirty.mark_range(count, count + rows.size());
+            count += rows.size();
+            if (!nulls.empty()) {
+                nulls.resize((count + 63) / 64, 0);
+            }
             return;
         }
+        for (uint32_t row : rows)
+        {
+            append_from(other, row);
+        }
+    }
+
+    // дописывает в конец все строки колонки того же типа целыми буферами
+    void append_column(const Column& other)
+    {
+        size_t start = count;
         if (type == 0) {
-            cells.push_back(std::make_shared<CellInt>(dynamic_cast<CellInt&>(cell)));  
+            ints.append(other.ints.data(), other.ints.size());
         } else if (type == 1) {
-            cells.push_back(std::make_shared<CellBool>(dynamic_cast<CellBool&>(cell)));  
-        } else if (type == 2) {
-            cells.push_back(std::make_shared<CellString>(dynamic_cast<CellString&>(cell))); 
-        } else if (type == 3) {
-            cells.push_back(std::make_shared<CellBytes>(dynamic_cast<CellBytes&>(cell)));  
+            append_bits(bools, start, other.bools, other.count);
         } else {
-            throw std::runtime_error("Unknown cell type");
+            uint64_t shift = blob.size();
+            str_offsets.reserve(start + other.count);
+            for (uint64_t offset : other.str_offsets) {
+                str_offsets.push_back(offset + shift);
+            }
+            str_lengths.append(other.str_lengths.data(), other.str_lengths.size());
+            blob.append(other.blob.data(), other.blob.size());
+            dead_bytes += other.dead_bytes;
+        }
+        if (!other.nulls.empty()) {
+            if (nulls.empty()) {
+                nulls.assign((start + 63) / 64, 0);
+            }
+            append_bits(nulls, start, other.nulls, other.count);
+            __atomic_store_n(&any_nulls, true, __ATOMIC_RELEASE);
+        } else if (!nulls.empty()) {
+            nulls.resize((start + other.count + 63) / 64, 0);
         }
+        count += other.count;
+        dirty.mark_range(start, count);
+    }
+
+    // оставляет только строки rows (по возрастанию) за один проход
+    void retain_rows(const std::vector<uint32_t>& rows)
+    {
+        Column kept(type);
+        kept.is_key = is_key;
+        kept.is_unique = is_unique;
+        kept.is_autoincrement = is_autoincrement;
+        kept.next_autoincrement = next_autoincrement;
+        kept.append_rows(*this, rows);
+        *this = std::move(kept);
+    }
+
+    // Буферы ints/bools/str_offsets/str_lengths/blob/nulls заполнены напрямую (например, из снимка):
+    // выставляет число строк, проверив, что буферы ему соответствуют
+    void adopt_buffers(size_t rows)
+    {
+        size_t words = (rows + 63) / 64;
+        bool valid = nulls.empty() || nulls.size() == words;
+        if (type == 0) {
+            valid = valid && ints.size() == rows;
+        } else if (type == 1) {
+            valid = valid && bools.size() == words;
+        } else {
+            valid = valid && str_offsets.size() == rows && str_lengths.size() == rows;
+        }
+        uint64_t used = 0;
+        for (size_t i = 0; valid && type >= 2 && i < rows; ++i)
+        {
+            valid = str_offsets[i] <= blob.size() && str_lengths[i] <= blob.size() - str_offsets[i];
+            used += str_lengths[i];
+        }
+        if (!valid)
+        {
+            throw std::runtime_error("Column buffers do not match row count");
+        }
+        count = rows;
+        any_nulls = !nulls.empty();
+        dead_bytes = used < blob.size() ? blob.size() - used : 0;
+        dirty.mark_range(0, rows);
     }
 
     ~Column() = default;
-};
\ No newline at end of file
+
+private:
+    size_t count = 0;
+    size_t dead_bytes = 0; // байты blob, на которые больше не ссылается ни одна строка
+    bool any_nulls = false; // !nulls.empty(), но читается без гонки с ростом nulls
+
+    void grow()
+    {
+        dirty.mark(count);
+        ++count;
+        if (!nulls.empty() && nulls.size() * 64 < count) {
+            nulls.push_back(0);
+        }
+    }
+
+    // через неё проходит каждое изменение значения строки
+    void set_null_bit(size_t index, bool value)
+    {
+        dirty.mark(index);
+        if (nulls.empty())
+        {
+            if (!value) {
+                return;
+            }
+            nulls.assign((count + 63) / 64, 0);
+            __atomic_store_n(&any_nulls, true, __ATOMIC_RELEASE);
+        }
+        uint64_t mask = uint64_t(1) << (index & 63);
+        if (value) {
+            __atomic_fetch_or(&nulls[index >> 6], mask, __ATOMIC_RELAXED);
+        } else {
+            __atomic_fetch_and(&nulls[index >> 6], ~mask, __ATOMIC_RELAXED);
+        }
+    }
+
+    // биты [0, moreSize) из more дописываются в words после первых size бит
+    static void append_bits(RowBuffer<uint64_t>& words, size_t size, const RowBuffer<uint64_t>& more, size_t moreSize)
+    {
+        size_t shift = size & 63;
+        words.resize((size + moreSize + 63) / 64, 0);
+        // первое слово может быть общим со строками, которые читают снимки
+        if (shift != 0) {
+            __atomic_fetch_and(&words[size >> 6], (uint64_t(1) << shift) - 1, __ATOMIC_RELAXED);
+        }
+        size_t moreWords = (moreSize + 63) / 64;
+        for (size_t w = 0; w < moreWords; ++w)
+        {
+            uint64_t word = more[w];
+            if (w + 1 == moreWords && (moreSize & 63) != 0) {
+                word &= (uint64_t(1) << (moreSize & 63)) - 1;
+            }
+            size_t target = (size >> 6) + w;
+            __atomic_fetch_or(&words[target], word << shift, __ATOMIC_RELAXED);
+            if (shift != 0 && target + 1 < words.size()) {
+                words[target + 1] |= word >> (64 - shift);
+            }
+        }
+    }
+
+    void check_type(const Cell& cell) const
+    {
+        if (type != cell_type(cell))
+        {
+            throw std::invalid_argument("Cell type does not match column type");
+        }
+    }
+
+    void compact_blob()
+    {
+        RowBuffer<char> packed;
+        packed.reserve(blob.size() - dead_bytes);
+        for (size_t i = 0; i < count; ++i)
+        {
+            uint64_t offset = packed.size();
+            packed.append(blob.data() + str_offsets[i], str_lengths[i]);
+            str_offsets[i] = offset;
+        }
+        blob = std::move(packed);
+        dead_bytes = 0;
+    }
+};
+
+#endif //COLUMN_H
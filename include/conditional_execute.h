@@ -1,3 +1,6 @@
+#ifndef CONDITIONAL_EXECUTE_H
+#define CONDITIONAL_EXECUTE_H
+
 #include <iostream>
 #include <sstream>
 #include <cctype>
@@ -5,6 +8,8 @@
 #include <algorithm>
 #include <vector>
 #include <cmath>
+#include <map>
+#include <memory>
 
 enum class TokenType {
     IDENTIFIER,
@@ -89,7 +94,8 @@ private:
 
     bool is_operator_start(char ch) {
         return ch == '=' || ch == '!' || ch == '>' || ch == '<' ||
-               ch == '+' || ch == '-' || ch == '*' || ch == '/';
+               ch == '+' || ch == '-' || ch == '*' || ch == '/' ||
+               ch == '%' || ch == '&' || ch == '|';
     }
 
     Token operator_token() {
@@ -100,6 +106,9 @@ private:
         if ((op == "!" || op == "=" || op == "<" || op == ">") && current_char_ == '=') {
             op += current_char_;
             advance();
+        } else if ((op == "&" || op == "|") && current_char_ == op[0]) {
+            op += current_char_;
+            advance();
         }
 
         return Token{TokenType::OPERATOR, op};
@@ -119,6 +128,18 @@ private:
         std::string result;
         bool has_decimal = false;
 
+        if (current_char_ == '0' && pos_ < input_.size() && (input_[pos_] == 'x' || input_[pos_] == 'X')) {
+            // шестнадцатеричный литерал (для bytes)
+            result = "0x";
+            advance();
+            advance();
+            while (current_char_ != '\0' && std::isxdigit(current_char_)) {
+                result += current_char_;
+                advance();
+            }
+            return Token{TokenType::NUMBER, result};
+        }
+
         while (current_char_ != '\0' &&
                (std::isdigit(current_char_) || current_char_ == '.')) {
             if (current_char_ == '.') {
@@ -680,3 +701,5 @@ bool check_conditional(const ASTNodePtr& ast, const std::map<std::string, std::s
     Value result = ast->evaluate(variables);
     return result.as_number() != 0.0;
 }
+
+#endif // CONDITIONAL_EXECUTE_H
@@ -0,0 +1,291 @@
+#ifndef CSV_LOADER_H
+#define CSV_LOADER_H
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "column.h"
+#include "mapped_file.h"
+#include "table.h"
+#include "thread_pool.h"
+
+// Массовая загрузка CSV (RFC 4180) в существующую таблицу.
+// Первая строка - имена колонок. Поле в двойных кавычках может содержать запятые и переводы строк,
+// кавычка внутри него пишется как "", в поле без кавычек кавычка - ошибка. Пустое поле без кавычек -
+// NULL, "" - пустая строка; bool - 1/0 или true/false, bytes - как есть. Пустые строки файла
+// пропускаются, \r\n допускается.
+// Файл отображается в память и делится на куски по kChunkBytes; граница куска сдвигается к ближайшему
+// переводу строки вне кавычек (чётность кавычек перед куском известна из их подсчёта по кускам).
+// Куски разбираются параллельно в пуле (числа - std::from_chars) в свои колонки, которые затем
+// дописываются в таблицу целыми буферами через Table::appendColumns (по задаче на колонку)
+class CsvLoader
+{
+public:
+    static constexpr size_t kChunkBytes = 4 * 1024 * 1024;
+
+    // возвращает число добавленных строк
+    static size_t load(Table& table, const std::string& filename, ThreadPool* pool)
+    {
+        MappedFile file(filename);
+        return load(table, file.text(), pool);
+    }
+
+    static size_t load(Table& table, std::string_view text, ThreadPool* pool)
+    {
+        const char* end = text.data() + text.size();
+        std::vector<std::string> names;
+        const char* body = parseHeader(text.data(), end, names);
+        std::vector<int> types;
+        for (const std::string& columnName : names)
+        {
+            auto it = table.columns.find(columnName);
+            if (it == table.columns.end())
+            {
+                throw std::invalid_argument("Column not found: " + columnName);
+            }
+            types.push_back(it->second.type);
+        }
+
+        std::vector<const char*> splits = split(body, end, pool);
+        std::vector<std::vector<Column>> parts(splits.size() - 1);
+        forEach(pool, parts.size(), [&](size_t k) {
+            parts[k] = parseRange(text.data(), splits[k], splits[k + 1], names, types);
+        });
+
+        size_t rows = 0;
+        for (const auto& part : parts)
+        {
+            rows += part.empty() ? 0 : part[0].size();
+        }
+        table.appendColumns(names, parts);
+        return rows;
+    }
+
+private:
+    template <class Task>
+    static void forEach(ThreadPool* pool, size_t count, const Task& task)
+    {
+        if (pool != nullptr && pool->workers() > 0 && count > 1)
+        {
+            pool->parallelFor(count, task);
+            return;
+        }
+        for (size_t i = 0; i < count; ++i)
+        {
+            task(i);
+        }
+    }
+
+    static const char* parseHeader(const char* p, const char* end, std::vector<std::string>& names)
+    {
+        if (p == end)
+        {
+            throw std::invalid_argument("CSV file has no header");
+        }
+        std::string scratch;
+        while (true)
+        {
+            std::string_view value;
+            bool quoted;
+            p = parseField(p, end, scratch, value, quoted);
+            if (!quoted && value.find('"') != std::string_view::npos)
+            {
+                throw std::invalid_argument("Quote inside unquoted field in CSV header");
+            }
+            names.emplace_back(value);
+            if (p == end || *p == '\n')
+            {
+                return p == end ? p : p + 1;
+            }
+            ++p;
+        }
+    }
+
+    // границы кусков: начало, сдвинутые к началу записи точки через kChunkBytes, конец
+    static std::vector<const char*> split(const char* begin, const char* end, ThreadPool* pool)
+    {
+        size_t chunks = std::max<size_t>(1, (end - begin + kChunkBytes - 1) / kChunkBytes);
+        std::vector<size_t> quotes(chunks);
+        forEach(pool, chunks, [&](size_t k) {
+            const char* from = begin + k * kChunkBytes;
+            quotes[k] = std::count(from, std::min(end, from + kChunkBytes), '"');
+        });
+
+        std::vector<const char*> splits{begin};
+        size_t seen = 0;
+        for (size_t k = 1; k < chunks; ++k)
+        {
+            seen += quotes[k - 1];
+            const char* p = begin + k * kChunkBytes;
+            bool inside = seen % 2 == 1;
+            for (; p < end; ++p)
+            {
+                if (*p == '"')
+                {
+                    inside = !inside;
+                }
+                else if (*p == '\n' && !inside)
+                {
+                    break;
+                }
+            }
+            p = p < end ? p + 1 : end;
+            // запись длиннее куска: граница уже дальше
+            if (p > splits.back())
+            {
+                splits.push_back(p);
+            }
+        }
+        if (splits.back() != end)
+        {
+            splits.push_back(end);
+        }
+        return splits;
+    }
+
+    // Поле с позиции p; возвращает позицию сразу за ним (разделитель, перевод строки или конец).
+    // value указывает в текст, а если в поле были "", - в scratch
+    static const char* parseField(const char* p, const char* end, std::string& scratch, std::string_view& value, bool& quoted)
+    {
+        quoted = p < end && *p == '"';
+        if (!quoted)
+        {
+            const char* start = p;
+            while (p < end && *p != ',' && *p != '\n')
+            {
+                ++p;
+            }
+            const char* stop = p;
+            if (stop > start && stop[-1] == '\r' && (p == end || *p == '\n'))
+            {
+                --stop;
+            }
+            value = std::string_view(start, stop - start);
+            return p;
+        }
+
+        const char* start = ++p;
+        bool escaped = false;
+        while (true)
+        {
+            const char* quote = static_cast<const char*>(std::memchr(p, '"', end - p));
+            if (quote == nullptr)
+            {
+                throw std::invalid_argument("Unterminated quoted field in CSV");
+            }
+            if (quote + 1 < end && quote[1] == '"')
+            {
+                if (!escaped)
+                {
+                    scratch.clear();
+                    escaped = true;
+                }
+                scratch.append(p, quote + 1 - p);
+                p = quote + 2;
+                continue;
+            }
+            if (escaped)
+            {
+                scratch.append(p, quote - p);
+                value = scratch;
+            }
+            else
+            {
+                value = std::string_view(start, quote - start);
+            }
+            p = quote + 1;
+            if (p < end && *p == '\r' && (p + 1 == end || p[1] == '\n'))
+            {
+                ++p;
+            }
+            if (p < end && *p != ',' && *p != '\n')
+            {
+                throw std::invalid_argument("Unexpected character after quoted field in CSV");
+            }
+            return p;
+        }
+    }
+
+    // text - начало файла, по нему считается номер строки для сообщений об ошибках
+    static std::vector<Column> parseRange(const char* text, const char* p, const char* end,
+            const std::vector<std::string>& names, const std::vector<int>& types)
+    {
+        std::vector<Column> columns;
+        size_t rows = std::count(p, end, '\n') + 1;
+        for (int type : types)
+        {
+            columns.emplace_back(type);
+            columns.back().reserve(rows);
+        }
+        std::string scratch;
+        while (p < end)
+        {
+            if (*p == '\n' || (*p == '\r' && (p + 1 == end || p[1] == '\n')))
+            {
+                p = std::min(end, p + (*p == '\r' ? 2 : 1));
+                continue;
+            }
+            for (size_t f = 0; f < types.size(); ++f)
+            {
+                std::string_view value;
+                bool quoted;
+                const char* start = p;
+                p = parseField(p, end, scratch, value, quoted);
+                // кавычка без кавычек вокруг поля сбила бы подсчёт чётности в split
+                if (!quoted && value.find('"') != std::string_view::npos)
+                {
+                    throw std::invalid_argument("Quote inside unquoted field in CSV at line " +
+                            std::to_string(std::count(text, start, '\n') + 1) + ", column " + names[f]);
+                }
+                bool last = f + 1 == types.size();
+                if (last ? (p < end && *p != '\n') : (p == end || *p != ','))
+                {
+                    throw std::invalid_argument("Wrong number of fields in CSV row");
+                }
+                push(columns[f], value, quoted);
+                if (p < end)
+                {
+                    ++p;
+                }
+            }
+        }
+        return columns;
+    }
+
+    static void push(Column& column, std::string_view value, bool quoted)
+    {
+        if (value.empty() && !quoted)
+        {
+            column.push_null();
+        }
+        else if (column.type == 0)
+        {
+            int32_t number;
+            auto [rest, error] = std::from_chars(value.data(), value.data() + value.size(), number);
+            if (error != std::errc() || rest != value.data() + value.size())
+            {
+                throw std::invalid_argument("Bad int32 value in CSV: " + std::string(value));
+            }
+            column.push_int(number);
+        }
+        else if (column.type == 1)
+        {
+            if (value != "1" && value != "0" && value != "true" && value != "false")
+            {
+                throw std::invalid_argument("Bad bool value in CSV: " + std::string(value));
+            }
+            column.push_bool(value == "1" || value == "true");
+        }
+        else
+        {
+            column.push_string(value);
+        }
+    }
+};
+
+#endif // CSV_LOADER_H
@@ -0,0 +1,259 @@
+#ifndef CURSOR_H
+#define CURSOR_H
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <stdexcept>
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+
+#include "table.h"
+
+// Курсор SELECT: строки результата выдаются по запросу (next или пачками через fetch), пока идёт
+// проход по таблице, так что результат целиком нигде не копируется.
+// Курсор со снимком (view) видит таблицу такой, какой она была при его открытии, и не мешает её менять,
+// пока держит Table::holdRows (курсоры Database делают это, см. hold). Курсор без снимка смотрит
+// в последнее состояние таблицы, и пока он открыт, таблицу нельзя менять
+class Cursor
+{
+public:
+    Cursor(const Table& table, const std::vector<std::string>& columnNames, const QueryCondition& condition,
+            const ReadView* view = nullptr)
+        : source(&table), sourceName(table.name), names(columnNames)
+    {
+        if (view != nullptr)
+        {
+            snapshot = *view;
+        }
+        for (const auto& columnName : names)
+        {
+            auto it = table.columns.find(columnName);
+            if (it == table.columns.end())
+            {
+                throw std::invalid_argument("Column not found: " + columnName);
+            }
+            projection.push_back(&it->second);
+            types.push_back(it->second.type);
+        }
+        bound = condition.bind(table.columns);
+        useCandidates = table.indexCandidates(*bound, candidates);
+    }
+
+    // снимок, по которому идёт курсор (nullptr - последнее состояние таблицы)
+    const ReadView* view() const
+    {
+        return snapshot ? &*snapshot : nullptr;
+    }
+
+    // курсор по промежуточной таблице (результат join), которая освобождается вместе с курсором
+    Cursor(std::shared_ptr<Table> table, const std::vector<std::string>& columnNames, const QueryCondition& condition)
+        : Cursor(*table, columnNames, condition)
+    {
+        owned = std::move(table);
+    }
+
+    // lock держится, пока курсор открыт (блокировки таблиц Database), и снимается в close
+    void hold(std::shared_ptr<void> lock)
+    {
+        held = std::move(lock);
+    }
+
+    // дальше курсор идёт ровно по строкам rows в их порядке (например, отсортированным sortedRows)
+    void order(std::vector<uint32_t> rows)
+    {
+        candidates = std::move(rows);
+        useCandidates = true;
+        filtered = true;
+        position = 0;
+        selection.clear();
+        selectionPosition = 0;
+    }
+
+    // пропустить первые offset строк результата и выдать не больше count; на count-й строке
+    // проход останавливается, остаток таблицы не читается
+    void limit(size_t offset, size_t count)
+    {
+        skip = offset;
+        remaining = count;
+    }
+
+    // переходит к следующей подходящей строке; false, когда строки кончились.
+    // Условие проверяется пачками по Table::kBatchSize строк (Table::matchBlock или QueryCondition::select)
+    bool next()
+    {
+        if (closed || remaining == 0)
+        {
+            close();
+            return false;
+        }
+        while (true)
+        {
+            while (selectionPosition < selection.size())
+            {
+                uint32_t row = selection[selectionPosition++];
+                if (skip > 0)
+                {
+                    --skip;
+                    continue;
+                }
+                if (remaining != SIZE_MAX)
+                {
+                    --remaining;
+                }
+                current = row;
+                return true;
+            }
+            if (!refill())
+            {
+                close();
+                return false;
+            }
+        }
+    }
+
+    // номер текущей строки в исходной таблице
+    uint32_t row() const
+    {
+        return current;
+    }
+
+    const std::vector<std::string>& columnNames() const
+    {
+        return names;
+    }
+
+    // k-я колонка проекции; значение текущей строки - column(k).get_...(row())
+    const Column& column(size_t k) const
+    {
+        return *projection[k];
+    }
+
+    // текущая строка в виде Line (только колонки проекции)
+    Line line() const
+    {
+        Line result;
+        for (size_t k = 0; k < names.size(); ++k)
+        {
+            result.addCell(names[k], projection[k]->get_cell(current));
+        }
+        return result;
+    }
+
+    // заменяет содержимое batch следующими (не более maxRows) строками результата, возвращает их число
+    size_t fetch(Table& batch, size_t maxRows)
+    {
+        batch = Table(sourceName);
+        for (size_t k = 0; k < names.size(); ++k)
+        {
+            batch.addColumn(names[k], types[k]);
+        }
+        if (closed)
+        {
+            return 0;
+        }
+        // next() на последней строке закрывает курсор
+        std::shared_ptr<Table> keep = owned;
+        std::shared_ptr<void> keepLock = held;
+        std::vector<uint32_t> rows;
+        if (position == 0 && selection.empty() && !useCandidates && skip == 0 && remaining == SIZE_MAX &&
+            maxRows >= source->slotCount(view()))
+        {
+            // весь результат за раз: полный проход по морселям таблицы, параллельно на её пуле
+            rows = source->boundMatchingRows(*bound, view());
+            close();
+        }
+        while (rows.size() < maxRows && next())
+        {
+            rows.push_back(current);
+        }
+        source->gather(batch, names, rows);
+        return rows.size();
+    }
+
+    // досрочно завершает проход и освобождает всё, что держит курсор
+    void close()
+    {
+        closed = true;
+        bound.reset();
+        candidates.clear();
+        candidates.shrink_to_fit();
+        selection.clear();
+        selection.shrink_to_fit();
+        owned.reset();
+        held.reset();
+    }
+
+    bool done() const
+    {
+        return closed;
+    }
+
+private:
+    // следующая пачка живых подходящих строк; false, когда строк больше нет
+    bool refill()
+    {
+        size_t end = useCandidates ? candidates.size() : source->slotCount(view());
+        selection.clear();
+        selectionPosition = 0;
+        while (selection.empty() && position < end)
+        {
+            size_t stop = std::min(end, position + Table::kBatchSize);
+            if (!useCandidates)
+            {
+                uint64_t words[Table::kBatchSize / 64];
+                source->matchBlock(*bound, position, stop - position, words, view());
+                for (size_t w = 0; position + w * 64 < stop; ++w)
+                {
+                    for (uint64_t bits = words[w]; bits != 0; bits &= bits - 1)
+                    {
+                        selection.push_back(uint32_t(position + w * 64 + __builtin_ctzll(bits)));
+                    }
+                }
+                position = stop;
+                continue;
+            }
+            for (; position < stop; ++position)
+            {
+                if (source->isVisible(candidates[position], view()))
+                {
+                    selection.push_back(candidates[position]);
+                }
+            }
+            if (!filtered)
+            {
+                selection.resize(bound->select(selection.data(), selection.size()));
+            }
+        }
+        return !selection.empty();
+    }
+
+    const Table* source;
+    std::shared_ptr<Table> owned;
+    std::shared_ptr<void> held;
+    std::optional<ReadView> snapshot;
+    std::string sourceName;
+    std::vector<std::string> names;
+    std::vector<const Column*> projection;
+    std::vector<int> types;
+    std::shared_ptr<QueryCondition> bound;
+
+    // строки-кандидаты из индекса; без индекса проходим по всем строкам таблицы
+    bool useCandidates = false;
+    bool filtered = false; // строки уже отобраны по условию (order)
+    std::vector<uint32_t> candidates;
+
+    size_t skip = 0;
+    size_t remaining = SIZE_MAX;
+
+    // подходящие строки текущей пачки
+    std::vector<uint32_t> selection;
+    size_t selectionPosition = 0;
+
+    size_t position = 0;
+    uint32_t current = 0;
+    bool closed = false;
+};
+
+#endif // CURSOR_H
@@ -1,6 +1,10 @@
+#ifndef DATABASE_H
+#define DATABASE_H
+
 #include <iostream>
 #include <fstream>
 #include <unordered_map>
+#include <map>
 #include <vector>
 #include <string>
 #include <functional>
@@ -9,19 +13,35 @@
 #include <stack>
 #include <stdexcept>
 #include <cassert>
+#include <thread>
+#include <type_traits>
 
 #include "table.h"
+#include "cursor.h"
+#include "aggregate.h"
+#include "join.h"
+#include "snapshot.h"
+#include "csv_loader.h"
+#include "wal.h"
+#include "checkpoint.h"
+#include "lock_manager.h"
+#include "transaction.h"
 #include "query_parser.h"
 
 
-
-int select_counter = 0;
-
 std::function<bool(const Line&)> parse_select_condition(const std::string& condition);
-std::function<bool(const Line&, const Line&)> parse_join_condition(const std::string& condition, const std::string& table1_name, const std::string& table2_name);
+std::function<bool(const Line&, const Line&)> parse_join_condition(const std::string& condition);
 std::unordered_map<std::string, std::shared_ptr<Cell>> dump_map(std::map<std::string, std::string> values);
 std::unordered_map<std::string, std::function<std::shared_ptr<Cell>(std::shared_ptr<Cell>)>> parse_transformations(const std::map<std::string, std::string>& transformations);
 
+// Методы Database можно вызывать из нескольких потоков: запросы к разным таблицам идут параллельно,
+// запись ждёт только другие записи в свою таблицу (блокировки - в lock_manager.h). SELECT и курсоры
+// читают снимок таблиц на момент начала запроса (mvcc.h) и запись не задерживают.
+// Обращения к tables напрямую, в обход методов, не синхронизированы.
+// В журнал (openWal) пишутся только изменяющие SQL-запросы translate_n_execute/executeParsed. Прямые
+// изменения - createTable, insert, update, remove, createIndex, importCsv, select и join с сохранением
+// результата, а также замена всех таблиц в clear, readFromFile и loadSnapshot - при открытом журнале
+// сразу закрепляются контрольной точкой (см. unlogged), без каталога контрольных точек они запрещены
 class Database
 {
 public:
@@ -29,91 +49,129 @@ public:
 
     QueryParser parser;
 
-    Database() = default;
-
-    void clear() 
+    // по умолчанию большие проходы используют все ядра
+    Database() : pool(makePool(std::thread::hardware_concurrency()))
     {
-        tables.clear();
     }
 
-    void readFromFile(const std::string& csv_filename)
+    // Степень параллелизма больших проходов (вместе с вызывающим потоком); 1 - всё в одном потоке.
+    // Пул общий для всех таблиц базы
+    void setParallelism(size_t threads)
     {
-        // Очищаем текущую базу данных
-        clear();
-
-        std::ifstream file(csv_filename);
-        if (!file.is_open()) 
+        LockManager::Guard guard = locks->exclusive();
+        pool = makePool(threads);
+        for (auto& [tableName, table] : tables)
         {
-            throw std::runtime_error("Could not open file");
+            table.pool = pool;
         }
+    }
 
-        std::string line;
-        std::getline(file, line);
-        int numTables = std::stoi(line);
+    size_t parallelism() const
+    {
+        LockManager::Guard guard = locks->tables({});
+        return pool ? pool->workers() + 1 : 1;
+    }
 
-        for (int t = 0; t < numTables; ++t) 
-        {
-            // Читаем заголовок таблицы
-            std::getline(file, line);
-            std::istringstream ss(line);
-            std::string tableName;
-            std::getline(ss, tableName, ',');
-
-            std::string numColumnsStr, numRowsStr;
-            std::getline(ss, numColumnsStr, ',');
-            int numColumns = std::stoi(numColumnsStr);
-            std::getline(ss, numRowsStr);
-            int numRows = std::stoi(numRowsStr);
-
-            std::vector<std::pair<std::string, int>> columns;
-            for (int c = 0; c < numColumns; ++c) 
+    void clear() 
+    {
+        unlogged("", [this]() { tables.clear(); });
+    }
+
+    void readFromFile(const std::string& csv_filename)
+    {
+        unlogged("", [&]() {
+            // Очищаем текущую базу данных
+            tables.clear();
+
+            std::ifstream file(csv_filename);
+            if (!file.is_open()) 
             {
-                std::string columnName;
-                int columnType;
-                std::getline(ss, columnName, ',');
-                std::string columnTypeStr;
-                std::getline(ss, columnTypeStr, ',');
-                columnType = std::stoi(columnTypeStr);
-                columns.emplace_back(columnName, columnType);
+                throw std::runtime_error("Could not open file");
             }
 
-            createTable(tableName, columns);
+            std::string line;
+            std::getline(file, line);
+            int numTables = std::stoi(line);
 
-            // Читаем данные таблицы
-            for (int r = 0; r < numRows; ++r) 
+            for (int t = 0; t < numTables; ++t) 
             {
+                // Читаем заголовок таблицы
+                std::getline(file, line);
+                std::istringstream ss(line);
+                std::string tableName;
+                std::getline(ss, tableName, ',');
+
+                std::string numColumnsStr, numRowsStr;
+                std::getline(ss, numColumnsStr, ',');
+                int numColumns = std::stoi(numColumnsStr);
+                std::getline(ss, numRowsStr);
+                int numRows = std::stoi(numRowsStr);
+
+                // Описание колонок лежит на отдельной строке
                 std::getline(file, line);
-                std::istringstream dataStream(line);
-                Line dataLine;
+                std::istringstream columnsStream(line);
+                std::vector<std::pair<std::string, int>> columns;
+                std::map<std::string, std::string> constraints;
+                for (int c = 0; c < numColumns; ++c) 
+                {
+                    std::string columnName;
+                    int columnType;
+                    std::getline(columnsStream, columnName, ',');
+                    std::string columnTypeStr;
+                    std::getline(columnsStream, columnTypeStr, ',');
+                    // после номера типа могут идти флаги ограничений: k - key, u - unique, a - autoincrement
+                    size_t flagsStart = 0;
+                    columnType = std::stoi(columnTypeStr, &flagsStart);
+                    columns.emplace_back(columnName, columnType);
+                    if (flagsStart < columnTypeStr.size())
+                    {
+                        constraints[columnName] = columnTypeStr.substr(flagsStart);
+                    }
+                }
+
+                addTable(tableName, columns, {});
+
+                // Читаем данные таблицы прямо в буферы колонок
+                Table& table = tables[tableName];
+                std::vector<Column*> targets;
                 for (const auto& [columnName, columnType] : columns) 
                 {
-                    std::string cellData;
-                    std::getline(dataStream, cellData, ',');
-                    if (columnType == 0) {
-                        dataLine.addCell(columnName, std::make_shared<CellInt>(std::stoi(cellData)));
-                    } else if (columnType == 1) {
-                        dataLine.addCell(columnName, std::make_shared<CellBool>(cellData == "1"));
-                    } else if (columnType == 2) {
-                        dataLine.addCell(columnName, std::make_shared<CellString>(cellData));
-                    } else if (columnType == 3) {
-                        std::string bytes = std::string(cellData.begin(), cellData.end());
-                        /*for (size_t i = 0; i < cellData.size(); i += 2) {
-                            bytes.push_back(cellData[i]);
-                        }*/
-                        dataLine.addCell(columnName, std::make_shared<CellBytes>(bytes));
+                    targets.push_back(&table.columns.at(columnName));
+                    targets.back()->reserve(numRows);
+                }
+                for (int r = 0; r < numRows; ++r) 
+                {
+                    std::getline(file, line);
+                    std::istringstream dataStream(line);
+                    for (Column* column : targets) 
+                    {
+                        std::string cellData;
+                        std::getline(dataStream, cellData, ',');
+                        if (column->type == 0) {
+                            column->push_int(std::stoi(cellData));
+                        } else if (column->type == 1) {
+                            column->push_bool(cellData == "1");
+                        } else {
+                            column->push_string(cellData);
+                        }
                     }
                 }
-                insert(tableName, dataLine);
+                for (const auto& [columnName, flags] : constraints)
+                {
+                    table.setConstraints(columnName, flags.find('k') != std::string::npos,
+                            flags.find('u') != std::string::npos, flags.find('a') != std::string::npos);
+                }
+                // Пропускаем пустую строку между таблицами
+                std::getline(file, line);
             }
-            // Пропускаем пустую строку между таблицами
-            std::getline(file, line);
-        }
 
-        file.close();
+            file.close();
+        });
     }
 
     void saveToFile(const std::string& filename) 
     {
+        LockManager::Guard guard = locks->readAll(tables);
         std::ofstream file(filename);
         if (!file.is_open()) 
         {
@@ -126,32 +184,34 @@ public:
         for (const auto& [tableName, table] : tables) 
         {
             // Записываем заголовок таблицы
-            file << tableName << "," << table.columns.size() << "," << table.columns.begin()->second.cells.size() << "\n";
+            file << tableName << "," << table.columns.size() << "," << table.rowCount() << "\n";
 
             for (const auto& [columnName, column] : table.columns) 
             {
-                file << columnName << "," << column.type << ",";
+                file << columnName << "," << column.type;
+                if (column.is_key) file << "k";
+                if (column.is_unique) file << "u";
+                if (column.is_autoincrement) file << "a";
+                file << ",";
             }
             file << "\n";
 
             // Записываем данные таблицы
-            size_t numRows = table.columns.begin()->second.cells.size();
+            size_t numRows = table.slotCount();
             for (size_t i = 0; i < numRows; ++i) 
             {
+                if (table.isDeleted(i)) 
+                {
+                    continue;
+                }
                 for (const auto& [columnName, column] : table.columns) 
                 {
                     if (column.type == 0) {
-                        file << std::static_pointer_cast<CellInt>(column.cells[i])->data;
+                        file << column.get_int(i);
                     } else if (column.type == 1) {
-                        file << std::static_pointer_cast<CellBool>(column.cells[i])->data;
-                    } else if (column.type == 2) {
-                        file << std::static_pointer_cast<CellString>(column.cells[i])->data;
-                    } else if (column.type == 3) {
-                        auto bytes = std::static_pointer_cast<CellBytes>(column.cells[i])->data;
-                        file << std::string(bytes.begin(), bytes.end());
-                        /*for (auto byte : bytes) {
-                            file << static_cast<int>(byte);
-                        }*/
+                        file << column.get_bool(i);
+                    } else {
+                        file << column.get_string(i);
                     }
                     file << ",";
                 }
@@ -163,15 +223,112 @@ public:
         file.close();
     }
 
+    // Бинарный снимок всей базы (формат описан в snapshot.h): пишется последовательно,
+    // читается через mmap копированием блоков колонок целиком. Снимок помнит LSN журнала,
+    // по который в нём есть изменения, - openWal после loadSnapshot повторит только более новые
+    void saveSnapshot(const std::string& filename) const
+    {
+        LockManager::Guard guard = locks->readAll(tables);
+        Snapshot::write(filename, tables, lastLsn());
+    }
+
+    // При ошибке чтения текущие таблицы не меняются; запросы ждут только замены таблиц, не чтения файла
+    void loadSnapshot(const std::string& filename)
+    {
+        uint64_t lsn = 0;
+        std::vector<Table> loaded = Snapshot::read(filename, currentPool().get(), &lsn);
+        unlogged("", [&]() {
+            appliedLsn = lsn;
+            tables.clear();
+            for (Table& table : loaded)
+            {
+                std::string tableName = table.name;
+                store(tableName, std::move(table));
+            }
+        });
+    }
+
+    // Инкрементальная контрольная точка в каталоге directory (формат - в checkpoint.h): пишутся только
+    // сегменты колонок, изменённые после прошлой точки в этом каталоге. Возвращается, скопировав их,
+    // запись идёт в фоне; когда новый манифест на диске, из журнала убираются вошедшие в точку записи
+    // Сама точка держит базу монопольно только на время копирования изменённых сегментов
+    void checkpoint(const std::string& directory)
+    {
+        // предыдущая точка дописывается без монопольной блокировки
+        waitForCheckpoint();
+        LockManager::Guard guard = locks->exclusive();
+        startCheckpoint(directory);
+    }
+
+    // ждёт фоновую запись контрольной точки; её ошибка выбрасывается здесь
+    void waitForCheckpoint()
+    {
+        LockManager::Guard guard = locks->tables({});
+        if (checkpointer)
+        {
+            checkpointer->wait();
+        }
+    }
+
+    // Последняя контрольная точка каталога directory; следующие точки в нём пишут только изменения.
+    // openWal после неё повторит только более новые записи. При ошибке чтения текущие таблицы не меняются
+    void loadCheckpoint(const std::string& directory)
+    {
+        waitForCheckpoint();
+        auto loader = std::make_unique<Checkpointer>(directory);
+        uint64_t lsn = 0;
+        std::vector<Table> loaded = loader->load(currentPool().get(), &lsn);
+        LockManager::Guard guard = locks->exclusive();
+        if (checkpointer)
+        {
+            checkpointer->wait();
+        }
+        checkpointer = std::move(loader);
+        appliedLsn = lsn;
+        tables.clear();
+        for (Table& table : loaded)
+        {
+            std::string tableName = table.name;
+            store(tableName, std::move(table));
+        }
+    }
+
+    // После каждых statements изменяющих запросов translate_n_execute сама начинается контрольная точка
+    // в directory, если предыдущая уже записана; 0 - выключить
+    void autoCheckpoint(const std::string& directory, size_t statements)
+    {
+        LockManager::Guard guard = locks->exclusive();
+        checkpointDirectory = directory;
+        checkpointInterval = statements;
+        locks->modifications = 0;
+    }
+
+    // Массовая загрузка CSV в существующую таблицу (формат - в csv_loader.h): первая строка - имена
+    // колонок, куски файла разбираются параллельно в пуле. Возвращает число добавленных строк
+    size_t importCsv(const std::string& tableName, const std::string& filename)
+    {
+        return unlogged(tableName, [&]() {
+            auto it = tables.find(tableName);
+            if (it == tables.end())
+            {
+                throw std::invalid_argument("Table not found: " + tableName);
+            }
+            return CsvLoader::load(it->second, filename, pool.get());
+        });
+    }
+
     /* Database(const std::string& csv_filename) 
     {
         readFromFile(csv_filename);
     }*/
 
+    Database(Database&&) = default;
+    Database& operator=(Database&&) = default;
     ~Database() = default;
 
     void printTable(const std::string& tableName) 
     {
+        LockManager::Guard guard = locks->tables({tableName});
         if (tables.find(tableName) == tables.end()) 
         {
             throw std::invalid_argument("Table not found: " + tableName);
@@ -179,106 +336,746 @@ public:
         tables.at(tableName).printTable();
     }
 
-    Table& createTable(const std::string tableName, const std::vector <std::pair<std::string, int>>& colums)
-    {   
-        tables[tableName] = Table(tableName);
-        for (auto& [columnName, columnType] : colums) 
+    // Курсор по строкам таблицы, подходящим под условие; строки читаются по мере прохода из снимка
+    // таблицы на момент открытия. Запись в таблицу, пока курсор открыт, его не ждёт; изменения
+    // каталога (CREATE, замена таблиц) ждут его закрытия
+    Cursor openCursor(const std::string& tableName, const std::vector<std::string>& columnNames, const QueryCondition& condition) const
+    {
+        std::shared_ptr<ReadPin> pin = pinTables({tableName});
+        Cursor cursor(tables.at(tableName), columnNames, condition, &pin->views.at(tableName));
+        cursor.hold(std::move(pin));
+        return cursor;
+    }
+
+    // Курсор по SELECT-запросу; промежуточная таблица join принадлежит курсору.
+    // ORDER BY сортирует только первые offset + limit строк, LIMIT без ORDER BY просто обрывает проход
+    Cursor openCursor(const std::string& query)
+    {
+        std::unique_ptr<Query> qry = parser.parse(query);
+        if (typeid(*qry) != typeid(SelectQuery))
+        {
+            throw std::invalid_argument("Cursor can only be opened for SELECT");
+        }
+        return openCursor(SelectQuery(std::move(qry)));
+    }
+
+    Cursor openCursor(const SelectQuery& query)
+    {
+        std::shared_ptr<ReadPin> pin = pinTables(queryTables(query));
+        Cursor cursor = cursorFor(query, pin.get());
+        cursor.hold(std::move(pin));
+        return cursor;
+    }
+
+    // печатает результат SELECT строка за строкой, не собирая его в таблицу
+    void printQuery(const std::string& query, std::ostream& out = std::cout)
+    {
+        Cursor cursor = openCursor(query);
+        const std::vector<std::string>& names = cursor.columnNames();
+        for (const auto& columnName : names)
+        {
+            out << columnName << "\t";
+        }
+        out << "\n";
+        while (cursor.next())
         {
-            tables[tableName].addColumn(columnName, columnType);
+            for (size_t k = 0; k < names.size(); ++k)
+            {
+                const Column& column = cursor.column(k);
+                if (column.is_null(cursor.row())) {
+                    out << "NULL";
+                } else if (column.type == 0) {
+                    out << column.get_int(cursor.row());
+                } else if (column.type == 1) {
+                    out << column.get_bool(cursor.row());
+                } else {
+                    out << column.get_string(cursor.row());
+                }
+                out << "\t";
+            }
+            out << "\n";
         }
-        return tables[tableName];
+    }
+
+    // attributes: колонка -> список из "key", "unique", "autoincrement"
+    Table& createTable(const std::string tableName, const std::vector <std::pair<std::string, int>>& colums,
+            const std::map<std::string, std::vector<std::string>>& attributes = {})
+    {   
+        return unlogged("", [&]() -> Table& {
+            return addTable(tableName, colums, attributes);
+        });
     }
 
     Table& select(const std::string& newTablename, const std::string& tableName, std::vector <std::string> columnNames, const std::function<bool(const Line&)>& condition)
     {
-        return tables[newTablename] = tables.at(tableName).select(newTablename, columnNames, condition);
+        return unlogged("", [&]() -> Table& {
+            return store(newTablename, tables.at(tableName).select(newTablename, columnNames, condition));
+        });
+    }
+
+    Table& select(const std::string& newTablename, const std::string& tableName, std::vector <std::string> columnNames, const QueryCondition& condition)
+    {
+        return unlogged("", [&]() -> Table& {
+            return store(newTablename, tables.at(tableName).select(newTablename, columnNames, condition));
+        });
     }
 
     Table& insert(const std::string& tableName, Line& line)
     {
-        tables.at(tableName).insert(line);
-        return tables[tableName];
+        return unlogged(tableName, [&]() -> Table& {
+            Table& table = tables.at(tableName);
+            table.insert(line);
+            return table;
+        });
     }
 
     Table& update(const std::string& tableName, const std::unordered_map<std::string, std::function<std::shared_ptr<Cell>(std::shared_ptr<Cell>)>>& transformations, const std::function<bool(const Line&)>& condition)
     {
-        tables.at(tableName).update(transformations, condition);
-        return tables[tableName];
+        return unlogged(tableName, [&]() -> Table& {
+            Table& table = tables.at(tableName);
+            table.update(transformations, condition);
+            return table;
+        });
+    }
+
+    Table& update(const std::string& tableName, const std::unordered_map<std::string, std::function<std::shared_ptr<Cell>(std::shared_ptr<Cell>)>>& transformations, const QueryCondition& condition)
+    {
+        return unlogged(tableName, [&]() -> Table& {
+            Table& table = tables.at(tableName);
+            table.update(transformations, condition);
+            return table;
+        });
     }
 
     Table& remove(const std::string& tableName, const std::function<bool(const Line&)>& condition)
     {
-        tables.at(tableName).remove(condition);
-        return tables[tableName];
+        return unlogged(tableName, [&]() -> Table& {
+            Table& table = tables.at(tableName);
+            table.remove(condition);
+            return table;
+        });
+    }
+
+    Table& remove(const std::string& tableName, const QueryCondition& condition)
+    {
+        return unlogged(tableName, [&]() -> Table& {
+            Table& table = tables.at(tableName);
+            table.remove(condition);
+            return table;
+        });
+    }
+
+    Table& createIndex(const std::string& tableName, const std::string& columnName, const std::string& indexName = "", bool ordered = false)
+    {
+        return unlogged(tableName, [&]() -> Table& {
+            return addIndex(tableName, columnName, indexName, ordered);
+        });
+    }
+
+    // сразу переписывает колонки без удалённых строк, не дожидаясь порога compactThreshold
+    Table& compact(const std::string& tableName)
+    {
+        LockManager::Guard guard = locks->tables({}, {tableName});
+        Table& table = tables.at(tableName);
+        table.compact();
+        return table;
     }
 
     Table& join(const std::string& newTableName, const std::string& tableName1, const std::string& tableName2, const std::function<bool(const Line&, const Line&)>& condition)
     {   
-        if (tables.find(tableName1) == tables.end()) {
-            throw std::invalid_argument("Table not found: " + tableName1);
-        }
-        if (tables.find(tableName2) == tables.end()) {
-            throw std::invalid_argument("Table not found: " + tableName2);
-        }
-        return tables[newTableName] = tables.at(tableName1).join(newTableName, tables.at(tableName2), condition);
+        return unlogged("", [&]() -> Table& {
+            if (tables.find(tableName1) == tables.end()) {
+                throw std::invalid_argument("Table not found: " + tableName1);
+            }
+            if (tables.find(tableName2) == tables.end()) {
+                throw std::invalid_argument("Table not found: " + tableName2);
+            }
+            return store(newTableName, tables.at(tableName1).join(newTableName, tables.at(tableName2), condition));
+        });
+    }
+
+    Table& join(const std::string& newTableName, const std::string& tableName1, const std::string& tableName2, const QueryCondition& condition)
+    {
+        return unlogged("", [&]() -> Table& {
+            if (tables.find(tableName1) == tables.end()) {
+                throw std::invalid_argument("Table not found: " + tableName1);
+            }
+            if (tables.find(tableName2) == tables.end()) {
+                throw std::invalid_argument("Table not found: " + tableName2);
+            }
+            return store(newTableName, tables.at(tableName1).join(newTableName, tables.at(tableName2), condition));
+        });
+    }
+
+    // Результат запроса принадлежит вызывающему и в tables не сохраняется:
+    // SELECT возвращает выбранные строки, промежуточная таблица join живёт только до конца запроса,
+    // INSERT/UPDATE/DELETE/CREATE возвращают таблицу-статус с одной строкой affected_rows
+    // Изменяющие запросы (INSERT/UPDATE/DELETE/CREATE), выполненные успешно, при открытом журнале
+    // дописываются в него и подтверждаются согласно его политике до возврата.
+    // Запись в журнал идёт под блокировкой таблицы, поэтому порядок записей одной таблицы совпадает
+    // с порядком выполнения; подтверждения (fsync) ждут уже без неё и объединяются между потоками.
+    // BEGIN/COMMIT/ROLLBACK ведут транзакцию самой базы (для одного клиента); потоки, у которых
+    // транзакции свои, передают их во второй перегрузке
+    Table translate_n_execute(std::string query) {
+        return translate_n_execute(std::move(query), session);
     }
 
-    
-    Table& translate_n_execute(std::string query) {
+    // Запрос в транзакции transaction: между BEGIN и COMMIT INSERT/UPDATE/DELETE только запоминаются
+    // (affected_rows - 0), а COMMIT применяет их все и возвращает их общее affected_rows (transaction.h)
+    Table translate_n_execute(std::string query, Transaction& transaction) {
         std::unique_ptr<Query> qry;
         try {
             qry = parser.parse(query);
         } catch (const std::exception& e) {
             std::cout << "Invalid query: " << e.what() << "\n";
-            return tables[""];
+            return Table();
+        }
+        return executeParsed(std::move(qry), std::move(query), transaction);
+    }
+
+    // то же для запроса, уже разобранного parser (ошибки разбора остаются вызывающему); query - его текст для журнала
+    Table executeParsed(std::unique_ptr<Query> qry, std::string query, Transaction& transaction) {
+        Table result;
+        if (typeid(*qry) == typeid(SelectQuery)) {
+            openCursor(SelectQuery(std::move(qry))).fetch(result, SIZE_MAX);
+            return result;
+        }
+        if (auto control = dynamic_cast<const TransactionQuery*>(qry.get())) {
+            if (control->action == TransactionQuery::Action::BEGIN) {
+                transaction.begin();
+                return status("", 0);
+            } else if (control->action == TransactionQuery::Action::COMMIT) {
+                return commit(transaction.finish());
+            }
+            transaction.finish();
+            return status("", 0);
+        }
+        if (transaction.active()) {
+            std::string tableName = writtenTable(*qry);
+            if (tableName.empty()) {
+                throw std::invalid_argument(qry->get_type() + " is not allowed inside a transaction");
+            }
+            transaction.add(std::move(query), std::move(qry));
+            return status(tableName, 0);
+        }
+        bool checkpointDue = false;
+        {
+            LockManager::Guard guard = lockFor(*qry);
+            result = execute(std::move(qry));
+            if (wal) {
+                uint64_t lsn = wal->append(query);
+                guard.releaseTables();
+                wal->commit(lsn);
+            }
+            checkpointDue = checkpointInterval != 0 && ++locks->modifications >= checkpointInterval &&
+                    !(checkpointer && checkpointer->running());
+        }
+        if (checkpointDue) {
+            checkpointIfDue();
+        }
+        return result;
+    }
+
+    // Открывает журнал filename: сначала повторяет его записи новее снимка, загруженного loadSnapshot
+    // (или все, если снимка не было), затем дописывает в него следующие изменяющие запросы
+    void openWal(const std::string& filename, WalSync sync = WalSync::GROUP)
+    {
+        LockManager::Guard guard = locks->exclusive();
+        // фоновая контрольная точка может ещё обрезать прежний журнал
+        if (checkpointer)
+        {
+            checkpointer->wait();
+        }
+        appliedLsn = lastLsn();
+        wal.reset();
+        uint64_t logged = WriteAheadLog::recover(filename, [this](uint64_t lsn, const std::string& statement) {
+            if (lsn > appliedLsn)
+            {
+                execute(parser.parse(statement));
+                appliedLsn = lsn;
+            }
+        });
+        wal = std::make_unique<WriteAheadLog>(filename, sync, std::max(logged, appliedLsn));
+    }
+
+    void closeWal()
+    {
+        LockManager::Guard guard = locks->exclusive();
+        if (checkpointer)
+        {
+            checkpointer->wait();
+        }
+        appliedLsn = lastLsn();
+        wal.reset();
+    }
+
+    // номер последней записи журнала, изменения которой есть в базе
+    uint64_t walLsn() const
+    {
+        LockManager::Guard guard = locks->tables({});
+        return lastLsn();
+    }
+
+    // Убирает из таблиц старые версии строк (таблицы делают это и сами после каждого изменения,
+    // но только для версий, которых уже не видят открытые курсоры); ждёт закрытия всех курсоров
+    void collectGarbage()
+    {
+        LockManager::Guard guard = locks->exclusive();
+        for (auto& [tableName, table] : tables)
+        {
+            table.collectGarbage();
+        }
+    }
+
+private:
+    std::shared_ptr<ThreadPool> pool;
+    std::unique_ptr<WriteAheadLog> wal;
+    uint64_t appliedLsn = 0; // LSN загруженного снимка или точки и повторённых при openWal записей
+
+    // объявлен после wal: фоновая точка, обрезающая журнал, завершается до его закрытия
+    std::unique_ptr<Checkpointer> checkpointer;
+    std::string checkpointDirectory;
+    size_t checkpointInterval = 0;
+
+    // в unique_ptr, чтобы Database оставалась перемещаемой
+    std::unique_ptr<LockManager> locks = std::make_unique<LockManager>();
+
+    // версии изменений всех таблиц базы
+    std::shared_ptr<VersionClock> clock = std::make_shared<VersionClock>();
+
+    // транзакция translate_n_execute без явного Transaction
+    Transaction session;
+
+    // Снимок таблиц одного чтения: каталог разделяемо (таблицы не заменят и не удалят),
+    // Table::holdRows каждой таблицы и её ReadView; снимок закрывается в деструкторе
+    struct ReadPin
+    {
+        LockManager::Guard guard;
+        std::vector<std::shared_lock<std::shared_mutex>> rows;
+        std::shared_ptr<VersionClock> clock;
+        ReadView view;
+        std::unordered_map<std::string, ReadView> views;
+
+        ~ReadPin()
+        {
+            clock->close(view);
+        }
+    };
+
+    // Открывает снимок таблиц names. Блокировки таблиц берутся только на время открытия - чтобы
+    // дождаться уже начатых в них записей, - дальше запись идёт параллельно с чтением снимка
+    std::shared_ptr<ReadPin> pinTables(const std::vector<std::string>& names) const
+    {
+        auto pin = std::make_shared<ReadPin>();
+        pin->guard = locks->tables(names);
+        pin->clock = clock;
+        pin->view = clock->open();
+        for (const std::string& tableName : names)
+        {
+            const Table& table = tables.at(tableName);
+            pin->rows.push_back(table.holdRows());
+            ReadView& view = pin->views[tableName];
+            view = pin->view;
+            view.rows = table.slotCount();
+            view.versioned = table.versions.created.size();
+        }
+        pin->guard.releaseTables();
+        return pin;
+    }
+
+    // пул для работы вне блокировок (setParallelism может заменить pool)
+    std::shared_ptr<ThreadPool> currentPool() const
+    {
+        LockManager::Guard guard = locks->tables({});
+        return pool;
+    }
+
+    // номер последней записи журнала, изменения которой есть в базе; вызывающий держит блокировку
+    uint64_t lastLsn() const
+    {
+        return wal ? wal->lastLsn() : appliedLsn;
+    }
+
+    // Применяет запросы транзакции: все под блокировками своих таблиц и в одной версии, которую снимки
+    // увидят только целиком. Если какой-то запрос не выполнился, таблицы откатываются и ошибка
+    // пробрасывается дальше; в журнал транзакция попадает одной группой записей (WriteAheadLog::appendBatch)
+    Table commit(std::vector<Transaction::Statement> statements)
+    {
+        std::vector<std::string> names;
+        for (const Transaction::Statement& statement : statements)
+        {
+            names.push_back(writtenTable(*statement.query));
+        }
+        size_t affected = 0;
+        bool checkpointDue = false;
+        {
+            LockManager::Guard guard = locks->tables({}, names);
+            std::sort(names.begin(), names.end());
+            names.erase(std::unique(names.begin(), names.end()), names.end());
+            std::vector<Table*> touched;
+            for (const std::string& tableName : names)
+            {
+                auto it = tables.find(tableName);
+                if (it == tables.end())
+                {
+                    throw std::invalid_argument("Table not found: " + tableName);
+                }
+                touched.push_back(&it->second);
+            }
+            uint64_t version = clock->begin();
+            for (Table* table : touched)
+            {
+                table->beginTransaction(version);
+            }
+            try
+            {
+                for (Transaction::Statement& statement : statements)
+                {
+                    affected += execute(std::move(statement.query)).columns["affected_rows"].get_int(0);
+                }
+            }
+            catch (...)
+            {
+                for (Table* table : touched)
+                {
+                    table->endTransaction(false);
+                }
+                clock->commit(version);
+                throw;
+            }
+            clock->commit(version);
+            for (Table* table : touched)
+            {
+                table->endTransaction(true);
+            }
+            if (wal && !statements.empty())
+            {
+                std::vector<std::string> texts;
+                for (const Transaction::Statement& statement : statements)
+                {
+                    texts.push_back(statement.text);
+                }
+                uint64_t lsn = wal->appendBatch(texts);
+                guard.releaseTables();
+                wal->commit(lsn);
+            }
+            checkpointDue = !statements.empty() && checkpointInterval != 0 &&
+                    (locks->modifications += statements.size()) >= checkpointInterval &&
+                    !(checkpointer && checkpointer->running());
+        }
+        if (checkpointDue)
+        {
+            checkpointIfDue();
+        }
+        return status("", affected);
+    }
+
+    // таблица, в которую пишет INSERT/UPDATE/DELETE (пусто для других запросов)
+    static std::string writtenTable(const Query& query)
+    {
+        if (auto insert = dynamic_cast<const InsertQuery*>(&query)) {
+            return insert->table;
+        } else if (auto update = dynamic_cast<const UpdateQuery*>(&query)) {
+            return update->table;
+        } else if (auto remove = dynamic_cast<const DeleteQuery*>(&query)) {
+            return remove->table;
+        }
+        return "";
+    }
+
+    // блокировки изменяющего запроса: CREATE TABLE меняет каталог, остальные пишут в одну таблицу
+    LockManager::Guard lockFor(const Query& query)
+    {
+        if (auto insert = dynamic_cast<const InsertQuery*>(&query)) {
+            return locks->tables({}, {insert->table});
+        } else if (auto update = dynamic_cast<const UpdateQuery*>(&query)) {
+            return locks->tables({}, {update->table});
+        } else if (auto remove = dynamic_cast<const DeleteQuery*>(&query)) {
+            return locks->tables({}, {remove->table});
+        } else if (auto index = dynamic_cast<const CreateIndexQuery*>(&query)) {
+            return locks->tables({}, {index->table});
+        } else {
+            return locks->exclusive();
+        }
+    }
+
+    static std::vector<std::string> queryTables(const SelectQuery& query)
+    {
+        std::vector<std::string> result = {query.table};
+        for (const JoinClause& clause : query.joins)
+        {
+            result.push_back(clause.table2);
+        }
+        return result;
+    }
+
+    // Прямое изменение change таблицы tableName ("" - изменение каталога таблиц). Без журнала - просто под
+    // блокировкой. С журналом change в него не попадает, поэтому выполняется монопольно и закрепляется
+    // контрольной точкой (в каталоге последней точки или autoCheckpoint), записанной до возврата: повтор
+    // журнала начнётся с этой точки, и его следующие записи применятся уже поверх change
+    template <class Change>
+    auto unlogged(const std::string& tableName, const Change& change) -> decltype(change())
+    {
+        if (!wal)
+        {
+            LockManager::Guard guard = tableName.empty() ? locks->exclusive() : locks->tables({}, {tableName});
+            return change();
+        }
+        LockManager::Guard guard = locks->exclusive();
+        std::string directory = checkpointer ? checkpointer->directory() : checkpointDirectory;
+        if (directory.empty())
+        {
+            throw std::invalid_argument("Change is not written to the write-ahead log: set a checkpoint directory first");
+        }
+        if (checkpointer)
+        {
+            checkpointer->wait();
+        }
+        if constexpr (std::is_void_v<decltype(change())>)
+        {
+            change();
+            startCheckpoint(directory);
+            checkpointer->wait();
+        }
+        else
+        {
+            decltype(auto) result = change();
+            startCheckpoint(directory);
+            checkpointer->wait();
+            return result;
+        }
+    }
+
+    // checkpoint без ожидания предыдущей точки; вызывающий держит каталог монопольно
+    void startCheckpoint(const std::string& directory)
+    {
+        // курсоров сейчас нет: старые версии строк в точку не попадают
+        for (auto& [tableName, table] : tables)
+        {
+            table.collectGarbage();
+        }
+        if (checkpointer && checkpointer->directory() != directory)
+        {
+            checkpointer->wait();
+            checkpointer.reset();
         }
+        if (!checkpointer)
+        {
+            checkpointer = std::make_unique<Checkpointer>(directory);
+        }
+        WriteAheadLog* log = wal.get();
+        checkpointer->begin(tables, lastLsn(), [log](uint64_t lsn) {
+            if (log != nullptr)
+            {
+                log->discardUpTo(lsn);
+            }
+        });
+        locks->modifications = 0;
+    }
+
+    // автоматическая точка autoCheckpoint; условие перепроверяется под монопольной блокировкой
+    void checkpointIfDue()
+    {
+        LockManager::Guard guard = locks->exclusive();
+        if (checkpointInterval != 0 && locks->modifications >= checkpointInterval && !(checkpointer && checkpointer->running()))
+        {
+            startCheckpoint(checkpointDirectory);
+        }
+    }
 
-        std::vector<const std::type_info*> QueryTypes(5);
+    Table execute(std::unique_ptr<Query> qry)
+    {
+        std::vector<const std::type_info*> QueryTypes(6);
         QueryTypes[0] = &typeid(SelectQuery);
         QueryTypes[1] = &typeid(InsertQuery);
         QueryTypes[2] = &typeid(UpdateQuery);
         QueryTypes[3] = &typeid(DeleteQuery);
         QueryTypes[4] = &typeid(CreateQuery);
+        QueryTypes[5] = &typeid(CreateIndexQuery);
 
         int query_type = std::find(QueryTypes.begin(), QueryTypes.end(), &typeid(*qry)) - QueryTypes.begin();
         if (query_type == 0) { // SELECT
             std::unique_ptr<SelectQuery> select_query = std::make_unique<SelectQuery>(std::move(qry));
-            if (select_query->joins.empty()) {
-                const std::function<bool(const Line&)>& cndtn = parse_select_condition(select_query->where_conditions);
-                return select("Select_number_" + std::to_string(select_counter++), select_query->table, select_query->columns, cndtn);
-            } else {
-                join(select_query->joins[0].table1 + "&" + select_query->joins[0].table2, select_query->joins[0].table1, select_query->joins[0].table2, parse_join_condition(select_query->joins[0].condition, select_query->joins[0].table1, select_query->joins[0].table2));
-                return select("Select_number_" + std::to_string(select_counter++), select_query->joins[0].table1 + "&" + select_query->joins[0].table2, select_query->columns, parse_select_condition(select_query->where_conditions));
-            }
+            Table result;
+            cursorFor(*select_query, nullptr).fetch(result, SIZE_MAX);
+            return result;
         } else if (query_type == 1) { // INSERT
             std::unique_ptr<InsertQuery> insert_query = std::make_unique<InsertQuery>(std::move(qry));
             std::unordered_map<std::string, std::shared_ptr<Cell>> values = dump_map(insert_query->values);
             Line insertline(values);
-            insert(insert_query->table, insertline);
-            return tables[insert_query->table];
+            tables.at(insert_query->table).insert(insertline);
+            return status(insert_query->table, 1);
         } else if (query_type == 2) { // UPDATE
             std::unique_ptr<UpdateQuery> update_query = std::make_unique<UpdateQuery>(std::move(qry));
             std::unordered_map<std::string, std::function<std::shared_ptr<Cell>(std::shared_ptr<Cell>)>> transformations = parse_transformations(update_query->assignments);
-            update(update_query->table, transformations, parse_select_condition(update_query->where_conditions));
-            return tables[update_query->table];
+            return status(update_query->table, tables.at(update_query->table).update(transformations, *QueryCondition::compile(update_query->where_conditions)));
         } else if (query_type == 3) { // DELETE
             std::unique_ptr<DeleteQuery> delete_query = std::make_unique<DeleteQuery>(std::move(qry));
-            remove(delete_query->table, parse_select_condition(delete_query->where_conditions));
-            return tables[delete_query->table];
+            return status(delete_query->table, tables.at(delete_query->table).remove(*QueryCondition::compile(delete_query->where_conditions)));
         } else if (query_type == 4) { // CREATE
             std::unique_ptr<CreateQuery> create_query = std::make_unique<CreateQuery>(std::move(qry));
-            createTable(create_query->table, create_query->columns);
-            return tables[create_query->table];
+            addTable(create_query->table, create_query->columns, create_query->attributes);
+            return status(create_query->table, 0);
+        } else if (query_type == 5) { // CREATE INDEX
+            std::unique_ptr<CreateIndexQuery> index_query = std::make_unique<CreateIndexQuery>(std::move(qry));
+            addIndex(index_query->table, index_query->column, index_query->name, index_query->ordered);
+            return status(index_query->table, 0);
         } else {
             throw std::runtime_error("Неизвестный тип запроса");
         }
     }
 
-   
-    
-};
-int to_int(const char& c) {
-    if (c <= '9' && c >= '0') {
+    // createTable и createIndex без блокировок (их держит вызывающий)
+    Table& addTable(const std::string& tableName, const std::vector<std::pair<std::string, int>>& colums,
+            const std::map<std::string, std::vector<std::string>>& attributes)
+    {
+        Table table(tableName);
+        for (auto& [columnName, columnType] : colums) 
+        {
+            table.addColumn(columnName, columnType);
+        }
+        for (const auto& [columnName, columnAttributes] : attributes)
+        {
+            auto has = [&columnAttributes](const std::string& attribute) {
+                return std::find(columnAttributes.begin(), columnAttributes.end(), attribute) != columnAttributes.end();
+            };
+            table.setConstraints(columnName, has("key"), has("unique"), has("autoincrement"));
+        }
+        return store(tableName, std::move(table));
+    }
+
+    Table& addIndex(const std::string& tableName, const std::string& columnName, const std::string& indexName, bool ordered)
+    {
+        Table& table = tables.at(tableName);
+        if (ordered) {
+            table.createOrderedIndex(columnName, indexName);
+        } else {
+            table.createIndex(columnName, indexName);
+        }
+        return table;
+    }
+
+    // SELECT по снимку pin (nullptr - по последнему состоянию таблиц, блокировки держит вызывающий)
+    Cursor cursorFor(const SelectQuery& query, const ReadPin* pin)
+    {
+        auto viewOf = [pin](const std::string& tableName) -> const ReadView* {
+            return pin ? &pin->views.at(tableName) : nullptr;
+        };
+        std::shared_ptr<QueryCondition> condition = QueryCondition::compile(query.where_conditions);
+        std::shared_ptr<Table> joined;
+        if (!query.joins.empty())
+        {
+            // вся цепочка JOIN вместе с WHERE считается по номерам строк, копируются только нужные колонки
+            std::vector<const Table*> chain = {&tables.at(query.table)};
+            std::vector<const ReadView*> views = {viewOf(query.table)};
+            std::string joinedName = query.table;
+            for (const JoinClause& clause : query.joins)
+            {
+                chain.push_back(&tables.at(clause.table2));
+                views.push_back(viewOf(clause.table2));
+                joinedName += "&" + clause.table2;
+            }
+            JoinPipeline pipeline(chain, views);
+            for (const JoinClause& clause : query.joins)
+            {
+                pipeline.addCondition(*QueryCondition::compile(clause.condition));
+            }
+            pipeline.addCondition(*condition);
+            joined = std::make_shared<Table>(pipeline.materialize(joinedName, neededColumns(query), pipeline.run()));
+            condition = QueryCondition::compile("");
+        }
+        if (query.is_aggregate())
+        {
+            // агрегаты считаются за один проход, дальше курсор идёт по маленькой таблице групп
+            for (const auto& columnName : query.columns)
+            {
+                bool aggregate = std::any_of(query.aggregates.begin(), query.aggregates.end(),
+                        [&columnName](const AggregateSpec& spec) { return spec.name == columnName; });
+                if (!aggregate && std::find(query.group_by.begin(), query.group_by.end(), columnName) == query.group_by.end())
+                {
+                    throw std::invalid_argument("Column must appear in GROUP BY or an aggregate: " + columnName);
+                }
+            }
+            const Table& input = joined ? *joined : tables.at(query.table);
+            const ReadView* view = joined ? nullptr : viewOf(query.table);
+            joined = std::make_shared<Table>(HashAggregation(input, query.group_by, query.aggregates).run(input.name, *condition, view));
+            condition = QueryCondition::compile("");
+        }
+        if (joined)
+        {
+            joined->pool = pool;
+        }
+        const Table& source = joined ? *joined : tables.at(query.table);
+        const ReadView* view = joined ? nullptr : viewOf(query.table);
+        Cursor cursor = joined ? Cursor(joined, query.columns, *condition) : Cursor(source, query.columns, *condition, view);
+
+        size_t limit = query.limit < 0 ? SIZE_MAX : size_t(query.limit);
+        size_t offset = size_t(query.offset);
+        if (!query.order_by.empty())
+        {
+            size_t needed = limit == SIZE_MAX ? SIZE_MAX : offset + limit;
+            cursor.order(source.sortedRows(*condition, query.order_by, query.order_desc, needed, view));
+        }
+        cursor.limit(offset, limit);
+        return cursor;
+    }
+
+    static std::shared_ptr<ThreadPool> makePool(size_t threads)
+    {
+        return threads > 1 ? std::make_shared<ThreadPool>(threads - 1) : nullptr;
+    }
+
+    Table& store(const std::string& tableName, Table table)
+    {
+        table.pool = pool;
+        table.clock = clock;
+        return tables[tableName] = std::move(table);
+    }
+
+    static Table status(const std::string& tableName, size_t affectedRows)
+    {
+        Table result(tableName);
+        result.addColumn("affected_rows", 0);
+        result.columns["affected_rows"].push_int(affectedRows);
+        return result;
+    }
+
+    // колонки, которые SELECT читает после JOIN: проекция, группировка, аргументы агрегатов, ORDER BY
+    static std::vector<std::string> neededColumns(const SelectQuery& query)
+    {
+        std::vector<std::string> result;
+        auto add = [&result](const std::string& columnName) {
+            if (columnName != "*" && std::find(result.begin(), result.end(), columnName) == result.end())
+            {
+                result.push_back(columnName);
+            }
+        };
+        for (const auto& columnName : query.columns)
+        {
+            bool aggregate = std::any_of(query.aggregates.begin(), query.aggregates.end(),
+                    [&columnName](const AggregateSpec& spec) { return spec.name == columnName; });
+            if (!aggregate)
+            {
+                add(columnName);
+            }
+        }
+        for (const auto& columnName : query.group_by)
+        {
+            add(columnName);
+        }
+        for (const auto& spec : query.aggregates)
+        {
+            add(spec.column);
+        }
+        if (!query.order_by.empty())
+        {
+            add(query.order_by);
+        }
+        return result;
+    }
+};
+int to_int(const char& c) {
+    if (c <= '9' && c >= '0') {
         return c - '0';
     } else {
         return c - 'a' + 10;
@@ -313,420 +1110,19 @@ std::unordered_map<std::string, std::shared_ptr<Cell>> dump_map(std::map<std::st
 
 
 // Функция для преобразования строки в дерево условий для двух Line
-std::function<bool(const Line&, const Line&)> parse_join_condition(const std::string& condition, const std::string& table1_name, const std::string& table2_name) {
-    // Функция для вычисления значения выражения
-    auto evaluate_expression = [table1_name, table2_name](const std::string& expr, const Line& line1, const Line& line2) -> std::string {
-        std::istringstream stream(expr);
-        std::stack<std::string> values;
-        std::stack<char> ops;
-
-        auto apply_op = [](const std::string& a, const std::string& b, char op) -> std::string {
-            if (a.front() == '\'' && a.back() == '\'' && b.front() == '\'' && b.back() == '\'') {
-                // Обработка строковых операций
-                std::string str_a = a.substr(1, a.size() - 2);
-                std::string str_b = b.substr(1, b.size() - 2);
-                switch (op) {
-                    case '+': return "'" + str_a + str_b + "'";
-                    default: throw std::invalid_argument("Unsupported operator for strings");
-                }
-            } else {
-                // Обработка числовых операций
-                int int_a = std::stoi(a);
-                int int_b = std::stoi(b);
-                switch (op) {
-                    case '+': return std::to_string(int_a + int_b);
-                    case '-': return std::to_string(int_a - int_b);
-                    case '*': return std::to_string(int_a * int_b);
-                    case '/': return std::to_string(int_a / int_b);
-                    default: throw std::invalid_argument("Unsupported operator for integers");
-                }
-            }
-        };
-
-        auto precedence = [](char op) -> int {
-            switch (op) {
-                case '+':
-                case '-': return 1;
-                case '*':
-                case '/': return 2;
-                default: return 0;
-            }
-        };
-
-        auto process_operator = [&]() {
-            std::string b = values.top(); values.pop();
-            std::string a = values.top(); values.pop();
-            char op = ops.top(); ops.pop();
-            values.push(apply_op(a, b, op));
-        };
-
-        std::string token;
-        while (stream >> token) {
-            if (isdigit(token[0]) || (token[0] == '-' && isdigit(token[1]))) {
-                values.push(token);
-            } else if (token.front() == '\'' && token.back() == '\'') {
-                values.push(token);
-            } else if (token[0] == '(') {
-                ops.push('(');
-            } else if (token[0] == ')') {
-                while (!ops.empty() && ops.top() != '(') {
-                    process_operator();
-                }
-                ops.pop();
-            } else if (token[0] == '+' || token[0] == '-' || token[0] == '*' || token[0] == '/') {
-                while (!ops.empty() && precedence(ops.top()) >= precedence(token[0])) {
-                    process_operator();
-                }
-                ops.push(token[0]);
-            } else {
-                // Предполагаем, что это имя столбца с префиксом таблицы или без него
-                auto dot_pos = token.find('.');
-                std::string table_name, column_name;
-                if (dot_pos != std::string::npos) {
-                    table_name = token.substr(0, dot_pos);
-                    column_name = token.substr(dot_pos + 1);
-                } else {
-                    column_name = token;
-                }
-
-                auto cell = (table_name == table1_name || (table_name.empty() && line1.cells.count(column_name))) ? line1.cells.at(column_name) : line2.cells.at(column_name);
-                if (auto cellInt = std::dynamic_pointer_cast<CellInt>(cell)) {
-                    values.push(std::to_string(cellInt->data));
-                } else if (auto cellString = std::dynamic_pointer_cast<CellString>(cell)) {
-                    values.push("'" + cellString->data + "'");
-                } else {
-                    throw std::invalid_argument("Unsupported cell type in expression");
-                }
-            }
-        }
-
-        while (!ops.empty()) {
-            process_operator();
-        }
-
-        return values.top();
-    };
-
-    // Функция для парсинга условий
-    return [condition, evaluate_expression, table1_name, table2_name](const Line& line1, const Line& line2) -> bool {
-        std::istringstream stream(condition);
-        std::stack<bool> values;
-        std::stack<std::string> ops;
-
-        auto apply_op = [](bool a, bool b, const std::string& op) -> bool {
-            if (op == "&&") return a && b;
-            if (op == "||") return a || b;
-            throw std::invalid_argument("Unsupported logical operator");
-        };
-
-        auto precedence = [](const std::string& op) -> int {
-            if (op == "||") return 1;
-            if (op == "&&") return 2;
-            return 0;
-        };
-
-        auto process_operator = [&]() {
-            bool b = values.top(); values.pop();
-            bool a = values.top(); values.pop();
-            std::string op = ops.top(); ops.pop();
-            values.push(apply_op(a, b, op));
-        };
-
-        std::string token;
-        while (stream >> token) {
-            if (token == "&&" || token == "||") {
-                while (!ops.empty() && precedence(ops.top()) >= precedence(token)) {
-                    process_operator();
-                }
-                ops.push(token);
-            } else if (token == "(") {
-                ops.push("(");
-            } else if (token == ")") {
-                while (!ops.empty() && ops.top() != "(") {
-                    process_operator();
-                }
-                ops.pop();
-            } else {
-                // Предполагаем, что это условие вида "table1.col op value" или "value op table2.col"
-                std::string column, op, value;
-                std::istringstream cond_stream(token);
-                cond_stream >> column >> op >> value;
-
-                // Удаляем кавычки из значения, если они есть
-                if (!value.empty() && value.front() == '\'' && value.back() == '\'') {
-                    value = value.substr(1, value.size() - 2);
-                }
-
-                auto dot_pos = column.find('.');
-                std::string table_name, column_name;
-                if (dot_pos != std::string::npos) {
-                    table_name = column.substr(0, dot_pos);
-                    column_name = column.substr(dot_pos + 1);
-                } else {
-                    column_name = column;
-                }
-
-                auto cell = (table_name == table1_name || (table_name.empty() && line1.cells.count(column_name))) ? line1.cells.at(column_name) : line2.cells.at(column_name);
-                bool result = false;
-
-                if (op == "=") {
-                    if (auto cellInt = std::dynamic_pointer_cast<CellInt>(cell)) {
-                        result = cellInt->data == std::stoi(value);
-                    } else if (auto cellBool = std::dynamic_pointer_cast<CellBool>(cell)) {
-                        result = cellBool->data == (value == "true" || value == "1");
-                    } else if (auto cellString = std::dynamic_pointer_cast<CellString>(cell)) {
-                        result = cellString->data == value;
-                    } else if (auto cellBytes = std::dynamic_pointer_cast<CellBytes>(cell)) {
-                        result = cellBytes->data == value;
-                    }
-                } else if (op == "!=") {
-                    if (auto cellInt = std::dynamic_pointer_cast<CellInt>(cell)) {
-                        result = cellInt->data != std::stoi(value);
-                    } else if (auto cellBool = std::dynamic_pointer_cast<CellBool>(cell)) {
-                        result = cellBool->data != (value == "true" || value == "1");
-                    } else if (auto cellString = std::dynamic_pointer_cast<CellString>(cell)) {
-                        result = cellString->data != value;
-                    } else if (auto cellBytes = std::dynamic_pointer_cast<CellBytes>(cell)) {
-                        result = cellBytes->data != value;
-                    }
-                } else if (op == "<") {
-                    if (auto cellInt = std::dynamic_pointer_cast<CellInt>(cell)) {
-                        result = cellInt->data < std::stoi(value);
-                    }
-                } else if (op == "<=") {
-                    if (auto cellInt = std::dynamic_pointer_cast<CellInt>(cell)) {
-                        result = cellInt->data <= std::stoi(value);
-                    }
-                } else if (op == ">") {
-                    if (auto cellInt = std::dynamic_pointer_cast<CellInt>(cell)) {
-                        result = cellInt->data > std::stoi(value);
-                    }
-                } else if (op == ">=") {
-                    if (auto cellInt = std::dynamic_pointer_cast<CellInt>(cell)) {
-                        result = cellInt->data >= std::stoi(value);
-                    }
-                } else {
-                    throw std::invalid_argument("Unsupported operation or type in condition: " + condition);
-                }
-
-                values.push(result);
-            }
-        }
-
-        while (!ops.empty()) {
-            process_operator();
-        }
-
-        return values.top();
+std::function<bool(const Line&, const Line&)> parse_join_condition(const std::string& condition) {
+    std::shared_ptr<QueryCondition> compiled = QueryCondition::compile(condition);
+    return [compiled](const Line& line1, const Line& line2) -> bool {
+        return compiled->matches(line1, line2);
     };
 }
 
 // Функция для преобразования строки в дерево условий для where(select, update, delete)
+// Условие разбирается один раз, на каждую строку только вычисляется дерево
 std::function<bool(const Line&)> parse_select_condition(const std::string& condition) {
-    // Функция для вычисления значения выражения
-    auto evaluate_expression = [](const std::string& expr, const Line& line) -> std::string {
-        std::istringstream stream(expr);
-        std::stack<std::string> values;
-        std::stack<char> ops;
-
-        auto apply_op = [](const std::string& a, const std::string& b, char op) -> std::string {
-            if (a.front() == '\'' && a.back() == '\'' && b.front() == '\'' && b.back() == '\'') {
-                // Обработка строковых операций
-                std::string str_a = a.substr(1, a.size() - 2);
-                std::string str_b = b.substr(1, b.size() - 2);
-                switch (op) {
-                    case '+': return "'" + str_a + str_b + "'";
-                    default: throw std::invalid_argument("Unsupported operator for strings");
-                }
-            } else {
-                // Обработка числовых операций
-                int int_a = std::stoi(a);
-                int int_b = std::stoi(b);
-                switch (op) {
-                    case '+': return std::to_string(int_a + int_b);
-                    case '-': return std::to_string(int_a - int_b);
-                    case '*': return std::to_string(int_a * int_b);
-                    case '/': return std::to_string(int_a / int_b);
-                    default: throw std::invalid_argument("Unsupported operator for integers");
-                }
-            }
-        };
-
-        auto precedence = [](char op) -> int {
-            switch (op) {
-                case '+':
-                case '-': return 1;
-                case '*':
-                case '/': return 2;
-                default: return 0;
-            }
-        };
-
-        auto process_operator = [&]() {
-            std::string b = values.top(); values.pop();
-            std::string a = values.top(); values.pop();
-            char op = ops.top(); ops.pop();
-            values.push(apply_op(a, b, op));
-        };
-
-        std::string token;
-        while (stream >> token) {
-            if (isdigit(token[0]) || (token[0] == '-' && isdigit(token[1]))) {
-                values.push(token);
-            } else if (token.front() == '\'' && token.back() == '\'') {
-                values.push(token);
-            } else if (token[0] == '(') {
-                ops.push('(');
-            } else if (token[0] == ')') {
-                while (!ops.empty() && ops.top() != '(') {
-                    process_operator();
-                }
-                ops.pop();
-            } else if (token[0] == '+' || token[0] == '-' || token[0] == '*' || token[0] == '/') {
-                while (!ops.empty() && precedence(ops.top()) >= precedence(token[0])) {
-                    process_operator();
-                }
-                ops.push(token[0]);
-            } else {
-                // Предполагаем, что это имя столбца
-                auto cell = line.cells.at(token);
-                if (auto cellInt = std::dynamic_pointer_cast<CellInt>(cell)) {
-                    values.push(std::to_string(cellInt->data));
-                } else if (auto cellString = std::dynamic_pointer_cast<CellString>(cell)) {
-                    values.push("'" + cellString->data + "'");
-                } else {
-                    throw std::invalid_argument("Unsupported cell type in expression");
-                }
-            }
-        }
-
-        while (!ops.empty()) {
-            process_operator();
-        }
-
-        return values.top();
-    };
-
-    // Функция для парсинга условий
-    return [condition, evaluate_expression](const Line& line) -> bool {
-        std::istringstream stream(condition);
-        std::stack<bool> values;
-        std::stack<std::string> ops;
-
-        auto apply_op = [](bool a, bool b, const std::string& op) -> bool {
-            if (op == "&&" || op == "AND" || op == "and") return a && b;
-            if (op == "||" || op == "OR" || op == "or") return a || b;
-            throw std::invalid_argument("Unsupported logical operator");
-        };
-
-        auto precedence = [](const std::string& op) -> int {
-            if (op == "||" || op == "OR" || op == "or") return 1;
-            if (op == "&&" || op == "AND" || op == "and") return 2;
-            return 0;
-        };
-
-        auto process_operator = [&]() {
-            bool b = values.top(); values.pop();
-            bool a = values.top(); values.pop();
-            std::string op = ops.top(); ops.pop();
-            values.push(apply_op(a, b, op));
-        };
-
-        std::string token;
-        while (stream >> token) {
-            if (token == "||" || token == "OR" || token == "or" || token == "&&" || token == "AND" || token == "and") {
-                while (!ops.empty() && precedence(ops.top()) >= precedence(token)) {
-                    process_operator();
-                }
-                ops.push(token);
-            } else if (token == "(") {
-                ops.push("(");
-            } else if (token == ")") {
-                while (!ops.empty() && ops.top() != "(") {
-                    process_operator();
-                }
-                ops.pop();
-            } else {
-                // Предполагаем, что это условие вида "col op value"
-                std::string column, op, value;
-                std::istringstream cond_stream(token);
-                cond_stream >> column >> op >> value;
-
-                // Удаляем кавычки из значения, если они есть
-                if (!value.empty() && value.front() == '\'' && value.back() == '\'') {
-                    value = value.substr(1, value.size() - 2);
-                }
-
-                auto cell = line.cells.at(column);
-                bool result = false;
-
-                if (op == "=") {
-                    if (auto cellInt = std::dynamic_pointer_cast<CellInt>(cell)) {
-                        result = cellInt->data == std::stoi(value);
-                    } else if (auto cellBool = std::dynamic_pointer_cast<CellBool>(cell)) {
-                        result = cellBool->data == (value == "true" || value == "1");
-                    } else if (auto cellString = std::dynamic_pointer_cast<CellString>(cell)) {
-                        result = cellString->data == value;
-                    } else if (auto cellBytes = std::dynamic_pointer_cast<CellBytes>(cell)) {
-                        result = cellBytes->data == value;
-                    }
-                } else if (op == "!=") {
-                    if (auto cellInt = std::dynamic_pointer_cast<CellInt>(cell)) {
-                        result = cellInt->data != std::stoi(value);
-                    } else if (auto cellBool = std::dynamic_pointer_cast<CellBool>(cell)) {
-                        result = cellBool->data != (value == "true" || value == "1");
-                    } else if (auto cellString = std::dynamic_pointer_cast<CellString>(cell)) {
-                        result = cellString->data != value;
-                    } else if (auto cellBytes = std::dynamic_pointer_cast<CellBytes>(cell)) {
-                        result = cellBytes->data != value;
-                    }
-                } else if (op == "<") {
-                    if (auto cellInt = std::dynamic_pointer_cast<CellInt>(cell)) {
-                        result = cellInt->data < std::stoi(value);
-                    }
-                } else if (op == "<=") {
-                    if (auto cellInt = std::dynamic_pointer_cast<CellInt>(cell)) {
-                        result = cellInt->data <= std::stoi(value);
-                    }
-                } else if (op == ">") {
-                    if (auto cellInt = std::dynamic_pointer_cast<CellInt>(cell)) {
-                        result = cellInt->data > std::stoi(value);
-                    }
-                } else if (op == ">=") {
-                    if (auto cellInt = std::dynamic_pointer_cast<CellInt>(cell)) {
-                        result = cellInt->data >= std::stoi(value);
-                    }
-                } else if (op == "") {
-
-                    if (auto cellInt = std::dynamic_pointer_cast<CellInt>(cell)) {
-                        result = cellInt->data != 0;
-                    } else if (auto cellBool = std::dynamic_pointer_cast<CellBool>(cell)) {
-                        result = cellBool->data;
-                    } else if (auto cellString = std::dynamic_pointer_cast<CellString>(cell)) {
-                        result = cellString->data != "";
-                    } else if (auto cellBytes = std::dynamic_pointer_cast<CellBytes>(cell)) {
-                        bool flg = false;
-                        for (auto byte : cellBytes->data) {
-                            if (byte != '0') {
-                                flg = true;
-                                break;
-                            }
-                        }
-                        result = flg;
-                    }
-                }else {
-                    throw std::invalid_argument("Unsupported operation or type in condition: " + condition);
-                }
-
-                values.push(result);
-            }
-        }
-
-        while (!ops.empty()) {
-            process_operator();
-        }
-
-        return values.top();
+    std::shared_ptr<QueryCondition> compiled = QueryCondition::compile(condition);
+    return [compiled](const Line& line) -> bool {
+        return compiled->matches(line);
     };
 }
 
@@ -836,3 +1232,5 @@ std::unordered_map<std::string, std::function<std::shared_ptr<Cell>(std::shared_
 
     return result;
 }
+
+#endif // DATABASE_H
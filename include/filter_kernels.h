@@ -0,0 +1,207 @@
+#ifndef FILTER_KERNELS_H
+#define FILTER_KERNELS_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FILTER_KERNELS_X86 1
+#endif
+
+// Сравнение подряд идущих int32 с константой в битовую маску: бит i слова i / 64 - результат для values[i],
+// биты после count нулевые. Процессор умеет только =, > и <, поэтому !=, <= и >= получаются из них
+// инверсией (negate). Ядро выбирается один раз по CPUID: AVX2 (8 значений за сравнение), SSE2 (4)
+// или скалярное; отдельные ядра можно вызвать напрямую (тесты, бенчмарк)
+enum class KernelCompare {
+    EQUAL,
+    GREATER,
+    LESS
+};
+
+enum class KernelLevel {
+    SCALAR,
+    SSE2,
+    AVX2
+};
+
+class FilterKernels
+{
+public:
+    using Int32Kernel = void (*)(const int32_t* values, size_t count, KernelCompare cmp, int32_t value, bool negate, uint64_t* words);
+
+    static KernelLevel detect()
+    {
+#ifdef FILTER_KERNELS_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+        {
+            return KernelLevel::AVX2;
+        }
+        if (__builtin_cpu_supports("sse2"))
+        {
+            return KernelLevel::SSE2;
+        }
+#endif
+        return KernelLevel::SCALAR;
+    }
+
+    static KernelLevel level()
+    {
+        static const KernelLevel detected = detect();
+        return detected;
+    }
+
+    static const char* levelName(KernelLevel level)
+    {
+        switch (level)
+        {
+            case KernelLevel::AVX2: return "avx2";
+            case KernelLevel::SSE2: return "sse2";
+            default: return "scalar";
+        }
+    }
+
+    // ядро уровня level; уровни выше поддерживаемого процессором вызывать нельзя
+    static Int32Kernel kernel(KernelLevel level)
+    {
+#ifdef FILTER_KERNELS_X86
+        if (level == KernelLevel::AVX2)
+        {
+            return compareInt32Avx2;
+        }
+        if (level == KernelLevel::SSE2)
+        {
+            return compareInt32Sse2;
+        }
+#endif
+        return compareInt32Scalar;
+    }
+
+    static void compareInt32(const int32_t* values, size_t count, KernelCompare cmp, int32_t value, bool negate, uint64_t* words)
+    {
+        static const Int32Kernel chosen = kernel(level());
+        chosen(values, count, cmp, value, negate, words);
+    }
+
+    static void compareInt32Scalar(const int32_t* values, size_t count, KernelCompare cmp, int32_t value, bool negate, uint64_t* words)
+    {
+        switch (cmp)
+        {
+            case KernelCompare::EQUAL:
+                scalar(values, count, negate, words, [value](int32_t x) { return x == value; });
+                break;
+            case KernelCompare::GREATER:
+                scalar(values, count, negate, words, [value](int32_t x) { return x > value; });
+                break;
+            case KernelCompare::LESS:
+                scalar(values, count, negate, words, [value](int32_t x) { return x < value; });
+                break;
+        }
+    }
+
+#ifdef FILTER_KERNELS_X86
+    __attribute__((target("avx2")))
+    static void compareInt32Avx2(const int32_t* values, size_t count, KernelCompare cmp, int32_t value, bool negate, uint64_t* words)
+    {
+        switch (cmp)
+        {
+            case KernelCompare::EQUAL: avx2<KernelCompare::EQUAL>(values, count, value, negate, words); break;
+            case KernelCompare::GREATER: avx2<KernelCompare::GREATER>(values, count, value, negate, words); break;
+            case KernelCompare::LESS: avx2<KernelCompare::LESS>(values, count, value, negate, words); break;
+        }
+    }
+
+    __attribute__((target("sse2")))
+    static void compareInt32Sse2(const int32_t* values, size_t count, KernelCompare cmp, int32_t value, bool negate, uint64_t* words)
+    {
+        switch (cmp)
+        {
+            case KernelCompare::EQUAL: sse2<KernelCompare::EQUAL>(values, count, value, negate, words); break;
+            case KernelCompare::GREATER: sse2<KernelCompare::GREATER>(values, count, value, negate, words); break;
+            case KernelCompare::LESS: sse2<KernelCompare::LESS>(values, count, value, negate, words); break;
+        }
+    }
+#endif
+
+private:
+    template <class Test>
+    static void scalar(const int32_t* values, size_t count, bool negate, uint64_t* words, const Test& test)
+    {
+        for (size_t w = 0; w * 64 < count; ++w)
+        {
+            size_t n = std::min<size_t>(64, count - w * 64);
+            const int32_t* block = values + w * 64;
+            uint64_t word = 0;
+            for (size_t i = 0; i < n; ++i)
+            {
+                word |= uint64_t(test(block[i])) << i;
+            }
+            if (negate)
+            {
+                word = ~word & (n == 64 ? ~uint64_t(0) : (uint64_t(1) << n) - 1);
+            }
+            words[w] = word;
+        }
+    }
+
+#ifdef FILTER_KERNELS_X86
+    // полные слова по 64 значения - векторно, хвост - скалярным ядром
+    template <KernelCompare Cmp>
+    __attribute__((target("avx2")))
+    static void avx2(const int32_t* values, size_t count, int32_t value, bool negate, uint64_t* words)
+    {
+        const __m256i constant = _mm256_set1_epi32(value);
+        const uint64_t flip = negate ? ~uint64_t(0) : 0;
+        size_t w = 0;
+        for (; (w + 1) * 64 <= count; ++w)
+        {
+            const int32_t* block = values + w * 64;
+            uint64_t word = 0;
+            for (size_t i = 0; i < 64; i += 8)
+            {
+                __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + i));
+                __m256i result = Cmp == KernelCompare::EQUAL ? _mm256_cmpeq_epi32(x, constant)
+                               : Cmp == KernelCompare::GREATER ? _mm256_cmpgt_epi32(x, constant)
+                               : _mm256_cmpgt_epi32(constant, x);
+                word |= uint64_t(uint32_t(_mm256_movemask_ps(_mm256_castsi256_ps(result)))) << i;
+            }
+            words[w] = word ^ flip;
+        }
+        if (w * 64 < count)
+        {
+            compareInt32Scalar(values + w * 64, count - w * 64, Cmp, value, negate, words + w);
+        }
+    }
+
+    template <KernelCompare Cmp>
+    __attribute__((target("sse2")))
+    static void sse2(const int32_t* values, size_t count, int32_t value, bool negate, uint64_t* words)
+    {
+        const __m128i constant = _mm_set1_epi32(value);
+        const uint64_t flip = negate ? ~uint64_t(0) : 0;
+        size_t w = 0;
+        for (; (w + 1) * 64 <= count; ++w)
+        {
+            const int32_t* block = values + w * 64;
+            uint64_t word = 0;
+            for (size_t i = 0; i < 64; i += 4)
+            {
+                __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + i));
+                __m128i result = Cmp == KernelCompare::EQUAL ? _mm_cmpeq_epi32(x, constant)
+                               : Cmp == KernelCompare::GREATER ? _mm_cmpgt_epi32(x, constant)
+                               : _mm_cmplt_epi32(x, constant);
+                word |= uint64_t(uint32_t(_mm_movemask_ps(_mm_castsi128_ps(result)))) << i;
+            }
+            words[w] = word ^ flip;
+        }
+        if (w * 64 < count)
+        {
+            compareInt32Scalar(values + w * 64, count - w * 64, Cmp, value, negate, words + w);
+        }
+    }
+#endif
+};
+
+#endif // FILTER_KERNELS_H
@@ -0,0 +1,342 @@
+#ifndef INDEX_H
+#define INDEX_H
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+
+#include "column.h"
+#include "query_condition.h"
+#include "bplus_tree.h"
+
+// Хеш-индекс по одной колонке: значение -> номера строк с этим значением.
+// Для int32 и bool ключ - число, для string и bytes - копия строки
+class HashIndex
+{
+public:
+    std::string name;
+    int type = 0;
+
+    HashIndex() = default;
+    HashIndex(const std::string& indexName, int columnType) : name(indexName), type(columnType) {}
+
+    void clear()
+    {
+        numbers.clear();
+        strings.clear();
+    }
+
+    void add(const Column& column, uint32_t row)
+    {
+        if (column.is_null(row)) {
+            return;
+        }
+        if (type >= 2) {
+            strings.emplace(std::string(column.get_string(row)), row);
+        } else {
+            numbers.emplace(number_key(column, row), row);
+        }
+    }
+
+    // убирает строку row с её текущим значением в колонке
+    void erase(const Column& column, uint32_t row)
+    {
+        if (column.is_null(row)) {
+            return;
+        }
+        if (type >= 2) {
+            erase_from(strings, std::string(column.get_string(row)), row);
+        } else {
+            erase_from(numbers, number_key(column, row), row);
+        }
+    }
+
+    // убирает строки rows (по возрастанию) с их текущими значениями: записи каждого значения
+    // просматриваются один раз, а не на каждую строку с ним
+    void erase(const Column& column, const std::vector<uint32_t>& rows)
+    {
+        if (type >= 2) {
+            std::unordered_set<std::string> keys;
+            for (uint32_t row : rows) {
+                if (!column.is_null(row)) {
+                    keys.emplace(column.get_string(row));
+                }
+            }
+            for (const std::string& key : keys) {
+                erase_rows(strings, key, rows);
+            }
+        } else {
+            std::unordered_set<int32_t> keys;
+            for (uint32_t row : rows) {
+                if (!column.is_null(row)) {
+                    keys.insert(number_key(column, row));
+                }
+            }
+            for (int32_t key : keys) {
+                erase_rows(numbers, key, rows);
+            }
+        }
+    }
+
+    bool contains(const Datum& key) const
+    {
+        if (key.type == -1) {
+            return false;
+        }
+        if (type >= 2) {
+            return strings.count(std::string(key.text)) != 0;
+        }
+        return numbers.count(key.number) != 0;
+    }
+
+    // строки со значением key по возрастанию номера
+    std::vector<uint32_t> find(const Datum& key) const
+    {
+        std::vector<uint32_t> rows;
+        if (key.type == -1) {
+            return rows;
+        }
+        if (type >= 2) {
+            auto range = strings.equal_range(std::string(key.text));
+            for (auto it = range.first; it != range.second; ++it) {
+                rows.push_back(it->second);
+            }
+        } else {
+            auto range = numbers.equal_range(key.number);
+            for (auto it = range.first; it != range.second; ++it) {
+                rows.push_back(it->second);
+            }
+        }
+        std::sort(rows.begin(), rows.end());
+        return rows;
+    }
+
+    size_t size() const
+    {
+        return numbers.size() + strings.size();
+    }
+
+private:
+    std::unordered_multimap<int32_t, uint32_t> numbers;
+    std::unordered_multimap<std::string, uint32_t> strings;
+
+    static int32_t number_key(const Column& column, uint32_t row)
+    {
+        return column.type == 0 ? column.get_int(row) : int32_t(column.get_bool(row));
+    }
+
+    template <class Map, class Key>
+    static void erase_from(Map& map, const Key& key, uint32_t row)
+    {
+        auto range = map.equal_range(key);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second == row) {
+                map.erase(it);
+                return;
+            }
+        }
+    }
+
+    template <class Map, class Key>
+    static void erase_rows(Map& map, const Key& key, const std::vector<uint32_t>& rows)
+    {
+        auto range = map.equal_range(key);
+        for (auto it = range.first; it != range.second;) {
+            if (std::binary_search(rows.begin(), rows.end(), it->second)) {
+                it = map.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+};
+
+// Диапазон значений колонки, собранный из сравнений с константами (x > 1 AND x <= 5 -> (1, 5]).
+// Каждое новое сравнение только сужает диапазон
+struct KeyRange
+{
+    bool has_low = false, low_inclusive = true;
+    bool has_high = false, high_inclusive = true;
+    Datum low, high;
+    bool empty = false; // условия противоречат друг другу или сравнение с NULL
+
+    // сужает диапазон условием "колонка op value"; false, если такое условие диапазоном не выражается
+    bool restrict(CompareOperator op, const Datum& value)
+    {
+        if (op == CompareOperator::NOT_EQUAL || op == CompareOperator::DEFAULT)
+        {
+            return false;
+        }
+        if (value.type == -1)
+        {
+            empty = true;
+            return true;
+        }
+        if (op == CompareOperator::EQUAL || op == CompareOperator::GREATER_THAN || op == CompareOperator::GREATER_EQUAL)
+        {
+            bool inclusive = op != CompareOperator::GREATER_THAN;
+            int cmp = has_low ? compare(value, low) : 1;
+            if (cmp > 0 || (cmp == 0 && !inclusive))
+            {
+                has_low = true;
+                low = value;
+                low_inclusive = inclusive;
+            }
+        }
+        if (op == CompareOperator::EQUAL || op == CompareOperator::LESS_THAN || op == CompareOperator::LESS_EQUAL)
+        {
+            bool inclusive = op != CompareOperator::LESS_THAN;
+            int cmp = has_high ? compare(value, high) : -1;
+            if (cmp < 0 || (cmp == 0 && !inclusive))
+            {
+                has_high = true;
+                high = value;
+                high_inclusive = inclusive;
+            }
+        }
+        if (has_low && has_high)
+        {
+            int cmp = compare(low, high);
+            if (cmp > 0 || (cmp == 0 && !(low_inclusive && high_inclusive)))
+            {
+                empty = true;
+            }
+        }
+        return true;
+    }
+
+    static int compare(const Datum& a, const Datum& b)
+    {
+        if (a.is_number())
+        {
+            return a.number < b.number ? -1 : (a.number > b.number ? 1 : 0);
+        }
+        return a.text.compare(b.text);
+    }
+};
+
+// Упорядоченный индекс по колонке int32 или string на B+-дереве: отвечает на запросы по диапазону
+// и позволяет обходить строки в порядке значений. NULL в индекс не попадают
+class OrderedIndex
+{
+public:
+    std::string name;
+    int type = 0;
+
+    OrderedIndex() = default;
+    OrderedIndex(const std::string& indexName, int columnType) : name(indexName), type(columnType)
+    {
+        if (type != 0 && type != 2)
+        {
+            throw std::invalid_argument("Ordered index supports only int32 and string columns");
+        }
+    }
+
+    void clear()
+    {
+        numbers.clear();
+        strings.clear();
+    }
+
+    // строит индекс заново по живым строкам rows одной сортировкой, без вставок по одной
+    void build(const Column& column, const std::vector<uint32_t>& rows)
+    {
+        if (type == 0) {
+            numbers.bulk_load(sorted_entries<int32_t>(rows, column, [&column](uint32_t row) {
+                return column.get_int(row);
+            }));
+        } else {
+            strings.bulk_load(sorted_entries<std::string>(rows, column, [&column](uint32_t row) {
+                return std::string(column.get_string(row));
+            }));
+        }
+    }
+
+    void add(const Column& column, uint32_t row)
+    {
+        if (column.is_null(row)) {
+            return;
+        }
+        if (type == 0) {
+            numbers.insert(column.get_int(row), row);
+        } else {
+            strings.insert(std::string(column.get_string(row)), row);
+        }
+    }
+
+    // убирает строку row с её текущим значением в колонке
+    void erase(const Column& column, uint32_t row)
+    {
+        if (column.is_null(row)) {
+            return;
+        }
+        if (type == 0) {
+            numbers.erase(column.get_int(row), row);
+        } else {
+            strings.erase(std::string(column.get_string(row)), row);
+        }
+    }
+
+    // emit(строка) в порядке значений для строк из диапазона; emit возвращает false, чтобы остановиться
+    template <class Emit>
+    void scan(const KeyRange& range, const Emit& emit) const
+    {
+        if (range.empty) {
+            return;
+        }
+        auto forward = [&emit](const auto&, uint32_t row) { return emit(row); };
+        if (type == 0) {
+            int32_t low = range.low.number, high = range.high.number;
+            numbers.scan(range.has_low ? &low : nullptr, range.low_inclusive,
+                         range.has_high ? &high : nullptr, range.high_inclusive, forward);
+        } else {
+            std::string low(range.low.text), high(range.high.text);
+            strings.scan(range.has_low ? &low : nullptr, range.low_inclusive,
+                         range.has_high ? &high : nullptr, range.high_inclusive, forward);
+        }
+    }
+
+    // строки из диапазона по возрастанию номера
+    std::vector<uint32_t> find(const KeyRange& range) const
+    {
+        std::vector<uint32_t> rows;
+        scan(range, [&rows](uint32_t row) {
+            rows.push_back(row);
+            return true;
+        });
+        std::sort(rows.begin(), rows.end());
+        return rows;
+    }
+
+    size_t size() const
+    {
+        return numbers.size() + strings.size();
+    }
+
+private:
+    BPlusTree<int32_t> numbers;
+    BPlusTree<std::string> strings;
+
+    template <class Key, class Get>
+    static std::vector<typename BPlusTree<Key>::Entry> sorted_entries(const std::vector<uint32_t>& rows, const Column& column, const Get& get)
+    {
+        std::vector<typename BPlusTree<Key>::Entry> entries;
+        entries.reserve(rows.size());
+        for (uint32_t row : rows)
+        {
+            if (!column.is_null(row))
+            {
+                entries.push_back({get(row), row});
+            }
+        }
+        std::sort(entries.begin(), entries.end());
+        return entries;
+    }
+};
+
+#endif // INDEX_H
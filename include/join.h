@@ -0,0 +1,439 @@
+#ifndef JOIN_H
+#define JOIN_H
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <unordered_map>
+#include <stdexcept>
+#include <utility>
+#include <algorithm>
+#include <cstdint>
+
+#include "table.h"
+
+// Цепочка JOIN из нескольких таблиц. Все условия ON и WHERE разбиваются на части по AND:
+//  - части про одну таблицу сразу фильтруют её строки (с использованием индексов);
+//  - таблицы присоединяются по одной, начиная с самой маленькой после фильтров, и следующей берётся
+//    самая маленькая из связанных с уже присоединёнными равенством колонок (тогда шаг - hash join),
+//    иначе - самая маленькая вообще (декартово произведение);
+//  - остальные части проверяются, как только присоединены все их таблицы.
+// Промежуточный результат - только номера строк каждой таблицы (rows[таблица][k] - k-й кортеж),
+// колонки копируются один раз в materialize
+class JoinPipeline
+{
+public:
+    // views[t] - снимок, по которому читается таблица t (пусто - последнее состояние таблиц)
+    explicit JoinPipeline(const std::vector<const Table*>& joinTables, std::vector<const ReadView*> joinViews = {})
+        : tables(joinTables), views(std::move(joinViews))
+    {
+        views.resize(tables.size(), nullptr);
+        if (tables.size() > 64)
+        {
+            throw std::invalid_argument("Too many tables in JOIN");
+        }
+        for (size_t i = 0; i < tables.size(); ++i)
+        {
+            for (size_t j = 0; j < i; ++j)
+            {
+                if (tables[i]->name == tables[j]->name)
+                {
+                    throw std::invalid_argument("Table joined twice: " + tables[i]->name);
+                }
+            }
+        }
+    }
+
+    // "table.column" ищется в своей таблице, имя без префикса - в первой таблице, где оно есть
+    std::pair<int, const Column*> resolve(const std::string& columnName) const
+    {
+        size_t dot = columnName.find('.');
+        if (dot != std::string::npos)
+        {
+            std::string tableName = columnName.substr(0, dot);
+            std::string shortName = columnName.substr(dot + 1);
+            for (size_t t = 0; t < tables.size(); ++t)
+            {
+                if (tables[t]->name == tableName)
+                {
+                    auto it = tables[t]->columns.find(shortName);
+                    return {int(t), it == tables[t]->columns.end() ? nullptr : &it->second};
+                }
+            }
+        }
+        for (size_t t = 0; t < tables.size(); ++t)
+        {
+            auto it = tables[t]->columns.find(columnName);
+            if (it != tables[t]->columns.end())
+            {
+                return {int(t), &it->second};
+            }
+        }
+        return {0, nullptr};
+    }
+
+    void addCondition(const QueryCondition& condition)
+    {
+        std::shared_ptr<QueryCondition> tree = condition.bind([this](const std::string& columnName) {
+            return resolve(columnName);
+        });
+        for (const QueryCondition* part : tree->conjuncts())
+        {
+            parts.push_back(part);
+        }
+        trees.push_back(std::move(tree));
+    }
+
+    // номера строк каждой таблицы для всех кортежей результата
+    std::vector<std::vector<uint32_t>> run() const
+    {
+        size_t n = tables.size();
+        std::vector<std::vector<uint32_t>> rows(n);
+        std::vector<bool> applied(parts.size(), false);
+        std::vector<uint32_t> tuple(n, 0);
+
+        // условия без колонок (1 = 1) проверяются один раз
+        for (size_t p = 0; p < parts.size(); ++p)
+        {
+            if (parts[p]->sources() == 0)
+            {
+                applied[p] = true;
+                if (!parts[p]->matches(tuple))
+                {
+                    return rows;
+                }
+            }
+        }
+
+        std::vector<std::vector<uint32_t>> filtered(n);
+        for (size_t t = 0; t < n; ++t)
+        {
+            filtered[t] = filterTable(t, applied);
+        }
+
+        uint64_t joined = 0;
+        size_t first = 0;
+        for (size_t t = 1; t < n; ++t)
+        {
+            if (filtered[t].size() < filtered[first].size())
+            {
+                first = t;
+            }
+        }
+        rows[first] = std::move(filtered[first]);
+        joined |= uint64_t(1) << first;
+        size_t count = rows[first].size();
+
+        for (size_t step = 1; step < n; ++step)
+        {
+            // следующая таблица: связанная равенством с уже присоединёнными и самая маленькая
+            size_t next = n;
+            const QueryCondition* equality = nullptr;
+            for (size_t t = 0; t < n; ++t)
+            {
+                if (joined >> t & 1)
+                {
+                    continue;
+                }
+                const QueryCondition* link = equalityBetween(joined, t, applied);
+                bool better = next == n || (link != nullptr && equality == nullptr) ||
+                              ((link != nullptr) == (equality != nullptr) && filtered[t].size() < filtered[next].size());
+                if (better)
+                {
+                    next = t;
+                    equality = link;
+                }
+            }
+
+            std::vector<std::vector<uint32_t>> result(n);
+            auto emit = [&](size_t k, uint32_t row) {
+                for (size_t t = 0; t < n; ++t)
+                {
+                    if (joined >> t & 1)
+                    {
+                        result[t].push_back(rows[t][k]);
+                    }
+                }
+                result[next].push_back(row);
+            };
+            if (equality != nullptr)
+            {
+                applied[std::find(parts.begin(), parts.end(), equality) - parts.begin()] = true;
+                const QueryCondition& added = equality->left->source == int(next) ? *equality->left : *equality->right;
+                const QueryCondition& existing = equality->left->source == int(next) ? *equality->right : *equality->left;
+                hashStep(rows[existing.source], count, *existing.column, filtered[next], *added.column, emit);
+            }
+            else
+            {
+                for (size_t k = 0; k < count; ++k)
+                {
+                    for (uint32_t row : filtered[next])
+                    {
+                        emit(k, row);
+                    }
+                }
+            }
+            filtered[next].clear();
+            filtered[next].shrink_to_fit();
+            rows = std::move(result);
+            joined |= uint64_t(1) << next;
+            count = rows[next].size();
+
+            // остальные условия, все таблицы которых уже присоединены
+            std::vector<const QueryCondition*> ready;
+            for (size_t p = 0; p < parts.size(); ++p)
+            {
+                if (!applied[p] && (parts[p]->sources() & ~joined) == 0)
+                {
+                    applied[p] = true;
+                    ready.push_back(parts[p]);
+                }
+            }
+            if (!ready.empty())
+            {
+                count = filterTuples(rows, joined, count, ready);
+            }
+        }
+        return rows;
+    }
+
+    // таблица результата с колонками columnNames (имена как в запросе)
+    Table materialize(const std::string& newTableName, const std::vector<std::string>& columnNames,
+            const std::vector<std::vector<uint32_t>>& rows) const
+    {
+        Table result(newTableName);
+        for (const auto& columnName : columnNames)
+        {
+            auto [t, column] = resolve(columnName);
+            if (column == nullptr)
+            {
+                throw std::invalid_argument("Column not found: " + columnName);
+            }
+            if (result.columns.count(columnName))
+            {
+                continue;
+            }
+            result.addColumn(columnName, column->type);
+            result.columns[columnName].append_rows(*column, rows[t]);
+        }
+        return result;
+    }
+
+private:
+    std::vector<const Table*> tables;
+    std::vector<const ReadView*> views;
+    std::vector<std::shared_ptr<QueryCondition>> trees; // владеют частями parts
+    std::vector<const QueryCondition*> parts;
+
+    // живые строки таблицы t, прошедшие все условия только про неё
+    std::vector<uint32_t> filterTable(size_t t, std::vector<bool>& applied) const
+    {
+        const Table& table = *tables[t];
+        std::shared_ptr<QueryCondition> filter = QueryCondition::compile("");
+        bool first = true;
+        for (size_t p = 0; p < parts.size(); ++p)
+        {
+            if (applied[p] || parts[p]->sources() != uint64_t(1) << t)
+            {
+                continue;
+            }
+            applied[p] = true;
+            // заново привязываем к одной таблице, чтобы работали её индексы
+            std::shared_ptr<QueryCondition> own = parts[p]->bind([this](const std::string& columnName) {
+                return std::make_pair(0, resolve(columnName).second);
+            });
+            unqualify(*own, table.name + ".");
+            filter = first ? own : QueryCondition::conjunction(filter, own);
+            first = false;
+        }
+        if (first)
+        {
+            filter = filter->bind(table.columns);
+        }
+        std::vector<uint32_t> result;
+        table.forEachMatching(*filter, [&result](uint32_t row) {
+            result.push_back(row);
+            return true;
+        }, views[t]);
+        return result;
+    }
+
+    // индексы таблицы ищутся по имени колонки без префикса "table."
+    static void unqualify(QueryCondition& node, const std::string& prefix)
+    {
+        if (node.kind == QueryCondition::Kind::COLUMN && node.column_name.compare(0, prefix.size(), prefix) == 0)
+        {
+            node.column_name.erase(0, prefix.size());
+        }
+        if (node.left)
+        {
+            unqualify(*node.left, prefix);
+        }
+        if (node.right)
+        {
+            unqualify(*node.right, prefix);
+        }
+    }
+
+    // неиспользованное равенство колонки таблицы t с колонкой уже присоединённой таблицы
+    const QueryCondition* equalityBetween(uint64_t joined, size_t t, const std::vector<bool>& applied) const
+    {
+        for (size_t p = 0; p < parts.size(); ++p)
+        {
+            const QueryCondition* part = parts[p];
+            if (applied[p] || !part->is_equi_join())
+            {
+                continue;
+            }
+            int a = part->left->source, b = part->right->source;
+            if ((a == int(t) && (joined >> b & 1)) || (b == int(t) && (joined >> a & 1)))
+            {
+                return part;
+            }
+        }
+        return nullptr;
+    }
+
+    // hash join кортежей (ключ - existing в строках existingRows) со строками addedRows (ключ - added);
+    // хеш-таблица строится по меньшей стороне, NULL ни с чем не совпадает. Большие шаги идут
+    // через RadixJoin (в пуле первой таблицы, если он есть)
+    template <class Emit>
+    void hashStep(const std::vector<uint32_t>& existingRows, size_t count, const Column& existing,
+            const std::vector<uint32_t>& addedRows, const Column& added, const Emit& emit) const
+    {
+        if (count + addedRows.size() >= tables[0]->parallelThreshold)
+        {
+            bool buildAdded = addedRows.size() <= count;
+            RadixJoin::Side existingSide{&existing, &existingRows};
+            RadixJoin::Side addedSide{&added, &addedRows};
+            std::vector<uint32_t> buildPositions, probePositions;
+            RadixJoin::run(tables[0]->pool.get(), buildAdded ? addedSide : existingSide,
+                    buildAdded ? existingSide : addedSide, [](uint32_t, uint32_t) { return true; },
+                    buildPositions, probePositions);
+            for (size_t k = 0; k < buildPositions.size(); ++k)
+            {
+                if (buildAdded)
+                {
+                    emit(probePositions[k], addedRows[buildPositions[k]]);
+                }
+                else
+                {
+                    emit(buildPositions[k], addedRows[probePositions[k]]);
+                }
+            }
+        }
+        else if (existing.type >= 2)
+        {
+            hashStepBy(existingRows, count, existing, addedRows, added, [](const Column& column, uint32_t row) {
+                return column.get_string(row);
+            }, emit);
+        }
+        else
+        {
+            hashStepBy(existingRows, count, existing, addedRows, added, [](const Column& column, uint32_t row) {
+                return column.type == 0 ? column.get_int(row) : int32_t(column.get_bool(row));
+            }, emit);
+        }
+    }
+
+    template <class Key, class Emit>
+    static void hashStepBy(const std::vector<uint32_t>& existingRows, size_t count, const Column& existing,
+            const std::vector<uint32_t>& addedRows, const Column& added, const Key& key, const Emit& emit)
+    {
+        bool buildAdded = addedRows.size() <= count;
+        size_t buildCount = buildAdded ? addedRows.size() : count;
+        size_t probeCount = buildAdded ? count : addedRows.size();
+        auto buildRow = [&](size_t i) { return buildAdded ? addedRows[i] : existingRows[i]; };
+        auto probeRow = [&](size_t i) { return buildAdded ? existingRows[i] : addedRows[i]; };
+        const Column& build = buildAdded ? added : existing;
+        const Column& probe = buildAdded ? existing : added;
+
+        // цепочки позиций с одинаковым ключом: heads[ключ] -> первая, next[позиция] -> следующая
+        const uint32_t none = UINT32_MAX;
+        std::unordered_map<decltype(key(build, 0)), uint32_t> heads;
+        heads.reserve(buildCount);
+        std::vector<uint32_t> next(buildCount, none);
+        for (size_t i = buildCount; i-- > 0;)
+        {
+            uint32_t row = buildRow(i);
+            if (build.is_null(row))
+            {
+                continue;
+            }
+            auto [it, inserted] = heads.try_emplace(key(build, row), i);
+            if (!inserted)
+            {
+                next[i] = it->second;
+                it->second = i;
+            }
+        }
+
+        for (size_t p = 0; p < probeCount; ++p)
+        {
+            uint32_t row = probeRow(p);
+            if (probe.is_null(row))
+            {
+                continue;
+            }
+            auto it = heads.find(key(probe, row));
+            if (it == heads.end())
+            {
+                continue;
+            }
+            for (uint32_t b = it->second; b != none; b = next[b])
+            {
+                if (buildAdded)
+                {
+                    emit(p, addedRows[b]);
+                }
+                else
+                {
+                    emit(b, addedRows[p]);
+                }
+            }
+        }
+    }
+
+    // оставляет кортежи, на которых выполнены все условия ready; возвращает их число
+    size_t filterTuples(std::vector<std::vector<uint32_t>>& rows, uint64_t joined, size_t count,
+            const std::vector<const QueryCondition*>& ready) const
+    {
+        std::vector<uint32_t> tuple(tables.size(), 0);
+        size_t kept = 0;
+        for (size_t k = 0; k < count; ++k)
+        {
+            for (size_t t = 0; t < tables.size(); ++t)
+            {
+                if (joined >> t & 1)
+                {
+                    tuple[t] = rows[t][k];
+                }
+            }
+            bool ok = std::all_of(ready.begin(), ready.end(), [&tuple](const QueryCondition* part) {
+                return part->matches(tuple);
+            });
+            if (!ok)
+            {
+                continue;
+            }
+            for (size_t t = 0; t < tables.size(); ++t)
+            {
+                if (joined >> t & 1)
+                {
+                    rows[t][kept] = rows[t][k];
+                }
+            }
+            ++kept;
+        }
+        for (size_t t = 0; t < tables.size(); ++t)
+        {
+            if (joined >> t & 1)
+            {
+                rows[t].resize(kept);
+            }
+        }
+        return kept;
+    }
+};
+
+#endif // JOIN_H
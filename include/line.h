@@ -1,6 +1,11 @@
+#ifndef LINE_H
+#define LINE_H
+
 #include <unordered_map>
 #include <string>
 #include <memory>
+#include <vector>
+#include <stdexcept>
 
 #include "cells.h"
 
@@ -47,3 +52,4 @@ public:
     }
 };
 
+#endif //LINE_H
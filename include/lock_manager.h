@@ -0,0 +1,125 @@
+#ifndef LOCK_MANAGER_H
+#define LOCK_MANAGER_H
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Блокировки Database для запросов из нескольких потоков:
+//   каталог - набор таблиц: запросы к данным держат его разделяемо, а CREATE TABLE, загрузка базы,
+//             смена пула и контрольная точка - монопольно;
+//   таблицы - по shared_mutex на имя: INSERT/UPDATE/DELETE/CREATE INDEX - монопольно, чтение - разделяемо
+//             (SELECT и курсоры - только на время открытия снимка, дальше читают его без блокировки таблиц).
+// Каталог берётся первым, таблицы одного запроса - по возрастанию имени, поэтому запросы не могут
+// ждать друг друга по кругу. Блокировки не рекурсивные: внутри Guard снова блокировать нельзя
+class LockManager
+{
+public:
+    // блокировки одного запроса; снимаются в деструкторе (таблицы раньше каталога)
+    class Guard
+    {
+    public:
+        Guard() = default;
+        Guard(Guard&&) = default;
+        Guard& operator=(Guard&&) = default;
+
+        // снимает блокировки таблиц, оставляя каталог
+        void releaseTables()
+        {
+            writers.clear();
+            readers.clear();
+        }
+
+    private:
+        friend class LockManager;
+
+        std::shared_lock<std::shared_mutex> catalogShared;
+        std::unique_lock<std::shared_mutex> catalogExclusive;
+        std::vector<std::shared_lock<std::shared_mutex>> readers;
+        std::vector<std::unique_lock<std::shared_mutex>> writers;
+    };
+
+    // изменяющие запросы после последней контрольной точки (для Database::autoCheckpoint)
+    std::atomic<size_t> modifications{0};
+
+    // весь каталог монопольно: других запросов к базе в это время нет
+    Guard exclusive()
+    {
+        Guard guard;
+        guard.catalogExclusive = std::unique_lock<std::shared_mutex>(catalog);
+        return guard;
+    }
+
+    // каталог разделяемо, таблицы reads - разделяемо, writes - монопольно (имя из обоих списков - монопольно)
+    Guard tables(const std::vector<std::string>& reads, const std::vector<std::string>& writes = {})
+    {
+        std::map<std::string, bool> order;
+        for (const std::string& tableName : reads)
+        {
+            order.emplace(tableName, false);
+        }
+        for (const std::string& tableName : writes)
+        {
+            order[tableName] = true;
+        }
+        Guard guard;
+        guard.catalogShared = std::shared_lock<std::shared_mutex>(catalog);
+        for (const auto& [tableName, exclusive] : order)
+        {
+            std::shared_mutex& mutex = table(tableName);
+            if (exclusive)
+            {
+                guard.writers.emplace_back(mutex);
+            }
+            else
+            {
+                guard.readers.emplace_back(mutex);
+            }
+        }
+        return guard;
+    }
+
+    // каталог разделяемо и все таблицы catalog (имя -> таблица) разделяемо
+    template <class Catalog>
+    Guard readAll(const Catalog& tables)
+    {
+        Guard guard;
+        guard.catalogShared = std::shared_lock<std::shared_mutex>(catalog);
+        std::vector<std::string> names;
+        for (const auto& entry : tables)
+        {
+            names.push_back(entry.first);
+        }
+        std::sort(names.begin(), names.end());
+        for (const std::string& tableName : names)
+        {
+            guard.readers.emplace_back(table(tableName));
+        }
+        return guard;
+    }
+
+private:
+    std::shared_mutex catalog;
+    std::mutex registryMutex;
+    std::unordered_map<std::string, std::unique_ptr<std::shared_mutex>> registry;
+
+    // блокировка таблицы по имени; заводится при первом обращении и дальше не удаляется
+    std::shared_mutex& table(const std::string& tableName)
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        std::unique_ptr<std::shared_mutex>& mutex = registry[tableName];
+        if (!mutex)
+        {
+            mutex = std::make_unique<std::shared_mutex>();
+        }
+        return *mutex;
+    }
+};
+
+#endif // LOCK_MANAGER_H
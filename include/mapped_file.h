@@ -0,0 +1,69 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Файл, целиком отображённый в память только для чтения (mmap). Пустой файл - data == nullptr, size == 0
+class MappedFile
+{
+public:
+    const char* data = nullptr;
+    size_t size = 0;
+
+    explicit MappedFile(const std::string& filename)
+    {
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            throw std::runtime_error("Could not open file");
+        }
+        struct stat info;
+        if (::fstat(fd, &info) != 0)
+        {
+            ::close(fd);
+            throw std::runtime_error("Could not open file");
+        }
+        size = size_t(info.st_size);
+        if (size == 0)
+        {
+            ::close(fd);
+            return;
+        }
+        void* mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED)
+        {
+            throw std::runtime_error("Could not map file: " + filename);
+        }
+        // файл читается подряд и целиком: просим ядро читать вперёд
+        ::madvise(mapping, size, MADV_SEQUENTIAL);
+        ::madvise(mapping, size, MADV_WILLNEED);
+        data = static_cast<const char*>(mapping);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile()
+    {
+        if (data != nullptr)
+        {
+            ::munmap(const_cast<char*>(data), size);
+        }
+    }
+
+    std::string_view text() const
+    {
+        return std::string_view(data, size);
+    }
+};
+
+#endif // MAPPED_FILE_H
@@ -0,0 +1,214 @@
+#ifndef MVCC_H
+#define MVCC_H
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <shared_mutex>
+#include <vector>
+
+#include "row_buffer.h"
+
+// Многоверсионность (MVCC). Каждый изменяющий запрос получает у VersionClock номер версии:
+// вставленные им строки помечаются этой версией как созданные, удалённые - как истёкшие, а UPDATE
+// не меняет строку на месте, а дописывает её новую версию и помечает старую истёкшей.
+// Читатель в начале запроса открывает ReadView и дальше видит только строки, созданные и ещё не истёкшие
+// в версиях, подтверждённых к этому моменту, - что бы ни писали в таблицу, пока он читает.
+// Истёкшие строки, которых не видит уже ни один открытый ReadView, убирает Table::collectGarbage
+
+// Что видит один читатель: версии не больше upper, кроме ещё не подтверждённых active,
+// и первые rows строк таблицы (строки дальше дописаны после начала чтения). Из них версии есть
+// у первых versioned (остальные записаны до появления версий); размеры буферов таблицы читатель
+// не смотрит - их меняют пишущие потоки
+struct ReadView
+{
+    uint64_t upper = 0;
+    std::vector<uint64_t> active; // по возрастанию
+    size_t rows = 0;
+    size_t versioned = 0;
+
+    bool sees(uint64_t version) const
+    {
+        return version <= upper && !std::binary_search(active.begin(), active.end(), version);
+    }
+
+    // все версии не больше этой видны читателю
+    uint64_t horizon() const
+    {
+        return active.empty() ? upper : active.front() - 1;
+    }
+};
+
+// Номера версий базы; общий для всех её таблиц, чтобы снимок нескольких таблиц был согласован
+class VersionClock
+{
+public:
+    // версия изменяющего запроса; её изменения никто не видит до commit
+    uint64_t begin()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running.insert(++last);
+        return last;
+    }
+
+    void commit(uint64_t version)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running.erase(version);
+    }
+
+    // открывает снимок (rows заполняет читатель для каждой таблицы);
+    // пока он не закрыт через close, видимые ему версии строк не собираются
+    ReadView open()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ReadView view;
+        view.upper = last;
+        view.active.assign(running.begin(), running.end());
+        pinned.insert(view.horizon());
+        return view;
+    }
+
+    void close(const ReadView& view)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = pinned.find(view.horizon());
+        if (it != pinned.end())
+        {
+            pinned.erase(it);
+        }
+    }
+
+    // версии не больше этой подтверждены и видны всем открытым и будущим снимкам
+    uint64_t horizon() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        uint64_t result = running.empty() ? last : *running.begin() - 1;
+        return pinned.empty() ? result : std::min(result, *pinned.begin());
+    }
+
+    // открытые снимки
+    size_t readers() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return pinned.size();
+    }
+
+private:
+    mutable std::mutex mutex;
+    uint64_t last = 0;
+    std::set<uint64_t> running;
+    std::multiset<uint64_t> pinned; // horizon() открытых снимков
+};
+
+// Версии строк таблицы: created[i] - версия, в которой появилась строка i, expired[i] - в которой её
+// удалили или заменили (kNever - ещё нет). Пусты, пока таблица не получила VersionClock: тогда все
+// строки - версии 0 и живы. Читатели снимков обращаются к ним, пока в таблицу пишут, поэтому элементы
+// читаются и пишутся атомарно, а буферы растут только в Table::reserveRows
+struct RowVersions
+{
+    static constexpr uint64_t kNever = UINT64_MAX;
+
+    RowBuffer<uint64_t> created;
+    RowBuffer<uint64_t> expired;
+
+    bool empty() const
+    {
+        return created.empty();
+    }
+
+    uint64_t createdAt(size_t row) const
+    {
+        return __atomic_load_n(&created[row], __ATOMIC_RELAXED);
+    }
+
+    uint64_t expiredAt(size_t row) const
+    {
+        return __atomic_load_n(&expired[row], __ATOMIC_RELAXED);
+    }
+
+    void expire(size_t row, uint64_t version)
+    {
+        __atomic_store_n(&expired[row], version, __ATOMIC_RELAXED);
+    }
+
+    // строка есть в последнем состоянии таблицы
+    bool current(size_t row) const
+    {
+        return row >= expired.size() || expiredAt(row) == kNever;
+    }
+
+    bool visible(size_t row, const ReadView& view) const
+    {
+        return row >= view.versioned || (view.sees(createdAt(row)) && !view.sees(expiredAt(row)));
+    }
+
+    // строки [size, rows), записанные до появления версий, - версии 0
+    void cover(size_t rows)
+    {
+        created.resize(rows, 0);
+        expired.resize(rows, kNever);
+    }
+
+    // в пределах зарезервированного (reserve), без перевыделения
+    void append(size_t rows, uint64_t version)
+    {
+        size_t begin = created.size();
+        created.resize(begin + rows);
+        expired.resize(begin + rows);
+        for (size_t row = begin; row < begin + rows; ++row)
+        {
+            __atomic_store_n(&created[row], version, __ATOMIC_RELAXED);
+            expire(row, kNever);
+        }
+    }
+
+    void reserve(size_t rows)
+    {
+        created.reserve(rows);
+        expired.reserve(rows);
+    }
+
+    void share(std::vector<std::shared_ptr<const void>>& kept) const
+    {
+        kept.push_back(created.share());
+        kept.push_back(expired.share());
+    }
+
+    // оставляет версии строк rows (по возрастанию), как Column::retain_rows
+    void retain(const std::vector<uint32_t>& rows)
+    {
+        if (empty())
+        {
+            return;
+        }
+        RowBuffer<uint64_t> keptCreated, keptExpired;
+        keptCreated.reserve(rows.size());
+        keptExpired.reserve(rows.size());
+        for (uint32_t row : rows)
+        {
+            keptCreated.push_back(created[row]);
+            keptExpired.push_back(expired[row]);
+        }
+        created = std::move(keptCreated);
+        expired = std::move(keptExpired);
+    }
+};
+
+// Защёлки таблицы для читателей снимков (см. Table::holdRows): у копии таблицы - свои
+struct TableLatches
+{
+    std::shared_mutex growth;  // читатели держат разделяемо; монопольно - compact и освобождение прежних буферов
+    std::shared_mutex indexes; // поиск по индексам - разделяемо, их изменение - монопольно
+
+    TableLatches() = default;
+    TableLatches(const TableLatches&) {}
+    TableLatches& operator=(const TableLatches&)
+    {
+        return *this;
+    }
+};
+
+#endif // MVCC_H
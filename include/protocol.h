@@ -0,0 +1,297 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "column.h"
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "The wire protocol copies numbers in host byte order");
+
+// Двоичный протокол memorydb-server поверх потока байт (TCP или Unix-сокет). Всё передаётся кадрами:
+//   длина содержимого (u32), вид кадра (u8), содержимое; числа - little-endian. И числа, и буферы
+//   колонок копируются как лежат в памяти, поэтому протокол собирается только на little-endian машинах.
+// Клиент шлёт кадры QUERY с текстом запроса и может не ждать ответа на предыдущий (конвейер).
+// Сервер отвечает на запросы строго по порядку, на каждый - одним из:
+//   HEADER, ROWS..., DONE  - SELECT: колонки результата, строки пачками, DONE - число строк (u64);
+//   DONE                   - изменяющий запрос: affected_rows (u64);
+//   ERROR                  - текст ошибки.
+// HEADER: число колонок (u32), по каждой - код типа (u8, как Column::type) и имя (u32 длина, байты).
+// ROWS: число строк n (u32), затем колонки в порядке HEADER, каждая целиком, как буферы Column:
+//   маска NULL - u8 0 (NULL нет) или 1 и (n + 63) / 64 слов u64;
+//   int32 - n чисел i32; bool - (n + 63) / 64 слов u64 по 64 значения;
+//   string/bytes - n длин u32, затем сами значения подряд.
+// Значения NULL в данных - нули и пустые строки
+enum class FrameKind : uint8_t
+{
+    QUERY = 'Q',
+    HEADER = 'H',
+    ROWS = 'R',
+    DONE = 'D',
+    ERROR = 'E'
+};
+
+class Protocol
+{
+public:
+    static constexpr size_t kFrameHeaderSize = sizeof(uint32_t) + sizeof(uint8_t);
+    // больший кадр считается ошибкой протокола
+    static constexpr uint32_t kMaxFrameSize = 64u << 20;
+
+    static void appendFrame(std::string& out, FrameKind kind, std::string_view payload)
+    {
+        if (payload.size() > kMaxFrameSize)
+        {
+            throw std::invalid_argument("Frame too large");
+        }
+        put(out, uint32_t(payload.size()));
+        out += char(kind);
+        out.append(payload.data(), payload.size());
+    }
+
+    // Кадр из начала buffer[offset, ...): при успехе offset сдвигается за него.
+    // false - кадр пришёл не целиком; слишком длинный кадр - runtime_error
+    static bool nextFrame(std::string_view buffer, size_t& offset, FrameKind& kind, std::string_view& payload)
+    {
+        if (buffer.size() - offset < kFrameHeaderSize)
+        {
+            return false;
+        }
+        uint32_t size = get<uint32_t>(buffer.data() + offset);
+        if (size > kMaxFrameSize)
+        {
+            throw std::runtime_error("Frame too large");
+        }
+        if (buffer.size() - offset - kFrameHeaderSize < size)
+        {
+            return false;
+        }
+        kind = FrameKind(uint8_t(buffer[offset + sizeof(uint32_t)]));
+        payload = buffer.substr(offset + kFrameHeaderSize, size);
+        offset += kFrameHeaderSize + size;
+        return true;
+    }
+
+    static void appendHeader(std::string& out, const std::vector<std::string>& names, const std::vector<int>& types)
+    {
+        size_t start = beginFrame(out);
+        put(out, uint32_t(names.size()));
+        for (size_t k = 0; k < names.size(); ++k)
+        {
+            put(out, uint8_t(types[k]));
+            put(out, uint32_t(names[k].size()));
+            out += names[k];
+        }
+        endFrame(out, start, FrameKind::HEADER);
+    }
+
+    static void readHeader(std::string_view payload, std::vector<std::string>& names, std::vector<int>& types)
+    {
+        Reader reader{payload.data(), payload.data() + payload.size()};
+        uint32_t count = reader.value<uint32_t>();
+        names.clear();
+        types.clear();
+        for (uint32_t k = 0; k < count; ++k)
+        {
+            uint8_t type = reader.value<uint8_t>();
+            if (type > 3)
+            {
+                throw std::runtime_error("Unknown column type in frame");
+            }
+            types.push_back(type);
+            uint32_t size = reader.value<uint32_t>();
+            names.emplace_back(reader.bytes(size), size);
+        }
+        reader.finish();
+    }
+
+    // строки [from, to) колонок результата одним кадром ROWS
+    static void appendRows(std::string& out, const std::vector<const Column*>& columns, size_t from, size_t to)
+    {
+        size_t start = beginFrame(out);
+        size_t rows = to - from;
+        put(out, uint32_t(rows));
+        for (const Column* column : columns)
+        {
+            put(out, uint8_t(column->nulls.empty() ? 0 : 1));
+            if (!column->nulls.empty())
+            {
+                putBits(out, column->nulls, from, rows);
+            }
+            if (column->type == 0)
+            {
+                out.append(reinterpret_cast<const char*>(column->ints.data() + from), rows * sizeof(int32_t));
+            }
+            else if (column->type == 1)
+            {
+                putBits(out, column->bools, from, rows);
+            }
+            else
+            {
+                out.append(reinterpret_cast<const char*>(column->str_lengths.data() + from), rows * sizeof(uint32_t));
+                for (size_t row = from; row < to; ++row)
+                {
+                    out.append(column->blob.data() + column->str_offsets[row], column->str_lengths[row]);
+                }
+            }
+        }
+        if (out.size() - start - kFrameHeaderSize > kMaxFrameSize)
+        {
+            out.resize(start);
+            throw std::invalid_argument("Frame too large");
+        }
+        endFrame(out, start, FrameKind::ROWS);
+    }
+
+    // колонки пачки ROWS с типами из HEADER; испорченный кадр - runtime_error
+    static std::vector<Column> readRows(std::string_view payload, const std::vector<int>& types)
+    {
+        Reader reader{payload.data(), payload.data() + payload.size()};
+        size_t rows = reader.value<uint32_t>();
+        size_t words = (rows + 63) / 64;
+        std::vector<Column> columns;
+        for (int type : types)
+        {
+            Column column(type);
+            if (reader.value<uint8_t>() != 0)
+            {
+                reader.fill(column.nulls, words);
+            }
+            if (type == 0)
+            {
+                reader.fill(column.ints, rows);
+            }
+            else if (type == 1)
+            {
+                reader.fill(column.bools, words);
+            }
+            else
+            {
+                reader.fill(column.str_lengths, rows);
+                column.str_offsets.resize(rows);
+                uint64_t bytes = 0;
+                for (size_t row = 0; row < rows; ++row)
+                {
+                    column.str_offsets[row] = bytes;
+                    bytes += column.str_lengths[row];
+                }
+                if (bytes > reader.left())
+                {
+                    throw std::runtime_error("Malformed frame");
+                }
+                column.blob.assign(reader.bytes(bytes), bytes);
+            }
+            column.adopt_buffers(rows);
+            columns.push_back(std::move(column));
+        }
+        reader.finish();
+        return columns;
+    }
+
+    template <class T>
+    static void put(std::string& out, T number)
+    {
+        out.append(reinterpret_cast<const char*>(&number), sizeof(number));
+    }
+
+    template <class T>
+    static T get(const char* data)
+    {
+        T number;
+        std::memcpy(&number, data, sizeof(number));
+        return number;
+    }
+
+private:
+    // последовательное чтение содержимого кадра с проверкой границ
+    struct Reader
+    {
+        const char* position;
+        const char* end;
+
+        size_t left() const
+        {
+            return size_t(end - position);
+        }
+
+        const char* bytes(size_t size)
+        {
+            if (size > left())
+            {
+                throw std::runtime_error("Malformed frame");
+            }
+            const char* data = position;
+            position += size;
+            return data;
+        }
+
+        template <class T>
+        T value()
+        {
+            return get<T>(bytes(sizeof(T)));
+        }
+
+        template <class T>
+        void fill(RowBuffer<T>& buffer, size_t count)
+        {
+            if (count > left() / sizeof(T))
+            {
+                throw std::runtime_error("Malformed frame");
+            }
+            buffer.resize(count);
+            if (count != 0)
+            {
+                std::memcpy(buffer.data(), bytes(count * sizeof(T)), count * sizeof(T));
+            }
+        }
+
+        void finish() const
+        {
+            if (position != end)
+            {
+                throw std::runtime_error("Malformed frame");
+            }
+        }
+    };
+
+    // кадр пишется сразу в out, длина проставляется в endFrame
+    static size_t beginFrame(std::string& out)
+    {
+        size_t start = out.size();
+        out.append(kFrameHeaderSize, '\0');
+        return start;
+    }
+
+    static void endFrame(std::string& out, size_t start, FrameKind kind)
+    {
+        uint32_t size = uint32_t(out.size() - start - kFrameHeaderSize);
+        std::memcpy(&out[start], &size, sizeof(size));
+        out[start + sizeof(uint32_t)] = char(kind);
+    }
+
+    // биты [from, from + count) маски по 64 в слове; хвост последнего слова обнулён
+    static void putBits(std::string& out, const RowBuffer<uint64_t>& bits, size_t from, size_t count)
+    {
+        size_t shift = from & 63;
+        for (size_t bit = 0; bit < count; bit += 64)
+        {
+            size_t word = (from + bit) >> 6;
+            uint64_t value = bits[word] >> shift;
+            if (shift != 0 && word + 1 < bits.size())
+            {
+                value |= bits[word + 1] << (64 - shift);
+            }
+            if (count - bit < 64)
+            {
+                value &= (uint64_t(1) << (count - bit)) - 1;
+            }
+            put(out, value);
+        }
+    }
+};
+
+#endif // PROTOCOL_H
@@ -5,6 +5,7 @@
 #include <map>
 #include <iostream>
 #include <memory>
+#include <vector>
 
 class Query {
 public:
@@ -25,12 +26,29 @@ public:
             : table1(t1), table2(t2), condition(cond) {}
     };
 
+    // агрегатная функция в списке SELECT: SUM(total) -> {"sum", "total", "SUM(total)"}
+    struct AggregateSpec {
+        std::string function; // count, sum, min, max, avg
+        std::string column;   // "*" для COUNT(*)
+        std::string name;     // имя колонки результата
+
+        AggregateSpec() = default;
+        AggregateSpec(const std::string& fn, const std::string& col, const std::string& nm)
+            : function(fn), column(col), name(nm) {}
+    };
+
 class SelectQuery : public Query {
 public:
     std::vector<std::string> columns;
     std::string table;
     std::vector<JoinClause> joins;
     std::string where_conditions;
+    std::vector<AggregateSpec> aggregates;
+    std::vector<std::string> group_by;
+    std::string order_by;      // пусто - без сортировки
+    bool order_desc = false;
+    long long limit = -1;      // -1 - без ограничения
+    long long offset = 0;
 
     SelectQuery() = default;
     SelectQuery(std::unique_ptr<Query> query) {
@@ -51,6 +69,28 @@ public:
         where_conditions = condition;
     }
 
+    void add_aggregate(const std::string& function, const std::string& column, const std::string& name) {
+        aggregates.emplace_back(function, column, name);
+    }
+
+    void set_group_by(const std::vector<std::string>& cols) {
+        group_by = cols;
+    }
+
+    bool is_aggregate() const {
+        return !aggregates.empty() || !group_by.empty();
+    }
+
+    void set_order(const std::string& column, bool descending) {
+        order_by = column;
+        order_desc = descending;
+    }
+
+    void set_limit(long long count, long long skip) {
+        limit = count;
+        offset = skip;
+    }
+
     void set_table(const std::string& tbl) override {
         table = tbl;
     }
@@ -75,6 +115,19 @@ public:
         if (!where_conditions.empty()) {
             std::cout << "Where Conditions: " << where_conditions << "\n";
         }
+        if (!group_by.empty()) {
+            std::cout << "Group By: ";
+            for (const auto& col : group_by) {
+                std::cout << col << " ";
+            }
+            std::cout << "\n";
+        }
+        if (!order_by.empty()) {
+            std::cout << "Order By: " << order_by << (order_desc ? " DESC" : " ASC") << "\n";
+        }
+        if (limit >= 0) {
+            std::cout << "Limit: " << limit << " Offset: " << offset << "\n";
+        }
     }
 };
 
@@ -180,6 +233,7 @@ class CreateQuery : public Query {
 public:
     std::string table;
     std::vector<std::pair<std::string, int>> columns;
+    std::map<std::string, std::vector<std::string>> attributes; // колонка -> key / unique / autoincrement
 
     CreateQuery() = default;
     CreateQuery(std::unique_ptr<Query> base_query) {
@@ -196,6 +250,10 @@ public:
         columns = cols;
     }
 
+    void set_attributes(const std::map<std::string, std::vector<std::string>>& attrs) {
+        attributes = attrs;
+    }
+
     void set_where(const std::string&) override {}
 
     void print() const override {
@@ -203,9 +261,82 @@ public:
         std::cout << "Table: " << table << "\n";
         std::cout << "Columns:\n";
         for (const auto& [name, type] : columns) {
-            std::cout << "  " << name << " : " << type << "\n";
+            std::cout << "  " << name << " : " << type;
+            auto it = attributes.find(name);
+            if (it != attributes.end()) {
+                for (const auto& attribute : it->second) {
+                    std::cout << " " << attribute;
+                }
+            }
+            std::cout << "\n";
         }
     }
 };
 
+class CreateIndexQuery : public Query {
+public:
+    std::string table;
+    std::string name;
+    std::string column;
+    bool ordered = false; // B+-дерево вместо хеш-индекса
+
+    CreateIndexQuery() = default;
+    CreateIndexQuery(std::unique_ptr<Query> base_query) {
+        *this = dynamic_cast<CreateIndexQuery&>(*base_query);
+    }
+
+    std::string get_type() const override { return "CREATE INDEX"; }
+
+    void set_table(const std::string& tbl) override {
+        table = tbl;
+    }
+
+    void set_column(const std::string& col) {
+        column = col;
+    }
+
+    void set_name(const std::string& index_name) {
+        name = index_name;
+    }
+
+    void set_ordered(bool is_ordered) {
+        ordered = is_ordered;
+    }
+
+    void set_where(const std::string&) override {}
+
+    void print() const override {
+        std::cout << "Query Type: CREATE INDEX\n";
+        std::cout << "Table: " << table << "\n";
+        std::cout << "Column: " << column << "\n";
+        std::cout << "Kind: " << (ordered ? "ordered" : "unordered") << "\n";
+        if (!name.empty()) {
+            std::cout << "Name: " << name << "\n";
+        }
+    }
+};
+
+// BEGIN / COMMIT / ROLLBACK; изменяющие запросы между BEGIN и COMMIT применяются вместе (см. transaction.h)
+class TransactionQuery : public Query {
+public:
+    enum class Action { BEGIN, COMMIT, ROLLBACK };
+
+    Action action = Action::BEGIN;
+
+    TransactionQuery() = default;
+    TransactionQuery(Action act) : action(act) {}
+
+    std::string get_type() const override {
+        return action == Action::BEGIN ? "BEGIN" : action == Action::COMMIT ? "COMMIT" : "ROLLBACK";
+    }
+
+    void set_table(const std::string&) override {}
+
+    void set_where(const std::string&) override {}
+
+    void print() const override {
+        std::cout << "Query Type: " << get_type() << "\n";
+    }
+};
+
 #endif // QUERY_H
@@ -3,18 +3,24 @@
 
 
 #include <string>
+#include <string_view>
 #include <functional>
+#include <unordered_map>
 #include <utility>
 #include <memory>
-#include <stack>
-#include <sstream>
+#include <stdexcept>
+#include <vector>
+#include <algorithm>
 
-//#include "column.h"
-//#include "cells.h"
+#include "conditional_execute.h"
+#include "filter_kernels.h"
+#include "column.h"
+#include "line.h"
 
+// Условие WHERE/ON компилируется один раз в дерево QueryCondition:
+// литералы сразу приводятся к типам колонок, а после bind ссылки на колонки
+// указывают прямо на Column, так что на каждую строку ничего не парсится и не аллоцируется
 
-class QueryCondition;
-/*
 enum class CompareOperator {
     DEFAULT,
     EQUAL,
@@ -39,146 +45,760 @@ enum class MathOperator {
     DIVIDE,
     MOD
 };
-std::unordered_map<std::string, int> priority = {
-        {"+", 0},
-        {"-", 0},
-        {"*", 0},
-        {"/", 0},
-        {"%", 0},
-        {"=", 1},
-        {"!=", 1},
-        {">", 1},
-        {"<", 1},
-        {">=", 1},
-        {"<=", 1},
-        {"NOT", 2},
-        {"AND", 3},
-        { "OR", 4},
-        {"(", 5},
-        {")", 5}
-};
-std::unordered_map<std::string, CompareOperator> compare_str_to_enum = {
-        {"=", CompareOperator::EQUAL},
-        {"!=", CompareOperator::NOT_EQUAL},
-        {">", CompareOperator::GREATER_THAN},
-        {"<", CompareOperator::LESS_THAN},
-        {">=", CompareOperator::GREATER_EQUAL},
-        {"<=", CompareOperator::LESS_EQUAL}
-};
-std::unordered_map<std::string, LogicalOperator> logical_str_to_enum = {
-        {"AND", LogicalOperator::AND},
-        {"OR", LogicalOperator::OR},
-        {"NOT", LogicalOperator::NOT}
-};
-std::unordered_map<std::string, MathOperator> math_str_to_enum = {
-        {"+", MathOperator::PLUS},
-        {"-", MathOperator::MINUS},
-        {"*", MathOperator::MULTIPLY},
-        {"/", MathOperator::DIVIDE},
-        {"%", MathOperator::MOD}
+
+// значение узла; строки не копируются, а смотрят в колонку или в литерал
+struct Datum {
+    int type = -1; // -1 - NULL, остальные как у колонок: 0 - int32, 1 - bool, 2 - string, 3 - bytes
+    int32_t number = 0;
+    std::string_view text;
+
+    static Datum from_column(const Column& column, size_t row) {
+        Datum datum;
+        if (column.is_null(row)) {
+            return datum;
+        }
+        datum.type = column.type;
+        if (column.type == 0) {
+            datum.number = column.get_int(row);
+        } else if (column.type == 1) {
+            datum.number = column.get_bool(row);
+        } else {
+            datum.text = column.get_string(row);
+        }
+        return datum;
+    }
+
+    static Datum from_cell(const std::shared_ptr<Cell>& cell) {
+        Datum datum;
+        if (cell == nullptr) {
+            return datum;
+        }
+        datum.type = Column::cell_type(*cell);
+        if (datum.type == 0) {
+            datum.number = static_cast<const CellInt&>(*cell).data;
+        } else if (datum.type == 1) {
+            datum.number = static_cast<const CellBool&>(*cell).data;
+        } else if (datum.type == 2) {
+            datum.text = static_cast<const CellString&>(*cell).data;
+        } else if (datum.type == 3) {
+            datum.text = static_cast<const CellBytes&>(*cell).data;
+        } else {
+            throw std::invalid_argument("Unsupported cell type in condition");
+        }
+        return datum;
+    }
+
+    bool is_number() const { return type == 0 || type == 1; }
+    bool is_text() const { return type == 2 || type == 3; }
+
+    bool truthy() const {
+        if (is_number()) {
+            return number != 0;
+        }
+        if (type == 2) {
+            return !text.empty();
+        }
+        if (type == 3) {
+            return text.find('1') != std::string_view::npos;
+        }
+        return false;
+    }
 };
-bool isLogicalOperator(const std::string &token) {
-    return token == "AND" || token == "OR" || token == "NOT";
-}
-bool isCompareOperator(const std::string &token) {
-    return token == "=" || token == "!=" || token == ">" || token == "<" || token == ">=" || token == "<=";
-}
-bool isMathOperator(const std::string &token) {
-    return token == "+" || token == "-" || token == "*" || token == "/" || token == "%";
-}
 
 class QueryCondition {
 public:
-    std::string column_name; //если сейчас в condition название колонки
-    Value value; //если сейчас в condition значение
-    LogicalOperator logical_op = LogicalOperator::DEFAULT; //если сейчас в condition логический оператор
-    CompareOperator op = CompareOperator::DEFAULT; //если сейчас в condition оператор сравнения
-    MathOperator math_op = MathOperator::DEFAULT; //если сейчас в condition математический оператор
-    std::shared_ptr<QueryCondition> left = nullptr; //если сейчас в condition левая часть
-    std::shared_ptr<QueryCondition> right = nullptr; //если сейчас в condition правая часть
-
-    QueryCondition() = default;
-    explicit QueryCondition(LogicalOperator logical_op) : logical_op(logical_op) {};
-    explicit QueryCondition(CompareOperator op) : op(op) {};
-    explicit QueryCondition(MathOperator math_op) : math_op(math_op) {};
-    QueryCondition(const std::string& val, const std::string& position) {
-        if (position == "left") {
-            column_name = val;
-        } else if (position == "right") {
-            value = Value(val);
+    enum class Kind {
+        CONSTANT,
+        COLUMN,
+        COMPARE,
+        LOGICAL,
+        MATH
+    };
+
+    Kind kind = Kind::CONSTANT;
+
+    std::string column_name;        // для COLUMN
+    int source = 0;                 // для COLUMN: номер таблицы в join (0 - левая, 1 - правая)
+    const Column* column = nullptr; // для COLUMN: заполняется в bind
+
+    int value_type = 1;             // для CONSTANT
+    int32_t number = 1;
+    std::string literal;
+
+    CompareOperator op = CompareOperator::DEFAULT;
+    LogicalOperator logical_op = LogicalOperator::DEFAULT;
+    MathOperator math_op = MathOperator::DEFAULT;
+    std::shared_ptr<QueryCondition> left = nullptr;
+    std::shared_ptr<QueryCondition> right = nullptr;
+
+    // Пустое условие всегда истинно
+    static std::shared_ptr<QueryCondition> compile(const std::string& condition);
+
+    // копия дерева, в которой колонки привязаны через resolve(имя) -> {номер таблицы, колонка}
+    std::shared_ptr<QueryCondition> bind(const std::function<std::pair<int, const Column*>(const std::string&)>& resolve) const {
+        auto node = std::make_shared<QueryCondition>(*this);
+        if (kind == Kind::COLUMN) {
+            auto [src, col] = resolve(column_name);
+            if (col == nullptr) {
+                throw std::invalid_argument("Column not found: " + column_name);
+            }
+            node->source = src;
+            node->column = col;
         }
+        if (left) {
+            node->left = left->bind(resolve);
+        }
+        if (right) {
+            node->right = right->bind(resolve);
+        }
+        node->check_types();
+        return node;
     }
-};
 
-std::vector<std::string> tokenize(const std::string &tokens_in_str) {
-    std::vector<std::string> tokens;
-    std::istringstream iss(tokens_in_str);
-    for (std::string s; iss >> s;) {
-        tokens.push_back(s);
+    std::shared_ptr<QueryCondition> bind(const std::unordered_map<std::string, Column>& columns) const {
+        return bind([&columns](const std::string& name) -> std::pair<int, const Column*> {
+            auto it = columns.find(name);
+            return {0, it == columns.end() ? nullptr : &it->second};
+        });
+    }
+
+    // fetch(узел COLUMN) -> Datum
+    template <class Fetch>
+    Datum evaluate(const Fetch& fetch) const {
+        switch (kind) {
+            case Kind::CONSTANT: {
+                Datum datum;
+                datum.type = value_type;
+                datum.number = number;
+                datum.text = literal;
+                return datum;
+            }
+            case Kind::COLUMN:
+                return fetch(*this);
+            case Kind::COMPARE:
+                return boolean(compare(left->evaluate(fetch), right->evaluate(fetch)));
+            case Kind::LOGICAL: {
+                bool lhs = left->evaluate(fetch).truthy();
+                if (logical_op == LogicalOperator::NOT) {
+                    return boolean(!lhs);
+                }
+                if (logical_op == LogicalOperator::AND && !lhs) {
+                    return boolean(false);
+                }
+                if (logical_op == LogicalOperator::OR && lhs) {
+                    return boolean(true);
+                }
+                return boolean(right->evaluate(fetch).truthy());
+            }
+            case Kind::MATH:
+                return arithmetic(left->evaluate(fetch), right->evaluate(fetch));
+        }
+        return Datum();
+    }
+
+    // для дерева, привязанного к одной таблице
+    bool matches(size_t row) const {
+        return evaluate([row](const QueryCondition& node) {
+            return Datum::from_column(*node.column, row);
+        }).truthy();
+    }
+
+    // для дерева, привязанного к паре таблиц join
+    bool matches(size_t row1, size_t row2) const {
+        return evaluate([row1, row2](const QueryCondition& node) {
+            return Datum::from_column(*node.column, node.source == 0 ? row1 : row2);
+        }).truthy();
+    }
+
+    // Пакетная проверка для дерева, привязанного к одной таблице: из rows[0..count) на месте и в том же
+    // порядке остаются подходящие строки (вектор выбора), возвращается их число.
+    // AND сужает вектор для правой части, OR проверяет правую часть только на отвергнутых левой строках,
+    // сравнение колонки int32/bool с константой - цикл без ветвлений прямо по буферу колонки
+    size_t select(uint32_t* rows, size_t count) const {
+        if (count == 0) {
+            return 0;
+        }
+        if (kind == Kind::CONSTANT) {
+            return constant_value().truthy() ? count : 0;
+        }
+        if (kind == Kind::LOGICAL && logical_op == LogicalOperator::AND) {
+            return right->select(rows, left->select(rows, count));
+        }
+        if (kind == Kind::LOGICAL && logical_op == LogicalOperator::OR) {
+            return select_either(rows, count);
+        }
+        const QueryCondition* col;
+        const QueryCondition* value;
+        CompareOperator cmp;
+        if (is_column_vs_constant(col, value, cmp) && col->column->type <= 1 &&
+            (value->value_type == 0 || value->value_type == 1)) {
+            return select_compare(*col->column, value->number, cmp, rows, count);
+        }
+        if (kind == Kind::COLUMN && column->type <= 1) {
+            return select_compare(*column, 0, CompareOperator::NOT_EQUAL, rows, count);
+        }
+        size_t kept = 0;
+        for (size_t i = 0; i < count; ++i) {
+            uint32_t row = rows[i];
+            rows[kept] = row;
+            kept += matches(row);
+        }
+        return kept;
+    }
+
+    // сколько подряд идущих строк за раз обрабатывает refine
+    static constexpr size_t kBlockRows = 1024;
+
+    // Пакетная проверка подряд идущих строк [begin, begin + count) по битовой маске (begin кратен 64,
+    // count не больше kBlockRows): в words остаются только биты строк, подходящих под условие.
+    // AND/OR/NOT - операции над словами маски, сравнение колонки int32 с константой - SIMD-ядро
+    // FilterKernels, bool-колонки - операции над её битами; прочие узлы проверяются по одной строке,
+    // но только для ещё не отброшенных строк
+    void refine(size_t begin, size_t count, uint64_t* words) const {
+        size_t n = (count + 63) / 64;
+        if (kind == Kind::CONSTANT) {
+            if (!constant_value().truthy()) {
+                std::fill(words, words + n, 0);
+            }
+            return;
+        }
+        if (kind == Kind::LOGICAL) {
+            uint64_t saved[kBlockRows / 64];
+            std::copy(words, words + n, saved);
+            left->refine(begin, count, logical_op == LogicalOperator::NOT ? saved : words);
+            if (logical_op == LogicalOperator::NOT) {
+                for (size_t w = 0; w < n; ++w) {
+                    words[w] &= ~saved[w];
+                }
+            } else if (logical_op == LogicalOperator::AND) {
+                if (std::any_of(words, words + n, [](uint64_t word) { return word != 0; })) {
+                    right->refine(begin, count, words);
+                }
+            } else {
+                // OR: правая часть - только на строках, которые отбросила левая
+                for (size_t w = 0; w < n; ++w) {
+                    saved[w] &= ~words[w];
+                }
+                right->refine(begin, count, saved);
+                for (size_t w = 0; w < n; ++w) {
+                    words[w] |= saved[w];
+                }
+            }
+            return;
+        }
+        const QueryCondition* col;
+        const QueryCondition* value;
+        CompareOperator cmp;
+        if (is_column_vs_constant(col, value, cmp) && col->column->type <= 1 &&
+            (value->value_type == 0 || value->value_type == 1)) {
+            refine_compare(*col->column, value->number, cmp, begin, count, words);
+            return;
+        }
+        if (kind == Kind::COLUMN && column->type <= 1) {
+            refine_compare(*column, 0, CompareOperator::NOT_EQUAL, begin, count, words);
+            return;
+        }
+        for (size_t w = 0; w < n; ++w) {
+            for (uint64_t bits = words[w]; bits != 0; bits &= bits - 1) {
+                size_t row = begin + w * 64 + __builtin_ctzll(bits);
+                if (!matches(row)) {
+                    words[w] &= ~(uint64_t(1) << (row & 63));
+                }
+            }
+        }
+    }
+
+    // для дерева, привязанного к нескольким таблицам: строка таблицы source - rows[source]
+    bool matches(const std::vector<uint32_t>& rows) const {
+        return evaluate([&rows](const QueryCondition& node) {
+            return Datum::from_column(*node.column, rows[node.source]);
+        }).truthy();
+    }
+
+    // битовая маска таблиц (source), на колонки которых ссылается привязанное дерево
+    uint64_t sources() const {
+        uint64_t mask = kind == Kind::COLUMN ? uint64_t(1) << source : 0;
+        if (left) {
+            mask |= left->sources();
+        }
+        if (right) {
+            mask |= right->sources();
+        }
+        return mask;
+    }
+
+    static std::shared_ptr<QueryCondition> conjunction(std::shared_ptr<QueryCondition> lhs, std::shared_ptr<QueryCondition> rhs) {
+        auto node = std::make_shared<QueryCondition>();
+        node->kind = Kind::LOGICAL;
+        node->logical_op = LogicalOperator::AND;
+        node->left = std::move(lhs);
+        node->right = std::move(rhs);
+        return node;
     }
-    return tokens;
-}
 
-std::stack<std::string> get_polish_notation(const std::string &condition_str) {
-    std::vector<std::string> tokens = tokenize(condition_str);
-    std::stack<std::string> polish_notation;
-    std::stack<std::string> operations;
-    for (const auto &token: tokens) {
-        if (isLogicalOperator(token) || isCompareOperator(token) || isMathOperator(token)) {
-            while (!operations.empty() && priority[operations.top()] <= priority[token]) {
-                polish_notation.push(operations.top());
-                operations.pop();
-            }
-            operations.push(token);
-        } else if (token == "(") {
-            operations.push(token);
-        } else if (token == ")") {
-            while (operations.top() != "(") {
-                polish_notation.push(operations.top());
-                operations.pop();
-            }
-            operations.pop();
+    // для непривязанного дерева: колонки ищутся в Line по имени
+    bool matches(const Line& line) const {
+        return evaluate([&line](const QueryCondition& node) {
+            return Datum::from_cell(line.cells.at(node.column_name));
+        }).truthy();
+    }
+
+    // для непривязанного дерева join: колонка ищется сначала в line1, потом в line2
+    bool matches(const Line& line1, const Line& line2) const {
+        return evaluate([&line1, &line2](const QueryCondition& node) {
+            auto it = line1.cells.find(node.column_name);
+            return Datum::from_cell(it != line1.cells.end() ? it->second : line2.cells.at(node.column_name));
+        }).truthy();
+    }
+
+    // условия, соединённые верхнеуровневыми AND
+    std::vector<const QueryCondition*> conjuncts() const {
+        if (kind == Kind::LOGICAL && logical_op == LogicalOperator::AND) {
+            std::vector<const QueryCondition*> result = left->conjuncts();
+            std::vector<const QueryCondition*> rest = right->conjuncts();
+            result.insert(result.end(), rest.begin(), rest.end());
+            return result;
+        }
+        return {this};
+    }
+
+    // узел вида "колонка op константа" или "константа op колонка"; оператор разворачивается так,
+    // как если бы колонка стояла слева (5 < id -> id > 5)
+    bool is_column_vs_constant(const QueryCondition*& col, const QueryCondition*& value, CompareOperator& cmp) const {
+        if (kind != Kind::COMPARE) {
+            return false;
+        }
+        cmp = op;
+        if (left->kind == Kind::COLUMN && right->kind == Kind::CONSTANT) {
+            col = left.get();
+            value = right.get();
+            return true;
+        }
+        if (left->kind == Kind::CONSTANT && right->kind == Kind::COLUMN) {
+            col = right.get();
+            value = left.get();
+            switch (op) {
+                case CompareOperator::GREATER_THAN: cmp = CompareOperator::LESS_THAN; break;
+                case CompareOperator::LESS_THAN: cmp = CompareOperator::GREATER_THAN; break;
+                case CompareOperator::GREATER_EQUAL: cmp = CompareOperator::LESS_EQUAL; break;
+                case CompareOperator::LESS_EQUAL: cmp = CompareOperator::GREATER_EQUAL; break;
+                default: break;
+            }
+            return true;
+        }
+        return false;
+    }
+
+    // значение узла CONSTANT
+    Datum constant_value() const {
+        return evaluate([](const QueryCondition&) { return Datum(); });
+    }
+
+    // привязанное условие вида a.x = b.y между разными таблицами join
+    bool is_equi_join() const {
+        return kind == Kind::COMPARE && op == CompareOperator::EQUAL &&
+               left->kind == Kind::COLUMN && right->kind == Kind::COLUMN &&
+               left->source != right->source &&
+               (left->column->type >= 2) == (right->column->type >= 2);
+    }
+
+private:
+    size_t select_either(uint32_t* rows, size_t count) const {
+        std::vector<uint32_t> lhs(rows, rows + count);
+        size_t left_count = left->select(lhs.data(), count);
+        std::vector<uint32_t> rhs;
+        rhs.reserve(count - left_count);
+        for (size_t i = 0, a = 0; i < count; ++i) {
+            if (a < left_count && lhs[a] == rows[i]) {
+                ++a;
+            } else {
+                rhs.push_back(rows[i]);
+            }
+        }
+        size_t right_count = right->select(rhs.data(), rhs.size());
+        // обе части - непересекающиеся подпоследовательности rows, слияние сохраняет порядок
+        size_t kept = 0;
+        for (size_t i = 0, a = 0, b = 0; i < count; ++i) {
+            bool in_left = a < left_count && lhs[a] == rows[i];
+            bool in_right = b < right_count && rhs[b] == rows[i];
+            a += in_left;
+            b += in_right;
+            rows[kept] = rows[i];
+            kept += in_left || in_right;
+        }
+        return kept;
+    }
+
+    static size_t select_compare(const Column& column, int32_t value, CompareOperator cmp, uint32_t* rows, size_t count) {
+        switch (cmp) {
+            case CompareOperator::EQUAL: return select_where(column, rows, count, [value](int32_t x) { return x == value; });
+            case CompareOperator::NOT_EQUAL: return select_where(column, rows, count, [value](int32_t x) { return x != value; });
+            case CompareOperator::GREATER_THAN: return select_where(column, rows, count, [value](int32_t x) { return x > value; });
+            case CompareOperator::LESS_THAN: return select_where(column, rows, count, [value](int32_t x) { return x < value; });
+            case CompareOperator::GREATER_EQUAL: return select_where(column, rows, count, [value](int32_t x) { return x >= value; });
+            case CompareOperator::LESS_EQUAL: return select_where(column, rows, count, [value](int32_t x) { return x <= value; });
+            default: throw std::invalid_argument("Unknown comparison operator");
+        }
+    }
+
+    static void refine_compare(const Column& column, int32_t value, CompareOperator cmp, size_t begin, size_t count, uint64_t* words) {
+        size_t n = (count + 63) / 64;
+        size_t first = begin / 64;
+        if (column.type == 0) {
+            uint64_t result[kBlockRows / 64];
+            KernelCompare kernel = KernelCompare::EQUAL;
+            bool negate = false;
+            switch (cmp) {
+                case CompareOperator::EQUAL: break;
+                case CompareOperator::NOT_EQUAL: negate = true; break;
+                case CompareOperator::GREATER_THAN: kernel = KernelCompare::GREATER; break;
+                case CompareOperator::LESS_EQUAL: kernel = KernelCompare::GREATER; negate = true; break;
+                case CompareOperator::LESS_THAN: kernel = KernelCompare::LESS; break;
+                case CompareOperator::GREATER_EQUAL: kernel = KernelCompare::LESS; negate = true; break;
+                default: throw std::invalid_argument("Unknown comparison operator");
+            }
+            FilterKernels::compareInt32(column.ints.data() + begin, count, kernel, value, negate, result);
+            for (size_t w = 0; w < n; ++w) {
+                words[w] &= result[w];
+            }
+        } else {
+            // у bool всего два значения: строка проходит, если проходит её значение
+            Datum zero, one;
+            zero.type = one.type = 1;
+            one.number = 1;
+            QueryCondition test;
+            test.op = cmp;
+            Datum constant;
+            constant.type = 0;
+            constant.number = value;
+            uint64_t pass_zero = test.compare(zero, constant) ? ~uint64_t(0) : 0;
+            uint64_t pass_one = test.compare(one, constant) ? ~uint64_t(0) : 0;
+            for (size_t w = 0; w < n; ++w) {
+                uint64_t bits = column.bool_word(first + w);
+                words[w] &= (bits & pass_one) | (~bits & pass_zero);
+            }
+        }
+        if (column.has_nulls()) {
+            for (size_t w = 0; w < n; ++w) {
+                words[w] &= ~column.null_word(first + w);
+            }
+        }
+    }
+
+    // строка записывается всегда, а счётчик сдвигается только если test прошёл - без ветвлений;
+    // NULL не проходит ни одно сравнение и убирается отдельным проходом, если в колонке есть NULL
+    template <class Test>
+    static size_t select_where(const Column& column, uint32_t* rows, size_t count, const Test& test) {
+        size_t kept = 0;
+        if (column.type == 0) {
+            const int32_t* data = column.ints.data();
+            for (size_t i = 0; i < count; ++i) {
+                uint32_t row = rows[i];
+                rows[kept] = row;
+                kept += test(data[row]);
+            }
         } else {
-            polish_notation.push(token);
+            for (size_t i = 0; i < count; ++i) {
+                uint32_t row = rows[i];
+                rows[kept] = row;
+                kept += test(int32_t(column.get_bool(row)));
+            }
+        }
+        if (!column.has_nulls()) {
+            return kept;
+        }
+        size_t not_null = 0;
+        for (size_t i = 0; i < kept; ++i) {
+            uint32_t row = rows[i];
+            rows[not_null] = row;
+            not_null += !column.is_null(row);
         }
+        return not_null;
     }
-    while (!operations.empty()) {
-        polish_notation.push(operations.top());
-        operations.pop();
+
+    static Datum boolean(bool value) {
+        Datum datum;
+        datum.type = 1;
+        datum.number = value;
+        return datum;
     }
-    return polish_notation;
-}
 
-std::shared_ptr<QueryCondition> build_condition_tree(std::stack<std::string> &cur, const std::string &which_side = "") {
-    if (cur.empty()) {
-        return nullptr;
-    }
-    std::string token = cur.top();
-    cur.pop();
-    std::shared_ptr<QueryCondition> node;
-    if (isLogicalOperator(token)) {
-        node = std::make_shared<QueryCondition>(logical_str_to_enum[token]);
-        node->left = build_condition_tree(cur, "left");
-        node->right = build_condition_tree(cur, "right");
-    } else if (isCompareOperator(token)) {
-        node = std::make_shared<QueryCondition>(compare_str_to_enum[token]);
-        node->left = build_condition_tree(cur, "left");
-        node->right = build_condition_tree(cur, "right");
-    } else if (isMathOperator(token)) {
-        node = std::make_shared<QueryCondition>(math_str_to_enum[token]);
-        node->left = build_condition_tree(cur, "left");
-        node->right = build_condition_tree(cur, "right");
-    } else {
-        node = std::make_shared<QueryCondition>(token, which_side);
-    }
-    return node;
-}
+    bool compare(const Datum& a, const Datum& b) const {
+        if (a.type == -1 || b.type == -1) {
+            return false;
+        }
+        int cmp;
+        if (a.is_number() && b.is_number()) {
+            cmp = (a.number > b.number) - (a.number < b.number);
+        } else if (a.is_text() && b.is_text()) {
+            cmp = a.text.compare(b.text);
+        } else {
+            throw std::invalid_argument("Cannot compare values of different types");
+        }
+        switch (op) {
+            case CompareOperator::EQUAL: return cmp == 0;
+            case CompareOperator::NOT_EQUAL: return cmp != 0;
+            case CompareOperator::GREATER_THAN: return cmp > 0;
+            case CompareOperator::LESS_THAN: return cmp < 0;
+            case CompareOperator::GREATER_EQUAL: return cmp >= 0;
+            case CompareOperator::LESS_EQUAL: return cmp <= 0;
+            default: throw std::invalid_argument("Unknown comparison operator");
+        }
+    }
+
+    Datum arithmetic(const Datum& a, const Datum& b) const {
+        if (a.type == -1 || b.type == -1) {
+            return Datum();
+        }
+        if (!a.is_number() || !b.is_number()) {
+            throw std::invalid_argument("Unsupported operator for strings");
+        }
+        Datum datum;
+        datum.type = 0;
+        switch (math_op) {
+            case MathOperator::PLUS: datum.number = a.number + b.number; break;
+            case MathOperator::MINUS: datum.number = a.number - b.number; break;
+            case MathOperator::MULTIPLY: datum.number = a.number * b.number; break;
+            case MathOperator::DIVIDE:
+            case MathOperator::MOD:
+                if (b.number == 0) {
+                    throw std::runtime_error("Division by zero");
+                }
+                datum.number = math_op == MathOperator::DIVIDE ? a.number / b.number : a.number % b.number;
+                break;
+            default: throw std::invalid_argument("Unknown arithmetic operator");
+        }
+        return datum;
+    }
+
+    // тип значения узла после bind: 0/1 - число, 2/3 - строка
+    int static_type() const {
+        switch (kind) {
+            case Kind::CONSTANT: return value_type;
+            case Kind::COLUMN: return column->type;
+            case Kind::MATH: return 0;
+            default: return 1;
+        }
+    }
+
+    void check_types() const {
+        if (kind != Kind::COMPARE && kind != Kind::MATH) {
+            return;
+        }
+        bool left_text = left->static_type() >= 2;
+        bool right_text = right->static_type() >= 2;
+        if (kind == Kind::MATH && (left_text || right_text)) {
+            throw std::invalid_argument("Unsupported operator for strings");
+        }
+        if (left_text != right_text) {
+            throw std::invalid_argument("Cannot compare values of different types");
+        }
+    }
+};
+
+// Разбор текста условия в дерево QueryCondition (токены берём из Lexer)
+class ConditionParser {
+public:
+    ConditionParser(const std::string& condition) : condition_(condition), lexer_(condition_) {
+        current_token_ = lexer_.next_token();
+    }
+
+    std::shared_ptr<QueryCondition> parse() {
+        if (current_token_.type == TokenType::END) {
+            return std::make_shared<QueryCondition>();
+        }
+        auto node = parse_or();
+        if (current_token_.type != TokenType::END) {
+            throw std::invalid_argument("Unexpected token in condition: " + current_token_.value);
+        }
+        return node;
+    }
+
+private:
+    std::string condition_;
+    Lexer lexer_;
+    Token current_token_;
+
+    void advance() {
+        current_token_ = lexer_.next_token();
+    }
 
-std::shared_ptr<QueryCondition> get_condition_tree(const std::string &str) {
-    std::stack<std::string> polish_notation = get_polish_notation(str);
-    return build_condition_tree(polish_notation);
+    bool is_keyword(const std::string& keyword) const {
+        if (current_token_.type != TokenType::IDENTIFIER || current_token_.value.size() != keyword.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < keyword.size(); ++i) {
+            if (std::toupper(static_cast<unsigned char>(current_token_.value[i])) != keyword[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool is_operator(const std::string& op) const {
+        return current_token_.type == TokenType::OPERATOR && current_token_.value == op;
+    }
+
+    static std::shared_ptr<QueryCondition> make_logical(LogicalOperator op, std::shared_ptr<QueryCondition> left, std::shared_ptr<QueryCondition> right) {
+        auto node = std::make_shared<QueryCondition>();
+        node->kind = QueryCondition::Kind::LOGICAL;
+        node->logical_op = op;
+        node->left = std::move(left);
+        node->right = std::move(right);
+        return node;
+    }
+
+    std::shared_ptr<QueryCondition> parse_or() {
+        auto node = parse_and();
+        while (is_keyword("OR") || is_operator("||")) {
+            advance();
+            node = make_logical(LogicalOperator::OR, node, parse_and());
+        }
+        return node;
+    }
+
+    std::shared_ptr<QueryCondition> parse_and() {
+        auto node = parse_not();
+        while (is_keyword("AND") || is_operator("&&")) {
+            advance();
+            node = make_logical(LogicalOperator::AND, node, parse_not());
+        }
+        return node;
+    }
+
+    std::shared_ptr<QueryCondition> parse_not() {
+        if (is_keyword("NOT") || is_operator("!")) {
+            advance();
+            return make_logical(LogicalOperator::NOT, parse_not(), nullptr);
+        }
+        return parse_comparison();
+    }
+
+    std::shared_ptr<QueryCondition> parse_comparison() {
+        auto node = parse_additive();
+        static const std::unordered_map<std::string, CompareOperator> compare_ops = {
+            {"=", CompareOperator::EQUAL},
+            {"==", CompareOperator::EQUAL},
+            {"!=", CompareOperator::NOT_EQUAL},
+            {">", CompareOperator::GREATER_THAN},
+            {"<", CompareOperator::LESS_THAN},
+            {">=", CompareOperator::GREATER_EQUAL},
+            {"<=", CompareOperator::LESS_EQUAL}
+        };
+        if (current_token_.type == TokenType::OPERATOR && compare_ops.count(current_token_.value)) {
+            auto compare = std::make_shared<QueryCondition>();
+            compare->kind = QueryCondition::Kind::COMPARE;
+            compare->op = compare_ops.at(current_token_.value);
+            advance();
+            compare->left = node;
+            compare->right = parse_additive();
+            return compare;
+        }
+        return node;
+    }
+
+    std::shared_ptr<QueryCondition> make_math(MathOperator op, std::shared_ptr<QueryCondition> left, std::shared_ptr<QueryCondition> right) {
+        auto node = std::make_shared<QueryCondition>();
+        node->kind = QueryCondition::Kind::MATH;
+        node->math_op = op;
+        node->left = std::move(left);
+        node->right = std::move(right);
+        return node;
+    }
+
+    std::shared_ptr<QueryCondition> parse_additive() {
+        auto node = parse_multiplicative();
+        while (is_operator("+") || is_operator("-")) {
+            MathOperator op = current_token_.value == "+" ? MathOperator::PLUS : MathOperator::MINUS;
+            advance();
+            node = make_math(op, node, parse_multiplicative());
+        }
+        return node;
+    }
+
+    std::shared_ptr<QueryCondition> parse_multiplicative() {
+        auto node = parse_unary();
+        while (is_operator("*") || is_operator("/") || is_operator("%")) {
+            MathOperator op = current_token_.value == "*" ? MathOperator::MULTIPLY
+                            : current_token_.value == "/" ? MathOperator::DIVIDE : MathOperator::MOD;
+            advance();
+            node = make_math(op, node, parse_unary());
+        }
+        return node;
+    }
+
+    std::shared_ptr<QueryCondition> parse_unary() {
+        if (is_operator("-")) {
+            advance();
+            auto operand = parse_unary();
+            if (operand->kind == QueryCondition::Kind::CONSTANT && operand->value_type == 0) {
+                operand->number = -operand->number;
+                return operand;
+            }
+            auto zero = std::make_shared<QueryCondition>();
+            zero->value_type = 0;
+            zero->number = 0;
+            return make_math(MathOperator::MINUS, zero, operand);
+        }
+        if (is_operator("+")) {
+            advance();
+            return parse_unary();
+        }
+        return parse_primary();
+    }
+
+    std::shared_ptr<QueryCondition> parse_primary() {
+        auto node = std::make_shared<QueryCondition>();
+        if (current_token_.type == TokenType::PAREN_OPEN) {
+            advance();
+            node = parse_or();
+            if (current_token_.type != TokenType::PAREN_CLOSE) {
+                throw std::invalid_argument("Expected closing parenthesis ')'");
+            }
+            advance();
+        } else if (current_token_.type == TokenType::NUMBER) {
+            const std::string& value = current_token_.value;
+            if (value.size() > 1 && value[1] == 'x') {
+                node->value_type = 3;
+                node->literal = hex_to_bits(value.substr(2));
+            } else {
+                node->value_type = 0;
+                node->number = std::stoi(value);
+            }
+            advance();
+        } else if (current_token_.type == TokenType::STRING) {
+            node->value_type = 2;
+            node->literal = current_token_.value;
+            advance();
+        } else if (is_keyword("TRUE") || is_keyword("FALSE")) {
+            node->value_type = 1;
+            node->number = is_keyword("TRUE");
+            advance();
+        } else if (current_token_.type == TokenType::IDENTIFIER) {
+            node->kind = QueryCondition::Kind::COLUMN;
+            node->column_name = current_token_.value;
+            advance();
+        } else {
+            throw std::invalid_argument("Unexpected token in condition: " + current_token_.value);
+        }
+        return node;
+    }
+
+    // bytes хранятся строкой из '0' и '1', как в CellBytes
+    static std::string hex_to_bits(const std::string& hex) {
+        std::string bits;
+        for (char c : hex) {
+            int digit = std::isdigit(static_cast<unsigned char>(c)) ? c - '0' : std::tolower(static_cast<unsigned char>(c)) - 'a' + 10;
+            for (int j = 3; j >= 0; --j) {
+                bits.push_back((digit >> j & 1) ? '1' : '0');
+            }
+        }
+        return bits;
+    }
+};
+
+inline std::shared_ptr<QueryCondition> QueryCondition::compile(const std::string& condition) {
+    return ConditionParser(condition).parse();
 }
 
-*/
 #endif // QUERY_CONDITION_H
-
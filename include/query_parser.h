@@ -32,24 +32,69 @@ public:
             return parse_delete(stream);
         } else if (query_type == "create") {
             return parse_create(stream);
+        } else if (query_type == "begin" || query_type == "commit" || query_type == "rollback") {
+            return parse_transaction(stream, query_type);
         } else {
             throw std::invalid_argument("Unsupported query type: " + query_type);
         }
     }
 
 private:
-    std::unique_ptr<CreateQuery> parse_create(std::istringstream& stream) {
+    // BEGIN [TRANSACTION], COMMIT [TRANSACTION], ROLLBACK [TRANSACTION]
+    std::unique_ptr<Query> parse_transaction(std::istringstream& stream, const std::string& keyword) {
+        std::string word;
+        if (stream >> word && to_lower_case(word) != "transaction") {
+            throw std::invalid_argument("Unexpected token after " + keyword + ": " + word);
+        }
+        if (stream >> word) {
+            throw std::invalid_argument("Unexpected token after " + keyword + ": " + word);
+        }
+        TransactionQuery::Action action = keyword == "begin" ? TransactionQuery::Action::BEGIN :
+                keyword == "commit" ? TransactionQuery::Action::COMMIT : TransactionQuery::Action::ROLLBACK;
+        return std::make_unique<TransactionQuery>(action);
+    }
+
+    std::unique_ptr<Query> parse_create(std::istringstream& stream) {
         std::string table_keyword, table_name;
-        stream >> table_keyword >> table_name;
+        stream >> table_keyword;
 
+        std::string kind = to_lower_case(table_keyword);
+        if (kind == "index" || kind == "unordered" || kind == "ordered") {
+            return parse_create_index(stream, kind != "index", kind == "ordered");
+        }
         if (to_lower_case(table_keyword) != "table") {
             throw std::invalid_argument("Invalid CREATE query");
         }
+        stream >> table_name;
+
+        std::string definitions;
+        std::getline(stream, definitions);
+        definitions = trim(definitions);
+        if (!definitions.empty() && definitions.front() == '(' && definitions.back() == ')') {
+            definitions = definitions.substr(1, definitions.size() - 2);
+        }
 
         std::vector<std::pair<std::string, int>> columns;
-        std::string column_def;
-        while (std::getline(stream, column_def, ',')) {
+        std::map<std::string, std::vector<std::string>> attributes;
+        for (std::string column_def : split_column_definitions(definitions)) {
             column_def.erase(std::remove_if(column_def.begin(), column_def.end(), ::isspace), column_def.end());
+            std::vector<std::string> column_attributes;
+            if (!column_def.empty() && column_def.front() == '{') {
+                size_t close = column_def.find('}');
+                if (close == std::string::npos) {
+                    throw std::invalid_argument("Unclosed attribute list in column definition");
+                }
+                std::istringstream attribute_stream(column_def.substr(1, close - 1));
+                std::string attribute;
+                while (std::getline(attribute_stream, attribute, ',')) {
+                    attribute = to_lower_case(attribute);
+                    if (attribute != "key" && attribute != "unique" && attribute != "autoincrement") {
+                        throw std::invalid_argument("Unknown column attribute: " + attribute);
+                    }
+                    column_attributes.push_back(attribute);
+                }
+                column_def = column_def.substr(close + 1);
+            }
             size_t pos = column_def.find(':');
             if (pos == std::string::npos) {
                 throw std::invalid_argument("Invalid column definition");
@@ -73,45 +118,130 @@ private:
             }
 
             columns.emplace_back(column_name, column_type);
+            if (!column_attributes.empty()) {
+                attributes[column_name] = column_attributes;
+            }
         }
 
         auto query = std::make_unique<CreateQuery>();
         query->set_table(table_name);
         query->set_columns(columns);
+        query->set_attributes(attributes);
+
+        return query;
+    }
+    // делит список колонок по запятым вне {...}: "{key, autoincrement} id:int32, name:string[32]"
+    std::vector<std::string> split_column_definitions(const std::string& definitions) {
+        std::vector<std::string> result;
+        std::string current;
+        int depth = 0;
+        for (char c : definitions) {
+            if (c == '{') {
+                ++depth;
+            } else if (c == '}') {
+                --depth;
+            } else if (c == ',' && depth == 0) {
+                result.push_back(current);
+                current.clear();
+                continue;
+            }
+            current += c;
+        }
+        if (!trim(current).empty()) {
+            result.push_back(current);
+        }
+        return result;
+    }
+
+    // CREATE INDEX [name] ON table (column)
+    // CREATE UNORDERED INDEX [name] ON table BY column
+    // CREATE ORDERED INDEX [name] ON table BY column
+    std::unique_ptr<CreateIndexQuery> parse_create_index(std::istringstream& stream, bool expect_index_keyword, bool ordered) {
+        std::string word;
+        if (expect_index_keyword && (!(stream >> word) || to_lower_case(word) != "index")) {
+            throw std::invalid_argument("CREATE [UN]ORDERED query missing 'INDEX' keyword.");
+        }
+
+        auto query = std::make_unique<CreateIndexQuery>();
+        query->set_ordered(ordered);
+        stream >> word;
+        if (to_lower_case(word) != "on") {
+            query->set_name(word);
+            stream >> word;
+        }
+        if (to_lower_case(word) != "on") {
+            throw std::invalid_argument("CREATE INDEX query missing 'ON' keyword.");
+        }
+
+        std::string rest;
+        std::getline(stream, rest);
+        std::replace(rest.begin(), rest.end(), '(', ' ');
+        std::replace(rest.begin(), rest.end(), ')', ' ');
+        std::istringstream rest_stream(rest);
+        std::string table, column;
+        rest_stream >> table >> column;
+        if (to_lower_case(column) == "by") {
+            rest_stream >> column;
+        }
+        if (table.empty() || column.empty()) {
+            throw std::invalid_argument("Invalid CREATE INDEX query");
+        }
 
+        query->set_table(table);
+        query->set_column(column);
         return query;
     }
+
     std::unique_ptr<SelectQuery> parse_select(std::istringstream& stream) {
-        std::string columns_part, from_keyword, table_or_join, where_keyword, condition;
+        std::string columns_part, word, table;
 
-        std::getline(stream, columns_part, ' ');
-        while (to_lower_case(columns_part) != "from") {
-            std::string next_part;
-            stream >> next_part;
-            columns_part += " " + next_part;
+        while (stream >> word && to_lower_case(word) != "from") {
+            columns_part += word + " ";
         }
-        columns_part = columns_part.substr(0, columns_part.size() - 5);
-        columns_part = trim(columns_part);
-        std::vector<std::string> columns = split_by_comma(columns_part);
+        if (to_lower_case(word) != "from") {
+            throw std::invalid_argument("SELECT query missing 'FROM' keyword.");
+        }
+        std::vector<std::string> columns = split_by_comma(trim(columns_part));
 
-        std::getline(stream, table_or_join);
-        table_or_join = trim(table_or_join);
+        if (!(stream >> table)) {
+            throw std::invalid_argument("SELECT query missing table name.");
+        }
 
         auto query = std::make_unique<SelectQuery>();
-        query->set_columns(columns);
-
-        if (to_lower_case(table_or_join).find("join") != std::string::npos) {
-            parse_join(stream, *query);
-        } else {
-            query->set_table(table_or_join);
+        for (auto& column : columns) {
+            column.erase(std::remove_if(column.begin(), column.end(), ::isspace), column.end());
+            size_t open = column.find('(');
+            if (open == std::string::npos) {
+                continue;
+            }
+            std::string function = to_lower_case(column.substr(0, open));
+            if (column.back() != ')' || (function != "count" && function != "sum" && function != "min" &&
+                                         function != "max" && function != "avg")) {
+                throw std::invalid_argument("Unknown aggregate function: " + column);
+            }
+            std::string argument = column.substr(open + 1, column.size() - open - 2);
+            if (argument.empty() || (argument == "*" && function != "count")) {
+                throw std::invalid_argument("Invalid aggregate argument: " + column);
+            }
+            query->add_aggregate(function, argument, column);
         }
+        query->set_columns(columns);
+        query->set_table(table);
 
-        if (stream >> where_keyword) {
-            if (to_lower_case(where_keyword) != "where") {
-                throw std::invalid_argument("Unexpected keyword in SELECT query: " + where_keyword);
+        while (stream >> word) {
+            if (to_lower_case(word) == "join") {
+                parse_join(stream, *query);
+            } else if (to_lower_case(word) == "where") {
+                parse_where(stream, *query);
+            } else if (to_lower_case(word) == "group") {
+                parse_group_by(stream, *query);
+            } else if (to_lower_case(word) == "order") {
+                parse_order_by(stream, *query);
+            } else if (to_lower_case(word) == "limit") {
+                parse_limit(stream, *query);
+            } else {
+                throw std::invalid_argument("Unexpected keyword in SELECT query: " + word);
             }
-            std::getline(stream, condition);
-            query->set_where(trim(condition));
         }
 
         return query;
@@ -272,15 +402,24 @@ private:
         std::ostringstream condition_stream;
         std::string word;
 
+        std::streampos before = stream.tellg();
         while (stream >> word) {
             if (to_lower_case(word) == "where") {
                 parse_where(stream, query);
                 break;
             }
+            // следующий JOIN цепочки разбирает parse_select
+            if (is_select_tail(word) || to_lower_case(word) == "join") {
+                stream.seekg(before);
+                break;
+            }
             condition_stream << word << " ";
+            before = stream.tellg();
         }
 
-        query.set_join(query.table, table2, trim(condition_stream.str()));
+        // t1 JOIN t2 ON ... JOIN t3 ON ...: каждая таблица присоединяется к цепочке после предыдущей
+        std::string table1 = query.joins.empty() ? query.table : query.joins.back().table2;
+        query.set_join(table1, table2, trim(condition_stream.str()));
     }
 
 
@@ -288,16 +427,89 @@ private:
         std::ostringstream conditions;
         std::string word;
 
+        std::streampos before = stream.tellg();
         while (stream >> word) {
+            if (is_select_tail(word) && dynamic_cast<SelectQuery*>(&query)) {
+                stream.seekg(before);
+                break;
+            }
             if (word.back() == ',') {
                 word.pop_back();
             }
             conditions << word << " ";
+            before = stream.tellg();
         }
 
         query.set_where(trim(conditions.str()));
     }
 
+    // GROUP BY, ORDER BY и LIMIT заканчивают условия JOIN ... ON и WHERE
+    bool is_select_tail(const std::string& word) {
+        std::string lower = to_lower_case(word);
+        return lower == "group" || lower == "order" || lower == "limit";
+    }
+
+    // GROUP BY column [, column ...]
+    void parse_group_by(std::istringstream& stream, SelectQuery& query) {
+        std::string word, columns_part;
+        if (!(stream >> word) || to_lower_case(word) != "by") {
+            throw std::invalid_argument("GROUP clause must be GROUP BY columns.");
+        }
+        std::streampos before = stream.tellg();
+        while (stream >> word) {
+            if (is_select_tail(word)) {
+                stream.seekg(before);
+                break;
+            }
+            columns_part += word + " ";
+            before = stream.tellg();
+        }
+        stream.clear();
+        std::vector<std::string> columns = split_by_comma(trim(columns_part));
+        if (columns.empty() || std::find(columns.begin(), columns.end(), "") != columns.end()) {
+            throw std::invalid_argument("GROUP BY expects column names.");
+        }
+        query.set_group_by(columns);
+    }
+
+    // ORDER BY column [ASC|DESC]
+    void parse_order_by(std::istringstream& stream, SelectQuery& query) {
+        std::string word, column;
+        if (!(stream >> word) || to_lower_case(word) != "by" || !(stream >> column)) {
+            throw std::invalid_argument("ORDER clause must be ORDER BY column.");
+        }
+        bool descending = false;
+        std::streampos before = stream.tellg();
+        if (stream >> word) {
+            if (to_lower_case(word) == "desc") {
+                descending = true;
+            } else if (to_lower_case(word) != "asc") {
+                stream.seekg(before);
+            }
+        }
+        stream.clear();
+        query.set_order(column, descending);
+    }
+
+    // LIMIT count [OFFSET skip]
+    void parse_limit(std::istringstream& stream, SelectQuery& query) {
+        long long count, skip = 0;
+        if (!(stream >> count) || count < 0) {
+            throw std::invalid_argument("LIMIT expects a non-negative number.");
+        }
+        std::string word;
+        std::streampos before = stream.tellg();
+        if (stream >> word) {
+            if (to_lower_case(word) != "offset") {
+                stream.seekg(before);
+            } else if (!(stream >> skip) || skip < 0) {
+                throw std::invalid_argument("OFFSET expects a non-negative number.");
+            }
+        }
+        stream.clear();
+        query.set_limit(count, skip);
+    }
+
     std::map<std::string, std::string> parse_values(const std::string& values_str) {
         std::map<std::string, std::string> values;
         std::istringstream stream(values_str);
@@ -0,0 +1,233 @@
+#ifndef RADIX_JOIN_H
+#define RADIX_JOIN_H
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <string_view>
+#include <vector>
+
+#include "column.h"
+#include "thread_pool.h"
+
+// Хеш-join с разбиением на разделы (radix join) двух наборов строк по равенству ключевых колонок.
+//  1. Каждая сторона делится на морсели; для каждого морселя считаются хеши ключей и гистограмма
+//     по младшим битам хеша (номер раздела).
+//  2. По гистограммам каждому морселю заранее известно, куда писать в каждом разделе, так что
+//     раскладка записей (хеш, позиция) по разделам идёт параллельно без блокировок.
+//  3. Разделы независимы: для каждого строится маленькая хеш-таблица (помещается в L2) и сразу
+//     пробуется записями второй стороны того же раздела. Пары собираются в каждом разделе отдельно
+//     и склеиваются по порядку разделов.
+// Порядок результата зависит только от входа, а не от числа потоков. NULL ни с чем не совпадает
+class RadixJoin
+{
+public:
+    // размер L2, под который подбирается число разделов
+    static constexpr size_t kCacheBytes = 256 * 1024;
+    static constexpr size_t kMorselRows = 16 * 1024;
+    static constexpr size_t kMaxPartitionBits = 12;
+
+    // Сторона join: ключ строки rows[k] - key.get_...(rows[k]); в результат попадает позиция k
+    struct Side
+    {
+        const Column* key;
+        const std::vector<uint32_t>* rows;
+    };
+
+    // buildPositions[t], probePositions[t] - t-я найденная пара позиций, для которой accept(позиция build,
+    // позиция probe) истинно. pool может быть nullptr - тогда всё в вызывающем потоке
+    template <class Accept>
+    static void run(ThreadPool* pool, const Side& build, const Side& probe, const Accept& accept,
+            std::vector<uint32_t>& buildPositions, std::vector<uint32_t>& probePositions)
+    {
+        size_t bits = partitionBits(build.rows->size());
+        std::vector<Entry> buildEntries, probeEntries;
+        std::vector<size_t> buildStarts, probeStarts;
+        partition(pool, build, bits, buildEntries, buildStarts);
+        partition(pool, probe, bits, probeEntries, probeStarts);
+
+        size_t partitions = size_t(1) << bits;
+        bool text = build.key->type >= 2;
+        std::vector<std::vector<uint32_t>> foundBuild(partitions), foundProbe(partitions);
+        forEach(pool, partitions, [&](size_t p) {
+            joinPartition(build, probe, text, bits,
+                    buildEntries.data() + buildStarts[p], buildStarts[p + 1] - buildStarts[p],
+                    probeEntries.data() + probeStarts[p], probeStarts[p + 1] - probeStarts[p],
+                    accept, foundBuild[p], foundProbe[p]);
+        });
+        for (size_t p = 0; p < partitions; ++p)
+        {
+            buildPositions.insert(buildPositions.end(), foundBuild[p].begin(), foundBuild[p].end());
+            probePositions.insert(probePositions.end(), foundProbe[p].begin(), foundProbe[p].end());
+        }
+    }
+
+    // столько младших бит хеша задают раздел, чтобы хеш-таблица раздела build помещалась в kCacheBytes
+    static size_t partitionBits(size_t buildRows)
+    {
+        // запись раздела + голова цепочки + ссылка на следующую
+        size_t perPartition = kCacheBytes / (sizeof(Entry) + 3 * sizeof(uint32_t));
+        size_t bits = 0;
+        while (bits < kMaxPartitionBits && (buildRows >> bits) > perPartition)
+        {
+            ++bits;
+        }
+        return bits;
+    }
+
+private:
+    struct Entry
+    {
+        uint32_t hash;
+        uint32_t position;
+    };
+
+    template <class Task>
+    static void forEach(ThreadPool* pool, size_t count, const Task& task)
+    {
+        if (pool != nullptr && pool->workers() > 0 && count > 1)
+        {
+            pool->parallelFor(count, task);
+            return;
+        }
+        for (size_t i = 0; i < count; ++i)
+        {
+            task(i);
+        }
+    }
+
+    static uint32_t hashOf(const Column& key, uint32_t row)
+    {
+        uint64_t value;
+        if (key.type >= 2)
+        {
+            value = std::hash<std::string_view>()(key.get_string(row));
+        }
+        else
+        {
+            value = uint32_t(key.type == 0 ? key.get_int(row) : int32_t(key.get_bool(row)));
+        }
+        // перемешивание splitmix64: у целых ключей младшие биты иначе плохо распределены по разделам
+        value += 0x9e3779b97f4a7c15ull;
+        value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ull;
+        value = (value ^ (value >> 27)) * 0x94d049bb133111ebull;
+        return uint32_t(value ^ (value >> 31));
+    }
+
+    // entries - записи стороны, разложенные по разделам; раздел p - [starts[p], starts[p + 1])
+    static void partition(ThreadPool* pool, const Side& side, size_t bits, std::vector<Entry>& entries, std::vector<size_t>& starts)
+    {
+        const std::vector<uint32_t>& rows = *side.rows;
+        const Column& key = *side.key;
+        size_t partitions = size_t(1) << bits;
+        uint32_t mask = uint32_t(partitions - 1);
+        size_t morsels = (rows.size() + kMorselRows - 1) / kMorselRows;
+
+        // позиции с NULL отмечаются в nulls и не попадают ни в один раздел
+        std::vector<uint32_t> hashes(rows.size(), 0);
+        std::vector<uint8_t> nulls(rows.size(), 0);
+        std::vector<size_t> counts(morsels * partitions, 0);
+        forEach(pool, morsels, [&](size_t m) {
+            size_t end = std::min(rows.size(), (m + 1) * kMorselRows);
+            size_t* histogram = counts.data() + m * partitions;
+            for (size_t k = m * kMorselRows; k < end; ++k)
+            {
+                if (key.is_null(rows[k]))
+                {
+                    nulls[k] = 1;
+                    continue;
+                }
+                hashes[k] = hashOf(key, rows[k]);
+                ++histogram[hashes[k] & mask];
+            }
+        });
+
+        // начало каждого (морсель, раздел): разделы подряд, внутри раздела - морсели по порядку
+        starts.assign(partitions + 1, 0);
+        std::vector<size_t> offsets(morsels * partitions);
+        size_t total = 0;
+        for (size_t p = 0; p < partitions; ++p)
+        {
+            starts[p] = total;
+            for (size_t m = 0; m < morsels; ++m)
+            {
+                offsets[m * partitions + p] = total;
+                total += counts[m * partitions + p];
+            }
+        }
+        starts[partitions] = total;
+
+        entries.resize(total);
+        forEach(pool, morsels, [&](size_t m) {
+            size_t end = std::min(rows.size(), (m + 1) * kMorselRows);
+            size_t* offset = offsets.data() + m * partitions;
+            for (size_t k = m * kMorselRows; k < end; ++k)
+            {
+                if (!nulls[k])
+                {
+                    entries[offset[hashes[k] & mask]++] = Entry{hashes[k], uint32_t(k)};
+                }
+            }
+        });
+    }
+
+    template <class Accept>
+    static void joinPartition(const Side& build, const Side& probe, bool text, size_t bits,
+            const Entry* buildEntries, size_t buildCount, const Entry* probeEntries, size_t probeCount,
+            const Accept& accept, std::vector<uint32_t>& foundBuild, std::vector<uint32_t>& foundProbe)
+    {
+        if (buildCount == 0 || probeCount == 0)
+        {
+            return;
+        }
+        // цепочки с общей корзиной: heads[корзина] -> первая запись, next[запись] -> следующая;
+        // корзина - следующие за номером раздела биты хеша
+        const uint32_t none = UINT32_MAX;
+        size_t buckets = 1;
+        while (buckets < buildCount * 2)
+        {
+            buckets <<= 1;
+        }
+        std::vector<uint32_t> heads(buckets, none);
+        std::vector<uint32_t> next(buildCount, none);
+        size_t bucketMask = buckets - 1;
+        for (size_t e = buildCount; e-- > 0;)
+        {
+            uint32_t& head = heads[(buildEntries[e].hash >> bits) & bucketMask];
+            next[e] = head;
+            head = uint32_t(e);
+        }
+
+        const Column& buildKey = *build.key;
+        const Column& probeKey = *probe.key;
+        const std::vector<uint32_t>& buildRows = *build.rows;
+        const std::vector<uint32_t>& probeRows = *probe.rows;
+        for (size_t q = 0; q < probeCount; ++q)
+        {
+            const Entry& entry = probeEntries[q];
+            uint32_t probeRow = probeRows[entry.position];
+            for (uint32_t e = heads[(entry.hash >> bits) & bucketMask]; e != none; e = next[e])
+            {
+                if (buildEntries[e].hash != entry.hash)
+                {
+                    continue;
+                }
+                uint32_t buildRow = buildRows[buildEntries[e].position];
+                bool equal = text ? buildKey.get_string(buildRow) == probeKey.get_string(probeRow)
+                                  : intKey(buildKey, buildRow) == intKey(probeKey, probeRow);
+                if (equal && accept(buildEntries[e].position, entry.position))
+                {
+                    foundBuild.push_back(buildEntries[e].position);
+                    foundProbe.push_back(entry.position);
+                }
+            }
+        }
+    }
+
+    static int32_t intKey(const Column& key, uint32_t row)
+    {
+        return key.type == 0 ? key.get_int(row) : int32_t(key.get_bool(row));
+    }
+};
+
+#endif // RADIX_JOIN_H
@@ -0,0 +1,229 @@
+#ifndef ROW_BUFFER_H
+#define ROW_BUFFER_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <initializer_list>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+// Непрерывный буфер тривиальных значений - то, что std::vector, для буферов колонок, версий строк и
+// маски deleted таблицы. Их читают читатели снимков (Table::holdRows), пока пишущий поток дописывает
+// строки, поэтому указатель на данные и размер читаются и публикуются атомарно: новые элементы и новая
+// память заполняются до того, как их увидит читатель. Перевыделение не освобождает прежнюю память,
+// пока на неё есть share(), - читатель, уже взявший указатель, дочитывает старую копию
+template <class T>
+class RowBuffer
+{
+    static_assert(std::is_trivially_copyable_v<T>, "RowBuffer holds trivially copyable values");
+
+public:
+    using value_type = T;
+    using iterator = T*;
+    using const_iterator = const T*;
+
+    RowBuffer() = default;
+
+    RowBuffer(std::initializer_list<T> items)
+    {
+        append(items.begin(), items.size());
+    }
+
+    RowBuffer(const RowBuffer& other)
+    {
+        append(other.data(), other.size());
+    }
+
+    RowBuffer(RowBuffer&& other) noexcept
+    {
+        swap(other);
+    }
+
+    RowBuffer& operator=(const RowBuffer& other)
+    {
+        if (this != &other)
+        {
+            RowBuffer copy(other);
+            swap(copy);
+        }
+        return *this;
+    }
+
+    RowBuffer& operator=(RowBuffer&& other) noexcept
+    {
+        RowBuffer moved(std::move(other));
+        swap(moved);
+        return *this;
+    }
+
+    size_t size() const
+    {
+        return __atomic_load_n(&used, __ATOMIC_ACQUIRE);
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    size_t capacity() const
+    {
+        return room;
+    }
+
+    T* data()
+    {
+        return __atomic_load_n(&first, __ATOMIC_ACQUIRE);
+    }
+
+    const T* data() const
+    {
+        return __atomic_load_n(&first, __ATOMIC_ACQUIRE);
+    }
+
+    T& operator[](size_t index)
+    {
+        return data()[index];
+    }
+
+    const T& operator[](size_t index) const
+    {
+        return data()[index];
+    }
+
+    T* begin()
+    {
+        return data();
+    }
+
+    T* end()
+    {
+        return data() + size();
+    }
+
+    const T* begin() const
+    {
+        return data();
+    }
+
+    const T* end() const
+    {
+        return data() + size();
+    }
+
+    T& back()
+    {
+        return data()[size() - 1];
+    }
+
+    void reserve(size_t count)
+    {
+        if (count <= room)
+        {
+            return;
+        }
+        std::shared_ptr<T[]> grown(new T[count]);
+        if (size() != 0)
+        {
+            std::memcpy(grown.get(), data(), size() * sizeof(T));
+        }
+        __atomic_store_n(&first, grown.get(), __ATOMIC_RELEASE);
+        storage = std::move(grown);
+        room = count;
+    }
+
+    void resize(size_t count, T value = T())
+    {
+        size_t old = size();
+        if (count > old)
+        {
+            make_room(count);
+            std::fill(data() + old, data() + count, value);
+        }
+        __atomic_store_n(&used, count, __ATOMIC_RELEASE);
+    }
+
+    void push_back(T value)
+    {
+        size_t old = size();
+        make_room(old + 1);
+        data()[old] = value;
+        __atomic_store_n(&used, old + 1, __ATOMIC_RELEASE);
+    }
+
+    void append(const T* items, size_t count)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+        size_t old = size();
+        make_room(old + count);
+        std::memcpy(data() + old, items, count * sizeof(T));
+        __atomic_store_n(&used, old + count, __ATOMIC_RELEASE);
+    }
+
+    void assign(size_t count, T value)
+    {
+        clear();
+        resize(count, value);
+    }
+
+    void assign(const T* items, size_t count)
+    {
+        clear();
+        append(items, count);
+    }
+
+    void clear()
+    {
+        __atomic_store_n(&used, size_t(0), __ATOMIC_RELEASE);
+    }
+
+    void swap(RowBuffer& other)
+    {
+        T* mine = data();
+        size_t mineUsed = size();
+        __atomic_store_n(&first, other.data(), __ATOMIC_RELEASE);
+        __atomic_store_n(&used, other.size(), __ATOMIC_RELEASE);
+        __atomic_store_n(&other.first, mine, __ATOMIC_RELEASE);
+        __atomic_store_n(&other.used, mineUsed, __ATOMIC_RELEASE);
+        storage.swap(other.storage);
+        std::swap(room, other.room);
+    }
+
+    // текущая память буфера не освободится, пока жив результат, даже если буфер перевыделят
+    std::shared_ptr<const void> share() const
+    {
+        return storage;
+    }
+
+    friend bool operator==(const RowBuffer& left, const RowBuffer& right)
+    {
+        return std::equal(left.begin(), left.end(), right.begin(), right.end());
+    }
+
+    friend bool operator==(const RowBuffer& left, const std::vector<T>& right)
+    {
+        return std::equal(left.begin(), left.end(), right.begin(), right.end());
+    }
+
+private:
+    std::shared_ptr<T[]> storage;
+    T* first = nullptr;  // storage.get()
+    size_t used = 0;
+    size_t room = 0;
+
+    // как у std::vector: при нехватке места ёмкость растёт хотя бы вдвое
+    void make_room(size_t count)
+    {
+        if (count > room)
+        {
+            reserve(std::max(count, 2 * room));
+        }
+    }
+};
+
+#endif // ROW_BUFFER_H
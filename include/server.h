@@ -0,0 +1,694 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "database.h"
+#include "protocol.h"
+
+// Сервер запросов к одной общей Database по двоичному протоколу protocol.h, на TCP-порту и/или Unix-сокете.
+// Все сокеты обслуживает один поток цикла событий (run) через epoll: он принимает соединения, читает
+// кадры запросов и отправляет накопленные ответы. Запросы выполняют рабочие потоки: соединение
+// целиком берёт один поток, отвечает на его запросы по порядку и отдаёт соединение, когда запросы
+// кончились или у соединения накопилось kHighWater неотправленных байт (клиент читает медленно).
+// Результат SELECT не собирается целиком: курсор остаётся у соединения и выдаёт по kBatchRows строк
+// по мере отправки предыдущих пачек. Открытый курсор держит снимок таблиц (Database::openCursor): запись
+// в них его не ждёт, но изменения каталога, контрольные точки и сборка старых версий строк ждут его
+// закрытия. Поэтому курсор, который стоит дольше cursorTimeout из-за клиента, не забирающего ответ,
+// закрывается, и ответ обрывается ошибкой. У каждого соединения своя транзакция
+class Server
+{
+public:
+    static constexpr size_t kBatchRows = 1024;
+    static constexpr size_t kHighWater = 1 << 20;
+    static constexpr size_t kLowWater = 256 << 10;
+    // принятых, но ещё не выполненных запросов соединения; больше - сокет не читается
+    static constexpr size_t kMaxQueued = 4096;
+
+    // сколько курсор SELECT может ждать, пока клиент заберёт уже готовые пачки
+    std::chrono::milliseconds cursorTimeout = std::chrono::seconds(10);
+
+    explicit Server(Database& database, size_t workerCount = 4) : db(database)
+    {
+        epoll = ::epoll_create1(EPOLL_CLOEXEC);
+        wake = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (epoll < 0 || wake < 0)
+        {
+            closeDescriptor(epoll);
+            closeDescriptor(wake);
+            throw std::runtime_error("Could not create event loop");
+        }
+        watch(wake, EPOLLIN, EPOLL_CTL_ADD);
+        for (size_t i = 0; i < std::max<size_t>(workerCount, 1); ++i)
+        {
+            workers.emplace_back([this] { work(); });
+        }
+    }
+
+    Server(const Server&) = delete;
+    Server& operator=(const Server&) = delete;
+
+    // run к этому моменту должен завершиться (stop)
+    ~Server()
+    {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            stopping = true;
+        }
+        queueReady.notify_all();
+        for (std::thread& worker : workers)
+        {
+            worker.join();
+        }
+        for (auto& [fd, connection] : connections)
+        {
+            ::close(fd);
+        }
+        for (int listener : listeners)
+        {
+            ::close(listener);
+        }
+        if (!unixPath.empty())
+        {
+            ::unlink(unixPath.c_str());
+        }
+        ::close(wake);
+        ::close(epoll);
+    }
+
+    // слушает TCP host:port (port 0 - любой свободный), возвращает порт; вызывается до run
+    uint16_t listenTcp(const std::string& host, uint16_t port)
+    {
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        if (::inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1)
+        {
+            throw std::invalid_argument("Invalid IPv4 address: " + host);
+        }
+        int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        int one = 1;
+        ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        socklen_t length = sizeof(address);
+        if (fd < 0 || ::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+            ::listen(fd, SOMAXCONN) != 0 || ::getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length) != 0)
+        {
+            closeDescriptor(fd);
+            throw std::runtime_error("Could not listen on " + host + ":" + std::to_string(port));
+        }
+        addListener(fd);
+        return ntohs(address.sin_port);
+    }
+
+    // слушает Unix-сокет path (прежний файл сокета удаляется); вызывается до run
+    void listenUnix(const std::string& path)
+    {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(address.sun_path))
+        {
+            throw std::invalid_argument("Socket path too long: " + path);
+        }
+        std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+        ::unlink(path.c_str());
+        int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0 || ::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || ::listen(fd, SOMAXCONN) != 0)
+        {
+            closeDescriptor(fd);
+            throw std::runtime_error("Could not listen on " + path);
+        }
+        unixPath = path;
+        addListener(fd);
+    }
+
+    // цикл событий в вызывающем потоке; возвращается после stop
+    void run()
+    {
+        std::vector<epoll_event> events(256);
+        auto sweep = std::chrono::steady_clock::now();
+        while (!stopRequested)
+        {
+            auto period = std::max(cursorTimeout / 4, std::chrono::milliseconds(1));
+            if (std::chrono::steady_clock::now() - sweep >= period)
+            {
+                expireCursors();
+                sweep = std::chrono::steady_clock::now();
+            }
+            int count = ::epoll_wait(epoll, events.data(), int(events.size()), int(period.count()));
+            if (count < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                throw std::runtime_error("epoll_wait failed");
+            }
+            for (int i = 0; i < count; ++i)
+            {
+                int fd = events[i].data.fd;
+                uint32_t flags = events[i].events;
+                if (fd == wake)
+                {
+                    uint64_t signals;
+                    while (::read(wake, &signals, sizeof(signals)) > 0)
+                    {
+                    }
+                    flushReady();
+                    continue;
+                }
+                if (std::find(listeners.begin(), listeners.end(), fd) != listeners.end())
+                {
+                    acceptAll(fd);
+                    continue;
+                }
+                auto it = connections.find(fd);
+                if (it == connections.end())
+                {
+                    continue;
+                }
+                std::shared_ptr<Connection> connection = it->second;
+                if (flags & (EPOLLHUP | EPOLLERR))
+                {
+                    // клиент закрыл соединение совсем: отвечать уже некому
+                    closeConnection(connection);
+                    continue;
+                }
+                if (flags & EPOLLIN)
+                {
+                    receive(connection);
+                }
+                if (!connection->closed && (flags & EPOLLOUT))
+                {
+                    flush(connection);
+                }
+            }
+        }
+    }
+
+    // можно из любого потока и из обработчика сигнала
+    void stop()
+    {
+        stopRequested = true;
+        uint64_t one = 1;
+        ssize_t written = ::write(wake, &one, sizeof(one));
+        (void)written;
+    }
+
+    size_t connectionCount() const
+    {
+        return openConnections;
+    }
+
+private:
+    struct Connection
+    {
+        int fd = -1;
+
+        // только поток цикла
+        std::string input;
+        uint32_t interest = 0;
+        bool eof = false;
+
+        // под mutex
+        std::mutex mutex;
+        std::deque<std::string> requests;
+        std::string output;
+        size_t written = 0;
+        bool scheduled = false; // соединение у рабочего потока или в очереди к ним
+        bool streaming = false; // курсор SELECT ещё не отдал все строки в output
+        std::atomic<bool> closed{false};
+
+        // когда курсор остановился, дожидаясь, пока клиент заберёт ответ (под mutex)
+        std::chrono::steady_clock::time_point parked;
+
+        // только рабочий поток, пока scheduled; cursor ещё закрывает цикл (expireCursors)
+        Transaction transaction;
+        std::optional<Cursor> cursor;
+        std::vector<std::string> names;
+        uint64_t sent = 0;
+
+        size_t unsent() const
+        {
+            return output.size() - written;
+        }
+    };
+
+    Database& db;
+    int epoll = -1;
+    int wake = -1; // eventfd: рабочие потоки и stop будят цикл
+    std::vector<int> listeners;
+    std::string unixPath;
+    std::unordered_map<int, std::shared_ptr<Connection>> connections;
+    std::atomic<bool> stopRequested{false};
+    std::atomic<size_t> openConnections{0};
+
+    std::mutex queueMutex;
+    std::condition_variable queueReady;
+    std::deque<std::shared_ptr<Connection>> queue;
+    bool stopping = false;
+    std::vector<std::thread> workers;
+
+    // соединения, которым рабочие потоки дописали ответы
+    std::mutex readyMutex;
+    std::vector<std::shared_ptr<Connection>> ready;
+
+    static void closeDescriptor(int fd)
+    {
+        if (fd >= 0)
+        {
+            ::close(fd);
+        }
+    }
+
+    void watch(int fd, uint32_t events, int operation)
+    {
+        epoll_event event{};
+        event.events = events;
+        event.data.fd = fd;
+        if (::epoll_ctl(epoll, operation, fd, &event) != 0)
+        {
+            throw std::runtime_error("epoll_ctl failed");
+        }
+    }
+
+    void addListener(int fd)
+    {
+        watch(fd, EPOLLIN, EPOLL_CTL_ADD);
+        listeners.push_back(fd);
+    }
+
+    void acceptAll(int listener)
+    {
+        while (true)
+        {
+            int fd = ::accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0)
+            {
+                if (errno == EINTR || errno == ECONNABORTED)
+                {
+                    continue;
+                }
+                // EAGAIN - принимать больше некого; EMFILE и подобные - попробуем при следующем событии
+                return;
+            }
+            int one = 1;
+            ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            auto connection = std::make_shared<Connection>();
+            connection->fd = fd;
+            connection->interest = EPOLLIN;
+            watch(fd, EPOLLIN, EPOLL_CTL_ADD);
+            connections[fd] = std::move(connection);
+            ++openConnections;
+        }
+    }
+
+    void closeConnection(const std::shared_ptr<Connection>& connection)
+    {
+        if (connection->closed.exchange(true))
+        {
+            return;
+        }
+        ::epoll_ctl(epoll, EPOLL_CTL_DEL, connection->fd, nullptr);
+        ::close(connection->fd);
+        connections.erase(connection->fd);
+        --openConnections;
+    }
+
+    // читает всё, что пришло, и ставит целые кадры запросов в очередь соединения
+    void receive(const std::shared_ptr<Connection>& connection)
+    {
+        char buffer[64 * 1024];
+        while (true)
+        {
+            ssize_t size = ::recv(connection->fd, buffer, sizeof(buffer), 0);
+            if (size > 0)
+            {
+                connection->input.append(buffer, size_t(size));
+                if (size_t(size) < sizeof(buffer))
+                {
+                    break;
+                }
+                continue;
+            }
+            if (size == 0)
+            {
+                connection->eof = true;
+                break;
+            }
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                break;
+            }
+            closeConnection(connection);
+            return;
+        }
+
+        std::vector<std::string> queries;
+        size_t offset = 0;
+        try
+        {
+            FrameKind kind;
+            std::string_view payload;
+            while (Protocol::nextFrame(connection->input, offset, kind, payload))
+            {
+                if (kind != FrameKind::QUERY)
+                {
+                    throw std::runtime_error("Unexpected frame from client");
+                }
+                queries.emplace_back(payload);
+            }
+        }
+        catch (const std::exception&)
+        {
+            closeConnection(connection);
+            return;
+        }
+        connection->input.erase(0, offset);
+        if (!queries.empty())
+        {
+            std::lock_guard<std::mutex> lock(connection->mutex);
+            for (std::string& query : queries)
+            {
+                connection->requests.push_back(std::move(query));
+            }
+            if (!connection->scheduled && connection->unsent() < kHighWater)
+            {
+                schedule(connection);
+            }
+        }
+        update(connection);
+    }
+
+    // отправляет, сколько примет сокет, и возвращает соединение рабочим, когда клиент всё прочитал
+    void flush(const std::shared_ptr<Connection>& connection)
+    {
+        bool failed = false;
+        {
+            std::lock_guard<std::mutex> lock(connection->mutex);
+            while (connection->unsent() > 0)
+            {
+                ssize_t size = ::send(connection->fd, connection->output.data() + connection->written,
+                        connection->unsent(), MSG_NOSIGNAL);
+                if (size > 0)
+                {
+                    connection->written += size_t(size);
+                    continue;
+                }
+                if (size < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                if (size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                {
+                    break;
+                }
+                failed = true;
+                break;
+            }
+            if (connection->unsent() == 0)
+            {
+                connection->output.clear();
+                connection->written = 0;
+            }
+            else if (connection->written > kLowWater)
+            {
+                connection->output.erase(0, connection->written);
+                connection->written = 0;
+            }
+            if (!connection->scheduled && connection->unsent() < kLowWater &&
+                (connection->streaming || !connection->requests.empty()))
+            {
+                schedule(connection);
+            }
+        }
+        if (failed)
+        {
+            closeConnection(connection);
+            return;
+        }
+        update(connection);
+    }
+
+    // Подписка epoll по состоянию соединения: читать, пока клиент не закрыл свою сторону и очередь
+    // запросов не переполнена, писать, пока есть неотправленное. Клиент, закрывший свою сторону,
+    // получает все ответы, после чего соединение закрывается
+    void update(const std::shared_ptr<Connection>& connection)
+    {
+        if (connection->closed)
+        {
+            return;
+        }
+        uint32_t interest = 0;
+        bool finished = false;
+        {
+            std::lock_guard<std::mutex> lock(connection->mutex);
+            if (!connection->eof && connection->requests.size() < kMaxQueued)
+            {
+                interest |= EPOLLIN;
+            }
+            if (connection->unsent() > 0)
+            {
+                interest |= EPOLLOUT;
+            }
+            finished = connection->eof && !connection->scheduled && !connection->streaming &&
+                    connection->requests.empty() && connection->unsent() == 0;
+        }
+        if (finished)
+        {
+            closeConnection(connection);
+            return;
+        }
+        if (interest != connection->interest)
+        {
+            watch(connection->fd, interest, EPOLL_CTL_MOD);
+            connection->interest = interest;
+        }
+    }
+
+    // закрывает курсоры, которые дольше cursorTimeout ждут медленного клиента: соединение не у рабочего
+    // потока, а клиент ещё не забрал готовые пачки (иначе flush вернул бы соединение рабочим)
+    void expireCursors()
+    {
+        auto now = std::chrono::steady_clock::now();
+        for (const auto& [fd, connection] : connections)
+        {
+            std::lock_guard<std::mutex> lock(connection->mutex);
+            if (connection->scheduled || !connection->streaming || now - connection->parked < cursorTimeout)
+            {
+                continue;
+            }
+            connection->cursor.reset();
+            connection->streaming = false;
+            Protocol::appendFrame(connection->output, FrameKind::ERROR, "Cursor timed out: client is not reading");
+        }
+    }
+
+    void flushReady()
+    {
+        std::vector<std::shared_ptr<Connection>> batch;
+        {
+            std::lock_guard<std::mutex> lock(readyMutex);
+            batch.swap(ready);
+        }
+        for (const std::shared_ptr<Connection>& connection : batch)
+        {
+            if (!connection->closed)
+            {
+                flush(connection);
+            }
+        }
+    }
+
+    // вызывающий держит mutex соединения
+    void schedule(const std::shared_ptr<Connection>& connection)
+    {
+        connection->scheduled = true;
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            queue.push_back(connection);
+        }
+        queueReady.notify_one();
+    }
+
+    void notify(const std::shared_ptr<Connection>& connection)
+    {
+        {
+            std::lock_guard<std::mutex> lock(readyMutex);
+            ready.push_back(connection);
+        }
+        uint64_t one = 1;
+        ssize_t written = ::write(wake, &one, sizeof(one));
+        (void)written;
+    }
+
+    void work()
+    {
+        while (true)
+        {
+            std::shared_ptr<Connection> connection;
+            {
+                std::unique_lock<std::mutex> lock(queueMutex);
+                // будят schedule и деструктор; срок ожидания - только потому, что wait без него
+                // требует libstdc++ новее, чем у GTest из сборки (см. ThreadPool::work)
+                while (!stopping && queue.empty())
+                {
+                    queueReady.wait_for(lock, std::chrono::hours(1));
+                }
+                if (stopping)
+                {
+                    return;
+                }
+                connection = std::move(queue.front());
+                queue.pop_front();
+            }
+            serve(connection);
+            notify(connection);
+        }
+    }
+
+    // отвечает на запросы соединения, пока они есть и клиент успевает забирать ответы
+    void serve(const std::shared_ptr<Connection>& connection)
+    {
+        Connection& state = *connection;
+        while (true)
+        {
+            std::string query;
+            bool next = false;
+            {
+                std::lock_guard<std::mutex> lock(state.mutex);
+                if (state.closed || state.unsent() >= kHighWater || (!state.streaming && state.requests.empty()))
+                {
+                    if (state.closed)
+                    {
+                        state.cursor.reset();
+                    }
+                    state.parked = std::chrono::steady_clock::now();
+                    state.scheduled = false;
+                    return;
+                }
+                if (!state.streaming)
+                {
+                    query = std::move(state.requests.front());
+                    state.requests.pop_front();
+                    next = true;
+                }
+            }
+            std::string out;
+            if (next)
+            {
+                answer(state, query, out);
+            }
+            else
+            {
+                appendRows(state, out);
+            }
+            bool wasEmpty;
+            {
+                std::lock_guard<std::mutex> lock(state.mutex);
+                wasEmpty = state.unsent() == 0;
+                state.output += out;
+                state.streaming = state.cursor.has_value();
+            }
+            if (wasEmpty)
+            {
+                notify(connection);
+            }
+        }
+    }
+
+    void answer(Connection& state, const std::string& query, std::string& out)
+    {
+        try
+        {
+            std::unique_ptr<Query> parsed = db.parser.parse(query);
+            if (typeid(*parsed) == typeid(SelectQuery))
+            {
+                state.cursor.emplace(db.openCursor(SelectQuery(std::move(parsed))));
+                state.names = state.cursor->columnNames();
+                state.sent = 0;
+                std::vector<int> types;
+                for (size_t k = 0; k < state.names.size(); ++k)
+                {
+                    types.push_back(state.cursor->column(k).type);
+                }
+                Protocol::appendHeader(out, state.names, types);
+                appendRows(state, out);
+                return;
+            }
+            Table status = db.executeParsed(std::move(parsed), query, state.transaction);
+            auto affected = status.columns.find("affected_rows");
+            std::string count;
+            Protocol::put(count, uint64_t(affected == status.columns.end() || affected->second.empty() ? 0 : affected->second.get_int(0)));
+            Protocol::appendFrame(out, FrameKind::DONE, count);
+        }
+        catch (const std::exception& e)
+        {
+            state.cursor.reset();
+            Protocol::appendFrame(out, FrameKind::ERROR, e.what());
+        }
+    }
+
+    // следующая пачка строк из курсора SELECT; после последней - DONE
+    void appendRows(Connection& state, std::string& out)
+    {
+        try
+        {
+            Table batch;
+            size_t rows = state.cursor->fetch(batch, kBatchRows);
+            if (rows > 0)
+            {
+                std::vector<const Column*> columns;
+                for (const std::string& columnName : state.names)
+                {
+                    columns.push_back(&batch.columns.at(columnName));
+                }
+                Protocol::appendRows(out, columns, 0, rows);
+                state.sent += rows;
+            }
+        }
+        catch (const std::exception& e)
+        {
+            // например, пачка не влезла в кадр: ответ на запрос обрывается ошибкой
+            state.cursor.reset();
+            Protocol::appendFrame(out, FrameKind::ERROR, e.what());
+            return;
+        }
+        if (state.cursor->done())
+        {
+            std::string count;
+            Protocol::put(count, state.sent);
+            Protocol::appendFrame(out, FrameKind::DONE, count);
+            state.cursor.reset();
+        }
+    }
+};
+
+#endif // SERVER_H
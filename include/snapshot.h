@@ -0,0 +1,412 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "checksum.h"
+#include "mapped_file.h"
+#include "table.h"
+#include "thread_pool.h"
+
+// Бинарный снимок базы. Файл пишется одним последовательным проходом:
+//   заголовок   "MEMDBSNP", версия (u32), 0 (u32)
+//   блоки       данные колонок как они лежат в памяти: ints, биты bools, str_offsets + str_lengths + blob
+//               для строк, биты nulls; каждый блок выровнен по 8 байт
+//   каталог     LSN журнала, по который снимок содержит изменения (с версии 2), таблицы, колонки,
+//               ограничения, индексы и ссылки на блоки (смещение, размер, контрольная сумма)
+//   хвост       смещение и размер каталога (u64), контрольная сумма каталога (u64), "MEMDBEND"
+// Числа - в порядке байт машины (little-endian на x86/ARM), чужой порядок отбрасывается по заголовку.
+// Чтение отображает файл в память (mmap), проверяет контрольные суммы и копирует блоки в буферы
+// колонок целиком, без разбора отдельных значений; колонки копируются параллельно в пуле
+class Snapshot
+{
+public:
+    static constexpr uint32_t kVersion = 2;
+
+    // lsn - номер последней записи журнала, изменения которой уже есть в tables
+    // Снимок пишется во временный файл рядом и заменяет прежний через rename только целиком и после fsync,
+    // поэтому сбой посреди записи оставляет прежний снимок нетронутым
+    static void write(const std::string& filename, const std::unordered_map<std::string, Table>& tables, uint64_t lsn = 0)
+    {
+        std::string temporary = filename + ".tmp";
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        if (!file.is_open())
+        {
+            throw std::runtime_error("Could not open file");
+        }
+        Writer writer{file, 0};
+        writer.raw(kMagic, sizeof(kMagic));
+        writer.value(kVersion);
+        writer.value(uint32_t(0));
+
+        std::string catalog;
+        put(catalog, lsn);
+        put(catalog, uint32_t(tables.size()));
+        for (const auto& [tableName, table] : tables)
+        {
+            // удалённые строки в снимок не попадают: колонки таблицы с удалениями сначала уплотняются
+            bool compact = table.rowCount() < table.slotCount();
+            std::vector<uint32_t> live;
+            if (compact)
+            {
+                live.reserve(table.rowCount());
+                for (size_t row = 0; row < table.slotCount(); ++row)
+                {
+                    if (!table.isDeleted(row))
+                    {
+                        live.push_back(row);
+                    }
+                }
+            }
+            putString(catalog, tableName);
+            put(catalog, uint64_t(table.rowCount()));
+            put(catalog, uint32_t(table.columns.size()));
+            for (const auto& [columnName, source] : table.columns)
+            {
+                Column packed;
+                if (compact)
+                {
+                    packed = source;
+                    packed.retain_rows(live);
+                }
+                const Column& column = compact ? packed : source;
+                putString(catalog, columnName);
+                put(catalog, uint8_t(column.type));
+                put(catalog, uint8_t((column.is_key ? 1 : 0) | (column.is_unique ? 2 : 0) | (column.is_autoincrement ? 4 : 0)));
+                put(catalog, column.next_autoincrement);
+                if (column.type == 0)
+                {
+                    putBlock(catalog, writer.block(column.ints));
+                }
+                else if (column.type == 1)
+                {
+                    putBlock(catalog, writer.block(column.bools));
+                }
+                else
+                {
+                    putBlock(catalog, writer.block(column.str_offsets));
+                    putBlock(catalog, writer.block(column.str_lengths));
+                    putBlock(catalog, writer.block(column.blob));
+                }
+                putBlock(catalog, writer.block(column.nulls));
+            }
+            put(catalog, uint32_t(table.indexes.size()));
+            for (const auto& [columnName, index] : table.indexes)
+            {
+                putString(catalog, columnName);
+                putString(catalog, index.name);
+            }
+            put(catalog, uint32_t(table.orderedIndexes.size()));
+            for (const auto& [columnName, index] : table.orderedIndexes)
+            {
+                putString(catalog, columnName);
+                putString(catalog, index.name);
+            }
+        }
+
+        uint64_t catalogOffset = writer.offset;
+        writer.raw(catalog.data(), catalog.size());
+        writer.value(catalogOffset);
+        writer.value(uint64_t(catalog.size()));
+        writer.value(Checksum::of(catalog.data(), catalog.size()));
+        writer.raw(kEndMagic, sizeof(kEndMagic));
+        file.close();
+        if (file.fail() || !sync(temporary, O_RDONLY) || ::rename(temporary.c_str(), filename.c_str()) != 0)
+        {
+            ::unlink(temporary.c_str());
+            throw std::runtime_error("Could not write snapshot: " + filename);
+        }
+        // rename переживает отключение питания только после fsync каталога
+        size_t slash = filename.rfind('/');
+        std::string directory = slash == std::string::npos ? "." : slash == 0 ? "/" : filename.substr(0, slash);
+        if (!sync(directory, O_RDONLY | O_DIRECTORY))
+        {
+            throw std::runtime_error("Could not sync snapshot directory: " + directory);
+        }
+    }
+
+    // Таблицы снимка (без пула - его задаёт Database) и, если lsn не nullptr, LSN журнала снимка
+    // (0 для версии 1). Повреждённый или чужой файл - runtime_error
+    static std::vector<Table> read(const std::string& filename, ThreadPool* pool, uint64_t* lsn = nullptr)
+    {
+        MappedFile mapped(filename);
+        const char* data = mapped.data;
+        size_t size = mapped.size;
+        const size_t headerSize = sizeof(kMagic) + 2 * sizeof(uint32_t);
+        const size_t trailerSize = 3 * sizeof(uint64_t) + sizeof(kEndMagic);
+        if (size < headerSize + trailerSize || std::memcmp(data, kMagic, sizeof(kMagic)) != 0 ||
+            std::memcmp(data + size - sizeof(kEndMagic), kEndMagic, sizeof(kEndMagic)) != 0)
+        {
+            throw std::runtime_error("Not a snapshot file: " + filename);
+        }
+        uint32_t version;
+        std::memcpy(&version, data + sizeof(kMagic), sizeof(version));
+        if (version == 0 || version > kVersion)
+        {
+            throw std::runtime_error("Unsupported snapshot version " + std::to_string(version));
+        }
+        uint64_t trailer[3];
+        std::memcpy(trailer, data + size - trailerSize, sizeof(trailer));
+        uint64_t catalogOffset = trailer[0];
+        uint64_t catalogSize = trailer[1];
+        if (catalogOffset < headerSize || catalogOffset > size - trailerSize || catalogSize != size - trailerSize - catalogOffset ||
+            Checksum::of(data + catalogOffset, catalogSize) != trailer[2])
+        {
+            throw std::runtime_error("Corrupted snapshot catalog");
+        }
+
+        // каталог разбирается сразу, блоки копируются потом, по одной задаче на колонку
+        Reader catalog{data + catalogOffset, data + catalogOffset + catalogSize};
+        uint64_t snapshotLsn = version >= 2 ? catalog.get<uint64_t>() : 0;
+        if (lsn != nullptr)
+        {
+            *lsn = snapshotLsn;
+        }
+        std::vector<Table> tables(catalog.get<uint32_t>());
+        std::vector<ColumnLoad> loads;
+        std::vector<std::vector<std::pair<std::string, std::string>>> hashIndexes(tables.size());
+        std::vector<std::vector<std::pair<std::string, std::string>>> orderedIndexes(tables.size());
+        for (size_t t = 0; t < tables.size(); ++t)
+        {
+            Table& table = tables[t];
+            table.name = catalog.getString();
+            uint64_t rows = catalog.get<uint64_t>();
+            uint32_t columnCount = catalog.get<uint32_t>();
+            for (uint32_t c = 0; c < columnCount; ++c)
+            {
+                std::string columnName = catalog.getString();
+                uint8_t type = catalog.get<uint8_t>();
+                if (type > 3)
+                {
+                    throw std::runtime_error("Corrupted snapshot catalog");
+                }
+                table.addColumn(columnName, type);
+                ColumnLoad load{t, columnName, &table.columns[columnName], rows, catalog.get<uint8_t>(), catalog.get<int32_t>(), {}};
+                for (size_t b = 0, blocks = type >= 2 ? 4 : 2; b < blocks; ++b)
+                {
+                    load.blocks.push_back(catalog.getBlock(catalogOffset));
+                }
+                loads.push_back(std::move(load));
+            }
+            for (auto* indexes : {&hashIndexes[t], &orderedIndexes[t]})
+            {
+                for (uint32_t i = 0, count = catalog.get<uint32_t>(); i < count; ++i)
+                {
+                    std::string columnName = catalog.getString();
+                    indexes->emplace_back(columnName, catalog.getString());
+                }
+            }
+        }
+
+        auto copy = [&loads, data](size_t k) {
+            ColumnLoad& load = loads[k];
+            Column& column = *load.column;
+            const Block* block = load.blocks.data();
+            if (column.type == 0)
+            {
+                fill(column.ints, data, *block++);
+            }
+            else if (column.type == 1)
+            {
+                fill(column.bools, data, *block++);
+            }
+            else
+            {
+                fill(column.str_offsets, data, *block++);
+                fill(column.str_lengths, data, *block++);
+                fill(column.blob, data, *block++);
+            }
+            fill(column.nulls, data, *block);
+            column.adopt_buffers(load.rows);
+            column.next_autoincrement = load.nextAutoincrement;
+        };
+        if (pool != nullptr && pool->workers() > 0)
+        {
+            pool->parallelFor(loads.size(), copy);
+        }
+        else
+        {
+            for (size_t k = 0; k < loads.size(); ++k)
+            {
+                copy(k);
+            }
+        }
+
+        // индексы строятся заново по загруженным колонкам; ограничения проверяются ими же
+        for (size_t t = 0; t < tables.size(); ++t)
+        {
+            for (const auto& [columnName, indexName] : hashIndexes[t])
+            {
+                tables[t].createIndex(columnName, indexName);
+            }
+            for (const auto& [columnName, indexName] : orderedIndexes[t])
+            {
+                tables[t].createOrderedIndex(columnName, indexName);
+            }
+        }
+        for (const ColumnLoad& load : loads)
+        {
+            if (load.flags != 0)
+            {
+                tables[load.table].setConstraints(load.name, load.flags & 1, load.flags & 2, load.flags & 4);
+            }
+        }
+        return tables;
+    }
+
+private:
+    static constexpr char kMagic[8] = {'M', 'E', 'M', 'D', 'B', 'S', 'N', 'P'};
+    static constexpr char kEndMagic[8] = {'M', 'E', 'M', 'D', 'B', 'E', 'N', 'D'};
+
+    struct Block
+    {
+        uint64_t offset;
+        uint64_t size;
+        uint64_t checksum;
+    };
+
+    struct ColumnLoad
+    {
+        size_t table;
+        std::string name;
+        Column* column;
+        uint64_t rows;
+        uint8_t flags;
+        int32_t nextAutoincrement;
+        std::vector<Block> blocks;
+    };
+
+    struct Writer
+    {
+        std::ofstream& file;
+        uint64_t offset;
+
+        void raw(const void* bytes, size_t size)
+        {
+            file.write(static_cast<const char*>(bytes), size);
+            offset += size;
+        }
+
+        template <class T>
+        void value(T number)
+        {
+            raw(&number, sizeof(number));
+        }
+
+        // блок пишется с текущего места и дополняется нулями до кратного 8 смещения
+        template <class Buffer>
+        Block block(const Buffer& buffer)
+        {
+            const char* bytes = reinterpret_cast<const char*>(buffer.data());
+            size_t size = buffer.size() * sizeof(buffer[0]);
+            Block result{offset, size, Checksum::of(bytes, size)};
+            raw(bytes, size);
+            static const char zeros[8] = {};
+            raw(zeros, (8 - offset % 8) % 8);
+            return result;
+        }
+    };
+
+    struct Reader
+    {
+        const char* position;
+        const char* end;
+
+        template <class T>
+        T get()
+        {
+            T number;
+            need(sizeof(number));
+            std::memcpy(&number, position, sizeof(number));
+            position += sizeof(number);
+            return number;
+        }
+
+        std::string getString()
+        {
+            uint32_t size = get<uint32_t>();
+            need(size);
+            std::string text(position, size);
+            position += size;
+            return text;
+        }
+
+        // блоки лежат между заголовком и каталогом
+        Block getBlock(uint64_t catalogOffset)
+        {
+            Block block{get<uint64_t>(), get<uint64_t>(), get<uint64_t>()};
+            if (block.offset > catalogOffset || block.size > catalogOffset - block.offset)
+            {
+                throw std::runtime_error("Corrupted snapshot catalog");
+            }
+            return block;
+        }
+
+        void need(size_t size) const
+        {
+            if (size > size_t(end - position))
+            {
+                throw std::runtime_error("Corrupted snapshot catalog");
+            }
+        }
+    };
+
+    static bool sync(const std::string& path, int flags)
+    {
+        int fd = ::open(path.c_str(), flags);
+        if (fd < 0)
+        {
+            return false;
+        }
+        bool synced = ::fsync(fd) == 0;
+        ::close(fd);
+        return synced;
+    }
+
+    template <class T>
+    static void put(std::string& out, T number)
+    {
+        out.append(reinterpret_cast<const char*>(&number), sizeof(number));
+    }
+
+    static void putString(std::string& out, const std::string& text)
+    {
+        put(out, uint32_t(text.size()));
+        out += text;
+    }
+
+    static void putBlock(std::string& out, const Block& block)
+    {
+        put(out, block.offset);
+        put(out, block.size);
+        put(out, block.checksum);
+    }
+
+    // буфер колонки - копия блока после проверки контрольной суммы
+    template <class Buffer>
+    static void fill(Buffer& buffer, const char* data, const Block& block)
+    {
+        size_t itemSize = sizeof(buffer[0]);
+        if (block.size % itemSize != 0 || Checksum::of(data + block.offset, block.size) != block.checksum)
+        {
+            throw std::runtime_error("Snapshot block checksum mismatch");
+        }
+        buffer.resize(block.size / itemSize);
+        if (block.size != 0)
+        {
+            std::memcpy(&buffer[0], data + block.offset, block.size);
+        }
+    }
+};
+
+#endif // SNAPSHOT_H
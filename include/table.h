@@ -1,229 +1,1803 @@
+#ifndef TABLE_H
+#define TABLE_H
+
+#include <iostream>
 #include <vector>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <stdexcept>
 #include <functional>
+#include <utility>
+#include <algorithm>
+#include <cstdint>
+#include <mutex>
+#include <shared_mutex>
 
 #include "column.h"
 #include "line.h"
+#include "query_condition.h"
+#include "index.h"
+#include "thread_pool.h"
+#include "radix_join.h"
+#include "mvcc.h"
 
-//TODO: добавть smart ptrs
-// потому что несколько таблиц могут ссылаться на одни и те же ячейки, и при удалении таблицы,
-// вторая таблица будет ссылаться на уже удаленные ячейки
-
-//C этим нужно будет очень внимательно порабоать
-// во все файлы в ниже в иерархии (line.h, column.h, cells.h) переписать на умные указатели
-
-class Table 
+class Table
 {
 public:
     std::string name;
     std::unordered_map<std::string, Column> columns;
 
+    // Удалённые строки только помечаются в битовой маске (размечена нулями с запасом в reserveRows) и сразу
+    // перестают быть видны select/update/join/save. Колонки переписываются одним проходом в compact(),
+    // когда доля удалённых строк превышает compactThreshold
+    RowBuffer<uint64_t> deleted;
+    size_t deletedCount = 0;
+    double compactThreshold = 0.25;
+
+    // сегменты маски deleted, изменённые после последней контрольной точки (колонки помечают свои сами)
+    DirtySegments deletedDirty;
+
+    // сколько строк за раз проверяет forEachMatching
+    static constexpr size_t kBatchSize = QueryCondition::kBlockRows;
+
+    // Пул потоков (его задаёт Database): полный проход select/update/remove, join и копирование колонок
+    // делятся на морсели по kMorselRows строк и выполняются параллельно, результаты склеиваются по порядку.
+    // Без пула и для таблиц меньше parallelThreshold строк всё выполняется в вызывающем потоке
+    std::shared_ptr<ThreadPool> pool;
+    size_t parallelThreshold = 64 * 1024;
+    static constexpr size_t kMorselRows = 16 * kBatchSize;
+
+    // хеш-индексы по имени колонки; поддерживаются insert/update/remove/compact
+    std::unordered_map<std::string, HashIndex> indexes;
+
+    // упорядоченные индексы (B+-дерево) по имени колонки: диапазоны и обход в порядке значений
+    std::unordered_map<std::string, OrderedIndex> orderedIndexes;
+
+    // Часы версий (их задаёт Database, формат версий - в mvcc.h). С ними UPDATE дописывает новые версии
+    // строк, а UPDATE и DELETE помечают старые истёкшими, не трогая их значений, так что читатели
+    // снимков (методы с ReadView) не мешают запросам, которые пишут в таблицу. Индексы содержат все
+    // неубранные версии. Без часов строки меняются и удаляются на месте, как раньше
+    std::shared_ptr<VersionClock> clock;
+    RowVersions versions;
+
     Table() = default;
 
     Table(const std::string& tableName) : name(tableName) {
         columns.clear();
-    } 
+    }
 
-    void addColumn(const std::string &columnName, int type) 
+    void addColumn(const std::string &columnName, int type)
     {
         columns[columnName] = Column(type);
     }
 
-    void insert(Line& line) 
+    // Ограничения колонки: key (уникальная и не NULL), unique, autoincrement (только int32).
+    // Для уникальности у колонки должен быть хеш-индекс: он создаётся здесь, если его ещё нет
+    void setConstraints(const std::string& columnName, bool isKey, bool isUnique, bool isAutoincrement)
     {
-        for (auto& [columnName, column] : columns) 
+        auto it = columns.find(columnName);
+        if (it == columns.end())
+        {
+            throw std::invalid_argument("Column not found: " + columnName);
+        }
+        Column& column = it->second;
+        if (isAutoincrement && column.type != 0)
+        {
+            throw std::invalid_argument("Autoincrement column must be int32: " + columnName);
+        }
+        std::vector<uint32_t> rows = liveRows();
+        if (isKey || isUnique)
         {
-            if (line.cells.find(columnName) != line.cells.end()) 
+            // строки проверяются до создания индекса: при ошибке таблица остаётся без него
+            std::unordered_set<int32_t> numbers;
+            std::unordered_set<std::string_view> texts;
+            for (uint32_t row : rows)
+            {
+                if (column.is_null(row))
+                {
+                    if (isKey)
+                    {
+                        throw std::invalid_argument("Key column contains NULL: " + columnName);
+                    }
+                    continue;
+                }
+                Datum key = Datum::from_column(column, row);
+                if (!(key.is_number() ? numbers.insert(key.number).second : texts.insert(key.text).second))
+                {
+                    throw std::invalid_argument("Duplicate value in unique column: " + columnName);
+                }
+            }
+            if (indexes.find(columnName) == indexes.end())
             {
-                column.cells.push_back(line.cells.at(columnName));
-            } 
-            else 
+                createIndex(columnName);
+            }
+        }
+        int32_t next = column.next_autoincrement;
+        if (isAutoincrement)
+        {
+            for (uint32_t row : rows)
             {
-                throw std::invalid_argument("Missing value for column: " + columnName);
+                if (!column.is_null(row) && column.get_int(row) >= next)
+                {
+                    next = autoincrementAfter(column.get_int(row));
+                }
             }
         }
+        column.is_key = isKey;
+        column.is_unique = isKey || isUnique;
+        column.is_autoincrement = isAutoincrement;
+        column.next_autoincrement = next;
     }
 
-    Table select(const std::string& newTableName, const std::vector<std::string>& columnNames, const std::function<bool(const Line&)>& condition) 
+    // число живых строк
+    size_t rowCount() const
     {
-        Table result(newTableName);
+        return slotCount() - deletedCount - expiring.size();
+    }
 
-        // Добавляем столбцы в результирующую таблицу
-        for (const auto& columnName : columnNames) 
+    // число строк в колонках вместе с удалёнными, номера строк идут от 0 до slotCount()
+    size_t slotCount() const
+    {
+        return columns.empty() ? 0 : columns.begin()->second.size();
+    }
+
+    // строки, которые может видеть читатель view (nullptr - последнее состояние таблицы)
+    size_t slotCount(const ReadView* view) const
+    {
+        return view ? view->rows : slotCount();
+    }
+
+    // строки нет в последнем состоянии таблицы (удалена или заменена новой версией)
+    bool isDeleted(size_t row) const
+    {
+        return isReclaimed(row) || !versions.current(row);
+    }
+
+    bool isVisible(size_t row, const ReadView* view) const
+    {
+        if (view == nullptr)
         {
-            if (columns.find(columnName) != columns.end()) 
-            {
-                result.addColumn(columnName, columns[columnName].type);
-            } 
-            else 
-            {
-                throw std::invalid_argument("Column not found: " + columnName);
-            }
+            return !isDeleted(row);
+        }
+        return row < view->rows && !isReclaimed(row) && versions.visible(row, *view);
+    }
+
+    // Читатель снимка держит это, пока работает со строками таблицы: прежние буферы, из которых
+    // он мог начать читать, не освобождаются после их роста (см. reserveRows), а compact ждёт,
+    // пока читателей не останется
+    std::shared_lock<std::shared_mutex> holdRows() const
+    {
+        return std::shared_lock<std::shared_mutex>(latches.growth);
+    }
+
+    // Убирает истёкшие версии, которых не видит ни один открытый снимок: они становятся удалёнными
+    // строками и уходят из индексов. Вызывается после каждого изменения таблицы
+    void collectGarbage()
+    {
+        if (expiring.empty())
+        {
+            return;
+        }
+        uint64_t horizon = clock ? clock->horizon() : RowVersions::kNever;
+        std::vector<uint32_t> reclaimed, kept;
+        for (uint32_t row : expiring)
+        {
+            (versions.expiredAt(row) <= horizon ? reclaimed : kept).push_back(row);
+        }
+        if (reclaimed.empty())
+        {
+            return;
+        }
+        expiring = std::move(kept);
+        std::sort(reclaimed.begin(), reclaimed.end());
+        markDeleted(reclaimed);
+    }
+
+    // все изменения таблицы попали в контрольную точку
+    void markClean()
+    {
+        for (auto& [columnName, column] : columns)
+        {
+            column.dirty.clear();
         }
+        deletedDirty.clear();
+    }
 
-        size_t rowCount = columns.begin()->second.cells.size();
+    // строка i в виде Line (ячейки создаются заново)
+    Line getLine(size_t i, const std::string& prefix = "") const
+    {
+        Line line;
+        for (const auto& [columnName, column] : columns)
+        {
+            line.addCell(prefix + columnName, column.get_cell(i));
+        }
+        return line;
+    }
 
-        for (size_t i = 0; i < rowCount; ++i) 
+    // Пропущенное или NULL значение autoincrement-колонки заполняется следующим номером,
+    // который записывается и в line
+    void insert(Line& line)
+    {
+        // сначала проверяем строку целиком, чтобы не вставить её частично
+        for (auto& [columnName, column] : columns)
         {
-            Line line;
-            for (const auto& [columnName, column] : columns) 
+            auto it = line.cells.find(columnName);
+            if (column.is_autoincrement && (it == line.cells.end() || it->second == nullptr))
+            {
+                continue;
+            }
+            if (it == line.cells.end())
             {
-                line.addCell(columnName, column.cells[i]);
+                throw std::invalid_argument("Missing value for column: " + columnName);
+            }
+            if (it->second != nullptr && Column::cell_type(*it->second) != column.type)
+            {
+                throw std::invalid_argument("Wrong value type for column: " + columnName);
             }
-            
-            if (condition(line)) 
+            checkUnique(columnName, it->second, {});
+        }
+        // номера autoincrement тоже до первой записи: исчерпанный счётчик отклоняет строку целиком
+        std::unordered_map<std::string, int32_t> counters;
+        for (const auto& [columnName, column] : columns)
+        {
+            if (column.is_autoincrement)
             {
-                Line resultLine;
-                for (const auto& columnName : columnNames) 
+                std::shared_ptr<Cell>& value = line.cells[columnName];
+                if (value == nullptr)
                 {
-                    resultLine.addCell(columnName, line.cells[columnName]);
+                    value = std::make_shared<CellInt>(column.next_autoincrement);
                 }
-                result.insert(resultLine);
+                counters[columnName] = std::max(column.next_autoincrement, autoincrementAfter(static_cast<const CellInt&>(*value).data));
             }
         }
-        return result;
+        std::unordered_map<std::string, size_t> bytes;
+        for (const auto& [columnName, value] : line.cells)
+        {
+            if (auto text = std::dynamic_pointer_cast<CellString>(value)) {
+                bytes[columnName] = text->data.size();
+            } else if (auto data = std::dynamic_pointer_cast<CellBytes>(value)) {
+                bytes[columnName] = data->data.size();
+            }
+        }
+        uint64_t version = beginVersion();
+        reserveRows(1, bytes);
+        for (auto& [columnName, column] : columns)
+        {
+            if (column.is_autoincrement)
+            {
+                column.next_autoincrement = counters.at(columnName);
+            }
+            column.push_cell(line.cells[columnName]);
+        }
+        addToIndexes(slotCount() - 1, slotCount(), version);
+        commitVersion(version);
     }
 
-    void update(const std::unordered_map<std::string, std::function<std::shared_ptr<Cell>(std::shared_ptr<Cell>)>>& transformations, 
-            const std::function<bool(const Line&)>& condition) 
+    // Массовая вставка: chunks[c][k] - значения колонки columnNames[k] в куске c, куски дописываются по
+    // порядку целыми буферами. Пропустить можно только autoincrement-колонку (её NULL заполняются
+    // следующими номерами). Ограничения проверяются по индексам после дописывания; при нарушении
+    // таблица возвращается к прежним строкам
+    void appendColumns(const std::vector<std::string>& columnNames, std::vector<std::vector<Column>>& chunks)
     {
-        size_t rowCount = columns.begin()->second.cells.size();
-
-        for (size_t i = 0; i < rowCount; ++i) 
+        // куски каждой колонки таблицы по порядку
+        std::unordered_map<std::string, std::vector<Column*>> pieces;
+        size_t rows = 0;
+        for (auto& chunk : chunks)
+        {
+            size_t chunkRows = chunk.empty() ? 0 : chunk[0].size();
+            for (size_t k = 0; k < columnNames.size(); ++k)
+            {
+                auto it = columns.find(columnNames[k]);
+                if (it == columns.end())
+                {
+                    throw std::invalid_argument("Column not found: " + columnNames[k]);
+                }
+                if (chunk.size() != columnNames.size() || chunk[k].type != it->second.type || chunk[k].size() != chunkRows)
+                {
+                    throw std::invalid_argument("Wrong value type for column: " + columnNames[k]);
+                }
+                pieces[columnNames[k]].push_back(&chunk[k]);
+            }
+            rows += chunkRows;
+        }
+        for (size_t k = 0; k < columnNames.size(); ++k)
+        {
+            if (pieces[columnNames[k]].size() != chunks.size())
+            {
+                throw std::invalid_argument("Duplicate column: " + columnNames[k]);
+            }
+        }
+        std::vector<Column> generated;
+        generated.reserve(columns.size());
+        for (auto& [columnName, column] : columns)
         {
-            Line line;
-            for (auto& [columnName, column] : columns) 
+            if (pieces.count(columnName))
+            {
+                continue;
+            }
+            if (!column.is_autoincrement)
             {
-                line.addCell(columnName, column.cells[i]);
+                throw std::invalid_argument("Missing value for column: " + columnName);
+            }
+            generated.emplace_back(0);
+            for (size_t r = 0; r < rows; ++r)
+            {
+                generated.back().push_null();
             }
-            if (condition(line)) 
+            pieces[columnName] = {&generated.back()};
+        }
+
+        size_t before = slotCount();
+        std::unordered_map<std::string, int32_t> counters, advanced;
+        std::vector<std::pair<Column*, const std::vector<Column*>*>> appends;
+        for (auto& [columnName, column] : columns)
+        {
+            const std::vector<Column*>& sources = pieces.at(columnName);
+            if (column.is_autoincrement)
             {
-                for (auto& [columnName, transform] : transformations) 
+                counters[columnName] = column.next_autoincrement;
+                int32_t next = column.next_autoincrement;
+                for (Column* source : sources)
                 {
-                    columns[columnName].cells[i] = transform(columns[columnName].cells[i]);
+                    for (size_t r = 0; r < source->size(); ++r)
+                    {
+                        if (source->is_null(r))
+                        {
+                            source->set_int(r, next);
+                        }
+                        next = std::max(next, autoincrementAfter(source->get_int(r)));
+                    }
                 }
+                advanced[columnName] = next;
+            }
+            appends.emplace_back(&column, &sources);
+        }
+        for (const auto& [columnName, next] : advanced)
+        {
+            columns.at(columnName).next_autoincrement = next;
+        }
+        std::unordered_map<std::string, size_t> bytes;
+        for (const auto& [columnName, sources] : pieces)
+        {
+            for (const Column* source : sources)
+            {
+                bytes[columnName] += source->blob.size();
+            }
+        }
+        uint64_t version = beginVersion();
+        reserveRows(rows, bytes);
+        auto append = [&appends](size_t k) {
+            Column& column = *appends[k].first;
+            for (const Column* source : *appends[k].second)
+            {
+                column.append_column(*source);
+            }
+        };
+        if (runsParallel(rows) && appends.size() > 1)
+        {
+            pool->parallelFor(appends.size(), append);
+        }
+        else
+        {
+            for (size_t k = 0; k < appends.size(); ++k)
+            {
+                append(k);
             }
         }
-    }
-
-    void remove(const std::function<bool(const Line&)>& condition) 
-    {
-        size_t rowCount = columns.begin()->second.cells.size();
 
-        for (size_t i = 0; i < rowCount; ++i) 
+        addToIndexes(before, before + rows, version);
+        for (const auto& [columnName, column] : columns)
         {
-            Line line;
-            for (auto& [columnName, column] : columns) 
+            if (!column.is_unique)
             {
-                line.addCell(columnName, column.cells[i]);
+                continue;
             }
-            if (condition(line)) 
+            const HashIndex& index = indexes.at(columnName);
+            for (size_t row = before; row < before + rows; ++row)
             {
-                for (auto& [columnName, column] : columns) 
+                if (column.is_null(row) ? column.is_key : currentRows(index, Datum::from_column(column, row)).size() > 1)
                 {
-                    column.cells[i].reset();
-                    //column.cells.erase(std::next(column.cells.begin(), i));
-                    column.cells.erase(column.cells.begin() + i);
+                    truncate(before, counters);
+                    commitVersion(version);
+                    throw std::invalid_argument((column.is_null(row) ? "Key column cannot be NULL: " : "Duplicate value in unique column: ") + columnName);
                 }
-                --i;
-                --rowCount;
             }
         }
+        commitVersion(version);
     }
-    
-    //сейчас нет обработки того, что таблицы можно объединять по совпадающему столбцу
-    //кстати, тут создаются новые экземпляры ячеек, а не копируются указатели (это надо исправить)
-    Table join(const std::string& newTableName, const Table& other, const std::function<bool(const Line&, const Line&)>& condition) 
+
+    void createIndex(const std::string& columnName, const std::string& indexName = "")
     {
-        Table result(newTableName);
+        auto it = columns.find(columnName);
+        if (it == columns.end())
+        {
+            throw std::invalid_argument("Column not found: " + columnName);
+        }
+        HashIndex index(indexName, it->second.type);
+        for (uint32_t row : storedRows())
+        {
+            index.add(it->second, row);
+        }
+        std::unique_lock<std::shared_mutex> lock(latches.indexes);
+        indexes[columnName] = std::move(index);
+    }
 
-        for (const auto& [columnName, column] : columns) 
+    void createOrderedIndex(const std::string& columnName, const std::string& indexName = "")
+    {
+        auto it = columns.find(columnName);
+        if (it == columns.end())
         {
-            result.addColumn(name + "." + columnName, column.type);
+            throw std::invalid_argument("Column not found: " + columnName);
+        }
+        OrderedIndex index(indexName, it->second.type);
+        index.build(it->second, storedRows());
+        std::unique_lock<std::shared_mutex> lock(latches.indexes);
+        orderedIndexes[columnName] = std::move(index);
+    }
+
+    // emit(строка) для живых строк в порядке значений колонки columnName (только из range);
+    // emit возвращает false, чтобы остановить обход. false, если упорядоченного индекса по колонке нет
+    template <class Emit>
+    bool scanOrdered(const std::string& columnName, const KeyRange& range, const Emit& emit, const ReadView* view = nullptr) const
+    {
+        std::shared_lock<std::shared_mutex> lock(latches.indexes);
+        auto index = orderedIndexes.find(columnName);
+        if (index == orderedIndexes.end())
+        {
+            return false;
         }
-        for (const auto& [columnName, column] : other.columns) 
+        index->second.scan(range, [this, &emit, view](uint32_t row) {
+            return !isVisible(row, view) || emit(row);
+        });
+        return true;
+    }
+
+    // копирует строки rows в result по колонкам columnNames
+    void gather(Table& result, const std::vector<std::string>& columnNames, const std::vector<uint32_t>& rows) const
+    {
+        std::vector<RowCopy> copies;
+        for (const auto& columnName : columnNames)
         {
-            result.addColumn(other.name + "." + columnName, column.type);
+            copies.push_back({&result.columns[columnName], &columns.at(columnName), &rows});
         }
+        copyRows(copies, rows.size());
+    }
+
+    Table select(const std::string& newTableName, const std::vector<std::string>& columnNames, const std::function<bool(const Line&)>& condition)
+    {
+        Table result = emptyProjection(newTableName, columnNames);
 
-        size_t rowCount1 = columns.begin()->second.cells.size();
-        size_t rowCount2 = other.columns.begin()->second.cells.size();
+        size_t count = slotCount();
+        std::vector<uint32_t> rows;
 
-        for (size_t i = 0; i < rowCount1; ++i) 
+        for (size_t i = 0; i < count; ++i)
         {
-            Line line1;
-            for (const auto& [columnName, column] : columns) 
+            if (!isDeleted(i) && condition(getLine(i)))
             {
-                line1.addCell(name + "." + columnName, column.cells[i]);
+                rows.push_back(i);
             }
-            for (size_t j = 0; j < rowCount2; ++j) 
-            {
-                Line line2;
-                for (const auto& [columnName, column] : other.columns) 
-                {
-                    line2.addCell(other.name + "." + columnName, column.cells[j]);
-                }
-                if (condition(line1, line2)) 
+        }
+        gather(result, columnNames, rows);
+        return result;
+    }
+
+    // условие уже скомпилировано: привязываем его к колонкам один раз и проверяем строки напрямую
+    Table select(const std::string& newTableName, const std::vector<std::string>& columnNames, const QueryCondition& condition)
+    {
+        Table result = emptyProjection(newTableName, columnNames);
+        gather(result, columnNames, matchingRows(condition));
+        return result;
+    }
+
+    // Если одно из условий AND - равенство индексированной колонки константе или сравнения
+    // колонки с упорядоченным индексом, проверяются только строки из индекса, иначе вся таблица
+    std::vector<uint32_t> matchingRows(const QueryCondition& condition, const ReadView* view = nullptr) const
+    {
+        std::shared_ptr<QueryCondition> bound = condition.bind(columns);
+        return boundMatchingRows(*bound, view);
+    }
+
+    // то же для уже привязанного условия
+    std::vector<uint32_t> boundMatchingRows(const QueryCondition& bound, const ReadView* view = nullptr) const
+    {
+        std::vector<uint32_t> rows;
+        std::vector<uint32_t> candidates;
+        if (indexCandidates(bound, candidates))
+        {
+            forEachCandidate(bound, candidates, [&rows](uint32_t row) {
+                rows.push_back(row);
+                return true;
+            }, view);
+            return rows;
+        }
+        std::vector<std::vector<uint32_t>> parts = forEachMorsel<std::vector<uint32_t>>(slotCount(view),
+                [this, &bound, view](size_t begin, size_t end, std::vector<uint32_t>& part) {
+            scanRange(bound, begin, end, [&part](uint32_t row) {
+                part.push_back(row);
+                return true;
+            }, view);
+        });
+        return concatenate(parts);
+    }
+
+    // Первые limit строк, подходящих под condition, в порядке orderColumn (NULL - в начале по
+    // возрастанию, равные значения - по номеру строки). С limit в памяти держится только куча
+    // из limit строк; по возрастанию по колонке с упорядоченным индексом и без NULL строки берутся
+    // прямо из индекса, и проход останавливается на limit-й подходящей
+    std::vector<uint32_t> sortedRows(const QueryCondition& condition, const std::string& orderColumn, bool descending,
+            size_t limit = SIZE_MAX, const ReadView* view = nullptr) const
+    {
+        auto it = columns.find(orderColumn);
+        if (it == columns.end())
+        {
+            throw std::invalid_argument("Column not found: " + orderColumn);
+        }
+        const Column& key = it->second;
+        std::shared_ptr<QueryCondition> bound = condition.bind(columns);
+        std::vector<uint32_t> rows;
+        if (limit == 0)
+        {
+            return rows;
+        }
+
+        bool hasNulls = false;
+        for (size_t w = 0; w < (slotCount(view) + 63) / 64 && !hasNulls && key.has_nulls(); ++w)
+        {
+            hasNulls = key.null_word(w) != 0;
+        }
+        if (!descending && limit != SIZE_MAX && !hasNulls && orderedIndexes.count(orderColumn))
+        {
+            scanOrdered(orderColumn, KeyRange(), [&](uint32_t row) {
+                if (bound->matches(row))
                 {
-                    Line joinedLine = line1;
-                    for (const auto& [columnName, cell] : line2.cells) 
-                    {
-                        joinedLine.addCell(columnName, cell);
-                    }
-                    for (const auto& [columnName, cell] : joinedLine.cells) 
-                    {
-                        result.columns[columnName].cells.push_back(cell);
-                    }
+                    rows.push_back(row);
                 }
+                return rows.size() < limit;
+            }, view);
+            return rows;
+        }
+
+        auto less = [&key, descending](uint32_t a, uint32_t b) {
+            int cmp;
+            if (key.is_null(a) || key.is_null(b)) {
+                cmp = int(key.is_null(b)) - int(key.is_null(a));
+            } else if (key.type == 0) {
+                cmp = key.get_int(a) < key.get_int(b) ? -1 : (key.get_int(a) > key.get_int(b) ? 1 : 0);
+            } else if (key.type == 1) {
+                cmp = int(key.get_bool(a)) - int(key.get_bool(b));
+            } else {
+                cmp = key.get_string(a).compare(key.get_string(b));
+            }
+            if (descending) {
+                cmp = -cmp;
             }
+            return cmp != 0 ? cmp < 0 : a < b;
+        };
+
+        if (limit == SIZE_MAX)
+        {
+            forEachMatching(*bound, [&rows](uint32_t row) {
+                rows.push_back(row);
+                return true;
+            }, view);
+            std::sort(rows.begin(), rows.end(), less);
+            return rows;
         }
 
-        return result;
+        // куча с наибольшей из отобранных строк наверху: новая строка вытесняет её, если меньше
+        forEachMatching(*bound, [&](uint32_t row) {
+            if (rows.size() < limit)
+            {
+                rows.push_back(row);
+                std::push_heap(rows.begin(), rows.end(), less);
+            }
+            else if (less(row, rows.front()))
+            {
+                std::pop_heap(rows.begin(), rows.end(), less);
+                rows.back() = row;
+                std::push_heap(rows.begin(), rows.end(), less);
+            }
+            return true;
+        }, view);
+        std::sort_heap(rows.begin(), rows.end(), less);
+        return rows;
     }
 
-    void printTable() {
-        std::cout << "Table: " << name << std::endl;
-        for (const auto& column : columns) {
-            std::cout << column.first << "  ";
-            if (column.second.type == 3) {
-                std:: cout << "                                                      ";
+    // update и remove возвращают число затронутых строк
+    size_t update(const std::unordered_map<std::string, std::function<std::shared_ptr<Cell>(std::shared_ptr<Cell>)>>& transformations,
+            const std::function<bool(const Line&)>& condition)
+    {
+        for (const auto& [columnName, transform] : transformations)
+        {
+            if (columns.find(columnName) == columns.end())
+            {
+                throw std::invalid_argument("Column not found: " + columnName);
             }
         }
-        std::cout << std::endl;
 
+        size_t count = slotCount();
+        std::vector<uint32_t> rows;
 
-        size_t numRows = columns.begin()->second.cells.size();
-        
-        for (size_t i = 0; i < numRows; ++i) {
-            for (const auto& column : columns) {
-                if (column.second.cells[i] == nullptr) {
-                    std::cerr << "Error: nullptr detected in column '" << column.first << "' at row " << i << std::endl;
-                    continue;
-                }
-                if (column.second.type == 0) {
-                    std::cout << std::static_pointer_cast<CellInt>(column.second.cells[i])->data << "\t";
-                } else if (column.second.type == 1) {
-                    std::cout << std::static_pointer_cast<CellBool>(column.second.cells[i])->data << "\t";
-                } else if (column.second.type == 2) {
-                    std::cout << std::static_pointer_cast<CellString>(column.second.cells[i])->data << "\t";
-                } else if (column.second.type == 3) {
-                    auto bytes = std::static_pointer_cast<CellBytes>(column.second.cells[i])->data;
-                    for (auto byte : bytes) {
-                        //std::cout << std::hex << static_cast<int>(byte);
-                        std::cout << byte;
-                    }
-                    std::cout << "\t";
-                }
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (!isDeleted(i) && condition(getLine(i)))
+            {
+                rows.push_back(i);
             }
-            std::cout << std::endl;
         }
-        std::cout << std::endl << std::endl << std::endl << std::endl;
+        applyUpdate(rows, transformations);
+        return rows.size();
     }
 
+    size_t update(const std::unordered_map<std::string, std::function<std::shared_ptr<Cell>(std::shared_ptr<Cell>)>>& transformations,
+            const QueryCondition& condition)
+    {
+        for (const auto& [columnName, transform] : transformations)
+        {
+            if (columns.find(columnName) == columns.end())
+            {
+                throw std::invalid_argument("Column not found: " + columnName);
+            }
+        }
+
+        std::vector<uint32_t> rows = matchingRows(condition);
+        applyUpdate(rows, transformations);
+        return rows.size();
+    }
 
-    ~Table() = default;
-};
+    size_t remove(const std::function<bool(const Line&)>& condition)
+    {
+        size_t count = slotCount();
+        std::vector<uint32_t> rows;
 
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (!isDeleted(i) && condition(getLine(i)))
+            {
+                rows.push_back(i);
+            }
+        }
+        removeRows(rows);
+        return rows.size();
+    }
+
+    size_t remove(const QueryCondition& condition)
+    {
+        std::vector<uint32_t> rows = matchingRows(condition);
+        removeRows(rows);
+        return rows.size();
+    }
+
+    // Все изменения таблицы до endTransaction идут в версии транзакции version: её берёт у clock и
+    // подтверждает вызывающий. Пока транзакция открыта, номера строк не меняются (compact откладывается)
+    void beginTransaction(uint64_t version)
+    {
+        if (!clock)
+        {
+            throw std::logic_error("Transactions need a version clock: " + name);
+        }
+        transactionVersion = version;
+        transactionRows = slotCount();
+        transactionCounters.clear();
+        for (const auto& [columnName, column] : columns)
+        {
+            if (column.is_autoincrement)
+            {
+                transactionCounters[columnName] = column.next_autoincrement;
+            }
+        }
+    }
+
+    // Завершает транзакцию. При commit её версия уже подтверждена; иначе таблица возвращается к
+    // состоянию до beginTransaction: дописанные строки отрезаются (см. truncate), истёкшие в транзакции снова живы
+    void endTransaction(bool commit)
+    {
+        uint64_t version = transactionVersion;
+        transactionVersion = 0;
+        if (commit)
+        {
+            collectGarbage();
+            return;
+        }
+        std::vector<uint32_t> kept;
+        for (uint32_t row : expiring)
+        {
+            if (row >= transactionRows)
+            {
+                continue;
+            }
+            if (versions.expiredAt(row) == version)
+            {
+                versions.expire(row, RowVersions::kNever);
+            }
+            else
+            {
+                kept.push_back(row);
+            }
+        }
+        expiring = std::move(kept);
+        if (slotCount() > transactionRows)
+        {
+            truncate(transactionRows, transactionCounters);
+        }
+    }
+
+    // Физически убирает удалённые строки из всех колонок за один линейный проход; номера строк
+    // меняются, поэтому ждёт, пока таблицу не перестанут читать по снимкам
+    void compact()
+    {
+        std::unique_lock<std::shared_mutex> lock(latches.growth);
+        compactRows();
+    }
+
+    //сейчас нет обработки того, что таблицы можно объединять по совпадающему столбцу
+    Table join(const std::string& newTableName, const Table& other, const std::function<bool(const Line&, const Line&)>& condition)
+    {
+        Table result(newTableName);
+
+        for (const auto& [columnName, column] : columns)
+        {
+            result.addColumn(name + "." + columnName, column.type);
+        }
+        for (const auto& [columnName, column] : other.columns)
+        {
+            result.addColumn(other.name + "." + columnName, column.type);
+        }
+
+        size_t rowCount1 = slotCount();
+        size_t rowCount2 = other.slotCount();
+
+        // строки второй таблицы собираем один раз, а не на каждой итерации внешнего цикла
+        std::vector<Line> lines2;
+        lines2.reserve(rowCount2);
+        for (size_t j = 0; j < rowCount2; ++j)
+        {
+            lines2.push_back(other.getLine(j, other.name + "."));
+        }
+
+        std::vector<uint32_t> rows1, rows2;
+        for (size_t i = 0; i < rowCount1; ++i)
+        {
+            if (isDeleted(i))
+            {
+                continue;
+            }
+            Line line1 = getLine(i, name + ".");
+            for (size_t j = 0; j < rowCount2; ++j)
+            {
+                if (!other.isDeleted(j) && condition(line1, lines2[j]))
+                {
+                    rows1.push_back(i);
+                    rows2.push_back(j);
+                }
+            }
+        }
+
+        for (const auto& [columnName, column] : columns)
+        {
+            result.columns[name + "." + columnName].append_rows(column, rows1);
+        }
+        for (const auto& [columnName, column] : other.columns)
+        {
+            result.columns[other.name + "." + columnName].append_rows(column, rows2);
+        }
+
+        return result;
+    }
+
+    // Если среди условий, соединённых AND, есть равенство колонок двух таблиц (users.id = orders.user_id),
+    // выполняется hash join: хеш-таблица строится по меньшей таблице, большая её только пробует,
+    // остальные условия проверяются на найденных парах. Иначе - вложенный цикл по привязанному условию
+    Table join(const std::string& newTableName, const Table& other, const QueryCondition& condition)
+    {
+        std::shared_ptr<QueryCondition> bound = condition.bind([this, &other](const std::string& columnName) {
+            return resolveJoinColumn(other, columnName);
+        });
+        std::vector<const QueryCondition*> parts = bound->conjuncts();
+        const QueryCondition* equality = nullptr;
+        for (const QueryCondition* part : parts)
+        {
+            if (part->is_equi_join())
+            {
+                equality = part;
+                break;
+            }
+        }
+
+        size_t rowCount1 = slotCount();
+        size_t rowCount2 = other.slotCount();
+        std::vector<uint32_t> rows1, rows2;
+
+        if (equality == nullptr)
+        {
+            // вложенный цикл: морсели - по строкам левой таблицы
+            std::vector<RowPairs> found = forEachMorsel<RowPairs>(rowCount1 * (rowCount2 > 0),
+                    [&](size_t begin, size_t end, RowPairs& pairs) {
+                for (size_t i = begin; i < end; ++i)
+                {
+                    if (isDeleted(i))
+                    {
+                        continue;
+                    }
+                    for (size_t j = 0; j < rowCount2; ++j)
+                    {
+                        if (!other.isDeleted(j) && bound->matches(i, j))
+                        {
+                            pairs.left.push_back(i);
+                            pairs.right.push_back(j);
+                        }
+                    }
+                }
+            });
+            concatenate(found, rows1, rows2);
+        }
+        else
+        {
+            const QueryCondition& key1 = equality->left->source == 0 ? *equality->left : *equality->right;
+            const QueryCondition& key2 = equality->left->source == 0 ? *equality->right : *equality->left;
+            bool residual = parts.size() > 1;
+            hashJoin(other, *key1.column, *key2.column, [&](uint32_t i, uint32_t j) {
+                return !residual || bound->matches(i, j);
+            }, rows1, rows2);
+        }
+
+        Table result(newTableName);
+        std::vector<RowCopy> copies;
+        for (const auto& [columnName, column] : columns)
+        {
+            result.addColumn(name + "." + columnName, column.type);
+            copies.push_back({&result.columns[name + "." + columnName], &column, &rows1});
+        }
+        for (const auto& [columnName, column] : other.columns)
+        {
+            result.addColumn(other.name + "." + columnName, column.type);
+            copies.push_back({&result.columns[other.name + "." + columnName], &column, &rows2});
+        }
+        copyRows(copies, rows1.size());
+        return result;
+    }
+
+    void printTable() {
+        std::cout << "Table: " << name << std::endl;
+        for (const auto& column : columns) {
+            std::cout << column.first << "  ";
+            if (column.second.type == 3) {
+                std:: cout << "                                                      ";
+            }
+        }
+        std::cout << std::endl;
+
+
+        size_t numRows = slotCount();
+
+        for (size_t i = 0; i < numRows; ++i) {
+            if (isDeleted(i)) {
+                continue;
+            }
+            for (const auto& column : columns) {
+                if (column.second.is_null(i)) {
+                    std::cerr << "Error: nullptr detected in column '" << column.first << "' at row " << i << std::endl;
+                    continue;
+                }
+                if (column.second.type == 0) {
+                    std::cout << column.second.get_int(i) << "\t";
+                } else if (column.second.type == 1) {
+                    std::cout << column.second.get_bool(i) << "\t";
+                } else {
+                    std::cout << column.second.get_string(i) << "\t";
+                }
+            }
+            std::cout << std::endl;
+        }
+        std::cout << std::endl << std::endl << std::endl << std::endl;
+    }
+
+
+    // emit(строка) для живых строк (видимых снимку view), подходящих под привязанное условие, по
+    // возрастанию номера; emit возвращает false, чтобы остановить проход
+    // Строки проверяются пачками по kBatchSize: при полном проходе - битовой маской строк пачки
+    // (matchBlock), по кандидатам из индекса - вектором выбора (QueryCondition::select)
+    template <class Emit>
+    void forEachMatching(const QueryCondition& bound, const Emit& emit, const ReadView* view = nullptr) const
+    {
+        std::vector<uint32_t> candidates;
+        if (indexCandidates(bound, candidates))
+        {
+            forEachCandidate(bound, candidates, emit, view);
+        }
+        else
+        {
+            scanRange(bound, 0, slotCount(view), emit, view);
+        }
+    }
+
+    // полный проход по строкам [begin, end), begin кратен 64; false - emit остановил проход
+    template <class Emit>
+    bool scanRange(const QueryCondition& bound, size_t begin, size_t end, const Emit& emit, const ReadView* view = nullptr) const
+    {
+        uint64_t words[kBatchSize / 64];
+        for (; begin < end; begin += kBatchSize)
+        {
+            size_t size = std::min(end - begin, kBatchSize);
+            matchBlock(bound, begin, size, words, view);
+            for (size_t w = 0; w * 64 < size; ++w)
+            {
+                for (uint64_t bits = words[w]; bits != 0; bits &= bits - 1)
+                {
+                    if (!emit(uint32_t(begin + w * 64 + __builtin_ctzll(bits))))
+                    {
+                        return false;
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    template <class Emit>
+    void forEachCandidate(const QueryCondition& bound, const std::vector<uint32_t>& candidates, const Emit& emit,
+            const ReadView* view = nullptr) const
+    {
+        std::vector<uint32_t> batch(std::min(candidates.size(), kBatchSize));
+        for (size_t begin = 0; begin < candidates.size(); begin += kBatchSize)
+        {
+            size_t end = std::min(candidates.size(), begin + kBatchSize);
+            size_t selected = 0;
+            for (size_t i = begin; i < end; ++i)
+            {
+                batch[selected] = candidates[i];
+                selected += isVisible(candidates[i], view);
+            }
+            selected = bound.select(batch.data(), selected);
+            for (size_t k = 0; k < selected; ++k)
+            {
+                if (!emit(batch[k]))
+                {
+                    return;
+                }
+            }
+        }
+    }
+
+    bool runsParallel(size_t rows) const
+    {
+        return pool && pool->workers() > 0 && rows >= parallelThreshold;
+    }
+
+    // task(begin, end, result) для морселей [0, count) по kMorselRows строк, параллельно, если
+    // строк достаточно; результаты возвращаются в порядке морселей
+    template <class Result, class Task>
+    std::vector<Result> forEachMorsel(size_t count, const Task& task) const
+    {
+        std::vector<Result> results((count + kMorselRows - 1) / kMorselRows);
+        auto run = [&](size_t m) {
+            task(m * kMorselRows, std::min(count, (m + 1) * kMorselRows), results[m]);
+        };
+        if (runsParallel(count) && results.size() > 1)
+        {
+            pool->parallelFor(results.size(), run);
+        }
+        else
+        {
+            for (size_t m = 0; m < results.size(); ++m)
+            {
+                run(m);
+            }
+        }
+        return results;
+    }
+
+    // маска строк [begin, begin + count) (begin кратен 64, count не больше kBatchSize), которые
+    // не удалены (видны снимку view) и подходят под привязанное условие
+    void matchBlock(const QueryCondition& bound, size_t begin, size_t count, uint64_t* words, const ReadView* view = nullptr) const
+    {
+        size_t n = (count + 63) / 64;
+        for (size_t w = 0; w < n; ++w)
+        {
+            size_t word = begin / 64 + w;
+            words[w] = word < deleted.size() ? ~__atomic_load_n(&deleted[word], __ATOMIC_RELAXED) : ~uint64_t(0);
+        }
+        if (count % 64 != 0)
+        {
+            words[n - 1] &= (uint64_t(1) << (count % 64)) - 1;
+        }
+        bound.refine(begin, count, words);
+        if (view ? view->versioned == 0 : versions.empty())
+        {
+            return;
+        }
+        // версии проверяются только у строк, уже подошедших под условие
+        for (size_t w = 0; w < n; ++w)
+        {
+            for (uint64_t bits = words[w]; bits != 0; bits &= bits - 1)
+            {
+                size_t row = begin + w * 64 + __builtin_ctzll(bits);
+                if (view ? !versions.visible(row, *view) : !versions.current(row))
+                {
+                    words[w] &= ~(uint64_t(1) << (row & 63));
+                }
+            }
+        }
+    }
+
+    // Кандидаты для привязанного условия по индексам. Равенство по хеш-индексу точнее всего; иначе
+    // сравнения с константами по колонке с упорядоченным индексом сводятся в один диапазон
+    // (a >= 1 AND a < 10 - один проход по дереву). false - подходящего индекса нет, нужен полный проход
+    bool indexCandidates(const QueryCondition& bound, std::vector<uint32_t>& rows) const
+    {
+        std::shared_lock<std::shared_mutex> lock(latches.indexes);
+        std::vector<const QueryCondition*> parts = bound.conjuncts();
+        for (const QueryCondition* part : parts)
+        {
+            const QueryCondition* column;
+            const QueryCondition* value;
+            CompareOperator op;
+            if (!part->is_column_vs_constant(column, value, op) || op != CompareOperator::EQUAL)
+            {
+                continue;
+            }
+            auto index = indexes.find(column->column_name);
+            if (index != indexes.end())
+            {
+                rows = index->second.find(value->constant_value());
+                return true;
+            }
+        }
+
+        if (orderedIndexes.empty())
+        {
+            return false;
+        }
+        std::unordered_map<std::string, KeyRange> ranges;
+        for (const QueryCondition* part : parts)
+        {
+            const QueryCondition* column;
+            const QueryCondition* value;
+            CompareOperator op;
+            if (!part->is_column_vs_constant(column, value, op) || !orderedIndexes.count(column->column_name))
+            {
+                continue;
+            }
+            // != и подобные диапазоном не выражаются и колонку в кандидаты не добавляют
+            auto known = ranges.find(column->column_name);
+            KeyRange range = known == ranges.end() ? KeyRange() : known->second;
+            if (range.restrict(op, value->constant_value()))
+            {
+                ranges[column->column_name] = range;
+            }
+        }
+        const std::pair<const std::string, KeyRange>* best = nullptr;
+        for (const auto& entry : ranges)
+        {
+            const KeyRange& range = entry.second;
+            if (!range.empty && !range.has_low && !range.has_high)
+            {
+                continue;
+            }
+            if (best == nullptr || range.empty || (!best->second.empty && range.has_low && range.has_high && !(best->second.has_low && best->second.has_high)))
+            {
+                best = &entry;
+            }
+        }
+        if (best == nullptr)
+        {
+            return false;
+        }
+        rows = orderedIndexes.at(best->first).find(best->second);
+        return true;
+    }
+
+    ~Table() = default;
+
+private:
+    // истёкшие версии, ещё видные открытым снимкам (их убирает collectGarbage)
+    std::vector<uint32_t> expiring;
+    mutable TableLatches latches;
+
+    // память буферов до их последнего роста, которую ещё могут читать снимки (см. reserveRows)
+    std::vector<std::shared_ptr<const void>> retired;
+
+    // открытая транзакция: её версия, число строк и счётчики autoincrement до её начала
+    uint64_t transactionVersion = 0;
+    size_t transactionRows = 0;
+    std::unordered_map<std::string, int32_t> transactionCounters;
+
+    // маска deleted растёт и её слова пишутся, пока её читают снимки
+    bool isReclaimed(size_t row) const
+    {
+        return (row >> 6) < deleted.size() && (__atomic_load_n(&deleted[row >> 6], __ATOMIC_RELAXED) >> (row & 63) & 1);
+    }
+
+    std::vector<uint32_t> liveRows() const
+    {
+        size_t count = slotCount();
+        std::vector<uint32_t> rows;
+        rows.reserve(rowCount());
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (!isDeleted(i))
+            {
+                rows.push_back(i);
+            }
+        }
+        return rows;
+    }
+
+    // строки, которые ещё хранятся и есть в индексах: живые и истёкшие версии, которые видят снимки
+    std::vector<uint32_t> storedRows() const
+    {
+        size_t count = slotCount();
+        std::vector<uint32_t> rows;
+        rows.reserve(count - deletedCount);
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (!isReclaimed(i))
+            {
+                rows.push_back(i);
+            }
+        }
+        return rows;
+    }
+
+    // строки последнего состояния таблицы со значением key по индексу
+    std::vector<uint32_t> currentRows(const HashIndex& index, const Datum& key) const
+    {
+        std::vector<uint32_t> rows = index.find(key);
+        rows.erase(std::remove_if(rows.begin(), rows.end(), [this](uint32_t row) { return isDeleted(row); }), rows.end());
+        return rows;
+    }
+
+    // версия изменения таблицы (0 без часов); до commitVersion его не видят снимки
+    uint64_t beginVersion()
+    {
+        if (transactionVersion != 0)
+        {
+            return transactionVersion;
+        }
+        return clock ? clock->begin() : 0;
+    }
+
+    void commitVersion(uint64_t version)
+    {
+        if (clock && transactionVersion == 0)
+        {
+            clock->commit(version);
+            collectGarbage();
+        }
+    }
+
+    // хватит ли буферов на rows строк; bytes - сколько байт строк ещё допишется в колонку
+    bool hasRoom(size_t rows, const std::unordered_map<std::string, size_t>& bytes) const
+    {
+        if (deleted.size() < (rows + 63) / 64 || (clock && (versions.created.capacity() < rows || versions.created.size() < slotCount())))
+        {
+            return false;
+        }
+        for (const auto& [columnName, column] : columns)
+        {
+            auto extra = bytes.find(columnName);
+            if (!column.fits(rows, column.blob.size() + (extra == bytes.end() ? 0 : extra->second)))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Перед дописыванием extra строк: их должно хватить в буферах колонок, маски deleted и версий, чтобы
+    // по ходу записи они не перевыделялись. Буферы растут с запасом вдвое (не меньше kBatchSize строк) и
+    // не ждут читателей снимков (holdRows): если они есть, прежние буферы остаются в retired, и читатели,
+    // уже взявшие из них указатели, дочитывают их. retired освобождается, когда читателей не остаётся.
+    // Маска deleted сразу получает нулевые слова на весь запас: дальше markDeleted только ставит в них биты
+    void reserveRows(size_t extra, const std::unordered_map<std::string, size_t>& bytes = {})
+    {
+        size_t rows = slotCount() + extra;
+        bool fits = hasRoom(rows, bytes);
+        if (fits && retired.empty())
+        {
+            return;
+        }
+        std::unique_lock<std::shared_mutex> lock(latches.growth, std::try_to_lock);
+        if (lock.owns_lock())
+        {
+            retired.clear();
+        }
+        if (fits)
+        {
+            return;
+        }
+        if (!lock.owns_lock())
+        {
+            for (const auto& [columnName, column] : columns)
+            {
+                column.share_buffers(retired);
+            }
+            retired.push_back(deleted.share());
+            versions.share(retired);
+        }
+        size_t room = std::max(2 * rows, kBatchSize);
+        for (auto& [columnName, column] : columns)
+        {
+            auto it = bytes.find(columnName);
+            column.reserve_room(room, 2 * (column.blob.size() + (it == bytes.end() ? 0 : it->second)));
+        }
+        deleted.resize(std::max(deleted.size(), (room + 63) / 64), 0);
+        if (clock)
+        {
+            versions.cover(slotCount());
+            versions.reserve(room);
+        }
+    }
+
+    // строки [begin, end) только что дописаны в версии version: добавляет их в индексы
+    void addToIndexes(size_t begin, size_t end, uint64_t version)
+    {
+        if (clock)
+        {
+            versions.append(end - begin, version);
+        }
+        std::unique_lock<std::shared_mutex> lock(latches.indexes);
+        for (auto& [columnName, index] : indexes)
+        {
+            const Column& column = columns.at(columnName);
+            for (size_t row = begin; row < end; ++row)
+            {
+                index.add(column, row);
+            }
+        }
+        for (auto& [columnName, index] : orderedIndexes)
+        {
+            const Column& column = columns.at(columnName);
+            for (size_t row = begin; row < end; ++row)
+            {
+                index.add(column, row);
+            }
+        }
+    }
+
+    // индексы заново по хранимым строкам (после смены номеров строк)
+    void rebuildIndexes()
+    {
+        std::vector<uint32_t> rows = storedRows();
+        std::unique_lock<std::shared_mutex> lock(latches.indexes);
+        for (auto& [columnName, index] : indexes)
+        {
+            index.clear();
+            for (uint32_t row : rows)
+            {
+                index.add(columns.at(columnName), row);
+            }
+        }
+        for (auto& [columnName, index] : orderedIndexes)
+        {
+            index.build(columns.at(columnName), rows);
+        }
+    }
+
+    // compact под защёлкой роста, взятой монопольно
+    void compactRows()
+    {
+        retired.clear();
+        if (deletedCount == 0)
+        {
+            return;
+        }
+        std::vector<uint32_t> kept = storedRows();
+        for (auto& [columnName, column] : columns)
+        {
+            column.retain_rows(kept);
+        }
+        versions.retain(kept);
+        deleted.assign(deleted.size(), 0);
+        deletedCount = 0;
+        deletedDirty.mark_range(0, slotCount());
+        expiring.clear();
+        for (size_t row = 0; row < versions.expired.size(); ++row)
+        {
+            if (!versions.current(row))
+            {
+                expiring.push_back(row);
+            }
+        }
+
+        // номера строк сдвинулись - индексы строим заново
+        rebuildIndexes();
+    }
+
+    // Откат дописанных строк (appendColumns, транзакции): счётчики autoincrement - прежние, остаются
+    // первые rows строк, индексы строятся заново. Пока таблицу читают снимки, буферы не перестраиваются:
+    // дописанные строки истекают в версии 0, то есть их не видит никто, и их убирает collectGarbage
+    void truncate(size_t rows, const std::unordered_map<std::string, int32_t>& counters)
+    {
+        for (const auto& [columnName, counter] : counters)
+        {
+            columns.at(columnName).next_autoincrement = counter;
+        }
+        std::unique_lock<std::shared_mutex> lock(latches.growth, std::try_to_lock);
+        if (!lock.owns_lock() && clock)
+        {
+            for (size_t row = rows; row < slotCount(); ++row)
+            {
+                // строки, уже убранные прошлым откатом, второй раз не истекают
+                if (!isReclaimed(row))
+                {
+                    versions.expire(row, 0);
+                    expiring.push_back(row);
+                }
+            }
+            collectGarbage();
+            return;
+        }
+        if (!lock.owns_lock())
+        {
+            lock.lock();
+        }
+        retired.clear();
+        std::vector<uint32_t> kept(rows);
+        for (size_t i = 0; i < rows; ++i)
+        {
+            kept[i] = i;
+        }
+        for (auto& [columnName, column] : columns)
+        {
+            column.retain_rows(kept);
+        }
+        if (versions.created.size() > rows)
+        {
+            versions.retain(kept);
+        }
+        rebuildIndexes();
+    }
+
+    static std::vector<uint32_t> concatenate(const std::vector<std::vector<uint32_t>>& parts)
+    {
+        size_t total = 0;
+        for (const auto& part : parts)
+        {
+            total += part.size();
+        }
+        std::vector<uint32_t> result;
+        result.reserve(total);
+        for (const auto& part : parts)
+        {
+            result.insert(result.end(), part.begin(), part.end());
+        }
+        return result;
+    }
+
+    // пары строк join, найденные одним морселем
+    struct RowPairs
+    {
+        std::vector<uint32_t> left, right;
+    };
+
+    static void concatenate(const std::vector<RowPairs>& parts, std::vector<uint32_t>& rows1, std::vector<uint32_t>& rows2)
+    {
+        for (const auto& part : parts)
+        {
+            rows1.insert(rows1.end(), part.left.begin(), part.left.end());
+            rows2.insert(rows2.end(), part.right.begin(), part.right.end());
+        }
+    }
+
+    // копирование строк rows колонки from в конец колонки to
+    struct RowCopy
+    {
+        Column* to;
+        const Column* from;
+        const std::vector<uint32_t>* rows;
+    };
+
+    // колонки независимы: на больших результатах каждую копирует свой поток
+    void copyRows(const std::vector<RowCopy>& copies, size_t rowCount) const
+    {
+        auto copy = [&copies](size_t k) {
+            copies[k].to->append_rows(*copies[k].from, *copies[k].rows);
+        };
+        if (runsParallel(rowCount) && copies.size() > 1)
+        {
+            pool->parallelFor(copies.size(), copy);
+            return;
+        }
+        for (size_t k = 0; k < copies.size(); ++k)
+        {
+            copy(k);
+        }
+    }
+
+    Table emptyProjection(const std::string& newTableName, const std::vector<std::string>& columnNames) const
+    {
+        Table result(newTableName);
+
+        // Добавляем столбцы в результирующую таблицу
+        for (const auto& columnName : columnNames)
+        {
+            auto it = columns.find(columnName);
+            if (it == columns.end())
+            {
+                throw std::invalid_argument("Column not found: " + columnName);
+            }
+            result.addColumn(columnName, it->second.type);
+        }
+        return result;
+    }
+
+    // "table.column" ищется в своей таблице, имя без префикса - сначала в левой, потом в правой
+    std::pair<int, const Column*> resolveJoinColumn(const Table& other, const std::string& columnName) const
+    {
+        size_t dot = columnName.find('.');
+        if (dot != std::string::npos)
+        {
+            std::string tableName = columnName.substr(0, dot);
+            std::string shortName = columnName.substr(dot + 1);
+            if (tableName == name && columns.count(shortName))
+            {
+                return {0, &columns.at(shortName)};
+            }
+            if (tableName == other.name && other.columns.count(shortName))
+            {
+                return {1, &other.columns.at(shortName)};
+            }
+            return {0, nullptr};
+        }
+        if (columns.count(columnName))
+        {
+            return {0, &columns.at(columnName)};
+        }
+        if (other.columns.count(columnName))
+        {
+            return {1, &other.columns.at(columnName)};
+        }
+        return {0, nullptr};
+    }
+
+    // в rows1/rows2 - пары (строка левой таблицы, строка правой) с равными ключами, для которых
+    // accept(i, j) истинно; NULL ни с чем не совпадает. Пробы большей таблицы идут морселями параллельно
+    template <class Accept>
+    void hashJoin(const Table& other, const Column& key1, const Column& key2, const Accept& accept,
+            std::vector<uint32_t>& rows1, std::vector<uint32_t>& rows2) const
+    {
+        if (slotCount() + other.slotCount() >= parallelThreshold)
+        {
+            radixJoin(other, key1, key2, accept, rows1, rows2);
+        }
+        else if (key1.type >= 2)
+        {
+            hashJoinBy(other, key1, key2, [](const Column& column, size_t row) {
+                return column.get_string(row);
+            }, accept, rows1, rows2);
+        }
+        else
+        {
+            hashJoinBy(other, key1, key2, [](const Column& column, size_t row) {
+                return column.type == 0 ? column.get_int(row) : int32_t(column.get_bool(row));
+            }, accept, rows1, rows2);
+        }
+    }
+
+    // большие таблицы соединяются по разделам (RadixJoin), и с пулом, и без него - тогда порядок
+    // результата не зависит от числа потоков; построение и пробы идут в пуле
+    template <class Accept>
+    void radixJoin(const Table& other, const Column& key1, const Column& key2, const Accept& accept,
+            std::vector<uint32_t>& rows1, std::vector<uint32_t>& rows2) const
+    {
+        std::vector<uint32_t> live1 = liveRows();
+        std::vector<uint32_t> live2 = other.liveRows();
+        bool buildLeft = live1.size() < live2.size();
+        RadixJoin::Side left{&key1, &live1};
+        RadixJoin::Side right{&key2, &live2};
+        std::vector<uint32_t> buildPositions, probePositions;
+        RadixJoin::run(pool.get(), buildLeft ? left : right, buildLeft ? right : left, [&](uint32_t b, uint32_t p) {
+            return buildLeft ? accept(live1[b], live2[p]) : accept(live1[p], live2[b]);
+        }, buildPositions, probePositions);
+
+        const std::vector<uint32_t>& positions1 = buildLeft ? buildPositions : probePositions;
+        const std::vector<uint32_t>& positions2 = buildLeft ? probePositions : buildPositions;
+        rows1.resize(positions1.size());
+        rows2.resize(positions2.size());
+        for (size_t k = 0; k < positions1.size(); ++k)
+        {
+            rows1[k] = live1[positions1[k]];
+            rows2[k] = live2[positions2[k]];
+        }
+    }
+
+    template <class Key, class Accept>
+    void hashJoinBy(const Table& other, const Column& key1, const Column& key2, const Key& key, const Accept& accept,
+            std::vector<uint32_t>& rows1, std::vector<uint32_t>& rows2) const
+    {
+        bool buildLeft = rowCount() < other.rowCount();
+        const Table& buildTable = buildLeft ? *this : other;
+        const Table& probeTable = buildLeft ? other : *this;
+        const Column& build = buildLeft ? key1 : key2;
+        const Column& probe = buildLeft ? key2 : key1;
+        size_t buildCount = buildTable.slotCount();
+        size_t probeCount = probeTable.slotCount();
+
+        // цепочки строк с одинаковым ключом: heads[ключ] -> первая строка, next[строка] -> следующая
+        const uint32_t none = UINT32_MAX;
+        std::unordered_map<decltype(key(build, 0)), uint32_t> heads;
+        heads.reserve(buildCount);
+        std::vector<uint32_t> next(buildCount, none);
+        for (size_t r = buildCount; r-- > 0;)
+        {
+            if (build.is_null(r) || buildTable.isDeleted(r))
+            {
+                continue;
+            }
+            auto [it, inserted] = heads.try_emplace(key(build, r), r);
+            if (!inserted)
+            {
+                next[r] = it->second;
+                it->second = r;
+            }
+        }
+
+        std::vector<RowPairs> found = forEachMorsel<RowPairs>(probeCount, [&](size_t begin, size_t end, RowPairs& pairs) {
+            for (size_t p = begin; p < end; ++p)
+            {
+                if (probe.is_null(p) || probeTable.isDeleted(p))
+                {
+                    continue;
+                }
+                auto it = heads.find(key(probe, p));
+                if (it == heads.end())
+                {
+                    continue;
+                }
+                for (uint32_t b = it->second; b != none; b = next[b])
+                {
+                    uint32_t i = buildLeft ? b : p;
+                    uint32_t j = buildLeft ? p : b;
+                    if (accept(i, j))
+                    {
+                        pairs.left.push_back(i);
+                        pairs.right.push_back(j);
+                    }
+                }
+            }
+        });
+        concatenate(found, rows1, rows2);
+    }
+
+    // Новые значения всех строк rows вычисляются и проверяются до первой записи,
+    // чтобы ошибка типа или нарушение уникальности не оставили обновление сделанным наполовину
+    void applyUpdate(const std::vector<uint32_t>& rows,
+            const std::unordered_map<std::string, std::function<std::shared_ptr<Cell>(std::shared_ptr<Cell>)>>& transformations)
+    {
+        std::vector<std::pair<std::string, std::vector<std::shared_ptr<Cell>>>> updates;
+        for (const auto& [columnName, transform] : transformations)
+        {
+            const Column& column = columns.at(columnName);
+            std::vector<std::shared_ptr<Cell>> values;
+            values.reserve(rows.size());
+            for (uint32_t row : rows)
+            {
+                std::shared_ptr<Cell> value = transform(column.get_cell(row));
+                if (value != nullptr && Column::cell_type(*value) != column.type)
+                {
+                    throw std::invalid_argument("Wrong value type for column: " + columnName);
+                }
+                values.push_back(std::move(value));
+            }
+            if (column.is_unique && rows.size() > 1)
+            {
+                // одинаковые новые значения у разных строк
+                std::unordered_set<int32_t> numbers;
+                std::unordered_set<std::string_view> texts;
+                for (const auto& value : values)
+                {
+                    if (value == nullptr)
+                    {
+                        continue;
+                    }
+                    Datum key = Datum::from_cell(value);
+                    if (!(key.is_number() ? numbers.insert(key.number).second : texts.insert(key.text).second))
+                    {
+                        throw std::invalid_argument("Duplicate value in unique column: " + columnName);
+                    }
+                }
+            }
+            for (const auto& value : values)
+            {
+                checkUnique(columnName, value, rows);
+                if (column.is_autoincrement && value != nullptr)
+                {
+                    autoincrementAfter(static_cast<const CellInt&>(*value).data);
+                }
+            }
+            updates.emplace_back(columnName, std::move(values));
+        }
+
+        if (!clock)
+        {
+            for (const auto& [columnName, values] : updates)
+            {
+                for (size_t k = 0; k < rows.size(); ++k)
+                {
+                    setCell(columnName, rows[k], values[k]);
+                }
+            }
+            return;
+        }
+        if (rows.empty())
+        {
+            return;
+        }
+
+        // с версиями строки не меняются на месте: новые версии дописываются в конец, старые истекают
+        std::unordered_map<std::string, Column> fresh;
+        std::unordered_map<std::string, size_t> bytes;
+        for (auto& [columnName, column] : columns)
+        {
+            Column next(column.type);
+            auto update = std::find_if(updates.begin(), updates.end(), [&](const auto& u) { return u.first == columnName; });
+            if (update == updates.end())
+            {
+                next.append_rows(column, rows);
+            }
+            else
+            {
+                for (const auto& value : update->second)
+                {
+                    next.push_cell(value);
+                    if (column.is_autoincrement && value != nullptr)
+                    {
+                        column.next_autoincrement = std::max(column.next_autoincrement, autoincrementAfter(static_cast<const CellInt&>(*value).data));
+                    }
+                }
+            }
+            bytes[columnName] = next.blob.size();
+            fresh.emplace(columnName, std::move(next));
+        }
+        size_t first = slotCount();
+        uint64_t version = beginVersion();
+        reserveRows(rows.size(), bytes);
+        for (auto& [columnName, column] : columns)
+        {
+            column.append_column(fresh.at(columnName));
+        }
+        addToIndexes(first, first + rows.size(), version);
+        for (uint32_t row : rows)
+        {
+            versions.expire(row, version);
+            expiring.push_back(row);
+        }
+        commitVersion(version);
+    }
+
+    // удаление: с версиями строки только истекают, место освобождает collectGarbage
+    void removeRows(const std::vector<uint32_t>& rows)
+    {
+        if (!clock)
+        {
+            markDeleted(rows);
+            return;
+        }
+        if (rows.empty())
+        {
+            return;
+        }
+        uint64_t version = beginVersion();
+        reserveRows(0);
+        for (uint32_t row : rows)
+        {
+            versions.expire(row, version);
+            expiring.push_back(row);
+        }
+        commitVersion(version);
+    }
+
+    // номер autoincrement после value; после INT32_MAX номеров нет
+    static int32_t autoincrementAfter(int32_t value)
+    {
+        if (value == INT32_MAX)
+        {
+            throw std::invalid_argument("Autoincrement exhausted");
+        }
+        return value + 1;
+    }
+
+    // значение value колонки columnName не должно встречаться в строках вне replaced (по возрастанию)
+    void checkUnique(const std::string& columnName, const std::shared_ptr<Cell>& value, const std::vector<uint32_t>& replaced) const
+    {
+        const Column& column = columns.at(columnName);
+        if (column.is_key && value == nullptr)
+        {
+            throw std::invalid_argument("Key column cannot be NULL: " + columnName);
+        }
+        if (!column.is_unique || value == nullptr)
+        {
+            return;
+        }
+        Datum key = Datum::from_cell(value);
+        const HashIndex& index = indexes.at(columnName);
+        if (!index.contains(key))
+        {
+            return;
+        }
+        // в индексе есть и истёкшие версии, которые ещё видят снимки
+        for (uint32_t row : index.find(key))
+        {
+            if (!isDeleted(row) && !std::binary_search(replaced.begin(), replaced.end(), row))
+            {
+                throw std::invalid_argument("Duplicate value in unique column: " + columnName);
+            }
+        }
+    }
+
+    void setCell(const std::string& columnName, uint32_t row, const std::shared_ptr<Cell>& value)
+    {
+        Column& column = columns.at(columnName);
+        auto index = indexes.find(columnName);
+        auto ordered = orderedIndexes.find(columnName);
+        if (column.is_autoincrement && value != nullptr)
+        {
+            column.next_autoincrement = std::max(column.next_autoincrement, autoincrementAfter(static_cast<const CellInt&>(*value).data));
+        }
+        if (index != indexes.end())
+        {
+            index->second.erase(column, row);
+        }
+        if (ordered != orderedIndexes.end())
+        {
+            ordered->second.erase(column, row);
+        }
+        column.set_cell(row, value);
+        if (index != indexes.end())
+        {
+            index->second.add(column, row);
+        }
+        if (ordered != orderedIndexes.end())
+        {
+            ordered->second.add(column, row);
+        }
+    }
+
+    void markDeleted(const std::vector<uint32_t>& rows)
+    {
+        if (rows.empty())
+        {
+            return;
+        }
+        reserveRows(0);
+        for (uint32_t row : rows)
+        {
+            __atomic_fetch_or(&deleted[row >> 6], uint64_t(1) << (row & 63), __ATOMIC_RELAXED);
+            deletedDirty.mark(row);
+        }
+        {
+            std::vector<uint32_t> sorted;
+            if (!indexes.empty())
+            {
+                sorted = rows;
+                std::sort(sorted.begin(), sorted.end());
+            }
+            std::unique_lock<std::shared_mutex> lock(latches.indexes);
+            for (auto& [columnName, index] : indexes)
+            {
+                index.erase(columns.at(columnName), sorted);
+            }
+            for (auto& [columnName, index] : orderedIndexes)
+            {
+                for (uint32_t row : rows)
+                {
+                    index.erase(columns.at(columnName), row);
+                }
+            }
+        }
+        deletedCount += rows.size();
+        if (transactionVersion == 0 && deletedCount > compactThreshold * slotCount())
+        {
+            // пока открыты снимки, сжатие откладывается до следующего удаления
+            std::unique_lock<std::shared_mutex> lock(latches.growth, std::try_to_lock);
+            if (lock.owns_lock())
+            {
+                compactRows();
+            }
+        }
+    }
+};
 
+#endif //TABLE_H
@@ -0,0 +1,210 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Пул потоков с кражей работы: у каждого потока своя очередь, свои задания он берёт с начала,
+// а когда своя очередь пуста - крадёт с конца чужих.
+// Основной способ использования - parallelFor: задачи раздаются динамически (следующий свободный
+// поток берёт следующий номер), а вызывающий поток работает наравне с пулом, поэтому parallelFor
+// можно вызывать и изнутри задачи пула
+class ThreadPool
+{
+public:
+    explicit ThreadPool(size_t workerCount)
+    {
+        for (size_t i = 0; i < workerCount; ++i)
+        {
+            queues.push_back(std::make_unique<Queue>());
+        }
+        for (size_t i = 0; i < workerCount; ++i)
+        {
+            threads.emplace_back([this, i] { work(i); });
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+    }
+
+    // потоков пула, не считая вызывающего
+    size_t workers() const
+    {
+        return threads.size();
+    }
+
+    // task(i) для всех i из [0, count); возвращается, когда все задачи выполнены.
+    // Если задача бросила исключение, остальные номера не раздаются, а первое исключение пробрасывается
+    template <class Task>
+    void parallelFor(size_t count, const Task& task)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+        struct Progress
+        {
+            std::atomic<size_t> next{0};
+            std::atomic<size_t> active{0};
+            std::mutex mutex;
+            std::condition_variable finished;
+            std::exception_ptr error;
+        };
+        auto progress = std::make_shared<Progress>();
+        auto runner = [progress, &task, count] {
+            for (size_t i; (i = progress->next.fetch_add(1)) < count;)
+            {
+                try
+                {
+                    task(i);
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(progress->mutex);
+                    if (!progress->error)
+                    {
+                        progress->error = std::current_exception();
+                    }
+                    progress->next = count;
+                }
+            }
+            if (progress->active.fetch_sub(1) == 1)
+            {
+                std::lock_guard<std::mutex> lock(progress->mutex);
+                progress->finished.notify_all();
+            }
+        };
+
+        size_t helpers = std::min(workers(), count - 1);
+        progress->active = helpers + 1;
+        for (size_t h = 0; h < helpers; ++h)
+        {
+            push(runner);
+        }
+        runner();
+        // пока помощники не закончили, вызывающий поток сам выполняет задания из очередей
+        while (progress->active.load() != 0)
+        {
+            if (!runOne(queues.size()))
+            {
+                std::unique_lock<std::mutex> lock(progress->mutex);
+                progress->finished.wait_for(lock, std::chrono::milliseconds(1), [&progress] {
+                    return progress->active.load() == 0;
+                });
+            }
+        }
+        if (progress->error)
+        {
+            std::rethrow_exception(progress->error);
+        }
+    }
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()>> jobs;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> threads;
+    std::atomic<size_t> nextQueue{0};
+
+    // спящие потоки ждут на wake, пока pending > 0 или пул не останавливается
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    std::atomic<size_t> pending{0};
+    bool stopping = false;
+
+    void push(std::function<void()> job)
+    {
+        // pending растёт раньше, чем задание появляется в очереди, чтобы никогда не уходить ниже нуля
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            ++pending;
+        }
+        Queue& queue = *queues[nextQueue.fetch_add(1) % queues.size()];
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.jobs.push_back(std::move(job));
+        }
+        wake.notify_one();
+    }
+
+    // выполняет одно задание: своё с начала очереди или чужое с конца; self == queues.size() -
+    // вызывающий поток без своей очереди
+    bool runOne(size_t self)
+    {
+        std::function<void()> job;
+        for (size_t k = 0; k < queues.size() && !job; ++k)
+        {
+            size_t victim = (self + k) % queues.size();
+            Queue& queue = *queues[victim];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.jobs.empty())
+            {
+                continue;
+            }
+            if (victim == self)
+            {
+                job = std::move(queue.jobs.front());
+                queue.jobs.pop_front();
+            }
+            else
+            {
+                job = std::move(queue.jobs.back());
+                queue.jobs.pop_back();
+            }
+        }
+        if (!job)
+        {
+            return false;
+        }
+        --pending;
+        job();
+        return true;
+    }
+
+    void work(size_t self)
+    {
+        while (true)
+        {
+            if (runOne(self))
+            {
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            // wait_for, а не wait: без отметки времени wait требует libstdc++ новее, чем у GTest из сборки
+            wake.wait_for(lock, std::chrono::milliseconds(100), [this] { return stopping || pending.load() > 0; });
+            if (stopping)
+            {
+                return;
+            }
+        }
+    }
+};
+
+#endif // THREAD_POOL_H
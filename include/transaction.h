@@ -0,0 +1,66 @@
+#ifndef TRANSACTION_H
+#define TRANSACTION_H
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "query.h"
+
+// Транзакция одного клиента Database. Между BEGIN и COMMIT изменяющие запросы не выполняются, а
+// копятся здесь вместе с текстом для журнала. COMMIT применяет их все разом: под одними блокировками
+// таблиц, в одной версии (снимки видят либо все изменения транзакции, либо ни одного) и одной группой
+// записей журнала; ошибка любого запроса откатывает всю транзакцию. ROLLBACK просто забывает запросы.
+// SELECT внутри транзакции выполняется сразу и её ещё не применённых изменений не видит
+class Transaction
+{
+public:
+    struct Statement
+    {
+        std::string text;
+        std::unique_ptr<Query> query;
+    };
+
+    bool active() const
+    {
+        return open;
+    }
+
+    void begin()
+    {
+        if (open)
+        {
+            throw std::invalid_argument("Transaction already started");
+        }
+        open = true;
+    }
+
+    void add(std::string text, std::unique_ptr<Query> query)
+    {
+        statements.push_back({std::move(text), std::move(query)});
+    }
+
+    // отдаёт накопленные запросы и закрывает транзакцию
+    std::vector<Statement> finish()
+    {
+        if (!open)
+        {
+            throw std::invalid_argument("No transaction in progress");
+        }
+        open = false;
+        return std::move(statements);
+    }
+
+    size_t size() const
+    {
+        return statements.size();
+    }
+
+private:
+    bool open = false;
+    std::vector<Statement> statements;
+};
+
+#endif // TRANSACTION_H
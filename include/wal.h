@@ -0,0 +1,423 @@
+#ifndef WAL_H
+#define WAL_H
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "checksum.h"
+#include "mapped_file.h"
+
+// Когда запись журнала считается сохранённой:
+//  NONE  - после write(): переживает падение процесса, но не отключение питания;
+//  GROUP - commit ждёт fdatasync; одновременные commit разных потоков делят один fdatasync
+//          (первый из ждущих синхронизирует всё записанное к этому моменту, остальные ждут его);
+//  EVERY - fdatasync после каждой записи, без объединения
+enum class WalSync
+{
+    NONE,
+    GROUP,
+    EVERY
+};
+
+// Журнал упреждающей записи (WAL): изменяющие запросы дописываются в конец файла в виде текста,
+// каждый под своим номером (LSN, растёт на 1). Формат:
+//   заголовок  "MEMDBWAL", версия (u32), 0 (u32)
+//   записи     длина текста (u32), флаги (u32), контрольная сумма (u64), LSN (u64), текст
+// Контрольная сумма покрывает длину, флаги, LSN и текст (в версии 1 - только LSN и текст; такие файлы
+// по-прежнему читаются и дописываются в своём формате).
+// Запись, недописанная при сбое, обнаруживается по длине или контрольной сумме и отрезается при recover.
+// Записи транзакции (appendBatch) идут подряд, у всех, кроме последней, флаг kContinued: recover
+// отдаёт их только целой группой, а группу, оборванную сбоем, отрезает вместе с её началом
+class WriteAheadLog
+{
+public:
+    static constexpr uint32_t kVersion = 2;
+    static constexpr uint32_t kContinued = 1; // за записью идёт следующая запись той же транзакции
+
+    // Записи файла по порядку: visit(lsn, текст). Повреждённый хвост отрезается от файла.
+    // Возвращает LSN последней записи (0, если файла или записей нет)
+    static uint64_t recover(const std::string& filename, const std::function<void(uint64_t, const std::string&)>& visit)
+    {
+        if (::access(filename.c_str(), F_OK) != 0)
+        {
+            return 0;
+        }
+        uint64_t lastLsn = 0;
+        size_t valid = 0;
+        {
+            std::vector<std::pair<uint64_t, std::string>> group; // начатая транзакция
+            size_t groupStart = 0;
+            MappedFile mapped(filename);
+            const char* data = mapped.data;
+            size_t size = mapped.size;
+            if (size == 0)
+            {
+                return 0;
+            }
+            if (size < kHeaderSize || std::memcmp(data, kMagic, sizeof(kMagic)) != 0)
+            {
+                throw std::runtime_error("Not a write-ahead log: " + filename);
+            }
+            uint32_t version = headerVersion(data, filename);
+            valid = kHeaderSize;
+            uint64_t readLsn = 0;
+            size_t offset = kHeaderSize;
+            while (size - offset >= kRecordHeaderSize)
+            {
+                RecordHeader header;
+                std::memcpy(&header, data + offset, sizeof(header));
+                const char* body = data + offset + kRecordHeaderSize - sizeof(uint64_t);
+                if (size - offset - kRecordHeaderSize < header.size || header.lsn <= readLsn ||
+                    recordChecksum(version, header, body) != header.checksum)
+                {
+                    break;
+                }
+                readLsn = header.lsn;
+                if (group.empty())
+                {
+                    groupStart = offset;
+                }
+                group.emplace_back(header.lsn, std::string(data + offset + kRecordHeaderSize, header.size));
+                offset += kRecordHeaderSize + header.size;
+                if (header.flags & kContinued)
+                {
+                    continue;
+                }
+                for (const auto& [lsn, statement] : group)
+                {
+                    visit(lsn, statement);
+                }
+                group.clear();
+                lastLsn = readLsn;
+                valid = offset;
+            }
+            if (!group.empty())
+            {
+                valid = groupStart;
+            }
+            if (valid == size)
+            {
+                return lastLsn;
+            }
+        }
+        if (::truncate(filename.c_str(), off_t(valid)) != 0)
+        {
+            throw std::runtime_error("Could not truncate write-ahead log: " + filename);
+        }
+        return lastLsn;
+    }
+
+    // Файл открывается на дописывание; следующая запись получит LSN lastLsn + 1
+    WriteAheadLog(const std::string& filename, WalSync policy, uint64_t lastLsn)
+        : path(filename), policy(policy), writtenLsn(lastLsn), syncedLsn(lastLsn)
+    {
+        fd = ::open(filename.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+        if (fd < 0)
+        {
+            throw std::runtime_error("Could not open write-ahead log: " + filename);
+        }
+        char header[kHeaderSize] = {};
+        struct stat info;
+        if (::fstat(fd, &info) == 0 && info.st_size == 0)
+        {
+            std::memcpy(header, kMagic, sizeof(kMagic));
+            std::memcpy(header + sizeof(kMagic), &kVersion, sizeof(kVersion));
+            writeAll(header, sizeof(header));
+            syncFile();
+            return;
+        }
+        // записи дописываются в формате уже существующего файла
+        try
+        {
+            if (::pread(fd, header, sizeof(header), 0) != ssize_t(sizeof(header)) ||
+                std::memcmp(header, kMagic, sizeof(kMagic)) != 0)
+            {
+                throw std::runtime_error("Not a write-ahead log: " + filename);
+            }
+            version = headerVersion(header, filename);
+        }
+        catch (...)
+        {
+            ::close(fd);
+            throw;
+        }
+    }
+
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    ~WriteAheadLog()
+    {
+        if (policy != WalSync::NONE)
+        {
+            ::fdatasync(fd);
+        }
+        ::close(fd);
+    }
+
+    // дописывает запись и возвращает её LSN; при политике EVERY запись уже на диске
+    uint64_t append(const std::string& statement)
+    {
+        return appendBatch({statement});
+    }
+
+    // Дописывает записи транзакции одним write и возвращает LSN последней; после сбоя recover
+    // повторит либо все эти записи, либо ни одной
+    uint64_t appendBatch(const std::vector<std::string>& statements)
+    {
+        size_t total = 0;
+        for (const std::string& statement : statements)
+        {
+            total += kRecordHeaderSize + statement.size();
+        }
+        std::string records(total, '\0');
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t offset = 0;
+        for (size_t k = 0; k < statements.size(); ++k)
+        {
+            const std::string& statement = statements[k];
+            uint32_t flags = k + 1 < statements.size() ? kContinued : 0;
+            RecordHeader header{uint32_t(statement.size()), flags, 0, writtenLsn + k + 1};
+            char* record = &records[offset];
+            std::memcpy(record, &header, sizeof(header));
+            std::memcpy(record + kRecordHeaderSize, statement.data(), statement.size());
+            header.checksum = recordChecksum(version, header, record + kRecordHeaderSize - sizeof(uint64_t));
+            std::memcpy(record, &header, sizeof(header));
+            offset += kRecordHeaderSize + statement.size();
+        }
+        writeAll(records.data(), records.size());
+        writtenLsn += statements.size();
+        if (policy == WalSync::EVERY)
+        {
+            syncFile();
+            syncedLsn = writtenLsn;
+        }
+        return writtenLsn;
+    }
+
+    // возвращается, когда запись lsn сохранена согласно политике
+    void commit(uint64_t lsn)
+    {
+        if (policy == WalSync::NONE)
+        {
+            return;
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        while (syncedLsn < lsn)
+        {
+            if (syncing)
+            {
+                // wait_for, а не wait: см. ThreadPool::work
+                synced.wait_for(lock, std::chrono::milliseconds(10));
+                continue;
+            }
+            syncing = true;
+            uint64_t target = writtenLsn;
+            lock.unlock();
+            try
+            {
+                syncFile();
+            }
+            catch (...)
+            {
+                lock.lock();
+                syncing = false;
+                synced.notify_all();
+                throw;
+            }
+            lock.lock();
+            syncing = false;
+            syncedLsn = std::max(syncedLsn, target);
+            ++syncCount;
+            synced.notify_all();
+        }
+    }
+
+    // Убирает из начала журнала записи с LSN не больше lsn (их изменения уже в контрольной точке):
+    // остальные записи переносятся в новый файл, который заменяет старый через rename
+    void discardUpTo(uint64_t lsn)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (syncing)
+        {
+            synced.wait_for(lock, std::chrono::milliseconds(10));
+        }
+        std::string kept;
+        {
+            MappedFile mapped(path);
+            size_t offset = kHeaderSize;
+            while (offset < mapped.size && mapped.size - offset >= kRecordHeaderSize)
+            {
+                RecordHeader header;
+                std::memcpy(&header, mapped.data + offset, sizeof(header));
+                if (header.lsn > lsn)
+                {
+                    break;
+                }
+                offset += kRecordHeaderSize + header.size;
+            }
+            if (offset == kHeaderSize)
+            {
+                return;
+            }
+            kept.assign(mapped.data, kHeaderSize);
+            kept.append(mapped.data + std::min(offset, mapped.size), mapped.data + mapped.size);
+        }
+
+        std::string temporary = path + ".tmp";
+        int replacement = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+        if (replacement < 0)
+        {
+            throw std::runtime_error("Could not open write-ahead log: " + temporary);
+        }
+        std::swap(fd, replacement);
+        try
+        {
+            writeAll(kept.data(), kept.size());
+            syncFile();
+        }
+        catch (...)
+        {
+            std::swap(fd, replacement);
+            ::close(replacement);
+            throw;
+        }
+        if (::rename(temporary.c_str(), path.c_str()) != 0)
+        {
+            std::swap(fd, replacement);
+            ::close(replacement);
+            throw std::runtime_error("Could not replace write-ahead log: " + path);
+        }
+        ::close(replacement);
+        syncedLsn = writtenLsn;
+        // без fsync каталога после отключения питания может вернуться старый файл журнала,
+        // а записи, уже дописанные в новый, - пропасть
+        syncDirectory();
+    }
+
+    uint64_t lastLsn() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return writtenLsn;
+    }
+
+    // сколько раз commit вызывал fdatasync (для проверки объединения)
+    uint64_t syncs() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return syncCount;
+    }
+
+    const std::string& filename() const
+    {
+        return path;
+    }
+
+private:
+    static constexpr char kMagic[8] = {'M', 'E', 'M', 'D', 'B', 'W', 'A', 'L'};
+    static constexpr size_t kHeaderSize = sizeof(kMagic) + 2 * sizeof(uint32_t);
+
+    struct RecordHeader
+    {
+        uint32_t size;
+        uint32_t flags;
+        uint64_t checksum;
+        uint64_t lsn;
+    };
+    static constexpr size_t kRecordHeaderSize = sizeof(RecordHeader);
+
+    std::string path;
+    WalSync policy;
+    int fd = -1;
+    uint32_t version = kVersion; // формат записей открытого файла
+
+    mutable std::mutex mutex;
+    std::condition_variable synced;
+    uint64_t writtenLsn;
+    uint64_t syncedLsn;
+    bool syncing = false;
+    uint64_t syncCount = 0;
+
+    static uint32_t headerVersion(const char* header, const std::string& filename)
+    {
+        uint32_t version;
+        std::memcpy(&version, header + sizeof(kMagic), sizeof(version));
+        if (version == 0 || version > kVersion)
+        {
+            throw std::runtime_error("Unsupported write-ahead log version " + std::to_string(version) + ": " + filename);
+        }
+        return version;
+    }
+
+    // сумма записи; body - её LSN и следом текст длиной header.size
+    static uint64_t recordChecksum(uint32_t version, const RecordHeader& header, const char* body)
+    {
+        uint64_t checksum = Checksum::of(body, sizeof(uint64_t) + header.size);
+        if (version >= 2)
+        {
+            uint32_t fields[2] = {header.size, header.flags};
+            checksum ^= Checksum::of(reinterpret_cast<const char*>(fields), sizeof(fields));
+        }
+        return checksum;
+    }
+
+    void syncDirectory() const
+    {
+        size_t slash = path.rfind('/');
+        std::string directory = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+        int descriptor = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+        if (descriptor < 0 || ::fsync(descriptor) != 0)
+        {
+            if (descriptor >= 0)
+            {
+                ::close(descriptor);
+            }
+            throw std::runtime_error("Could not sync write-ahead log directory: " + directory);
+        }
+        ::close(descriptor);
+    }
+
+    void writeAll(const char* bytes, size_t size)
+    {
+        while (size > 0)
+        {
+            ssize_t written = ::write(fd, bytes, size);
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                throw std::runtime_error("Could not write to write-ahead log: " + path);
+            }
+            bytes += written;
+            size -= size_t(written);
+        }
+    }
+
+    void syncFile()
+    {
+        if (::fdatasync(fd) != 0)
+        {
+            throw std::runtime_error("Could not sync write-ahead log: " + path);
+        }
+    }
+};
+
+#endif // WAL_H
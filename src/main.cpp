@@ -124,15 +124,11 @@ void testUpdate(Database& db) {
     //printTable(db.tables["users"]);
 
     // Проверяем результат
-    for (const auto& [columnName, column] : db.tables["users"].columns) {
-        for (const auto& cell : column.cells) {
-            if (columnName == "login") {
-                auto strCell = std::static_pointer_cast<CellString>(cell);
-                if (strCell->data == "vasya_updated") {
-                    std::cout << "UPDATE test passed: login field updated correctly" << std::endl;
-                    return;
-                }
-            }
+    const Column& logins = db.tables["users"].columns["login"];
+    for (size_t i = 0; i < logins.size(); ++i) {
+        if (logins.get_string(i) == "vasya_updated") {
+            std::cout << "UPDATE test passed: login field updated correctly" << std::endl;
+            return;
         }
     }
     throw std::runtime_error("UPDATE test failed: login field not updated correctly");
@@ -179,9 +175,6 @@ int main() {
     
     std::cout << "testSaveToFile passed.\n";
     
-    //ЭТО ПОКА НЕ РАБОТАЕТ ;(
-    // НО ЕСЛИ ОТТЕБАЖИТ КТО-ТО, БУДЕТ СУПЕР)
-    /*
     std::cout << "testClearBase:\n";
     db.clear();
     std::cout << "db.tables.size() = " << db.tables.size() << std::endl;
@@ -193,7 +186,6 @@ int main() {
         db.printTable(tableName);
     }
     std::cout << "testReadFromFile passed.\n";
-    */
 
 
     
@@ -242,7 +234,7 @@ int main() {
     // Выполняем DELETE
 
     db.remove("users", [](const Line& line) {
-        return static_pointer_cast<CellString>(line.cells.at("login"))->data == "admin";
+        return std::static_pointer_cast<CellString>(line.cells.at("login"))->data == "admin";
     });
 
     // печатаем результаты DELETE
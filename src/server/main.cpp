@@ -0,0 +1,103 @@
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "../../include/database.h"
+#include "../../include/server.h"
+
+// memorydb-server [--host ADDR] [--port N] [--socket PATH] [--threads N] [--snapshot FILE] [--wal FILE]
+// Без --port и --socket слушает 127.0.0.1:5433. Снимок загружается до открытия журнала,
+// журнал повторяется поверх него и дальше пишется
+
+namespace
+{
+Server* running = nullptr;
+
+void stopServer(int)
+{
+    if (running != nullptr)
+    {
+        running->stop();
+    }
+}
+
+void usage()
+{
+    std::cerr << "usage: memorydb-server [--host ADDR] [--port N] [--socket PATH] [--threads N] "
+                 "[--snapshot FILE] [--wal FILE]\n";
+}
+}
+
+int main(int argc, char** argv)
+{
+    std::string host = "127.0.0.1", socketPath, snapshotFile, walFile;
+    int port = -1;
+    size_t threads = std::max(2u, std::thread::hardware_concurrency());
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string option = argv[i];
+        if (i + 1 >= argc)
+        {
+            usage();
+            return 2;
+        }
+        std::string value = argv[++i];
+        if (option == "--host") {
+            host = value;
+        } else if (option == "--port") {
+            port = std::atoi(value.c_str());
+        } else if (option == "--socket") {
+            socketPath = value;
+        } else if (option == "--threads") {
+            threads = std::max(1, std::atoi(value.c_str()));
+        } else if (option == "--snapshot") {
+            snapshotFile = value;
+        } else if (option == "--wal") {
+            walFile = value;
+        } else {
+            usage();
+            return 2;
+        }
+    }
+    if (port < 0 && socketPath.empty())
+    {
+        port = 5433;
+    }
+
+    try
+    {
+        Database db;
+        if (!snapshotFile.empty())
+        {
+            db.loadSnapshot(snapshotFile);
+        }
+        if (!walFile.empty())
+        {
+            db.openWal(walFile);
+        }
+
+        Server server(db, threads);
+        if (port >= 0)
+        {
+            std::cout << "listening on " << host << ":" << server.listenTcp(host, uint16_t(port)) << std::endl;
+        }
+        if (!socketPath.empty())
+        {
+            server.listenUnix(socketPath);
+            std::cout << "listening on " << socketPath << std::endl;
+        }
+        running = &server;
+        std::signal(SIGINT, stopServer);
+        std::signal(SIGTERM, stopServer);
+        server.run();
+        running = nullptr;
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "memorydb-server: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
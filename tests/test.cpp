@@ -1,5 +1,10 @@
 #include <gtest/gtest.h>
+#include <condition_variable>
+#include <filesystem>
+#include <set>
 #include "database.h"
+#include "client.h"
+#include "server.h"
 
 Database createTestDatabase() {
     Database db;
@@ -41,8 +46,8 @@ TEST(DatabaseTests, Insert) {
 
     db.insert("users", newLine);
 
-    ASSERT_EQ(db.tables["users"].columns["id"].cells.size(), 3);
-    ASSERT_EQ(std::static_pointer_cast<CellString>(db.tables["users"].columns["login"].cells[2])->data, "new_user");
+    ASSERT_EQ(db.tables["users"].columns["id"].size(), 3);
+    ASSERT_EQ(db.tables["users"].columns["login"].get_string(2), "new_user");
 }
 
 TEST(DatabaseTests, Insert_With_Missing_Values) {
@@ -62,7 +67,7 @@ TEST(DatabaseTests, Insert_With_Null_Values) {
     newLine.addCell("password_hash", nullptr);
 
     ASSERT_NO_THROW(db.insert("users", newLine));
-    ASSERT_EQ(db.tables["users"].columns["id"].cells.size(), 3);
+    ASSERT_EQ(db.tables["users"].columns["id"].size(), 3);
 }
 
 TEST(DatabaseTests, Insert_Invalid_Column) {
@@ -87,7 +92,9 @@ TEST(DatabaseTests, Update) {
         return std::static_pointer_cast<CellString>(line.cells.at("login"))->data == "ivan";
     });
 
-    ASSERT_EQ(std::static_pointer_cast<CellString>(db.tables["users"].columns["login"].cells[0])->data, "ivan_updated");
+    // новая версия строки дописана в конец таблицы, старая убрана
+    ASSERT_EQ(db.translate_n_execute("SELECT id FROM users WHERE login = 'ivan_updated'").rowCount(), 1);
+    ASSERT_EQ(db.translate_n_execute("SELECT id FROM users WHERE login = 'ivan'").rowCount(), 0);
 }
 
 TEST(DatabaseTests, Update_Without_Where) {
@@ -100,8 +107,8 @@ TEST(DatabaseTests, Update_Without_Where) {
 
     db.update("users", transformations, [](const Line&) { return true; });
 
-    ASSERT_TRUE(std::static_pointer_cast<CellBool>(db.tables["users"].columns["is_admin"].cells[0])->data);
-    ASSERT_TRUE(std::static_pointer_cast<CellBool>(db.tables["users"].columns["is_admin"].cells[1])->data);
+    ASSERT_TRUE(db.tables["users"].columns["is_admin"].get_bool(0));
+    ASSERT_TRUE(db.tables["users"].columns["is_admin"].get_bool(1));
 }
 
 TEST(DatabaseTests, Update_With_2_Where) {
@@ -118,7 +125,7 @@ TEST(DatabaseTests, Update_With_2_Where) {
         return id == 2;
     });
 
-    ASSERT_EQ(std::static_pointer_cast<CellString>(db.tables["users"].columns["login"].cells[1])->data, "updated_admin");
+    ASSERT_EQ(db.tables["users"].columns["login"].get_string(1), "updated_admin");
 }
 
 // тесты для DELETE
@@ -128,15 +135,15 @@ TEST(DatabaseTests, Delete) {
         return std::static_pointer_cast<CellString>(line.cells.at("login"))->data == "admin";
     });
 
-    ASSERT_EQ(db.tables["users"].columns["id"].cells.size(), 1);
-    ASSERT_EQ(std::static_pointer_cast<CellString>(db.tables["users"].columns["login"].cells[0])->data, "ivan");
+    ASSERT_EQ(db.tables["users"].columns["id"].size(), 1);
+    ASSERT_EQ(db.tables["users"].columns["login"].get_string(0), "ivan");
 }
 
 TEST(DatabaseTests, Delete_Without_Where) {
     Database db = createTestDatabase();
     db.remove("users", [](const Line&) { return true; });
 
-    ASSERT_EQ(db.tables["users"].columns["id"].cells.size(), 0);
+    ASSERT_EQ(db.tables["users"].columns["id"].size(), 0);
 }
 
 TEST(DatabaseTests, Delete_Invalid_Column) {
@@ -154,8 +161,8 @@ TEST(DatabaseTests, Delete_With_2_Where) {
         return id > 1;
     });
 
-    ASSERT_EQ(db.tables["users"].columns["id"].cells.size(), 1);
-    ASSERT_EQ(std::static_pointer_cast<CellString>(db.tables["users"].columns["login"].cells[0])->data, "ivan");
+    ASSERT_EQ(db.tables["users"].columns["id"].size(), 1);
+    ASSERT_EQ(db.tables["users"].columns["login"].get_string(0), "ivan");
 }
 
 // тесты для SELECT
@@ -165,17 +172,17 @@ TEST(DatabaseTests, Select) {
         return std::static_pointer_cast<CellBool>(line.cells.at("is_admin"))->data;
     });
 
-    ASSERT_EQ(db.tables["selected_users"].columns["id"].cells.size(), 1);
-    ASSERT_EQ(std::static_pointer_cast<CellString>(db.tables["selected_users"].columns["login"].cells[0])->data, "admin");
+    ASSERT_EQ(db.tables["selected_users"].columns["id"].size(), 1);
+    ASSERT_EQ(db.tables["selected_users"].columns["login"].get_string(0), "admin");
 }
 
 TEST(DatabaseTests, Select_Without_Where) {
     Database db = createTestDatabase();
     auto selected = db.select("selected_users", "users", {"id", "login"}, [](const Line&) { return true; });
 
-    ASSERT_EQ(db.tables["selected_users"].columns["id"].cells.size(), 2);
-    ASSERT_EQ(std::static_pointer_cast<CellString>(db.tables["selected_users"].columns["login"].cells[0])->data, "ivan");
-    ASSERT_EQ(std::static_pointer_cast<CellString>(db.tables["selected_users"].columns["login"].cells[1])->data, "admin");
+    ASSERT_EQ(db.tables["selected_users"].columns["id"].size(), 2);
+    ASSERT_EQ(db.tables["selected_users"].columns["login"].get_string(0), "ivan");
+    ASSERT_EQ(db.tables["selected_users"].columns["login"].get_string(1), "admin");
 }
 
 TEST(DatabaseTests, Select_With_2_Where) {
@@ -186,10 +193,1765 @@ TEST(DatabaseTests, Select_With_2_Where) {
         return id > 1 || isAdmin;
     });
 
-    ASSERT_EQ(db.tables["selected_users"].columns["id"].cells.size(), 1);
-    ASSERT_EQ(std::static_pointer_cast<CellInt>(db.tables["selected_users"].columns["id"].cells[0])->data, 2);
+    ASSERT_EQ(db.tables["selected_users"].columns["id"].size(), 1);
+    ASSERT_EQ(db.tables["selected_users"].columns["id"].get_int(0), 2);
     
 }
 
 
 
+
+// тесты для хранения колонок
+TEST(ColumnTests, Bool_Packing) {
+    Column column(1);
+    for (int i = 0; i < 130; ++i) {
+        column.push_bool(i % 3 == 0);
+    }
+    column.set_bool(64, true);
+
+    ASSERT_EQ(column.size(), 130);
+    ASSERT_TRUE(column.get_bool(0));
+    ASSERT_FALSE(column.get_bool(1));
+    ASSERT_TRUE(column.get_bool(64));
+    ASSERT_TRUE(column.get_bool(129));
+    ASSERT_FALSE(column.get_bool(128));
+}
+
+TEST(ColumnTests, String_Update_And_Null) {
+    Column column(2);
+    column.push_string("short");
+    column.push_null();
+    column.push_string("third");
+
+    column.set_string(0, "a much longer value");
+    column.set_string(2, "3");
+
+    ASSERT_EQ(column.get_string(0), "a much longer value");
+    ASSERT_TRUE(column.is_null(1));
+    ASSERT_EQ(column.get_cell(1), nullptr);
+    ASSERT_EQ(column.get_string(2), "3");
+
+    column.retain_rows({1, 2});
+    ASSERT_EQ(column.size(), 2);
+    ASSERT_TRUE(column.is_null(0));
+    ASSERT_EQ(column.get_string(1), "3");
+}
+
+TEST(DatabaseTests, Save_And_Read_From_File) {
+    Database db = createTestDatabase();
+    std::string filename = testing::TempDir() + "memorydb_test.csv";
+    db.saveToFile(filename);
+
+    Database restored;
+    restored.readFromFile(filename);
+
+    ASSERT_EQ(restored.tables["users"].rowCount(), 2);
+    ASSERT_EQ(restored.tables["users"].columns["login"].get_string(1), "admin");
+    ASSERT_EQ(restored.tables["users"].columns["password_hash"].get_string(0),
+              db.tables["users"].columns["password_hash"].get_string(0));
+    ASSERT_TRUE(restored.tables["users"].columns["is_admin"].get_bool(1));
+}
+
+TEST(DatabaseTests, Snapshot_Round_Trip) {
+    Database db = createTestDatabase();
+    db.translate_n_execute("CREATE TABLE items ({key, autoincrement} id : int32, name : string[16], price : int32)");
+    for (int i = 0; i < 300; ++i) {
+        db.translate_n_execute("INSERT INTO items (name, price) VALUES ('item" + std::to_string(i) + "', " + std::to_string(i % 50) + ")");
+    }
+    db.tables["items"].compactThreshold = 1.0;
+    db.translate_n_execute("DELETE FROM items WHERE price = 7");
+    db.tables["items"].columns["name"].set_string(8, "renamed");
+    db.tables["items"].columns["price"].set_null(0);
+    db.translate_n_execute("CREATE ORDERED INDEX items_price ON items BY price");
+    std::string filename = testing::TempDir() + "memorydb_test.snapshot";
+    db.saveSnapshot(filename);
+
+    Database restored;
+    restored.loadSnapshot(filename);
+    Table& items = restored.tables["items"];
+    ASSERT_EQ(items.rowCount(), 294);
+    ASSERT_EQ(items.slotCount(), 294);
+    ASSERT_TRUE(items.columns["price"].is_null(0));
+    ASSERT_EQ(items.columns["name"].get_string(7), "renamed");
+    ASSERT_EQ(items.columns["name"].get_string(293), "item299");
+    ASSERT_TRUE(items.columns["id"].is_key);
+    ASSERT_EQ(items.orderedIndexes.count("price"), 1);
+    ASSERT_EQ(restored.translate_n_execute("SELECT id FROM items WHERE price = 8").rowCount(), 6);
+    ASSERT_EQ(restored.translate_n_execute("SELECT id FROM items WHERE name = 'renamed'").rowCount(), 1);
+    ASSERT_EQ(restored.tables["users"].columns["password_hash"].get_string(1), db.tables["users"].columns["password_hash"].get_string(1));
+    restored.translate_n_execute("INSERT INTO items (name, price) VALUES ('next', 1)");
+    ASSERT_EQ(items.columns["id"].get_int(294), 300);
+    ASSERT_THROW(restored.translate_n_execute("INSERT INTO items (id, name, price) VALUES (3, 'dup', 1)"), std::invalid_argument);
+
+    // неудавшаяся запись не трогает прежний снимок: он заменяется только готовым файлом
+    std::filesystem::create_directory(filename + ".tmp");
+    ASSERT_THROW(restored.saveSnapshot(filename), std::runtime_error);
+    std::filesystem::remove(filename + ".tmp");
+    Database previous;
+    previous.loadSnapshot(filename);
+    ASSERT_EQ(previous.tables["items"].rowCount(), 294);
+
+    // испорченный байт данных ловится контрольной суммой, текстовый файл не принимается
+    {
+        std::fstream file(filename, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(40);
+        file.put('\x7f');
+    }
+    ASSERT_THROW(restored.loadSnapshot(filename), std::runtime_error);
+    ASSERT_EQ(restored.tables["items"].rowCount(), 295);
+    db.saveToFile(filename);
+    ASSERT_THROW(restored.loadSnapshot(filename), std::runtime_error);
+    std::remove(filename.c_str());
+}
+
+TEST(DatabaseTests, Import_Csv_In_Parallel_Chunks) {
+    Database db;
+    db.setParallelism(4);
+    db.translate_n_execute("CREATE TABLE notes ({key, autoincrement} id : int32, {unique} code : int32, done : bool, text : string[64])");
+    std::string filename = testing::TempDir() + "memorydb_import.csv";
+    {
+        // больше одного куска по CsvLoader::kChunkBytes, с запятыми, кавычками и переводами строк в полях
+        std::ofstream file(filename, std::ios::binary);
+        file << "code,text,done\r\n";
+        for (int i = 0; i < 250000; ++i) {
+            file << i << ",";
+            if (i % 1000 == 0) {
+                file << "\"line, \"\"quoted\"\"\nnext " << i << "\"";
+            } else if (i % 777 == 0) {
+                file << "";
+            } else {
+                file << "text number " << i;
+            }
+            file << "," << (i % 3 == 0 ? "true" : "0") << (i % 2 ? "\r\n" : "\n");
+        }
+    }
+    ASSERT_EQ(db.importCsv("notes", filename), 250000);
+
+    Table& notes = db.tables["notes"];
+    ASSERT_EQ(notes.rowCount(), 250000);
+    for (int i : {0, 1, 777, 2000, 123457, 249999}) {
+        ASSERT_EQ(notes.columns["id"].get_int(i), i);
+        ASSERT_EQ(notes.columns["code"].get_int(i), i);
+        ASSERT_EQ(notes.columns["done"].get_bool(i), i % 3 == 0);
+    }
+    ASSERT_EQ(notes.columns["text"].get_string(2000), "line, \"quoted\"\nnext 2000");
+    ASSERT_TRUE(notes.columns["text"].is_null(777));
+    ASSERT_EQ(notes.columns["text"].get_string(249999), "text number 249999");
+    ASSERT_EQ(db.translate_n_execute("SELECT id FROM notes WHERE code = 4242").columns["id"].get_int(0), 4242);
+
+    // нарушение уникальности откатывает весь файл, ошибка разбора ничего не меняет
+    {
+        std::ofstream file(filename, std::ios::binary);
+        file << "code,done,text\n1000000,1,\"ok\"\n5,0,dup\n";
+    }
+    ASSERT_THROW(db.importCsv("notes", filename), std::invalid_argument);
+    ASSERT_EQ(notes.slotCount(), 250000);
+    ASSERT_EQ(db.translate_n_execute("SELECT id FROM notes WHERE code = 1000000").rowCount(), 0);
+    {
+        // кавычка в поле без кавычек сбила бы деление файла на куски
+        std::ofstream file(filename, std::ios::binary);
+        file << "code,done,text\n1000001,1,ok\n1000002,1,say \"hi\n";
+    }
+    try {
+        db.importCsv("notes", filename);
+        FAIL();
+    } catch (const std::invalid_argument& e) {
+        ASSERT_NE(std::string(e.what()).find("line 3, column text"), std::string::npos);
+    }
+    ASSERT_EQ(notes.slotCount(), 250000);
+    {
+        std::ofstream file(filename, std::ios::binary);
+        file << "code,done,text\n1000000,maybe,x\n";
+    }
+    ASSERT_THROW(db.importCsv("notes", filename), std::invalid_argument);
+    db.translate_n_execute("INSERT INTO notes (code, done, text) VALUES (1000001, true, 'after')");
+    ASSERT_EQ(notes.columns["id"].get_int(250000), 250000);
+    std::remove(filename.c_str());
+}
+
+// тесты для журнала упреждающей записи
+TEST(WalTests, Replay_On_Top_Of_Snapshot) {
+    std::string walFile = testing::TempDir() + "memorydb_test.wal";
+    std::string snapshotFile = testing::TempDir() + "memorydb_wal_test.snapshot";
+    std::remove(walFile.c_str());
+    {
+        Database db;
+        db.openWal(walFile);
+        db.translate_n_execute("CREATE TABLE users ({key, autoincrement} id : int32, login : string[32], age : int32)");
+        db.translate_n_execute("INSERT INTO users (login, age) VALUES ('vasya', 20)");
+        db.translate_n_execute("INSERT INTO users (login, age) VALUES ('petya', 30)");
+        db.translate_n_execute("SELECT id FROM users WHERE age > 0");
+        ASSERT_EQ(db.walLsn(), 3);
+        db.saveSnapshot(snapshotFile);
+        db.translate_n_execute("UPDATE users SET age = 21 WHERE login = 'vasya'");
+        db.translate_n_execute("INSERT INTO users (login, age) VALUES ('masha', 40)");
+        db.translate_n_execute("DELETE FROM users WHERE age = 30");
+        ASSERT_THROW(db.translate_n_execute("INSERT INTO users (id, login, age) VALUES (0, 'dup', 1)"), std::invalid_argument);
+        ASSERT_EQ(db.walLsn(), 6);
+    }
+    {
+        // запись, недописанная при сбое, отбрасывается
+        std::ofstream file(walFile, std::ios::binary | std::ios::app);
+        file << "\x20\x00\x00";
+    }
+
+    auto check = [](Database& db) {
+        Table& users = db.tables["users"];
+        ASSERT_EQ(users.rowCount(), 2);
+        ASSERT_EQ(db.translate_n_execute("SELECT age FROM users WHERE login = 'vasya'").columns["age"].get_int(0), 21);
+        ASSERT_EQ(db.translate_n_execute("SELECT id FROM users WHERE login = 'masha'").columns["id"].get_int(0), 2);
+        ASSERT_EQ(db.walLsn(), 6);
+    };
+    Database fromSnapshot;
+    fromSnapshot.loadSnapshot(snapshotFile);
+    ASSERT_EQ(fromSnapshot.walLsn(), 3);
+    fromSnapshot.openWal(walFile);
+    check(fromSnapshot);
+    fromSnapshot.translate_n_execute("INSERT INTO users (login, age) VALUES ('dasha', 50)");
+    ASSERT_EQ(fromSnapshot.walLsn(), 7);
+    fromSnapshot.closeWal();
+
+    Database fromLog;
+    fromLog.openWal(walFile, WalSync::NONE);
+    ASSERT_EQ(fromLog.walLsn(), 7);
+    ASSERT_EQ(fromLog.tables["users"].rowCount(), 3);
+    fromLog.closeWal();
+    std::remove(walFile.c_str());
+    std::remove(snapshotFile.c_str());
+}
+
+TEST(WalTests, Direct_Changes_Are_Pinned_By_Checkpoint) {
+    std::string walFile = testing::TempDir() + "memorydb_direct.wal";
+    std::string directory = testing::TempDir() + "memorydb_direct_checkpoint";
+    std::string csvFile = testing::TempDir() + "memorydb_direct.csv";
+    std::remove(walFile.c_str());
+    std::filesystem::remove_all(directory);
+    {
+        std::ofstream file(csvFile, std::ios::binary);
+        file << "name\n";
+        for (int i = 0; i < 100; ++i) {
+            file << "imported" << i << "\n";
+        }
+    }
+    {
+        Database db;
+        db.openWal(walFile, WalSync::NONE);
+        db.translate_n_execute("CREATE TABLE t ({key, autoincrement} id : int32, name : string[16])");
+        // importCsv в журнал не пишется: без каталога контрольных точек его не повторить
+        ASSERT_THROW(db.importCsv("t", csvFile), std::invalid_argument);
+        db.checkpoint(directory);
+        ASSERT_EQ(db.importCsv("t", csvFile), 100u);
+        db.translate_n_execute("INSERT INTO t (name) VALUES ('logged')");
+        db.closeWal();
+    }
+    Database restored;
+    restored.loadCheckpoint(directory);
+    restored.openWal(walFile, WalSync::NONE);
+    ASSERT_EQ(restored.tables["t"].rowCount(), 101);
+    Table logged = restored.translate_n_execute("SELECT id FROM t WHERE name = 'logged'");
+    ASSERT_EQ(logged.columns["id"].get_int(0), 100);
+
+    // замена всех таблиц (clear, readFromFile, loadSnapshot) тоже закрепляется точкой: повтор журнала
+    // после перезапуска не возвращает прежние таблицы
+    std::string snapshotFile = testing::TempDir() + "memorydb_direct.snapshot";
+    std::string textFile = testing::TempDir() + "memorydb_direct.txt";
+    restored.saveSnapshot(snapshotFile);
+    restored.saveToFile(textFile);
+    restored.clear();
+    restored.translate_n_execute("CREATE TABLE u (v : int32)");
+    restored.closeWal();
+    auto afterRestart = [&](const std::function<void(Database&)>& change) {
+        std::set<std::string> result;
+        {
+            Database db;
+            db.loadCheckpoint(directory);
+            db.openWal(walFile, WalSync::NONE);
+            change(db);
+            db.closeWal();
+        }
+        Database db;
+        db.loadCheckpoint(directory);
+        db.openWal(walFile, WalSync::NONE);
+        for (const auto& [tableName, table] : db.tables) {
+            result.insert(tableName + ":" + std::to_string(table.rowCount()));
+        }
+        db.closeWal();
+        return result;
+    };
+    ASSERT_EQ(afterRestart([](Database&) {}), std::set<std::string>({"u:0"}));
+    ASSERT_EQ(afterRestart([&](Database& db) { db.readFromFile(textFile); }), std::set<std::string>({"t:101"}));
+    ASSERT_EQ(afterRestart([&](Database& db) {
+        db.translate_n_execute("DELETE FROM t WHERE id < 50");
+        db.loadSnapshot(snapshotFile);
+    }), std::set<std::string>({"t:101"}));
+    std::remove(walFile.c_str());
+    std::remove(csvFile.c_str());
+    std::remove(snapshotFile.c_str());
+    std::remove(textFile.c_str());
+    std::filesystem::remove_all(directory);
+}
+
+TEST(WalTests, Group_Commit_From_Many_Threads) {
+    std::string walFile = testing::TempDir() + "memorydb_group.wal";
+    std::remove(walFile.c_str());
+    const int threads = 8, perThread = 50;
+    uint64_t syncs = 0;
+    {
+        WriteAheadLog wal(walFile, WalSync::GROUP, 0);
+        // в каждом раунде все потоки дописывают запись до того, как кто-то из них подтверждает свою:
+        // первый fsync раунда покрывает записи всех потоков, остальные его только ждут
+        std::mutex roundMutex;
+        std::condition_variable roundDone;
+        int arrived = 0, round = 0;
+        auto rendezvous = [&]() {
+            std::unique_lock<std::mutex> lock(roundMutex);
+            int current = round;
+            if (++arrived == threads) {
+                arrived = 0;
+                ++round;
+                roundDone.notify_all();
+            }
+            while (round == current) {
+                roundDone.wait_for(lock, std::chrono::milliseconds(10));
+            }
+        };
+        std::vector<std::thread> writers;
+        for (int t = 0; t < threads; ++t) {
+            writers.emplace_back([&wal, &rendezvous, t] {
+                for (int i = 0; i < perThread; ++i) {
+                    uint64_t lsn = wal.append("INSERT INTO t (a, b) VALUES (" + std::to_string(t) + ", " + std::to_string(i) + ")");
+                    rendezvous();
+                    wal.commit(lsn);
+                }
+            });
+        }
+        for (auto& writer : writers) {
+            writer.join();
+        }
+        syncs = wal.syncs();
+        ASSERT_EQ(wal.lastLsn(), threads * perThread);
+    }
+    ASSERT_GE(syncs, 1u);
+    ASSERT_LE(syncs, uint64_t(perThread));
+
+    std::vector<int> next(threads, 0);
+    uint64_t expectedLsn = 1;
+    WriteAheadLog::recover(walFile, [&](uint64_t lsn, const std::string& statement) {
+        ASSERT_EQ(lsn, expectedLsn++);
+        int t = statement[29] - '0';
+        ASSERT_EQ(statement, "INSERT INTO t (a, b) VALUES (" + std::to_string(t) + ", " + std::to_string(next[t]++) + ")");
+    });
+    ASSERT_EQ(expectedLsn, uint64_t(threads * perThread + 1));
+    std::remove(walFile.c_str());
+}
+
+TEST(WalTests, Checksum_Covers_Record_Header) {
+    std::string walFile = testing::TempDir() + "memorydb_checksum.wal";
+    std::remove(walFile.c_str());
+    {
+        WriteAheadLog wal(walFile, WalSync::NONE, 0);
+        wal.appendBatch({"INSERT INTO t (v) VALUES (1)", "INSERT INTO t (v) VALUES (2)"});
+    }
+    // снятый флаг kContinued отдал бы первую запись транзакции без второй
+    {
+        std::fstream file(walFile, std::ios::in | std::ios::out | std::ios::binary);
+        uint32_t flags = 0;
+        file.seekp(16 + sizeof(uint32_t));
+        file.write(reinterpret_cast<const char*>(&flags), sizeof(flags));
+    }
+    size_t visited = 0;
+    ASSERT_EQ(WriteAheadLog::recover(walFile, [&](uint64_t, const std::string&) { ++visited; }), 0);
+    ASSERT_EQ(visited, 0);
+
+    // файл версии 1 (сумма только по LSN и тексту) читается и дописывается в своём формате
+    {
+        std::string statement = "INSERT INTO t (v) VALUES (3)";
+        uint32_t version = 1, zero = 0, size = uint32_t(statement.size());
+        uint64_t lsn = 1;
+        std::string body(reinterpret_cast<const char*>(&lsn), sizeof(lsn));
+        body += statement;
+        uint64_t checksum = Checksum::of(body.data(), body.size());
+        std::string bytes = "MEMDBWAL";
+        for (uint32_t field : {version, zero, size, zero}) {
+            bytes.append(reinterpret_cast<const char*>(&field), sizeof(field));
+        }
+        bytes.append(reinterpret_cast<const char*>(&checksum), sizeof(checksum));
+        std::ofstream(walFile, std::ios::binary | std::ios::trunc) << bytes + body;
+    }
+    std::vector<std::string> statements;
+    auto collect = [&statements](uint64_t, const std::string& statement) { statements.push_back(statement); };
+    ASSERT_EQ(WriteAheadLog::recover(walFile, collect), 1);
+    {
+        WriteAheadLog wal(walFile, WalSync::NONE, 1);
+        ASSERT_EQ(wal.append("INSERT INTO t (v) VALUES (4)"), 2);
+    }
+    statements.clear();
+    ASSERT_EQ(WriteAheadLog::recover(walFile, collect), 2);
+    ASSERT_EQ(statements, std::vector<std::string>({"INSERT INTO t (v) VALUES (3)", "INSERT INTO t (v) VALUES (4)"}));
+    std::remove(walFile.c_str());
+}
+
+TEST(CheckpointTests, Writes_Only_Changed_Segments) {
+    std::string directory = testing::TempDir() + "memorydb_checkpoint";
+    std::filesystem::remove_all(directory);
+    auto segmentFiles = [&directory]() {
+        size_t count = 0;
+        DIR* listing = opendir(directory.c_str());
+        while (dirent* item = readdir(listing)) {
+            count += std::string(item->d_name).find(".seg") != std::string::npos;
+        }
+        closedir(listing);
+        return count;
+    };
+
+    Database db;
+    db.translate_n_execute("CREATE TABLE notes ({key, autoincrement} id : int32, code : int32, text : string[64])");
+    std::string csv = "code,text\n";
+    for (int i = 0; i < 150000; ++i) {
+        csv += std::to_string(i) + "," + (i % 10 == 0 ? "" : "text " + std::to_string(i)) + "\n";
+    }
+    CsvLoader::load(db.tables["notes"], std::string_view(csv), nullptr);
+
+    // три сегмента в каждой из трёх колонок
+    Checkpointer checkpointer(directory);
+    checkpointer.begin(db.tables, 0, nullptr);
+    checkpointer.wait();
+    ASSERT_EQ(checkpointer.lastWritten(), 9);
+    checkpointer.begin(db.tables, 0, nullptr);
+    checkpointer.wait();
+    ASSERT_EQ(checkpointer.lastWritten(), 0);
+
+    // новая строка - последний сегмент каждой колонки
+    db.translate_n_execute("INSERT INTO notes (code, text) VALUES (999999, 'tail')");
+    checkpointer.begin(db.tables, 0, nullptr);
+    checkpointer.wait();
+    ASSERT_EQ(checkpointer.lastWritten(), 3);
+    // первое удаление - вся маска удалённых строк, дальше только её изменённые сегменты
+    db.translate_n_execute("DELETE FROM notes WHERE code = 5");
+    checkpointer.begin(db.tables, 0, nullptr);
+    checkpointer.wait();
+    ASSERT_EQ(checkpointer.lastWritten(), 3);
+    db.translate_n_execute("DELETE FROM notes WHERE code = 140000");
+    db.translate_n_execute("UPDATE notes SET code = 7 WHERE id = 70000");
+    checkpointer.begin(db.tables, 42, nullptr);
+    checkpointer.wait();
+    // два сегмента маски и последние сегменты колонок - туда дописана новая версия строки 70000
+    ASSERT_EQ(checkpointer.lastWritten(), 5);
+    ASSERT_EQ(segmentFiles(), 12);
+
+    Checkpointer loader(directory);
+    uint64_t lsn = 0;
+    std::vector<Table> loaded = loader.load(nullptr, &lsn);
+    ASSERT_EQ(lsn, 42);
+    ASSERT_EQ(loaded.size(), 1);
+    const Table& notes = db.tables["notes"];
+    const Table& restored = loaded[0];
+    ASSERT_EQ(restored.slotCount(), notes.slotCount());
+    ASSERT_EQ(restored.rowCount(), notes.rowCount());
+    ASSERT_TRUE(restored.columns.at("id").is_key && restored.columns.at("id").is_autoincrement);
+    ASSERT_EQ(restored.columns.at("id").next_autoincrement, 150001);
+    for (size_t row = 0; row < notes.slotCount(); ++row) {
+        ASSERT_EQ(restored.isDeleted(row), notes.isDeleted(row));
+        ASSERT_EQ(restored.columns.at("code").get_int(row), notes.columns.at("code").get_int(row));
+        ASSERT_EQ(restored.columns.at("text").is_null(row), notes.columns.at("text").is_null(row));
+        ASSERT_EQ(restored.columns.at("text").get_string(row), notes.columns.at("text").get_string(row));
+    }
+    ASSERT_TRUE(restored.isDeleted(70000));
+    ASSERT_EQ(restored.columns.at("text").get_string(150000), "tail");
+    ASSERT_EQ(restored.columns.at("code").get_int(150001), 7);
+
+    // загруженные таблицы чистые: следующая точка ничего не переписывает
+    std::unordered_map<std::string, Table> tables;
+    tables["notes"] = std::move(loaded[0]);
+    loader.begin(tables, 42, nullptr);
+    loader.wait();
+    ASSERT_EQ(loader.lastWritten(), 0);
+    std::filesystem::remove_all(directory);
+}
+
+TEST(CheckpointTests, Truncates_Wal_And_Recovers) {
+    std::string directory = testing::TempDir() + "memorydb_checkpoint_wal";
+    std::string walFile = testing::TempDir() + "memorydb_checkpoint.wal";
+    std::filesystem::remove_all(directory);
+    std::remove(walFile.c_str());
+    auto walRecords = [&walFile]() {
+        size_t count = 0;
+        WriteAheadLog::recover(walFile, [&count](uint64_t, const std::string&) { ++count; });
+        return count;
+    };
+    {
+        Database db;
+        db.openWal(walFile);
+        db.translate_n_execute("CREATE TABLE users ({key, autoincrement} id : int32, login : string[32], age : int32)");
+        db.translate_n_execute("INSERT INTO users (login, age) VALUES ('vasya', 20)");
+        db.translate_n_execute("INSERT INTO users (login, age) VALUES ('petya', 30)");
+        db.checkpoint(directory);
+        db.waitForCheckpoint();
+        ASSERT_EQ(walRecords(), 0);
+
+        // точка начинается сама после каждых двух изменений
+        db.autoCheckpoint(directory, 2);
+        db.translate_n_execute("INSERT INTO users (login, age) VALUES ('masha', 40)");
+        db.translate_n_execute("UPDATE users SET age = 21 WHERE login = 'vasya'");
+        db.waitForCheckpoint();
+        db.translate_n_execute("DELETE FROM users WHERE age = 30");
+        ASSERT_EQ(walRecords(), 1);
+        ASSERT_EQ(db.walLsn(), 6);
+    }
+
+    Database restored;
+    restored.loadCheckpoint(directory);
+    ASSERT_EQ(restored.walLsn(), 5);
+    ASSERT_EQ(restored.tables["users"].rowCount(), 3);
+    restored.openWal(walFile);
+    ASSERT_EQ(restored.walLsn(), 6);
+    ASSERT_EQ(restored.tables["users"].rowCount(), 2);
+    ASSERT_EQ(restored.translate_n_execute("SELECT age FROM users WHERE login = 'vasya'").columns["age"].get_int(0), 21);
+    ASSERT_EQ(restored.translate_n_execute("SELECT id FROM users WHERE login = 'masha'").columns["id"].get_int(0), 2);
+    restored.translate_n_execute("INSERT INTO users (login, age) VALUES ('dasha', 50)");
+    ASSERT_EQ(restored.walLsn(), 7);
+    restored.closeWal();
+    std::filesystem::remove_all(directory);
+    std::remove(walFile.c_str());
+}
+
+TEST(LockTests, Writer_Waits_Only_For_Its_Table) {
+    Database db;
+    db.translate_n_execute("CREATE TABLE a (x : int32)");
+    db.translate_n_execute("CREATE TABLE b (x : int32)");
+    db.translate_n_execute("INSERT INTO a (x) VALUES (1)");
+
+    // открытый курсор читает снимок таблицы a и запись в неё не держит
+    Cursor cursor = db.openCursor("SELECT x FROM a WHERE x > 0");
+    std::atomic<bool> wroteA{false}, wroteB{false};
+    std::thread writerA([&] {
+        db.translate_n_execute("INSERT INTO a (x) VALUES (2)");
+        wroteA = true;
+    });
+    std::thread writerB([&] {
+        db.translate_n_execute("INSERT INTO b (x) VALUES (3)");
+        wroteB = true;
+    });
+    for (int i = 0; i < 500 && !(wroteA && wroteB); ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    ASSERT_TRUE(wroteA);
+    ASSERT_TRUE(wroteB);
+    ASSERT_EQ(db.translate_n_execute("SELECT x FROM a WHERE x > 0").rowCount(), 2);
+
+    // курсор видит таблицу такой, какой она была при его открытии
+    ASSERT_TRUE(cursor.next());
+    ASSERT_FALSE(cursor.next());
+    writerA.join();
+    writerB.join();
+    ASSERT_TRUE(wroteA);
+    ASSERT_EQ(db.tables["a"].rowCount(), 2);
+}
+
+TEST(LockTests, Concurrent_Statements_Match_Wal_Replay) {
+    std::string walFile = testing::TempDir() + "memorydb_locks.wal";
+    std::remove(walFile.c_str());
+    const int threads = 6, perThread = 150;
+    {
+        Database db;
+        db.openWal(walFile);
+        db.translate_n_execute("CREATE TABLE t0 ({key, autoincrement} id : int32, v : int32)");
+        db.translate_n_execute("CREATE TABLE t1 ({key, autoincrement} id : int32, v : int32)");
+        std::vector<std::thread> workers;
+        std::atomic<int> failures{0};
+        for (int t = 0; t < threads; ++t) {
+            workers.emplace_back([&db, &failures, t] {
+                std::string table = "t" + std::to_string(t % 2);
+                for (int i = 0; i < perThread; ++i) {
+                    db.translate_n_execute("INSERT INTO " + table + " (v) VALUES (" + std::to_string(i) + ")");
+                    if (i % 10 == 0) {
+                        db.translate_n_execute("UPDATE " + table + " SET v = 1000 WHERE v = " + std::to_string(i));
+                    }
+                    Table seen = db.translate_n_execute("SELECT id FROM " + table + " WHERE v >= 0");
+                    if (seen.rowCount() == 0) {
+                        ++failures;
+                    }
+                }
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        ASSERT_EQ(failures, 0);
+        ASSERT_EQ(db.walLsn(), 2 + threads * (perThread + perThread / 10));
+        for (const char* name : {"t0", "t1"}) {
+            const Table& table = db.tables[name];
+            ASSERT_EQ(table.rowCount(), threads / 2 * perThread);
+            // autoincrement раздал номера без пропусков и повторов
+            std::set<int> ids;
+            for (size_t row = 0; row < table.slotCount(); ++row) {
+                ids.insert(table.columns.at("id").get_int(row));
+            }
+            ASSERT_EQ(ids.size(), threads / 2 * perThread);
+            ASSERT_EQ(*ids.rbegin(), threads / 2 * perThread - 1);
+        }
+
+        // журнал, повторённый по порядку, даёт те же таблицы
+        Database replayed;
+        replayed.openWal(walFile, WalSync::NONE);
+        for (const char* name : {"t0", "t1"}) {
+            const Table& original = db.tables[name];
+            const Table& copy = replayed.tables[name];
+            ASSERT_EQ(copy.slotCount(), original.slotCount());
+            for (size_t row = 0; row < original.slotCount(); ++row) {
+                ASSERT_EQ(copy.columns.at("id").get_int(row), original.columns.at("id").get_int(row));
+                ASSERT_EQ(copy.columns.at("v").get_int(row), original.columns.at("v").get_int(row));
+            }
+        }
+        replayed.closeWal();
+    }
+    std::remove(walFile.c_str());
+}
+
+// тесты для скомпилированных условий WHERE
+TEST(ConditionTests, Compiled_Select) {
+    Database db = createTestDatabase();
+    Table selected = db.translate_n_execute("SELECT id, login FROM users WHERE id >= 1 AND (is_admin = true OR login = 'nobody')");
+
+    ASSERT_EQ(selected.rowCount(), 1);
+    ASSERT_EQ(selected.columns["login"].get_string(0), "admin");
+}
+
+TEST(ConditionTests, Compiled_Arithmetic_And_Bytes) {
+    Database db = createTestDatabase();
+    auto condition = QueryCondition::compile("id * 2 - 1 = 3 OR password_hash = 0xdeadbeef");
+    std::vector<uint32_t> rows = db.tables["users"].matchingRows(*condition);
+
+    ASSERT_EQ(rows, (std::vector<uint32_t>{0, 1}));
+}
+
+TEST(ConditionTests, Compiled_Type_Mismatch) {
+    Database db = createTestDatabase();
+    auto condition = QueryCondition::compile("login > 5");
+
+    ASSERT_THROW(db.tables["users"].matchingRows(*condition), std::invalid_argument);
+    ASSERT_THROW(db.tables["users"].matchingRows(*QueryCondition::compile("missing = 1")), std::invalid_argument);
+}
+
+TEST(ConditionTests, Compiled_Update_And_Delete) {
+    Database db = createTestDatabase();
+    db.translate_n_execute("UPDATE users SET id = 10 WHERE NOT is_admin");
+    db.translate_n_execute("DELETE FROM users WHERE id < 5");
+
+    ASSERT_EQ(db.tables["users"].rowCount(), 1);
+    ASSERT_EQ(db.tables["users"].columns["id"].get_int(0), 10);
+}
+
+TEST(ConditionTests, Batch_Select_Matches_Row_By_Row) {
+    Database db;
+    db.createTable("numbers", {{"n", 0}, {"flag", 1}, {"s", 2}});
+    for (int i = 0; i < 5000; ++i) {
+        Line line;
+        line.addCell("n", i % 7 == 0 ? nullptr : std::make_shared<CellInt>(i % 100 - 50));
+        line.addCell("flag", std::make_shared<CellBool>(i % 3 == 0));
+        line.addCell("s", std::make_shared<CellString>(std::to_string(i % 10)));
+        db.insert("numbers", line);
+    }
+    Table& numbers = db.tables["numbers"];
+    numbers.compactThreshold = 1.0;
+    db.translate_n_execute("DELETE FROM numbers WHERE n = 13");
+
+    for (const char* text : {"n > 10", "n <= -3 AND flag", "NOT n = 0", "n < -40 OR s = '5' OR flag",
+                             "flag AND (n >= 0 OR n % 2 = 1)", "10 < n", "n = 1000", ""}) {
+        std::shared_ptr<QueryCondition> bound = QueryCondition::compile(text)->bind(numbers.columns);
+        std::vector<uint32_t> expected;
+        for (uint32_t row = 0; row < numbers.slotCount(); ++row) {
+            if (!numbers.isDeleted(row) && bound->matches(row)) {
+                expected.push_back(row);
+            }
+        }
+        ASSERT_EQ(numbers.matchingRows(*QueryCondition::compile(text)), expected) << text;
+    }
+    ASSERT_EQ(db.translate_n_execute("SELECT n FROM numbers WHERE n > 40 AND flag").rowCount(),
+              numbers.matchingRows(*QueryCondition::compile("n > 40 AND flag")).size());
+}
+
+TEST(ConditionTests, Simd_Kernels_Match_Scalar) {
+    std::vector<int32_t> values(1024 + 37);
+    for (size_t i = 0; i < values.size(); ++i) {
+        values[i] = int32_t(i * 2654435761u % 201) - 100;
+    }
+    values[5] = INT32_MIN;
+    values[6] = INT32_MAX;
+
+    std::vector<KernelLevel> levels = {KernelLevel::SCALAR};
+    if (FilterKernels::level() >= KernelLevel::SSE2) {
+        levels.push_back(KernelLevel::SSE2);
+    }
+    if (FilterKernels::level() >= KernelLevel::AVX2) {
+        levels.push_back(KernelLevel::AVX2);
+    }
+    for (size_t count : {size_t(0), size_t(1), size_t(63), size_t(64), size_t(100), values.size()}) {
+        for (KernelCompare cmp : {KernelCompare::EQUAL, KernelCompare::GREATER, KernelCompare::LESS}) {
+            for (bool negate : {false, true}) {
+                std::vector<uint64_t> expected((count + 63) / 64, 0);
+                for (size_t i = 0; i < count; ++i) {
+                    bool pass = cmp == KernelCompare::EQUAL ? values[i] == 7 : cmp == KernelCompare::GREATER ? values[i] > 7 : values[i] < 7;
+                    if (pass != negate) {
+                        expected[i / 64] |= uint64_t(1) << (i % 64);
+                    }
+                }
+                for (KernelLevel level : levels) {
+                    std::vector<uint64_t> words(expected.size(), ~uint64_t(0));
+                    FilterKernels::kernel(level)(values.data(), count, cmp, 7, negate, words.data());
+                    ASSERT_EQ(words, expected) << FilterKernels::levelName(level) << " " << count;
+                }
+            }
+        }
+    }
+}
+
+// тесты для многоверсионного чтения
+TEST(MvccTests, Cursor_Reads_Snapshot_While_Table_Changes) {
+    Database db;
+    db.translate_n_execute("CREATE TABLE t ({key, autoincrement} id : int32, v : int32)");
+    std::string csv = "v\n";
+    for (int i = 0; i < 1000; ++i) {
+        csv += std::to_string(i + 10) + "\n";
+    }
+    CsvLoader::load(db.tables["t"], std::string_view(csv), nullptr);
+
+    Cursor cursor = db.openCursor("SELECT v FROM t WHERE v >= 0");
+    long long sum = 0;
+    size_t count = 0;
+    for (int i = 0; i < 10 && cursor.next(); ++i, ++count) {
+        sum += cursor.column(0).get_int(cursor.row());
+    }
+
+    // запись не ждёт открытого курсора
+    std::atomic<bool> wrote{false};
+    std::thread writer([&] {
+        db.translate_n_execute("UPDATE t SET v = 5 WHERE v < 510");
+        db.translate_n_execute("DELETE FROM t WHERE v > 909");
+        db.translate_n_execute("INSERT INTO t (v) VALUES (7)");
+        wrote = true;
+    });
+    for (int i = 0; i < 500 && !wrote; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    ASSERT_TRUE(wrote);
+    writer.join();
+    ASSERT_EQ(db.translate_n_execute("SELECT v FROM t WHERE v = 5").rowCount(), 500);
+    ASSERT_EQ(db.tables["t"].rowCount(), 901);
+
+    // курсор дочитывает таблицу такой, какой она была при открытии
+    while (cursor.next()) {
+        sum += cursor.column(0).get_int(cursor.row());
+        ++count;
+    }
+    ASSERT_EQ(count, 1000);
+    ASSERT_EQ(sum, 1000LL * 10 + 999LL * 1000 / 2);
+
+    // старые версии убираются, когда их больше не видит ни один курсор
+    db.collectGarbage();
+    ASSERT_EQ(db.tables["t"].slotCount() - db.tables["t"].deletedCount, 901);
+    db.compact("t");
+    ASSERT_EQ(db.tables["t"].slotCount(), 901);
+    ASSERT_EQ(db.translate_n_execute("SELECT v FROM t WHERE v = 7").rowCount(), 1);
+}
+
+TEST(MvccTests, Readers_See_Consistent_State_During_Updates) {
+    Database db;
+    db.translate_n_execute("CREATE TABLE t ({key, autoincrement} id : int32, v : int32)");
+    std::string csv = "v\n";
+    for (int i = 0; i < 100; ++i) {
+        csv += "0\n";
+    }
+    CsvLoader::load(db.tables["t"], std::string_view(csv), nullptr);
+
+    // каждое обновление меняет все строки сразу: читатель видит либо все старые значения, либо все новые
+    std::atomic<bool> done{false};
+    std::atomic<int> failures{0}, reads{0};
+    std::thread writer([&] {
+        for (int k = 1; k <= 200; ++k) {
+            db.translate_n_execute("UPDATE t SET v = " + std::to_string(k) + " WHERE v = " + std::to_string(k - 1));
+        }
+        done = true;
+    });
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 2; ++r) {
+        readers.emplace_back([&] {
+            while (!done || reads < 10) {
+                Table result = db.translate_n_execute("SELECT v FROM t WHERE v >= 0");
+                const Column& v = result.columns["v"];
+                bool consistent = result.rowCount() == 100;
+                for (size_t i = 1; consistent && i < result.rowCount(); ++i) {
+                    consistent = v.get_int(i) == v.get_int(0);
+                }
+                failures += !consistent;
+                ++reads;
+            }
+        });
+    }
+    writer.join();
+    for (std::thread& reader : readers) {
+        reader.join();
+    }
+    ASSERT_EQ(failures, 0);
+    ASSERT_EQ(db.translate_n_execute("SELECT v FROM t WHERE v = 200").rowCount(), 100);
+
+    db.collectGarbage();
+    ASSERT_EQ(db.tables["t"].rowCount(), 100);
+    ASSERT_EQ(db.tables["t"].slotCount() - db.tables["t"].deletedCount, 100);
+}
+
+TEST(MvccTests, Cursor_Survives_Table_Growth) {
+    Database db;
+    db.translate_n_execute("CREATE TABLE t ({key, autoincrement} id : int32, {unique} v : int32, s : string[16])");
+    for (int i = 0; i < 100; ++i) {
+        db.translate_n_execute("INSERT INTO t (v, s) VALUES (" + std::to_string(i) + ", 'row" + std::to_string(i) + "')");
+    }
+    Cursor cursor = db.openCursor("SELECT v, s FROM t WHERE v >= 0");
+    ASSERT_TRUE(cursor.next());
+    size_t room = db.tables["t"].columns["v"].ints.capacity();
+
+    // таблица перерастает зарезервированные буферы, пока курсор открыт, и запись его не ждёт
+    std::atomic<bool> wrote{false};
+    std::thread writer([&] {
+        for (size_t i = 100; i < 3 * room; ++i) {
+            db.translate_n_execute("INSERT INTO t (v, s) VALUES (" + std::to_string(i) + ", 'row" + std::to_string(i) + "')");
+        }
+        // откат транзакции тоже
+        db.translate_n_execute("BEGIN");
+        db.translate_n_execute("INSERT INTO t (v, s) VALUES (-1, 'rolled back')");
+        db.translate_n_execute("INSERT INTO t (v, s) VALUES (0, 'duplicate')");
+        EXPECT_THROW(db.translate_n_execute("COMMIT"), std::invalid_argument);
+        wrote = true;
+    });
+    for (int i = 0; i < 3000 && !wrote; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    ASSERT_TRUE(wrote);
+    writer.join();
+    ASSERT_GT(db.tables["t"].columns["v"].ints.capacity(), room);
+    ASSERT_EQ(db.tables["t"].rowCount(), 3 * room);
+    ASSERT_EQ(db.translate_n_execute("SELECT v FROM t WHERE v < 0").rowCount(), 0);
+
+    // курсор дочитывает строки, которые были при его открытии
+    size_t count = 0;
+    bool same = true;
+    do {
+        int32_t v = cursor.column(0).get_int(cursor.row());
+        same = same && cursor.column(1).get_string(cursor.row()) == "row" + std::to_string(v);
+        ++count;
+    } while (cursor.next());
+    ASSERT_EQ(count, 100);
+    ASSERT_TRUE(same);
+}
+
+// тесты для транзакций
+TEST(TransactionTests, Commit_Applies_All_Or_Nothing) {
+    Database db;
+    db.translate_n_execute("CREATE TABLE t ({key, autoincrement} id : int32, {unique} v : int32)");
+    db.translate_n_execute("INSERT INTO t (v) VALUES (1)");
+
+    // до COMMIT изменения только запоминаются
+    db.translate_n_execute("BEGIN");
+    ASSERT_THROW(db.translate_n_execute("BEGIN"), std::invalid_argument);
+    ASSERT_EQ(db.translate_n_execute("INSERT INTO t (v) VALUES (2)").columns["affected_rows"].get_int(0), 0);
+    db.translate_n_execute("INSERT INTO t (v) VALUES (3)");
+    db.translate_n_execute("UPDATE t SET v = 10 WHERE v = 1");
+    ASSERT_EQ(db.translate_n_execute("SELECT v FROM t WHERE v >= 0").rowCount(), 1);
+    ASSERT_EQ(db.translate_n_execute("COMMIT").columns["affected_rows"].get_int(0), 3);
+    ASSERT_EQ(db.translate_n_execute("SELECT v FROM t WHERE v >= 0").rowCount(), 3);
+    ASSERT_EQ(db.translate_n_execute("SELECT v FROM t WHERE v = 10").rowCount(), 1);
+    int32_t lastId = db.translate_n_execute("SELECT id FROM t WHERE v = 3").columns["id"].get_int(0);
+
+    // повтор уникального значения в конце откатывает и вставку, и удаление перед ним
+    db.translate_n_execute("BEGIN");
+    db.translate_n_execute("INSERT INTO t (v) VALUES (4)");
+    db.translate_n_execute("DELETE FROM t WHERE v = 2");
+    db.translate_n_execute("UPDATE t SET v = 11 WHERE v = 10");
+    db.translate_n_execute("INSERT INTO t (v) VALUES (3)");
+    ASSERT_THROW(db.translate_n_execute("COMMIT"), std::invalid_argument);
+    ASSERT_EQ(db.tables["t"].rowCount(), 3);
+    ASSERT_EQ(db.translate_n_execute("SELECT v FROM t WHERE v = 2").rowCount(), 1);
+    ASSERT_EQ(db.translate_n_execute("SELECT v FROM t WHERE v = 10").rowCount(), 1);
+    ASSERT_EQ(db.translate_n_execute("SELECT v FROM t WHERE v = 4").rowCount(), 0);
+    db.translate_n_execute("INSERT INTO t (v) VALUES (5)");
+    ASSERT_EQ(db.translate_n_execute("SELECT id FROM t WHERE v = 5").columns["id"].get_int(0), lastId + 1);
+
+    db.translate_n_execute("BEGIN");
+    db.translate_n_execute("INSERT INTO t (v) VALUES (6)");
+    ASSERT_THROW(db.translate_n_execute("CREATE TABLE u (x : int32)"), std::invalid_argument);
+    db.translate_n_execute("ROLLBACK");
+    ASSERT_EQ(db.tables["t"].rowCount(), 4);
+    ASSERT_THROW(db.translate_n_execute("COMMIT"), std::invalid_argument);
+
+    // у каждого клиента своя транзакция
+    Transaction mine, theirs;
+    db.translate_n_execute("BEGIN TRANSACTION", mine);
+    db.translate_n_execute("INSERT INTO t (v) VALUES (7)", mine);
+    db.translate_n_execute("INSERT INTO t (v) VALUES (8)", theirs);
+    ASSERT_EQ(db.tables["t"].rowCount(), 5);
+    db.translate_n_execute("COMMIT", mine);
+    ASSERT_EQ(db.tables["t"].rowCount(), 6);
+}
+
+TEST(TransactionTests, Commit_Is_One_Wal_Group) {
+    std::string walFile = testing::TempDir() + "memorydb_transaction.wal";
+    std::remove(walFile.c_str());
+    {
+        Database db;
+        db.openWal(walFile);
+        db.translate_n_execute("CREATE TABLE t ({key, autoincrement} id : int32, v : int32)");
+        db.translate_n_execute("BEGIN");
+        for (int i = 0; i < 1000; ++i) {
+            db.translate_n_execute("INSERT INTO t (v) VALUES (" + std::to_string(i) + ")");
+        }
+        db.translate_n_execute("COMMIT");
+        ASSERT_EQ(db.walLsn(), 1001);
+        db.closeWal();
+    }
+    {
+        Database restored;
+        restored.openWal(walFile);
+        ASSERT_EQ(restored.tables["t"].rowCount(), 1000);
+        restored.closeWal();
+    }
+
+    // транзакция, оборванная сбоем посередине, не повторяется ни одной своей записью
+    {
+        WriteAheadLog wal(walFile, WalSync::NONE, 1001);
+        wal.appendBatch({"INSERT INTO t (v) VALUES (-1)", "INSERT INTO t (v) VALUES (-2)"});
+    }
+    struct stat info;
+    ASSERT_EQ(::stat(walFile.c_str(), &info), 0);
+    ASSERT_EQ(::truncate(walFile.c_str(), info.st_size - 3), 0);
+    size_t visited = 0;
+    ASSERT_EQ(WriteAheadLog::recover(walFile, [&](uint64_t, const std::string&) { ++visited; }), 1001);
+    ASSERT_EQ(visited, 1001);
+    {
+        WriteAheadLog wal(walFile, WalSync::NONE, 1001);
+        ASSERT_EQ(wal.appendBatch({"INSERT INTO t (v) VALUES (1)"}), 1002);
+    }
+    ASSERT_EQ(WriteAheadLog::recover(walFile, [](uint64_t, const std::string&) {}), 1002);
+    std::remove(walFile.c_str());
+}
+
+// тесты для сервера запросов
+TEST(ServerTests, Pipelined_Queries_Over_Tcp_And_Unix_Socket) {
+    Database db;
+    Server server(db, 2);
+    uint16_t port = server.listenTcp("127.0.0.1", 0);
+    std::string socketPath = testing::TempDir() + "memorydb_server.sock";
+    server.listenUnix(socketPath);
+    std::thread loop([&server] { server.run(); });
+
+    auto connectTo = [&](bool tcp) {
+        int fd = -1;
+        if (tcp) {
+            fd = ::socket(AF_INET, SOCK_STREAM, 0);
+            sockaddr_in address{};
+            address.sin_family = AF_INET;
+            address.sin_port = htons(port);
+            ::inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+            EXPECT_EQ(::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)), 0);
+        } else {
+            fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            sockaddr_un address{};
+            address.sun_family = AF_UNIX;
+            std::strcpy(address.sun_path, socketPath.c_str());
+            EXPECT_EQ(::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)), 0);
+        }
+        return fd;
+    };
+    auto send = [](int fd, const std::vector<std::string>& queries) {
+        std::string out;
+        for (const std::string& query : queries) {
+            Protocol::appendFrame(out, FrameKind::QUERY, query);
+        }
+        ASSERT_EQ(::send(fd, out.data(), out.size(), 0), ssize_t(out.size()));
+    };
+    std::string input;
+    auto receive = [&input](int fd, FrameKind& kind) {
+        size_t offset = 0;
+        std::string_view payload;
+        char buffer[4096];
+        while (!Protocol::nextFrame(input, offset, kind, payload)) {
+            ssize_t size = ::recv(fd, buffer, sizeof(buffer), 0);
+            if (size <= 0) {
+                kind = FrameKind::ERROR;
+                return std::string("connection closed");
+            }
+            input.append(buffer, size_t(size));
+        }
+        std::string result(payload);
+        input.erase(0, offset);
+        return result;
+    };
+    auto count = [](const std::string& payload) { return Protocol::get<uint64_t>(payload.data()); };
+
+    // все запросы отправлены сразу, ответы приходят по порядку
+    int tcp = connectTo(true);
+    send(tcp, {"CREATE TABLE t ({key, autoincrement} id : int32, v : int32, s : string[16])",
+            "INSERT INTO t (v, s) VALUES (1, 'one')", "INSERT INTO t (v, s) VALUES (2, 'two')",
+            "DROP TABLE t", "SELECT v, s FROM t WHERE v > 0"});
+    FrameKind kind;
+    ASSERT_EQ(count(receive(tcp, kind)), 0u);
+    ASSERT_EQ(kind, FrameKind::DONE);
+    ASSERT_EQ(count(receive(tcp, kind)), 1u);
+    ASSERT_EQ(count(receive(tcp, kind)), 1u);
+    receive(tcp, kind);
+    ASSERT_EQ(kind, FrameKind::ERROR);
+    std::vector<std::string> names;
+    std::vector<int> types;
+    Protocol::readHeader(receive(tcp, kind), names, types);
+    ASSERT_EQ(kind, FrameKind::HEADER);
+    ASSERT_EQ(names, std::vector<std::string>({"v", "s"}));
+    ASSERT_EQ(types, std::vector<int>({0, 2}));
+    std::vector<Column> batch = Protocol::readRows(receive(tcp, kind), types);
+    ASSERT_EQ(kind, FrameKind::ROWS);
+    ASSERT_EQ(batch[0].ints, std::vector<int32_t>({1, 2}));
+    ASSERT_EQ(batch[1].get_string(0), "one");
+    ASSERT_EQ(batch[1].get_string(1), "two");
+    ASSERT_EQ(count(receive(tcp, kind)), 2u);
+    ASSERT_EQ(kind, FrameKind::DONE);
+
+    // большой результат приходит несколькими пачками; клиент по Unix-сокету видит те же данные
+    std::vector<std::string> inserts = {"BEGIN"};
+    for (int i = 0; i < 3000; ++i) {
+        inserts.push_back("INSERT INTO t (v, s) VALUES (" + std::to_string(i + 10) + ", 'x')");
+    }
+    inserts.push_back("COMMIT");
+    send(tcp, inserts);
+    for (size_t i = 0; i + 1 < inserts.size(); ++i) {
+        ASSERT_EQ(count(receive(tcp, kind)), 0u);
+    }
+    ASSERT_EQ(count(receive(tcp, kind)), 3000u);
+
+    int local = connectTo(false);
+    ASSERT_TRUE(input.empty());
+    send(local, {"SELECT id FROM t WHERE v >= 10"});
+    Protocol::readHeader(receive(local, kind), names, types);
+    ASSERT_EQ(kind, FrameKind::HEADER);
+    size_t batches = 0, rows = 0;
+    while (true) {
+        std::string payload = receive(local, kind);
+        if (kind != FrameKind::ROWS) {
+            break;
+        }
+        ++batches;
+        rows += Protocol::readRows(payload, types)[0].size();
+    }
+    ASSERT_EQ(kind, FrameKind::DONE);
+    ASSERT_EQ(rows, 3000u);
+    ASSERT_EQ(batches, (3000 + Server::kBatchRows - 1) / Server::kBatchRows);
+    ASSERT_EQ(server.connectionCount(), 2u);
+
+    // закрыв свою сторону, клиент ещё получает ответы, затем сервер закрывает соединение
+    send(local, {"SELECT id FROM t WHERE v = 1"});
+    ::shutdown(local, SHUT_WR);
+    receive(local, kind);
+    ASSERT_EQ(kind, FrameKind::HEADER);
+    receive(local, kind);
+    ASSERT_EQ(kind, FrameKind::ROWS);
+    receive(local, kind);
+    ASSERT_EQ(kind, FrameKind::DONE);
+    ASSERT_EQ(receive(local, kind), "connection closed");
+    ::close(local);
+    ::close(tcp);
+
+    server.stop();
+    loop.join();
+    ASSERT_EQ(db.tables["t"].rowCount(), 3002);
+}
+
+TEST(ServerTests, Client_Decodes_Columnar_Results) {
+    Database db;
+    db.translate_n_execute("CREATE TABLE t ({key, autoincrement} id : int32, done : bool, s : string[16], b : bytes[4])");
+    std::string filename = testing::TempDir() + "memorydb_client.csv";
+    {
+        // пустое поле CSV - NULL
+        std::ofstream file(filename, std::ios::binary);
+        file << "done,s,b\n";
+        for (int i = 0; i < 2500; ++i) {
+            file << i % 2 << "," << (i % 3 == 0 ? "" : "s" + std::to_string(i)) << ","
+                 << (i % 5 == 0 ? "" : "b" + std::to_string(i % 10)) << "\n";
+        }
+    }
+    ASSERT_EQ(db.importCsv("t", filename), 2500);
+    Server server(db, 2);
+    uint16_t port = server.listenTcp("127.0.0.1", 0);
+    std::thread loop([&server] { server.run(); });
+
+    Client client;
+    client.connectTcp("127.0.0.1", port);
+    ASSERT_TRUE(client.query("CREATE TABLE u (v : int32)").ok());
+    // конвейер: все запросы уходят до первого ответа
+    for (int i = 0; i < 2000; ++i) {
+        client.send("INSERT INTO u (v) VALUES (" + std::to_string(i) + ")");
+    }
+    client.send("INSERT INTO nowhere (x) VALUES (1)");
+    client.send("SELECT id, done, s, b FROM t WHERE id >= 0");
+    ASSERT_EQ(client.pending(), 2002u);
+    for (int i = 0; i < 2000; ++i) {
+        ASSERT_EQ(client.receive().count, 1u);
+    }
+    ASSERT_FALSE(client.receive().ok());
+
+    Client::Result result = client.receive();
+    ASSERT_TRUE(result.ok());
+    ASSERT_EQ(client.pending(), 0u);
+    ASSERT_EQ(result.names, std::vector<std::string>({"id", "done", "s", "b"}));
+    ASSERT_EQ(result.count, 2500u);
+    ASSERT_EQ(result.rows.slotCount(), 2500u);
+    const Column& id = result.rows.columns["id"];
+    const Column& done = result.rows.columns["done"];
+    const Column& s = result.rows.columns["s"];
+    const Column& b = result.rows.columns["b"];
+    ASSERT_EQ(b.type, 3);
+    for (size_t row = 0; row < 2500; ++row) {
+        int i = id.get_int(row);
+        ASSERT_EQ(done.get_bool(row), i % 2 == 1);
+        ASSERT_EQ(s.is_null(row), i % 3 == 0);
+        ASSERT_EQ(b.is_null(row), i % 5 == 0);
+        if (i % 3 != 0) {
+            ASSERT_EQ(s.get_string(row), "s" + std::to_string(i));
+        }
+        if (i % 5 != 0) {
+            ASSERT_EQ(b.get_string(row), "b" + std::to_string(i % 10));
+        }
+    }
+    ASSERT_THROW(client.receive(), std::invalid_argument);
+    ASSERT_EQ(client.query("SELECT v FROM u WHERE v >= 1990").count, 10u);
+
+    client.close();
+    server.stop();
+    loop.join();
+}
+
+TEST(ServerTests, Stalled_Cursor_Times_Out) {
+    Database db;
+    db.translate_n_execute("CREATE TABLE t ({key, autoincrement} id : int32, s : string[64])");
+    std::string csv = "s\n";
+    for (int i = 0; i < 300000; ++i) {
+        csv += std::string(60, 'a' + i % 26) + "\n";
+    }
+    CsvLoader::load(db.tables["t"], std::string_view(csv), nullptr);
+    Server server(db, 2);
+    server.cursorTimeout = std::chrono::milliseconds(200);
+    uint16_t port = server.listenTcp("127.0.0.1", 0);
+    std::thread loop([&server] { server.run(); });
+
+    // клиент просит большой результат и не читает его
+    int stalled = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    ::inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+    ASSERT_EQ(::connect(stalled, reinterpret_cast<sockaddr*>(&address), sizeof(address)), 0);
+    std::string out;
+    Protocol::appendFrame(out, FrameKind::QUERY, "SELECT id, s FROM t WHERE id >= 0");
+    Protocol::appendFrame(out, FrameKind::QUERY, "SELECT id FROM t WHERE id = 7");
+    ASSERT_EQ(::send(stalled, out.data(), out.size(), 0), ssize_t(out.size()));
+
+    // его курсор закрывается по сроку, и изменение каталога не ждёт клиента
+    std::atomic<bool> created{false};
+    std::thread other([&] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        Client client;
+        client.connectTcp("127.0.0.1", port);
+        EXPECT_TRUE(client.query("CREATE TABLE u (v : int32)").ok());
+        created = true;
+    });
+    for (int i = 0; i < 1000 && !created; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    ASSERT_TRUE(created);
+    other.join();
+
+    // ответ обрывается ошибкой после уже отправленных пачек, следующий запрос выполняется
+    std::string input;
+    std::vector<FrameKind> kinds;
+    std::string error;
+    char buffer[64 * 1024];
+    while (kinds.empty() || kinds.back() != FrameKind::DONE) {
+        ssize_t size = ::recv(stalled, buffer, sizeof(buffer), 0);
+        ASSERT_GT(size, 0);
+        input.append(buffer, size_t(size));
+        size_t offset = 0;
+        FrameKind kind;
+        std::string_view payload;
+        while (Protocol::nextFrame(input, offset, kind, payload)) {
+            kinds.push_back(kind);
+            if (kind == FrameKind::ERROR) {
+                error = std::string(payload);
+            }
+        }
+        input.erase(0, offset);
+    }
+    ASSERT_EQ(error, "Cursor timed out: client is not reading");
+    ASSERT_GE(kinds.size(), 5u);
+    ASSERT_EQ(kinds.front(), FrameKind::HEADER);
+    ASSERT_EQ(kinds[kinds.size() - 4], FrameKind::ERROR);
+    ASSERT_LT(kinds.size() - 5, 300000u / Server::kBatchRows);
+    ASSERT_EQ(kinds[kinds.size() - 3], FrameKind::HEADER);
+
+    Client client;
+    client.connectTcp("127.0.0.1", port);
+    ASSERT_EQ(client.query("SELECT id FROM t WHERE id >= 0").count, 300000u);
+    ::close(stalled);
+    server.stop();
+    loop.join();
+}
+
+// тесты для JOIN
+Database createJoinDatabase() {
+    Database db = createTestDatabase();
+    db.translate_n_execute("CREATE TABLE orders order_id:int32, user_id:int32, buyer:string[32], total:int32");
+    db.translate_n_execute("INSERT INTO orders (order_id, user_id, buyer, total) VALUES (10, 2, 'admin', 100)");
+    db.translate_n_execute("INSERT INTO orders (order_id, user_id, buyer, total) VALUES (11, 1, 'ivan', 50)");
+    db.translate_n_execute("INSERT INTO orders (order_id, user_id, buyer, total) VALUES (12, 2, 'admin', 300)");
+    return db;
+}
+
+TEST(JoinTests, Hash_Join_On_Int_Key) {
+    Database db = createJoinDatabase();
+    Table& joined = db.join("joined", "users", "orders", *QueryCondition::compile("users.id = orders.user_id"));
+
+    ASSERT_EQ(joined.rowCount(), 3);
+    for (size_t i = 0; i < joined.rowCount(); ++i) {
+        ASSERT_EQ(joined.columns["users.id"].get_int(i), joined.columns["orders.user_id"].get_int(i));
+    }
+}
+
+TEST(JoinTests, Hash_Join_On_String_Key_With_Residual) {
+    Database db = createJoinDatabase();
+    Table& joined = db.join("joined", "users", "orders", *QueryCondition::compile("orders.buyer = users.login AND orders.total > 100"));
+
+    ASSERT_EQ(joined.rowCount(), 1);
+    ASSERT_EQ(joined.columns["orders.order_id"].get_int(0), 12);
+    ASSERT_EQ(joined.columns["users.login"].get_string(0), "admin");
+}
+
+TEST(JoinTests, Nested_Loop_For_Non_Equi_Join) {
+    Database db = createJoinDatabase();
+    Table& joined = db.join("joined", "users", "orders", *QueryCondition::compile("users.id < orders.user_id"));
+
+    ASSERT_EQ(joined.rowCount(), 2);
+    ASSERT_EQ(joined.columns["users.id"].get_int(0), 1);
+}
+
+TEST(JoinTests, Join_Query) {
+    Database db = createJoinDatabase();
+    Table selected = db.translate_n_execute("SELECT orders.order_id FROM users JOIN orders ON users.id = orders.user_id WHERE users.is_admin");
+
+    ASSERT_EQ(selected.rowCount(), 2);
+}
+
+TEST(JoinTests, Join_Chain_Of_Three_Tables) {
+    Database db = createJoinDatabase();
+    db.translate_n_execute("CREATE TABLE items item_id:int32, order_id:int32, price:int32");
+    db.translate_n_execute("INSERT INTO items (item_id, order_id, price) VALUES (1, 10, 60)");
+    db.translate_n_execute("INSERT INTO items (item_id, order_id, price) VALUES (2, 10, 40)");
+    db.translate_n_execute("INSERT INTO items (item_id, order_id, price) VALUES (3, 12, 300)");
+    db.translate_n_execute("INSERT INTO items (item_id, order_id, price) VALUES (4, 11, 50)");
+
+    Table selected = db.translate_n_execute("SELECT users.login, items.item_id FROM users JOIN orders ON users.id = orders.user_id "
+                                            "JOIN items ON items.order_id = orders.order_id WHERE users.is_admin AND price < 100 "
+                                            "ORDER BY items.item_id");
+    ASSERT_EQ(selected.rowCount(), 2);
+    ASSERT_EQ(selected.columns["items.item_id"].get_int(0), 1);
+    ASSERT_EQ(selected.columns["items.item_id"].get_int(1), 2);
+    ASSERT_EQ(selected.columns["users.login"].get_string(1), "admin");
+
+    Table totals = db.translate_n_execute("SELECT users.login, sum(price) FROM users JOIN orders ON users.id = orders.user_id "
+                                          "JOIN items ON items.order_id = orders.order_id GROUP BY users.login ORDER BY users.login");
+    ASSERT_EQ(totals.rowCount(), 2);
+    ASSERT_EQ(totals.columns["sum(price)"].get_int(0), 400);
+    ASSERT_EQ(totals.columns["sum(price)"].get_int(1), 50);
+
+    ASSERT_THROW(db.translate_n_execute("SELECT users.id FROM users JOIN orders ON users.id = orders.user_id JOIN users ON 1 = 1"),
+                 std::invalid_argument);
+}
+
+TEST(JoinTests, Radix_Join_Matches_Nested_Loop) {
+    Column buildInts(0), probeInts(0), buildStrings(2), probeStrings(2);
+    std::vector<uint32_t> buildRows, probeRows;
+    for (int i = 0; i < 40000; ++i) {
+        if (i % 97 == 0) {
+            buildInts.push_null();
+            buildStrings.push_null();
+        } else {
+            buildInts.push_int(i % 15000);
+            buildStrings.push_string("s" + std::to_string(i % 15000));
+        }
+        // строки с нечётными номерами не участвуют, как удалённые
+        if (i % 2 == 0) {
+            buildRows.push_back(i);
+        }
+    }
+    for (int i = 0; i < 3000; ++i) {
+        probeInts.push_int(i * 7 % 16000);
+        probeStrings.push_string("s" + std::to_string(i * 7 % 16000));
+        probeRows.push_back(i);
+    }
+
+    std::set<std::pair<uint32_t, uint32_t>> expected;
+    for (size_t b = 0; b < buildRows.size(); ++b) {
+        for (size_t p = 0; p < probeRows.size(); ++p) {
+            if (!buildInts.is_null(buildRows[b]) && buildInts.get_int(buildRows[b]) == probeInts.get_int(probeRows[p]) && p % 5 != 0) {
+                expected.emplace(b, p);
+            }
+        }
+    }
+    ASSERT_FALSE(expected.empty());
+    ASSERT_GT(RadixJoin::partitionBits(buildRows.size()), 0u);
+
+    ThreadPool pool(3);
+    std::vector<uint32_t> serialBuild, serialProbe;
+    for (ThreadPool* threads : {static_cast<ThreadPool*>(nullptr), &pool}) {
+        for (bool strings : {false, true}) {
+            std::vector<uint32_t> build, probe;
+            RadixJoin::Side buildSide{strings ? &buildStrings : &buildInts, &buildRows};
+            RadixJoin::Side probeSide{strings ? &probeStrings : &probeInts, &probeRows};
+            RadixJoin::run(threads, buildSide, probeSide, [](uint32_t, uint32_t p) { return p % 5 != 0; }, build, probe);
+            ASSERT_EQ(build.size(), expected.size());
+            std::set<std::pair<uint32_t, uint32_t>> found;
+            for (size_t k = 0; k < build.size(); ++k) {
+                found.emplace(build[k], probe[k]);
+            }
+            ASSERT_EQ(found, expected);
+            if (!strings && threads == nullptr) {
+                serialBuild = build;
+                serialProbe = probe;
+            } else if (!strings) {
+                ASSERT_EQ(build, serialBuild);
+                ASSERT_EQ(probe, serialProbe);
+            }
+        }
+    }
+}
+
+// тесты для параллельных проходов
+TEST(ParallelTests, Morsel_Scans_Match_Serial) {
+    Database db;
+    db.createTable("facts", {{"id", 0}, {"key", 0}, {"flag", 1}});
+    db.createTable("dims", {{"key", 0}, {"label", 2}});
+    Table& facts = db.tables["facts"];
+    for (int i = 0; i < 100000; ++i) {
+        facts.columns["id"].push_int(i);
+        facts.columns["key"].push_int(i * 7919 % 1000);
+        facts.columns["flag"].push_bool(i % 3 == 0);
+    }
+    for (int k = 0; k < 1000; k += 2) {
+        db.tables["dims"].columns["key"].push_int(k);
+        db.tables["dims"].columns["label"].push_string("k" + std::to_string(k));
+    }
+    facts.compactThreshold = 1.0;
+    db.translate_n_execute("DELETE FROM facts WHERE id % 10 = 3");
+
+    auto run = [&db]() {
+        std::vector<uint32_t> rows = db.tables["facts"].matchingRows(*QueryCondition::compile("key < 500 AND flag"));
+        Table& joined = db.join("joined", "facts", "dims", *QueryCondition::compile("facts.key = dims.key AND facts.id > 50"));
+        Table selected = db.translate_n_execute("SELECT id, key FROM facts WHERE key >= 990 OR id < 5");
+        return std::make_tuple(rows, joined.columns["facts.id"].ints, std::string(joined.columns["dims.label"].get_string(joined.rowCount() - 1)),
+                               selected.columns["id"].ints);
+    };
+
+    db.setParallelism(1);
+    auto serial = run();
+    db.setParallelism(4);
+    db.tables["facts"].parallelThreshold = 1000;
+    ASSERT_EQ(db.parallelism(), 4);
+    auto parallel = run();
+
+    ASSERT_EQ(std::get<0>(parallel), std::get<0>(serial));
+    ASSERT_EQ(std::get<1>(parallel), std::get<1>(serial));
+    ASSERT_EQ(std::get<2>(parallel), std::get<2>(serial));
+    ASSERT_EQ(std::get<3>(parallel), std::get<3>(serial));
+    size_t expected = 0;
+    for (int i = 0; i < 100000; ++i) {
+        expected += i % 10 != 3 && i * 7919 % 1000 < 500 && i % 3 == 0;
+    }
+    ASSERT_EQ(std::get<0>(serial).size(), expected);
+}
+
+TEST(ParallelTests, Thread_Pool_Runs_All_Tasks_And_Rethrows) {
+    ThreadPool pool(3);
+    std::vector<int> hits(1000, 0);
+    pool.parallelFor(hits.size(), [&hits, &pool](size_t i) {
+        hits[i] += 1;
+        if (i == 0) {
+            // вложенный parallelFor не должен зависать
+            std::atomic<int> inner{0};
+            pool.parallelFor(10, [&inner](size_t) { ++inner; });
+            hits[i] += inner - 10;
+        }
+    });
+    ASSERT_EQ(std::count(hits.begin(), hits.end(), 1), 1000);
+    ASSERT_THROW(pool.parallelFor(100, [](size_t i) {
+        if (i == 42) {
+            throw std::runtime_error("task failed");
+        }
+    }), std::runtime_error);
+}
+
+// тесты для удаления с пометкой строк
+TEST(DeleteTests, Tombstones_Hidden_Before_Compaction) {
+    Database db = createJoinDatabase();
+    Table& orders = db.tables["orders"];
+    orders.compactThreshold = 0.9;
+
+    db.translate_n_execute("DELETE FROM orders WHERE order_id = 11");
+
+    ASSERT_EQ(orders.slotCount(), 3);
+    ASSERT_EQ(orders.rowCount(), 2);
+    ASSERT_EQ(db.translate_n_execute("SELECT order_id FROM orders WHERE total > 0").rowCount(), 2);
+    ASSERT_EQ(db.join("joined", "users", "orders", *QueryCondition::compile("users.id = orders.user_id")).rowCount(), 2);
+
+    db.translate_n_execute("UPDATE orders SET total = 1 WHERE total > 0");
+    ASSERT_EQ(orders.columns["total"].get_int(1), 50);
+
+    db.compact("orders");
+    ASSERT_EQ(orders.slotCount(), 2);
+    ASSERT_EQ(orders.columns["order_id"].get_int(0), 10);
+    ASSERT_EQ(orders.columns["order_id"].get_int(1), 12);
+    ASSERT_EQ(orders.columns["total"].get_int(1), 1);
+}
+
+TEST(DeleteTests, Compaction_On_Threshold) {
+    Database db = createJoinDatabase();
+    Table& orders = db.tables["orders"];
+    orders.compactThreshold = 0.5;
+
+    db.translate_n_execute("DELETE FROM orders WHERE order_id = 10");
+    ASSERT_EQ(orders.slotCount(), 3);
+
+    db.translate_n_execute("DELETE FROM orders WHERE order_id = 12");
+    ASSERT_EQ(orders.slotCount(), 1);
+    ASSERT_EQ(orders.rowCount(), 1);
+    ASSERT_EQ(orders.columns["buyer"].get_string(0), "ivan");
+}
+
+// тесты для хеш-индексов
+TEST(IndexTests, Create_Index_Query) {
+    Database db = createJoinDatabase();
+    db.translate_n_execute("CREATE INDEX orders_user ON orders (user_id)");
+    db.translate_n_execute("CREATE UNORDERED INDEX ON orders BY buyer");
+
+    ASSERT_EQ(db.tables["orders"].indexes.size(), 2);
+    ASSERT_EQ(db.tables["orders"].indexes["user_id"].name, "orders_user");
+    ASSERT_EQ(db.translate_n_execute("SELECT order_id FROM orders WHERE user_id = 2").rowCount(), 2);
+    ASSERT_EQ(db.translate_n_execute("SELECT order_id FROM orders WHERE 'ivan' = buyer AND total < 100").rowCount(), 1);
+    ASSERT_EQ(db.translate_n_execute("SELECT order_id FROM orders WHERE buyer = 'nobody'").rowCount(), 0);
+}
+
+TEST(IndexTests, Index_Maintained_By_Writes) {
+    Database db = createJoinDatabase();
+    Table& orders = db.tables["orders"];
+    orders.compactThreshold = 0.9;
+    db.createIndex("orders", "user_id");
+
+    db.translate_n_execute("INSERT INTO orders (order_id, user_id, buyer, total) VALUES (13, 3, 'guest', 10)");
+    db.translate_n_execute("UPDATE orders SET user_id = 3 WHERE order_id = 10");
+    db.translate_n_execute("DELETE FROM orders WHERE order_id = 12");
+
+    Datum key;
+    key.type = 0;
+    key.number = 3;
+    // новая версия заказа 10 дописана после заказа 13
+    ASSERT_EQ(orders.indexes["user_id"].find(key), (std::vector<uint32_t>{3, 4}));
+    key.number = 2;
+    ASSERT_TRUE(orders.indexes["user_id"].find(key).empty());
+
+    db.compact("orders");
+    key.number = 3;
+    ASSERT_EQ(orders.indexes["user_id"].find(key), (std::vector<uint32_t>{1, 2}));
+    ASSERT_EQ(db.translate_n_execute("SELECT order_id FROM orders WHERE user_id = 3").rowCount(), 2);
+}
+
+TEST(IndexTests, Bulk_Delete_On_Low_Cardinality_Column) {
+    Database db;
+    db.translate_n_execute("CREATE TABLE t (g : int32, v : int32)");
+    std::string filename = testing::TempDir() + "memorydb_bulk_delete.csv";
+    {
+        std::ofstream file(filename, std::ios::binary);
+        file << "g,v\n";
+        for (int i = 0; i < 20000; ++i) {
+            file << i % 2 << "," << i << "\n";
+        }
+    }
+    db.importCsv("t", filename);
+    db.createIndex("t", "g");
+    db.tables["t"].compactThreshold = 0.9;
+
+    // все удаляемые строки делят два значения индекса
+    ASSERT_EQ(db.translate_n_execute("DELETE FROM t WHERE v < 15000").columns["affected_rows"].get_int(0), 15000);
+    Datum key;
+    key.type = 0;
+    key.number = 0;
+    std::vector<uint32_t> rows = db.tables["t"].indexes["g"].find(key);
+    ASSERT_EQ(rows.size(), 2500u);
+    ASSERT_EQ(rows.front(), 15000u);
+    ASSERT_EQ(db.tables["t"].indexes["g"].size(), 5000u);
+}
+
+TEST(DatabaseTests, Query_Results_Are_Not_Stored) {
+    Database db = createJoinDatabase();
+    size_t tableCount = db.tables.size();
+
+    for (int i = 0; i < 10; ++i) {
+        Table selected = db.translate_n_execute("SELECT order_id FROM orders WHERE total > 60");
+        ASSERT_EQ(selected.rowCount(), 2);
+        Table joined = db.translate_n_execute("SELECT orders.order_id FROM users JOIN orders ON users.id = orders.user_id");
+        ASSERT_EQ(joined.rowCount(), 3);
+    }
+    ASSERT_EQ(db.tables.size(), tableCount);
+
+    Table inserted = db.translate_n_execute("INSERT INTO orders (order_id, user_id, buyer, total) VALUES (13, 3, 'guest', 10)");
+    ASSERT_EQ(inserted.columns["affected_rows"].get_int(0), 1);
+    Table updated = db.translate_n_execute("UPDATE orders SET total = 0 WHERE user_id = 2");
+    ASSERT_EQ(updated.columns["affected_rows"].get_int(0), 2);
+    Table removed = db.translate_n_execute("DELETE FROM orders WHERE total = 0");
+    ASSERT_EQ(removed.columns["affected_rows"].get_int(0), 2);
+    ASSERT_EQ(db.translate_n_execute("SELEC nothing").rowCount(), 0);
+    ASSERT_EQ(db.tables.size(), tableCount);
+}
+
+TEST(CursorTests, Streams_Rows_And_Batches) {
+    Database db = createJoinDatabase();
+
+    Cursor cursor = db.openCursor("SELECT order_id, total FROM orders WHERE user_id = 2");
+    std::vector<int32_t> ids;
+    while (cursor.next()) {
+        ids.push_back(cursor.column(0).get_int(cursor.row()));
+        ASSERT_EQ(static_cast<CellInt&>(*cursor.line().cells["total"]).data, cursor.column(1).get_int(cursor.row()));
+    }
+    ASSERT_EQ(ids, (std::vector<int32_t>{10, 12}));
+    ASSERT_TRUE(cursor.done());
+
+    Cursor batches = db.openCursor("orders", {"order_id"}, *QueryCondition::compile(""));
+    Table batch;
+    ASSERT_EQ(batches.fetch(batch, 2), 2);
+    ASSERT_EQ(batch.rowCount(), 2);
+    ASSERT_EQ(batch.columns["order_id"].get_int(1), 11);
+    ASSERT_EQ(batches.fetch(batch, 2), 1);
+    ASSERT_EQ(batch.columns["order_id"].get_int(0), 12);
+    ASSERT_EQ(batches.fetch(batch, 2), 0);
+
+    Cursor joined = db.openCursor("SELECT orders.order_id FROM users JOIN orders ON users.id = orders.user_id WHERE users.is_admin");
+    ASSERT_TRUE(joined.next());
+    joined.close();
+    ASSERT_FALSE(joined.next());
+    ASSERT_EQ(joined.fetch(batch, 10), 0);
+    ASSERT_EQ(batch.columns.count("orders.order_id"), 1);
+
+    std::ostringstream out;
+    db.printQuery("SELECT order_id, buyer FROM orders WHERE total > 60", out);
+    ASSERT_EQ(out.str(), "order_id\tbuyer\t\n10\tadmin\t\n12\tadmin\t\n");
+    ASSERT_THROW(db.openCursor("DELETE FROM orders WHERE total > 0"), std::invalid_argument);
+    ASSERT_THROW(db.openCursor("orders", {"missing"}, *QueryCondition::compile("")), std::invalid_argument);
+}
+
+TEST(CursorTests, Order_By_And_Limit) {
+    Database db = createJoinDatabase();
+    db.translate_n_execute("INSERT INTO orders (order_id, user_id, buyer, total) VALUES (13, 3, 'guest', 75)");
+    db.translate_n_execute("INSERT INTO orders (order_id, user_id, buyer, total) VALUES (14, 1, 'ivan', 100)");
+
+    auto ids = [](const Table& result) {
+        std::vector<int32_t> values;
+        for (size_t i = 0; i < result.rowCount(); ++i) {
+            values.push_back(result.columns.at("order_id").get_int(i));
+        }
+        return values;
+    };
+
+    ASSERT_EQ(ids(db.translate_n_execute("SELECT order_id FROM orders LIMIT 2")), (std::vector<int32_t>{10, 11}));
+    ASSERT_EQ(ids(db.translate_n_execute("SELECT order_id FROM orders WHERE total > 60 LIMIT 2 OFFSET 1")), (std::vector<int32_t>{12, 13}));
+    ASSERT_EQ(ids(db.translate_n_execute("SELECT order_id FROM orders ORDER BY total")), (std::vector<int32_t>{11, 13, 10, 14, 12}));
+    ASSERT_EQ(ids(db.translate_n_execute("SELECT order_id FROM orders ORDER BY total DESC LIMIT 3")), (std::vector<int32_t>{12, 10, 14}));
+    ASSERT_EQ(ids(db.translate_n_execute("SELECT order_id FROM orders WHERE user_id < 3 ORDER BY buyer ASC LIMIT 2 OFFSET 1")), (std::vector<int32_t>{12, 11}));
+    ASSERT_EQ(ids(db.translate_n_execute("SELECT order_id FROM orders LIMIT 0")), (std::vector<int32_t>{}));
+
+    db.createIndex("orders", "total", "", true);
+    ASSERT_EQ(ids(db.translate_n_execute("SELECT order_id FROM orders WHERE user_id = 1 ORDER BY total LIMIT 1")), (std::vector<int32_t>{11}));
+    ASSERT_EQ(ids(db.translate_n_execute("SELECT order_id FROM orders ORDER BY total LIMIT 3 OFFSET 1")), (std::vector<int32_t>{13, 10, 14}));
+
+    Table joined = db.translate_n_execute("SELECT orders.order_id FROM users JOIN orders ON users.id = orders.user_id ORDER BY orders.total DESC LIMIT 1");
+    ASSERT_EQ(joined.columns["orders.order_id"].get_int(0), 12);
+    ASSERT_EQ(joined.rowCount(), 1);
+    ASSERT_THROW(db.translate_n_execute("SELECT order_id FROM orders ORDER BY missing"), std::invalid_argument);
+}
+
+TEST(AggregateTests, Group_By_With_Aggregates) {
+    Database db = createJoinDatabase();
+    db.translate_n_execute("INSERT INTO orders (order_id, user_id, buyer, total) VALUES (13, 1, 'ivan', 75)");
+    Line unpaid({{"order_id", std::make_shared<CellInt>(14)}, {"user_id", std::make_shared<CellInt>(3)},
+                 {"buyer", std::make_shared<CellString>("guest")}, {"total", nullptr}});
+    db.insert("orders", unpaid);
+
+    Table grouped = db.translate_n_execute(
+        "SELECT user_id, COUNT(*), COUNT(total), SUM(total), MIN(total), MAX(buyer), AVG(total) FROM orders GROUP BY user_id ORDER BY user_id");
+    ASSERT_EQ(grouped.rowCount(), 3);
+    ASSERT_EQ(grouped.columns["user_id"].get_int(0), 1);
+    ASSERT_EQ(grouped.columns["COUNT(*)"].get_int(0), 2);
+    ASSERT_EQ(grouped.columns["SUM(total)"].get_int(0), 125);
+    ASSERT_EQ(grouped.columns["MIN(total)"].get_int(0), 50);
+    ASSERT_EQ(grouped.columns["AVG(total)"].get_int(0), 62);
+    ASSERT_EQ(grouped.columns["MAX(buyer)"].get_string(1), "admin");
+    ASSERT_EQ(grouped.columns["SUM(total)"].get_int(1), 400);
+    ASSERT_EQ(grouped.columns["COUNT(*)"].get_int(2), 1);
+    ASSERT_EQ(grouped.columns["COUNT(total)"].get_int(2), 0);
+    ASSERT_TRUE(grouped.columns["SUM(total)"].is_null(2));
+
+    Table total = db.translate_n_execute("SELECT count(*), sum(total) FROM orders WHERE total >= 75");
+    ASSERT_EQ(total.rowCount(), 1);
+    ASSERT_EQ(total.columns["count(*)"].get_int(0), 3);
+    ASSERT_EQ(total.columns["sum(total)"].get_int(0), 475);
+
+    Table empty = db.translate_n_execute("SELECT COUNT(*) FROM orders WHERE total > 1000");
+    ASSERT_EQ(empty.columns["COUNT(*)"].get_int(0), 0);
+
+    Table byTwo = db.translate_n_execute("SELECT buyer, user_id, COUNT(*) FROM orders GROUP BY buyer, user_id ORDER BY COUNT(*) DESC LIMIT 1");
+    ASSERT_EQ(byTwo.rowCount(), 1);
+    ASSERT_EQ(byTwo.columns["COUNT(*)"].get_int(0), 2);
+
+    ASSERT_THROW(db.translate_n_execute("SELECT buyer, COUNT(*) FROM orders GROUP BY user_id"), std::invalid_argument);
+    ASSERT_THROW(db.translate_n_execute("SELECT SUM(buyer) FROM orders"), std::invalid_argument);
+}
+
+TEST(ConstraintTests, Key_Unique_Autoincrement) {
+    Database db;
+    db.translate_n_execute("CREATE TABLE accounts ({key, autoincrement} id : int32, {unique} login : string[32], age : int32)");
+    Table& accounts = db.tables["accounts"];
+    ASSERT_TRUE(accounts.columns["id"].is_key);
+    ASSERT_TRUE(accounts.columns["id"].is_autoincrement);
+    ASSERT_TRUE(accounts.columns["login"].is_unique);
+    ASSERT_FALSE(accounts.columns["age"].is_unique);
+
+    Line first({{"login", std::make_shared<CellString>("vasya")}, {"age", std::make_shared<CellInt>(20)}});
+    db.insert("accounts", first);
+    ASSERT_EQ(static_cast<CellInt&>(*first.cells["id"]).data, 0);
+    db.translate_n_execute("INSERT INTO accounts (id, login, age) VALUES (10, 'petya', 30)");
+    Line third({{"login", std::make_shared<CellString>("masha")}, {"age", std::make_shared<CellInt>(20)}});
+    db.insert("accounts", third);
+    ASSERT_EQ(static_cast<CellInt&>(*third.cells["id"]).data, 11);
+
+    ASSERT_THROW(db.translate_n_execute("INSERT INTO accounts (id, login, age) VALUES (10, 'other', 1)"), std::invalid_argument);
+    ASSERT_THROW(db.translate_n_execute("INSERT INTO accounts (id, login, age) VALUES (12, 'vasya', 1)"), std::invalid_argument);
+    ASSERT_EQ(accounts.rowCount(), 3);
+
+    auto setLogin = [](const std::string& login) {
+        std::unordered_map<std::string, std::function<std::shared_ptr<Cell>(std::shared_ptr<Cell>)>> transformations;
+        transformations["login"] = [login](std::shared_ptr<Cell>) { return std::make_shared<CellString>(login); };
+        return transformations;
+    };
+    ASSERT_THROW(db.update("accounts", setLogin("petya"), *QueryCondition::compile("id = 0")), std::invalid_argument);
+    ASSERT_THROW(db.update("accounts", setLogin("same"), *QueryCondition::compile("age = 20")), std::invalid_argument);
+    ASSERT_EQ(accounts.columns["login"].get_string(0), "vasya");
+    ASSERT_EQ(accounts.columns["login"].get_string(2), "masha");
+    db.update("accounts", setLogin("vasya"), *QueryCondition::compile("id = 0"));
+    ASSERT_THROW(db.translate_n_execute("UPDATE accounts SET id = 11 WHERE id = 0"), std::invalid_argument);
+    db.translate_n_execute("UPDATE accounts SET age = 21 WHERE age = 20");
+
+    // после INT32_MAX номеров нет: строка отклоняется целиком, счётчик не меняется
+    ASSERT_THROW(db.translate_n_execute("INSERT INTO accounts (id, login, age) VALUES (2147483647, 'max', 1)"), std::invalid_argument);
+    ASSERT_THROW(db.translate_n_execute("UPDATE accounts SET id = 2147483647 WHERE id = 11"), std::invalid_argument);
+    ASSERT_EQ(accounts.rowCount(), 3);
+    ASSERT_EQ(accounts.columns["id"].next_autoincrement, 12);
+
+    db.saveToFile("test_constraints.csv");
+    Database loaded;
+    loaded.readFromFile("test_constraints.csv");
+    Table& reloaded = loaded.tables["accounts"];
+    ASSERT_TRUE(reloaded.columns["id"].is_key);
+    ASSERT_TRUE(reloaded.columns["login"].is_unique);
+    ASSERT_EQ(reloaded.columns["id"].next_autoincrement, 12);
+    ASSERT_THROW(loaded.translate_n_execute("INSERT INTO accounts (id, login, age) VALUES (1, 'masha', 1)"), std::invalid_argument);
+    loaded.translate_n_execute("INSERT INTO accounts (id, login, age) VALUES (2147483646, 'last', 1)");
+    ASSERT_THROW(loaded.translate_n_execute("INSERT INTO accounts (login, age) VALUES ('next', 1)"), std::invalid_argument);
+    ASSERT_EQ(reloaded.rowCount(), 4);
+    std::remove("test_constraints.csv");
+
+    // ограничение, которому не отвечают строки, не оставляет после себя индекс
+    Table numbers("numbers");
+    numbers.addColumn("v", 0);
+    for (int i = 0; i < 2; ++i) {
+        Line line({{"v", std::make_shared<CellInt>(1)}});
+        numbers.insert(line);
+    }
+    ASSERT_THROW(numbers.setConstraints("v", false, true, false), std::invalid_argument);
+    ASSERT_EQ(numbers.indexes.count("v"), 0u);
+    ASSERT_FALSE(numbers.columns["v"].is_unique);
+}
+
+TEST(OrderedIndexTests, BPlusTree_Matches_Sorted_Set) {
+    BPlusTree<int32_t> tree;
+    std::set<std::pair<int32_t, uint32_t>> expected;
+    for (uint32_t row = 0; row < 5000; ++row) {
+        int32_t key = (row * 7919) % 1000;
+        tree.insert(key, row);
+        expected.insert({key, row});
+    }
+    for (uint32_t row = 0; row < 5000; row += 3) {
+        int32_t key = (row * 7919) % 1000;
+        ASSERT_TRUE(tree.erase(key, row));
+        expected.erase({key, row});
+    }
+    ASSERT_FALSE(tree.erase(-1, 0));
+    ASSERT_EQ(tree.size(), expected.size());
+
+    std::vector<std::pair<int32_t, uint32_t>> all;
+    tree.for_each([&all](int32_t key, uint32_t row) { all.push_back({key, row}); });
+    ASSERT_EQ(all, (std::vector<std::pair<int32_t, uint32_t>>(expected.begin(), expected.end())));
+
+    int32_t low = 100, high = 200;
+    std::vector<std::pair<int32_t, uint32_t>> range;
+    tree.scan(&low, false, &high, true, [&range](int32_t key, uint32_t row) {
+        range.push_back({key, row});
+        return true;
+    });
+    auto from = expected.lower_bound({101, 0});
+    auto to = expected.lower_bound({201, 0});
+    ASSERT_EQ(range, (std::vector<std::pair<int32_t, uint32_t>>(from, to)));
+
+    BPlusTree<int32_t> copy = tree;
+    ASSERT_EQ(copy.size(), tree.size());
+}
+
+TEST(OrderedIndexTests, Range_Queries_Use_Ordered_Index) {
+    Database db = createJoinDatabase();
+    db.translate_n_execute("CREATE ORDERED INDEX orders_total ON orders BY total");
+    db.translate_n_execute("CREATE ORDERED INDEX ON orders BY buyer");
+    Table& orders = db.tables["orders"];
+    ASSERT_EQ(orders.orderedIndexes.size(), 2);
+    ASSERT_EQ(orders.orderedIndexes["total"].name, "orders_total");
+    ASSERT_THROW(db.translate_n_execute("CREATE ORDERED INDEX ON orders BY missing"), std::invalid_argument);
+
+    ASSERT_EQ(db.translate_n_execute("SELECT order_id FROM orders WHERE total >= 100").rowCount(), 2);
+    ASSERT_EQ(db.translate_n_execute("SELECT order_id FROM orders WHERE total > 50 AND total < 300").rowCount(), 1);
+    ASSERT_EQ(db.translate_n_execute("SELECT order_id FROM orders WHERE 100 <= total AND total <= 300 AND user_id = 2").rowCount(), 2);
+    ASSERT_EQ(db.translate_n_execute("SELECT order_id FROM orders WHERE total > 300 AND total < 100").rowCount(), 0);
+    ASSERT_EQ(db.translate_n_execute("SELECT order_id FROM orders WHERE buyer < 'b'").rowCount(), 2);
+    // != диапазоном не выражается: полный проход вместо обхода всего дерева
+    std::vector<uint32_t> candidates;
+    ASSERT_FALSE(orders.indexCandidates(*QueryCondition::compile("total != 50")->bind(orders.columns), candidates));
+    ASSERT_TRUE(orders.indexCandidates(*QueryCondition::compile("total != 50 AND total > 60")->bind(orders.columns), candidates));
+    ASSERT_EQ(db.translate_n_execute("SELECT order_id FROM orders WHERE total != 50").rowCount(), 2);
+
+    orders.compactThreshold = 0.9;
+    db.translate_n_execute("INSERT INTO orders (order_id, user_id, buyer, total) VALUES (13, 3, 'guest', 75)");
+    db.translate_n_execute("UPDATE orders SET total = 500 WHERE order_id = 10");
+    db.translate_n_execute("DELETE FROM orders WHERE order_id = 12");
+
+    std::vector<int32_t> totals;
+    ASSERT_TRUE(orders.scanOrdered("total", KeyRange(), [&](uint32_t row) {
+        totals.push_back(orders.columns["total"].get_int(row));
+        return true;
+    }));
+    ASSERT_EQ(totals, (std::vector<int32_t>{50, 75, 500}));
+    ASSERT_FALSE(orders.scanOrdered("order_id", KeyRange(), [](uint32_t) { return true; }));
+
+    db.compact("orders");
+    Table result = db.translate_n_execute("SELECT order_id FROM orders WHERE total >= 60 AND total <= 500");
+    ASSERT_EQ(result.rowCount(), 2);
+    ASSERT_EQ(result.columns["order_id"].get_int(0), 13);
+    ASSERT_EQ(result.columns["order_id"].get_int(1), 10);
+}